@@ -0,0 +1,386 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks of the framework hot paths with the mock language model.
+ *
+ * Each case prints one JSON object per line:
+ *
+ * {"name": "...", "iterations": N, "ops": N, "total_ns": N,
+ *  "ns_per_op": X}
+ *
+ * where an iteration may consist of several ops, e.g. generated tokens.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "chatbot.h"
+
+#define BENCH_MOCK_PARAMETER                                                  \
+  "tokens=256:thinking-tokens=0:token-latency-us=0:prefill-latency-us=0:"     \
+  "seed=1"
+
+static gchar *mock_module_path = NULL;
+static gchar *filter = NULL;
+static gint min_time_ms = 200;
+
+static const GOptionEntry option_entries[] = {
+  { "mock-module", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,
+    &mock_module_path, "Mock language model module.", "module" },
+  { "filter", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, &filter,
+    "Run only benchmarks whose name contains the string.", "string" },
+  { "min-time", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &min_time_ms,
+    "Minimum measuring time of each benchmark in milliseconds.", "ms" },
+  G_OPTION_ENTRY_NULL
+};
+
+typedef void (*BenchFunc) (gpointer data, guint64 n_iterations);
+
+static void
+bench_run (const gchar *name, BenchFunc func, gpointer data,
+           guint64 ops_per_iteration)
+{
+  const gint64 min_time_us = (gint64)min_time_ms * 1000;
+  guint64 n_iterations = 1;
+  gint64 elapsed;
+
+  if (filter && (strstr (name, filter) == NULL))
+    return;
+
+  // Double the iterations until one run takes long enough to measure.
+  for (;;)
+    {
+      gint64 start = g_get_monotonic_time ();
+
+      func (data, n_iterations);
+      elapsed = g_get_monotonic_time () - start;
+      if ((elapsed >= min_time_us) || (n_iterations >= (1 << 30)))
+        break;
+      n_iterations *= 2;
+    }
+
+  printf ("{\"name\": \"%s\", \"iterations\": %" G_GUINT64_FORMAT
+          ", \"ops\": %" G_GUINT64_FORMAT ", \"total_ns\": %" G_GINT64_FORMAT
+          ", \"ns_per_op\": %.3f}\n",
+          name, n_iterations, n_iterations * ops_per_iteration,
+          elapsed * 1000,
+          (gdouble)elapsed * 1000.0
+              / (gdouble)(n_iterations * ops_per_iteration));
+  fflush (stdout);
+}
+
+/* Module construction and parameter parsing */
+
+static void
+bench_module_new (gpointer data, guint64 n_iterations)
+{
+  GType type = *(GType *)data;
+
+  for (guint64 i = 0; i < n_iterations; i++)
+    {
+      GError *error = NULL;
+      ChatbotModule *module
+          = chatbot_module_new (type, BENCH_MOCK_PARAMETER, &error);
+
+      if (module == NULL)
+        g_error ("Failed to construct module: %s", error->message);
+      g_object_unref (module);
+    }
+}
+
+/* Chat template */
+
+typedef struct
+{
+  ChatbotLanguageModel *language_model;
+  GStrv role_and_message;
+} BenchTemplate;
+
+static void
+bench_apply_chat_template (gpointer data, guint64 n_iterations)
+{
+  BenchTemplate *bench = data;
+
+  for (guint64 i = 0; i < n_iterations; i++)
+    g_free (chatbot_language_model_apply_chat_template (
+        bench->language_model, bench->role_and_message));
+}
+
+static void
+bench_run_apply_chat_template (ChatbotLanguageModel *language_model,
+                               guint n_turns)
+{
+  BenchTemplate bench = { language_model, NULL };
+  GStrvBuilder *builder = g_strv_builder_new ();
+  gchar *name;
+
+  for (guint i = 0; i < n_turns; i++)
+    g_strv_builder_add_many (builder, (i % 2) ? "assistant" : "user",
+                             "The quick brown fox jumps over the lazy dog.",
+                             NULL);
+  bench.role_and_message = g_strv_builder_end (builder);
+  g_strv_builder_unref (builder);
+
+  name = g_strdup_printf ("apply-chat-template/turns=%u", n_turns);
+  bench_run (name, bench_apply_chat_template, &bench, 1);
+  g_free (name);
+  g_strfreev (bench.role_and_message);
+}
+
+/* Chat data */
+
+static void
+bench_chat_data_append (gpointer data, guint64 n_iterations)
+{
+  ChatbotChatData *chat_data = chatbot_chat_data_new ();
+
+  for (guint64 i = 0; i < n_iterations; i++)
+    chatbot_chat_data_append (chat_data, "user",
+                              "The quick brown fox jumps over the lazy dog.");
+  chatbot_data_get_strings (CHATBOT_DATA (chat_data));
+  g_object_unref (chat_data);
+}
+
+static void
+bench_chat_data_append_get_strings (gpointer data, guint64 n_iterations)
+{
+  ChatbotChatData *chat_data = chatbot_chat_data_new ();
+
+  for (guint64 i = 0; i < n_iterations; i++)
+    {
+      chatbot_chat_data_append (
+          chat_data, "user", "The quick brown fox jumps over the lazy dog.");
+      chatbot_data_get_strings (CHATBOT_DATA (chat_data));
+    }
+  g_object_unref (chat_data);
+}
+
+/* Signal emission per token */
+
+static gboolean
+bench_generating (ChatbotLanguageModel *language_model, const gchar *text,
+                  gpointer user_data)
+{
+  return TRUE;
+}
+
+static void
+bench_generate (gpointer data, guint64 n_iterations)
+{
+  ChatbotLanguageModel *language_model = data;
+
+  for (guint64 i = 0; i < n_iterations; i++)
+    {
+      GError *error = NULL;
+      gchar *generated
+          = chatbot_language_model_generate (language_model, &error);
+
+      if (generated == NULL)
+        g_error ("Failed to generate: %s", error->message);
+      g_free (generated);
+    }
+}
+
+/* Tool function dispatch */
+
+#define BENCH_TYPE_TOOL bench_tool_get_type ()
+G_DECLARE_FINAL_TYPE (BenchTool, bench_tool, BENCH, TOOL, ChatbotModule);
+
+struct _BenchTool
+{
+  ChatbotModule parent_instance;
+};
+
+enum
+{
+  PROP_FUNCTIONS = 1,
+  N_PROPERTIES
+};
+
+static ChatbotToolArg bench_tool_arg_value = { "value", "any integer", "x",
+                                               -1 };
+static ChatbotToolArg *bench_tool_echo_args[] = { &bench_tool_arg_value,
+                                                  NULL };
+static ChatbotToolFunction bench_tool_echo
+    = { "echo", "Return the value as is.", bench_tool_echo_args,
+        bench_tool_echo_args, -1 };
+static const ChatbotToolFunction *const bench_tool_functions[]
+    = { &bench_tool_echo, NULL };
+
+static void bench_tool_tool_iface_init (ChatbotToolInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (BenchTool, bench_tool, CHATBOT_TYPE_MODULE,
+                         G_IMPLEMENT_INTERFACE (CHATBOT_TYPE_TOOL,
+                                                bench_tool_tool_iface_init));
+
+static const ChatbotToolFunction *const *
+bench_tool_get_function_definitions (ChatbotTool *tool)
+{
+  return bench_tool_functions;
+}
+
+static GVariantDict *
+bench_tool_call_function_args (ChatbotTool *tool,
+                               const ChatbotToolFunction *function,
+                               GVariant *const *args,
+                               ChatbotLanguageModel *language_model,
+                               GCancellable *cancellable, GError **error)
+{
+  GVariantDict *result = g_variant_dict_new (NULL);
+
+  g_variant_dict_insert_value (result, "value", args[0]);
+  return result;
+}
+
+static void
+bench_tool_tool_iface_init (ChatbotToolInterface *iface)
+{
+  iface->get_function_definitions = bench_tool_get_function_definitions;
+  iface->call_function_args = bench_tool_call_function_args;
+}
+
+static const gchar *
+bench_tool_get_name (ChatbotModule *module)
+{
+  return "bench";
+}
+
+static void
+bench_tool_get_property (GObject *object, guint property_id, GValue *value,
+                         GParamSpec *pspec)
+{
+  ChatbotTool *tool = CHATBOT_TOOL (object);
+
+  switch (property_id)
+    {
+    case PROP_FUNCTIONS:
+      g_value_take_boxed (value, chatbot_tool_dup_function_definitions (tool));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+bench_tool_class_init (BenchToolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = bench_tool_get_property;
+
+  CHATBOT_MODULE_CLASS (klass)->get_name = bench_tool_get_name;
+
+  g_object_class_override_property (object_class, PROP_FUNCTIONS,
+                                    "functions");
+}
+
+static void
+bench_tool_init (BenchTool *self)
+{
+}
+
+static void
+bench_tool_call (gpointer data, guint64 n_iterations)
+{
+  ChatbotTool *tool = data;
+  GVariantDict *parameters = g_variant_dict_new (NULL);
+
+  g_variant_dict_insert (parameters, "value", "x", G_GINT64_CONSTANT (42));
+  for (guint64 i = 0; i < n_iterations; i++)
+    {
+      GError *error = NULL;
+      GVariantDict *result = chatbot_tool_call_function (
+          tool, "echo", parameters, NULL, NULL, &error);
+
+      if (result == NULL)
+        g_error ("Failed to call function: %s", error->message);
+      g_variant_dict_unref (result);
+    }
+  g_variant_dict_unref (parameters);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *option_context = NULL;
+  ChatbotModule *mock = NULL;
+  ChatbotModule *tool = NULL;
+  GType type;
+  int ret_code = 1;
+  GError *error = NULL;
+
+  option_context = g_option_context_new (NULL);
+  g_option_context_add_main_entries (option_context, option_entries, NULL);
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    goto cleanup;
+
+  if (mock_module_path == NULL)
+    {
+      g_set_error (&error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                   "--mock-module is required.");
+      goto cleanup;
+    }
+
+  type = chatbot_module_registry_load_type (
+      chatbot_module_registry_get_default (), mock_module_path, &error);
+  if (type == G_TYPE_INVALID)
+    goto cleanup;
+
+  mock = chatbot_module_new (type, BENCH_MOCK_PARAMETER, &error);
+  if (mock == NULL)
+    goto cleanup;
+  if (!CHATBOT_IS_LANGUAGE_MODEL (mock))
+    {
+      g_set_error (&error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Module \"%s\" doesn't implement ChatbotLanguageModel.",
+                   mock_module_path);
+      goto cleanup;
+    }
+
+  bench_run ("module-new", bench_module_new, &type, 1);
+
+  for (guint n_turns = 1; n_turns <= 1024; n_turns *= 8)
+    bench_run_apply_chat_template (CHATBOT_LANGUAGE_MODEL (mock), n_turns);
+
+  bench_run ("chat-data/append", bench_chat_data_append, NULL, 1);
+  bench_run ("chat-data/append-get-strings",
+             bench_chat_data_append_get_strings, NULL, 1);
+
+  g_signal_connect (mock, "generating", G_CALLBACK (bench_generating), NULL);
+  bench_run ("generating-per-token", bench_generate, mock, 256);
+
+  tool = chatbot_module_new (BENCH_TYPE_TOOL, "", &error);
+  if (tool == NULL)
+    goto cleanup;
+  bench_run ("tool-call-function", bench_tool_call, tool, 1);
+
+  ret_code = 0;
+cleanup:
+  g_clear_object (&tool);
+  g_clear_object (&mock);
+  g_clear_pointer (&option_context, g_option_context_free);
+  g_free (mock_module_path);
+  g_free (filter);
+  if (error)
+    {
+      fprintf (stderr, "Benchmark Error: %s\n", error->message);
+      g_error_free (error);
+    }
+  return ret_code;
+}
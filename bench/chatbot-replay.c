@@ -0,0 +1,512 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Replays recorded conversations against a language model to reproduce
+ * production load offline.
+ *
+ * The conversations file has one conversation per line, written as "a(ss)"
+ * GVariant text of role and message, or is a log written by --chat-log of the
+ * CLI, whose sessions are the conversations. Each session replays the user
+ * turns of a conversation, in order, with the model generating its own
+ * responses. Sessions run on --concurrency instances of the model and arrive
+ * either as a Poisson process of --rate sessions per second, or back to back
+ * when the rate is 0 (closed loop). The summary is printed as a JSON object:
+ *
+ * {"sessions": N, "turns": N, "failed_turns": N, "tokens": N,
+ *  "duration_s": X, "turns_per_s": X, "tokens_per_s": X,
+ *  "time_to_first_token_us": {"p50": N, "p90": N, "p99": N},
+ *  "turn_us": {...}, "queue_us": {...}}
+ *
+ * where "queue_us" is how long sessions waited for a free instance after
+ * their arrival. In closed loop, a session arrives when the previous session
+ * on the same instance ends.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "chatbot.h"
+
+static gchar *module_path = NULL;
+static gchar *module_parameter = NULL;
+static gchar *conversations_path = NULL;
+static gint n_sessions = 0;
+static gint concurrency = 1;
+static gdouble rate = 0.0;
+static gint think_time_ms = 0;
+static gint seed = 0;
+
+static const GOptionEntry option_entries[] = {
+  { "module", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &module_path,
+    "Language model module.", "module" },
+  { "parameter", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING,
+    &module_parameter, "Parameter of the language model module.",
+    "parameter" },
+  { "conversations", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,
+    &conversations_path, "File of conversations to replay.", "file" },
+  { "sessions", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &n_sessions,
+    "Number of sessions, cycling the conversations. Defaults to the number "
+    "of conversations.",
+    "n" },
+  { "concurrency", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &concurrency,
+    "Number of model instances serving sessions.", "n" },
+  { "rate", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_DOUBLE, &rate,
+    "Poisson arrival rate of sessions per second. 0 starts a session as "
+    "soon as an instance is free.",
+    "rate" },
+  { "think-time", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &think_time_ms,
+    "Delay before each user turn after the first in milliseconds.", "ms" },
+  { "seed", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &seed,
+    "Seed of the arrival times.", "seed" },
+  G_OPTION_ENTRY_NULL
+};
+
+typedef struct
+{
+  GPtrArray *conversations;
+  GType type;
+  gint64 *arrivals;
+  gint64 start;
+  GMutex mutex;
+  guint next_session;
+  GArray *time_to_first_token;
+  GArray *turn;
+  GArray *queue;
+  guint64 n_tokens;
+  guint n_failed;
+} Replay;
+
+typedef struct
+{
+  Replay *replay;
+  ChatbotLanguageModel *language_model;
+  GThread *thread;
+  gint64 first_token;
+  guint64 n_tokens;
+} ReplayWorker;
+
+static GPtrArray *
+replay_load_log (const gchar *path, GError **error)
+{
+  ChatbotChatLogReader *reader;
+  GPtrArray *conversations;
+
+  reader = chatbot_chat_log_reader_new (path, error);
+  if (reader == NULL)
+    return NULL;
+
+  // Conversations are in the order their first message was logged.
+  conversations = chatbot_chat_log_reader_get_sessions (reader, error);
+  g_object_unref (reader);
+  if (conversations == NULL)
+    return NULL;
+
+  for (guint i = 0; i < conversations->len; i++)
+    chatbot_data_get_strings (CHATBOT_DATA (conversations->pdata[i]));
+  return conversations;
+}
+
+static GPtrArray *
+replay_load_conversations (const gchar *path, GError **error)
+{
+  GPtrArray *conversations;
+  gchar *contents;
+  gchar **lines;
+
+  if (chatbot_chat_log_is_log (path))
+    {
+      conversations = replay_load_log (path, error);
+      goto check;
+    }
+
+  if (!g_file_get_contents (path, &contents, NULL, error))
+    return NULL;
+
+  conversations = g_ptr_array_new_with_free_func (g_object_unref);
+  lines = g_strsplit (contents, "\n", -1);
+  for (guint i = 0; lines[i]; i++)
+    {
+      ChatbotChatData *chat_data;
+      GVariant *value;
+
+      g_strstrip (lines[i]);
+      if ((lines[i][0] == '\0') || (lines[i][0] == '#'))
+        continue;
+
+      value = g_variant_parse (G_VARIANT_TYPE ("a(ss)"), lines[i], NULL,
+                               NULL, error);
+      if (value == NULL)
+        {
+          g_prefix_error (error, "Line %u: ", i + 1);
+          g_clear_pointer (&conversations, g_ptr_array_unref);
+          break;
+        }
+      chat_data = chatbot_chat_data_new_from_variant (value);
+      g_variant_unref (value);
+
+      // Build the strings now, as it's not safe from several threads.
+      chatbot_data_get_strings (CHATBOT_DATA (chat_data));
+      g_ptr_array_add (conversations, chat_data);
+    }
+  g_strfreev (lines);
+  g_free (contents);
+
+check:
+  if (conversations && (conversations->len == 0))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "\"%s\" has no conversation.", path);
+      g_clear_pointer (&conversations, g_ptr_array_unref);
+    }
+  return conversations;
+}
+
+static gboolean
+replay_generating (ChatbotLanguageModel *language_model, const gchar *text,
+                   ReplayWorker *worker)
+{
+  if (worker->first_token == 0)
+    worker->first_token = g_get_monotonic_time ();
+  worker->n_tokens++;
+  return TRUE;
+}
+
+static gboolean
+replay_worker_open (ReplayWorker *worker, GError **error)
+{
+  ChatbotModule *module;
+
+  module = chatbot_module_new (worker->replay->type,
+                               module_parameter ? module_parameter : "",
+                               error);
+  if (module == NULL)
+    return FALSE;
+  if (!CHATBOT_IS_LANGUAGE_MODEL (module))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Module \"%s\" doesn't implement ChatbotLanguageModel.",
+                   module_path);
+      g_object_unref (module);
+      return FALSE;
+    }
+
+  g_clear_object (&worker->language_model);
+  worker->language_model = CHATBOT_LANGUAGE_MODEL (module);
+  g_signal_connect (worker->language_model, "generating",
+                    G_CALLBACK (replay_generating), worker);
+  return TRUE;
+}
+
+/*
+ * Starts a new session, constructing a new instance if the model can't
+ * reset.
+ */
+static gboolean
+replay_worker_reset (ReplayWorker *worker, GError **error)
+{
+  GError *local_error = NULL;
+
+  if (chatbot_language_model_reset (worker->language_model, &local_error))
+    return TRUE;
+  if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+    {
+      g_propagate_error (error, local_error);
+      return FALSE;
+    }
+  g_error_free (local_error);
+  return replay_worker_open (worker, error);
+}
+
+static gboolean
+replay_turn (ReplayWorker *worker, const gchar *system_prompt,
+             const gchar *user_prompt, GError **error)
+{
+  Replay *replay = worker->replay;
+  GStrvBuilder *builder = g_strv_builder_new ();
+  GStrv role_and_messages;
+  gchar *chat_template = NULL;
+  gchar *generated = NULL;
+  gboolean ret;
+  gint64 start, end;
+
+  if (system_prompt)
+    g_strv_builder_add_many (builder, "system", system_prompt, NULL);
+  g_strv_builder_add_many (builder, "user", user_prompt, "assistant", NULL);
+  role_and_messages = g_strv_builder_end (builder);
+
+  start = g_get_monotonic_time ();
+  worker->first_token = 0;
+  worker->n_tokens = 0;
+  chat_template = chatbot_language_model_apply_chat_template (
+      worker->language_model, role_and_messages);
+  if (chatbot_language_model_prefill (worker->language_model, chat_template,
+                                      error))
+    generated = chatbot_language_model_generate (worker->language_model,
+                                                 error);
+  end = g_get_monotonic_time ();
+  ret = generated != NULL;
+
+  g_mutex_lock (&replay->mutex);
+  if (ret)
+    {
+      gint64 time_to_first_token
+          = (worker->first_token ? worker->first_token : end) - start;
+      gint64 turn = end - start;
+
+      g_array_append_val (replay->time_to_first_token, time_to_first_token);
+      g_array_append_val (replay->turn, turn);
+      replay->n_tokens += worker->n_tokens;
+    }
+  else
+    replay->n_failed++;
+  g_mutex_unlock (&replay->mutex);
+
+  g_free (generated);
+  g_free (chat_template);
+  g_strfreev (role_and_messages);
+  g_strv_builder_unref (builder);
+  return ret;
+}
+
+static void
+replay_session (ReplayWorker *worker, ChatbotChatData *conversation)
+{
+  const GStrv role_and_messages
+      = chatbot_data_get_strings (CHATBOT_DATA (conversation));
+  guint length = role_and_messages ? g_strv_length (role_and_messages) : 0;
+  const gchar *system_prompt = NULL;
+  gboolean first_turn = TRUE;
+  GError *error = NULL;
+
+  for (guint i = 0; i + 1 < length; i += 2)
+    {
+      const gchar *role = role_and_messages[i];
+      const gchar *message = role_and_messages[i + 1];
+
+      if (!strcmp (role, "system"))
+        system_prompt = message;
+      if (strcmp (role, "user"))
+        continue;
+
+      if (!first_turn && (think_time_ms > 0))
+        g_usleep ((gulong)think_time_ms * 1000);
+
+      // The state of the model is unknown after a failure.
+      if (!replay_turn (worker, system_prompt, message, &error))
+        {
+          g_warning ("Session failed. Error: \"%s\"", error->message);
+          g_error_free (error);
+          return;
+        }
+      system_prompt = NULL;
+      first_turn = FALSE;
+    }
+}
+
+static gpointer
+replay_worker_run (gpointer user_data)
+{
+  ReplayWorker *worker = user_data;
+  Replay *replay = worker->replay;
+  gint64 last_end = replay->start;
+  gboolean fresh = TRUE;
+
+  while (TRUE)
+    {
+      ChatbotChatData *conversation;
+      gint64 arrival, now, queue;
+      guint index;
+      GError *error = NULL;
+
+      g_mutex_lock (&replay->mutex);
+      index = replay->next_session++;
+      g_mutex_unlock (&replay->mutex);
+      if (index >= (guint)n_sessions)
+        break;
+
+      // In closed loop, a session arrives when the previous session of the
+      // worker ends, not when the replay starts.
+      if (rate > 0.0)
+        arrival = replay->start + replay->arrivals[index];
+      else
+        arrival = last_end;
+      now = g_get_monotonic_time ();
+      if (arrival > now)
+        g_usleep (arrival - now);
+      queue = MAX (now - arrival, 0);
+
+      if (!fresh && !replay_worker_reset (worker, &error))
+        {
+          g_warning ("Failed to start a session. Error: \"%s\"",
+                     error->message);
+          g_error_free (error);
+          break;
+        }
+      fresh = FALSE;
+
+      g_mutex_lock (&replay->mutex);
+      g_array_append_val (replay->queue, queue);
+      g_mutex_unlock (&replay->mutex);
+
+      conversation = g_ptr_array_index (
+          replay->conversations, index % replay->conversations->len);
+      replay_session (worker, conversation);
+      last_end = g_get_monotonic_time ();
+    }
+  return NULL;
+}
+
+static gint
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+  return (x > y) - (x < y);
+}
+
+static void
+print_percentiles (const gchar *name, GArray *values)
+{
+  static const gdouble percentiles[] = { 50.0, 90.0, 99.0 };
+
+  g_array_sort (values, compare_gint64);
+  printf (", \"%s\": {", name);
+  for (guint i = 0; i < G_N_ELEMENTS (percentiles); i++)
+    {
+      gint64 value = 0;
+
+      if (values->len > 0)
+        {
+          guint rank = (guint)ceil (percentiles[i] / 100.0 * values->len);
+          rank = CLAMP (rank, 1, values->len);
+          value = g_array_index (values, gint64, rank - 1);
+        }
+      printf ("%s\"p%.0f\": %" G_GINT64_FORMAT, i ? ", " : "",
+              percentiles[i], value);
+    }
+  printf ("}");
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *option_context = NULL;
+  Replay replay = { 0 };
+  ReplayWorker *workers = NULL;
+  guint n_workers = 0;
+  GRand *random = NULL;
+  gint64 arrival = 0;
+  gdouble duration;
+  int ret_code = 1;
+  GError *error = NULL;
+
+  option_context = g_option_context_new (NULL);
+  g_option_context_add_main_entries (option_context, option_entries, NULL);
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    goto cleanup;
+
+  if ((module_path == NULL) || (conversations_path == NULL))
+    {
+      g_set_error (&error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                   "--module and --conversations are required.");
+      goto cleanup;
+    }
+
+  replay.conversations
+      = replay_load_conversations (conversations_path, &error);
+  if (replay.conversations == NULL)
+    goto cleanup;
+  if (n_sessions <= 0)
+    n_sessions = replay.conversations->len;
+
+  replay.type = chatbot_module_registry_load_type (
+      chatbot_module_registry_get_default (), module_path, &error);
+  if (replay.type == G_TYPE_INVALID)
+    goto cleanup;
+
+  g_mutex_init (&replay.mutex);
+  replay.time_to_first_token = g_array_new (FALSE, FALSE, sizeof (gint64));
+  replay.turn = g_array_new (FALSE, FALSE, sizeof (gint64));
+  replay.queue = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  // Exponential gaps between arrivals make a Poisson process.
+  random = g_rand_new_with_seed (seed);
+  replay.arrivals = g_new (gint64, n_sessions);
+  for (gint i = 0; i < n_sessions; i++)
+    {
+      replay.arrivals[i] = arrival;
+      if (rate > 0.0)
+        arrival += (gint64)(-log (1.0 - g_rand_double (random)) / rate
+                            * G_USEC_PER_SEC);
+    }
+
+  workers = g_new0 (ReplayWorker, MAX (concurrency, 1));
+  for (n_workers = 0; n_workers < (guint)MAX (concurrency, 1); n_workers++)
+    {
+      workers[n_workers].replay = &replay;
+      if (!replay_worker_open (&workers[n_workers], &error))
+        goto cleanup;
+    }
+
+  replay.start = g_get_monotonic_time ();
+  for (guint i = 0; i < n_workers; i++)
+    workers[i].thread
+        = g_thread_new ("replay-worker", replay_worker_run, &workers[i]);
+  for (guint i = 0; i < n_workers; i++)
+    g_thread_join (workers[i].thread);
+  duration = (g_get_monotonic_time () - replay.start)
+             / (gdouble)G_USEC_PER_SEC;
+
+  printf ("{\"sessions\": %d, \"turns\": %u, \"failed_turns\": %u, "
+          "\"tokens\": %" G_GUINT64_FORMAT ", \"duration_s\": %.3f, "
+          "\"turns_per_s\": %.3f, \"tokens_per_s\": %.3f",
+          n_sessions, replay.turn->len, replay.n_failed, replay.n_tokens,
+          duration, replay.turn->len / duration,
+          replay.n_tokens / duration);
+  print_percentiles ("time_to_first_token_us", replay.time_to_first_token);
+  print_percentiles ("turn_us", replay.turn);
+  print_percentiles ("queue_us", replay.queue);
+  printf ("}\n");
+
+  ret_code = 0;
+cleanup:
+  for (guint i = 0; workers && (i < n_workers); i++)
+    g_clear_object (&workers[i].language_model);
+  g_free (workers);
+  g_clear_pointer (&random, g_rand_free);
+  g_free (replay.arrivals);
+  if (replay.turn)
+    {
+      g_array_unref (replay.time_to_first_token);
+      g_array_unref (replay.turn);
+      g_array_unref (replay.queue);
+      g_mutex_clear (&replay.mutex);
+    }
+  g_clear_pointer (&replay.conversations, g_ptr_array_unref);
+  g_clear_pointer (&option_context, g_option_context_free);
+
+  g_free (conversations_path);
+  g_free (module_parameter);
+  g_free (module_path);
+  if (error)
+    {
+      fprintf (stderr, "Fatal Error: %s\n", error->message);
+      g_error_free (error);
+    }
+  return ret_code;
+}
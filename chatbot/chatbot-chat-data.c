@@ -29,12 +29,30 @@
 
 #include "chatbot-chat-data.h"
 
+#include <string.h>
+
+#include "chatbot-memory.h"
+
 typedef struct
 {
   GStrvBuilder *builder;
   GStrv role_and_messages;
+  // Bytes held by @builder and @role_and_messages, including array slots.
+  gsize builder_bytes;
+  gsize strings_bytes;
 } ChatbotChatDataPrivate;
 
+static void
+chatbot_chat_data_update_memory (ChatbotChatDataPrivate *priv,
+                                 gsize builder_bytes, gsize strings_bytes)
+{
+  chatbot_memory_update (CHATBOT_MEMORY_CHAT_DATA,
+                         priv->builder_bytes + priv->strings_bytes,
+                         builder_bytes + strings_bytes);
+  priv->builder_bytes = builder_bytes;
+  priv->strings_bytes = strings_bytes;
+}
+
 static void chatbot_chat_data_data_init (ChatbotDataInterface *iface);
 
 G_DEFINE_TYPE_EXTENDED (ChatbotChatData, chatbot_chat_data, G_TYPE_OBJECT, 0,
@@ -54,6 +72,7 @@ chatbot_chat_data_get_strings (ChatbotData *data)
   g_clear_pointer (&priv->role_and_messages, g_strfreev);
   priv->role_and_messages = g_strv_builder_end (priv->builder);
   g_clear_pointer (&priv->builder, g_strv_builder_unref);
+  chatbot_chat_data_update_memory (priv, 0, priv->builder_bytes);
   return priv->role_and_messages;
 }
 
@@ -78,6 +97,7 @@ chatbot_chat_data_finalize (GObject *object)
   ChatbotChatDataPrivate *priv
       = chatbot_chat_data_get_instance_private (CHATBOT_CHAT_DATA (object));
   g_strfreev (priv->role_and_messages);
+  chatbot_chat_data_update_memory (priv, 0, 0);
   G_OBJECT_CLASS (chatbot_chat_data_parent_class)->finalize (object);
 }
 
@@ -101,6 +121,33 @@ chatbot_chat_data_new (void)
   return CHATBOT_CHAT_DATA (g_object_new (CHATBOT_TYPE_CHAT_DATA, NULL));
 }
 
+/**
+ * chatbot_chat_data_new_from_variant:
+ * @value: "a(ss)" array of role and message
+ *
+ * Construct data holding the messages of @value, e.g. a conversation parsed
+ * with g_variant_parse() from "[('user', 'Hello'), ('assistant', 'Hi')]".
+ *
+ * Returns: (transfer full): Newly constructed instance.
+ */
+ChatbotChatData *
+chatbot_chat_data_new_from_variant (GVariant *value)
+{
+  ChatbotChatData *chat_data;
+  GVariantIter iter;
+  const gchar *role, *message;
+
+  g_return_val_if_fail (value != NULL, NULL);
+  g_return_val_if_fail (g_variant_is_of_type (value, G_VARIANT_TYPE ("a(ss)")),
+                        NULL);
+
+  chat_data = chatbot_chat_data_new ();
+  g_variant_iter_init (&iter, value);
+  while (g_variant_iter_next (&iter, "(&s&s)", &role, &message))
+    chatbot_chat_data_append (chat_data, role, message);
+  return chat_data;
+}
+
 /**
  * chatbot_chat_data_append:
  * @role: role
@@ -125,4 +172,25 @@ chatbot_chat_data_append (ChatbotChatData *chat_data, const gchar *role,
   if (priv->builder == NULL)
     priv->builder = g_strv_builder_new ();
   g_strv_builder_add_many (priv->builder, role, message, NULL);
+  chatbot_chat_data_update_memory (
+      priv,
+      priv->builder_bytes + strlen (role) + strlen (message) + 2
+          + 2 * sizeof (gchar *),
+      priv->strings_bytes);
+}
+
+/**
+ * chatbot_chat_data_get_memory_usage:
+ *
+ * Returns: approximate bytes used to hold messages
+ */
+gsize
+chatbot_chat_data_get_memory_usage (ChatbotChatData *chat_data)
+{
+  ChatbotChatDataPrivate *priv;
+
+  g_return_val_if_fail (CHATBOT_IS_CHAT_DATA (chat_data), 0);
+
+  priv = chatbot_chat_data_get_instance_private (chat_data);
+  return priv->builder_bytes + priv->strings_bytes;
 }
@@ -28,7 +28,9 @@ struct _ChatbotChatDataClass
 };
 
 ChatbotChatData *chatbot_chat_data_new (void);
+ChatbotChatData *chatbot_chat_data_new_from_variant (GVariant *value);
 void chatbot_chat_data_append (ChatbotChatData *chat_data, const gchar *role,
                                const gchar *message);
+gsize chatbot_chat_data_get_memory_usage (ChatbotChatData *chat_data);
 
 G_END_DECLS
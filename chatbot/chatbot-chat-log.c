@@ -0,0 +1,714 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * ChatbotChatLog:
+ *
+ * Append-only log of conversation messages.
+ *
+ * Each message is a record written with a single write() to a file opened
+ * with `O_APPEND`, so appending never rewrites earlier messages, and records
+ * of concurrent sessions don't interleave. A record is lost at most partially
+ * on a crash, and such a torn record at the end is truncated when the log is
+ * opened again. Opening takes an exclusive flock() while it checks and
+ * truncates the file, and appending takes a shared one, so opening a log
+ * never truncates a record another process is appending.
+ *
+ * The file starts with 8 bytes magic "CHATBOTL" and 32 bit version. Each
+ * record has 32 bit stored size, 32 bit original size and 32 bit flags, all
+ * little endian, followed by a little endian #GVariant of type "(txss)"
+ * holding session, real time in microseconds, role and message. The
+ * #GVariant is deflated if the flags say so. Logs are read with
+ * [class@ChatLogReader].
+ */
+
+/**
+ * ChatbotChatLogReader:
+ *
+ * Reads messages of a [class@ChatLog] in the order they were written.
+ *
+ * Records of concurrent sessions interleave in the log.
+ * [method@ChatLogReader.get_sessions] groups them into one conversation per
+ * session. The reader is also a [iface@Data], whose
+ * [method@Data.get_strings] returns role and message of all records grouped
+ * the same way, so each conversation is contiguous when a log is given to
+ * [method@Trainer.train].
+ */
+
+#include "chatbot-chat-log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include "chatbot-chat-data.h"
+#include "chatbot-data.h"
+
+#define CHATBOT_CHAT_LOG_MAGIC "CHATBOTL"
+#define CHATBOT_CHAT_LOG_VERSION 1
+#define CHATBOT_CHAT_LOG_HEADER_SIZE 12
+#define CHATBOT_CHAT_LOG_RECORD_HEADER_SIZE 12
+#define CHATBOT_CHAT_LOG_RECORD_TYPE "(txss)"
+#define CHATBOT_CHAT_LOG_RECORD_COMPRESSED (1 << 0)
+
+struct _ChatbotChatLog
+{
+  GObject parent_instance;
+
+  gchar *path;
+  int fd;
+  ChatbotChatLogFlags flags;
+  GMutex mutex;
+  GConverter *compressor; // protected by mutex
+};
+
+struct _ChatbotChatLogReader
+{
+  GObject parent_instance;
+
+  gchar *path;
+  GMappedFile *file;
+  GBytes *bytes;
+  gsize offset;
+  GConverter *decompressor;
+  GStrv role_and_messages;
+};
+
+G_DEFINE_TYPE (ChatbotChatLog, chatbot_chat_log, G_TYPE_OBJECT);
+
+static void chatbot_chat_log_reader_data_init (ChatbotDataInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (
+    ChatbotChatLogReader, chatbot_chat_log_reader, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE (CHATBOT_TYPE_DATA,
+                           chatbot_chat_log_reader_data_init));
+
+static gboolean
+chatbot_chat_log_set_error_from_errno (GError **error, const gchar *message,
+                                       const gchar *path)
+{
+  int errsv = errno;
+
+  g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+               "%s \"%s\": %s", message, path, g_strerror (errsv));
+  return FALSE;
+}
+
+/*
+ * Returns the size of the complete records in @data, which is less than
+ * @size if the last record is torn.
+ */
+static gsize
+chatbot_chat_log_scan (const guint8 *data, gsize size)
+{
+  gsize offset = CHATBOT_CHAT_LOG_HEADER_SIZE;
+
+  while (size - offset >= CHATBOT_CHAT_LOG_RECORD_HEADER_SIZE)
+    {
+      guint32 stored_size;
+
+      memcpy (&stored_size, data + offset, sizeof (stored_size));
+      stored_size = GUINT32_FROM_LE (stored_size);
+      if (size - offset - CHATBOT_CHAT_LOG_RECORD_HEADER_SIZE < stored_size)
+        break;
+      offset += CHATBOT_CHAT_LOG_RECORD_HEADER_SIZE + stored_size;
+    }
+  return offset;
+}
+
+static gboolean
+chatbot_chat_log_check_header (const guint8 *data, gsize size,
+                               const gchar *path, GError **error)
+{
+  guint32 version;
+
+  if ((size < CHATBOT_CHAT_LOG_HEADER_SIZE)
+      || (memcmp (data, CHATBOT_CHAT_LOG_MAGIC, 8) != 0))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "\"%s\" is not a chat log.", path);
+      return FALSE;
+    }
+
+  memcpy (&version, data + 8, sizeof (version));
+  if (GUINT32_FROM_LE (version) != CHATBOT_CHAT_LOG_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Version %u of chat log \"%s\" is not supported.",
+                   GUINT32_FROM_LE (version), path);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/*
+ * Writes the header to a new log, or truncates a torn record left by a crash
+ * at the end of an existing one, so new records follow complete ones.
+ */
+static gboolean
+chatbot_chat_log_prepare (ChatbotChatLog *log, GError **error)
+{
+  GMappedFile *file;
+  const guint8 *data;
+  gsize size, valid_size;
+  struct stat st;
+  gboolean ret;
+
+  if (fstat (log->fd, &st) < 0)
+    return chatbot_chat_log_set_error_from_errno (error, "Failed to stat",
+                                                  log->path);
+
+  if (st.st_size == 0)
+    {
+      guint8 header[CHATBOT_CHAT_LOG_HEADER_SIZE];
+      guint32 version = GUINT32_TO_LE (CHATBOT_CHAT_LOG_VERSION);
+
+      memcpy (header, CHATBOT_CHAT_LOG_MAGIC, 8);
+      memcpy (header + 8, &version, sizeof (version));
+      if (write (log->fd, header, sizeof (header)) != sizeof (header))
+        return chatbot_chat_log_set_error_from_errno (
+            error, "Failed to write", log->path);
+      return TRUE;
+    }
+
+  file = g_mapped_file_new_from_fd (log->fd, FALSE, error);
+  if (file == NULL)
+    return FALSE;
+  data = (const guint8 *)g_mapped_file_get_contents (file);
+  size = g_mapped_file_get_length (file);
+
+  ret = chatbot_chat_log_check_header (data, size, log->path, error);
+  if (ret)
+    {
+      valid_size = chatbot_chat_log_scan (data, size);
+      if ((valid_size < size) && (ftruncate (log->fd, valid_size) < 0))
+        ret = chatbot_chat_log_set_error_from_errno (
+            error, "Failed to truncate", log->path);
+    }
+  g_mapped_file_unref (file);
+  return ret;
+}
+
+static void
+chatbot_chat_log_finalize (GObject *object)
+{
+  ChatbotChatLog *log = CHATBOT_CHAT_LOG (object);
+
+  if (log->fd >= 0)
+    close (log->fd);
+  g_clear_object (&log->compressor);
+  g_mutex_clear (&log->mutex);
+  g_free (log->path);
+
+  G_OBJECT_CLASS (chatbot_chat_log_parent_class)->finalize (object);
+}
+
+static void
+chatbot_chat_log_class_init (ChatbotChatLogClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = chatbot_chat_log_finalize;
+}
+
+static void
+chatbot_chat_log_init (ChatbotChatLog *log)
+{
+  log->fd = -1;
+  g_mutex_init (&log->mutex);
+}
+
+/**
+ * chatbot_chat_log_open:
+ * @path: log file, which is created if it doesn't exist
+ * @flags: how messages are written
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Open a log to append messages to.
+ *
+ * Returns: (transfer full) (nullable): log, or %NULL on failure
+ */
+ChatbotChatLog *
+chatbot_chat_log_open (const gchar *path, ChatbotChatLogFlags flags,
+                       GError **error)
+{
+  ChatbotChatLog *log;
+  gboolean ret;
+
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), NULL);
+
+  log = g_object_new (CHATBOT_TYPE_CHAT_LOG, NULL);
+  log->path = g_strdup (path);
+  log->flags = flags;
+  if (flags & CHATBOT_CHAT_LOG_COMPRESS)
+    log->compressor = G_CONVERTER (
+        g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, -1));
+
+  log->fd = g_open (path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (log->fd < 0)
+    {
+      chatbot_chat_log_set_error_from_errno (error, "Failed to open", path);
+      g_object_unref (log);
+      return NULL;
+    }
+
+  // Another process may be opening or appending to the same log.
+  if (flock (log->fd, LOCK_EX) < 0)
+    {
+      chatbot_chat_log_set_error_from_errno (error, "Failed to lock", path);
+      g_object_unref (log);
+      return NULL;
+    }
+  ret = chatbot_chat_log_prepare (log, error);
+  flock (log->fd, LOCK_UN);
+  if (!ret)
+    {
+      g_object_unref (log);
+      return NULL;
+    }
+  return log;
+}
+
+/**
+ * chatbot_chat_log_new_session:
+ *
+ * Returns: random session identifier for [method@ChatLog.append]
+ */
+guint64
+chatbot_chat_log_new_session (void)
+{
+  return ((guint64)g_random_int () << 32) | g_random_int ();
+}
+
+/*
+ * Deflates @data. Returns NULL if it doesn't get smaller.
+ */
+static guint8 *
+chatbot_chat_log_compress (ChatbotChatLog *log, const guint8 *data,
+                           gsize size, gsize *compressed_size)
+{
+  gsize out_size = size;
+  guint8 *out = g_malloc (out_size);
+  gsize read = 0, written = 0;
+  GConverterResult result;
+
+  g_converter_reset (log->compressor);
+  result = g_converter_convert (log->compressor, data, size, out, out_size,
+                                G_CONVERTER_INPUT_AT_END, &read, &written,
+                                NULL);
+  if (result != G_CONVERTER_FINISHED)
+    {
+      g_free (out);
+      return NULL;
+    }
+  *compressed_size = written;
+  return out;
+}
+
+/**
+ * chatbot_chat_log_append:
+ * @log: log
+ * @session: session the message belongs to, e.g. one returned by
+ * [func@ChatLog.new_session]
+ * @role: role
+ * @message: message
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Append a message as one record. This is safe to call from several threads.
+ *
+ * Returns: %TRUE if the record is written
+ */
+gboolean
+chatbot_chat_log_append (ChatbotChatLog *log, guint64 session,
+                         const gchar *role, const gchar *message,
+                         GError **error)
+{
+  GVariant *record;
+  const guint8 *payload;
+  guint8 *compressed = NULL, *buffer;
+  gsize payload_size, stored_size;
+  guint32 header[3];
+  gssize written;
+  gboolean ret = TRUE;
+
+  g_return_val_if_fail (CHATBOT_IS_CHAT_LOG (log), FALSE);
+  g_return_val_if_fail (role != NULL, FALSE);
+  g_return_val_if_fail (message != NULL, FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  record = g_variant_ref_sink (
+      g_variant_new (CHATBOT_CHAT_LOG_RECORD_TYPE, session,
+                     g_get_real_time (), role, message));
+  if (G_BYTE_ORDER == G_BIG_ENDIAN)
+    {
+      GVariant *swapped = g_variant_byteswap (record);
+      g_variant_unref (record);
+      record = swapped;
+    }
+  payload = g_variant_get_data (record);
+  payload_size = stored_size = g_variant_get_size (record);
+
+  g_mutex_lock (&log->mutex);
+  if (log->compressor)
+    compressed = chatbot_chat_log_compress (log, payload, payload_size,
+                                            &stored_size);
+  if (compressed == NULL)
+    stored_size = payload_size;
+
+  header[0] = GUINT32_TO_LE ((guint32)stored_size);
+  header[1] = GUINT32_TO_LE ((guint32)payload_size);
+  header[2] = GUINT32_TO_LE (compressed ? CHATBOT_CHAT_LOG_RECORD_COMPRESSED
+                                        : 0);
+
+  // One write() per record, so it's appended as a whole. The shared lock
+  // keeps chatbot_chat_log_open() of other processes from truncating it.
+  buffer = g_malloc (sizeof (header) + stored_size);
+  memcpy (buffer, header, sizeof (header));
+  memcpy (buffer + sizeof (header), compressed ? compressed : payload,
+          stored_size);
+  if (flock (log->fd, LOCK_SH) < 0)
+    {
+      ret = chatbot_chat_log_set_error_from_errno (error, "Failed to lock",
+                                                   log->path);
+      goto unlock;
+    }
+  do
+    written = write (log->fd, buffer, sizeof (header) + stored_size);
+  while ((written < 0) && (errno == EINTR));
+  flock (log->fd, LOCK_UN);
+  if (written != (gssize)(sizeof (header) + stored_size))
+    {
+      if (written >= 0)
+        errno = ENOSPC;
+      ret = chatbot_chat_log_set_error_from_errno (error, "Failed to write",
+                                                   log->path);
+    }
+unlock:
+  g_mutex_unlock (&log->mutex);
+
+  g_free (buffer);
+  g_free (compressed);
+  g_variant_unref (record);
+  return ret;
+}
+
+/**
+ * chatbot_chat_log_is_log:
+ * @path: file
+ *
+ * Returns: %TRUE if @path starts with the magic of chat logs
+ */
+gboolean
+chatbot_chat_log_is_log (const gchar *path)
+{
+  gchar magic[8];
+  gboolean ret;
+  FILE *file;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+
+  file = g_fopen (path, "rb");
+  if (file == NULL)
+    return FALSE;
+  ret = (fread (magic, 1, sizeof (magic), file) == sizeof (magic))
+        && (memcmp (magic, CHATBOT_CHAT_LOG_MAGIC, sizeof (magic)) == 0);
+  fclose (file);
+  return ret;
+}
+
+/*
+ * Groups records by session until the end of the log or a broken record,
+ * whose error is stored in @error. The cursor of next() doesn't move.
+ */
+static GPtrArray *
+chatbot_chat_log_reader_collect_sessions (ChatbotChatLogReader *reader,
+                                          GError **error)
+{
+  GPtrArray *conversations;
+  GHashTable *sessions;
+  guint64 session;
+  gchar *role, *message;
+  gsize offset;
+
+  offset = reader->offset;
+  chatbot_chat_log_reader_rewind (reader);
+  conversations = g_ptr_array_new_with_free_func (g_object_unref);
+  sessions = g_hash_table_new_full (g_int64_hash, g_int64_equal, g_free,
+                                    NULL);
+  while (chatbot_chat_log_reader_next (reader, &session, NULL, &role,
+                                       &message, error))
+    {
+      ChatbotChatData *chat_data;
+
+      chat_data = g_hash_table_lookup (sessions, &session);
+      if (chat_data == NULL)
+        {
+          chat_data = chatbot_chat_data_new ();
+          g_hash_table_insert (sessions,
+                               g_memdup2 (&session, sizeof (session)),
+                               chat_data);
+          g_ptr_array_add (conversations, chat_data);
+        }
+      chatbot_chat_data_append (chat_data, role, message);
+      g_free (role);
+      g_free (message);
+    }
+  g_hash_table_unref (sessions);
+  reader->offset = offset;
+  return conversations;
+}
+
+static const GStrv
+chatbot_chat_log_reader_get_strings (ChatbotData *data)
+{
+  ChatbotChatLogReader *reader = CHATBOT_CHAT_LOG_READER (data);
+  GStrvBuilder *builder;
+  GPtrArray *sessions;
+
+  if (reader->role_and_messages)
+    return reader->role_and_messages;
+
+  // A broken record ends the data, like the end of the log.
+  builder = g_strv_builder_new ();
+  sessions = chatbot_chat_log_reader_collect_sessions (reader, NULL);
+  for (guint i = 0; i < sessions->len; i++)
+    g_strv_builder_addv (builder,
+                         (const gchar **)chatbot_data_get_strings (
+                             CHATBOT_DATA (sessions->pdata[i])));
+  g_ptr_array_unref (sessions);
+  reader->role_and_messages = g_strv_builder_end (builder);
+  g_strv_builder_unref (builder);
+  return reader->role_and_messages;
+}
+
+static void
+chatbot_chat_log_reader_data_init (ChatbotDataInterface *iface)
+{
+  iface->get_strings = chatbot_chat_log_reader_get_strings;
+}
+
+static void
+chatbot_chat_log_reader_finalize (GObject *object)
+{
+  ChatbotChatLogReader *reader = CHATBOT_CHAT_LOG_READER (object);
+
+  g_strfreev (reader->role_and_messages);
+  g_clear_object (&reader->decompressor);
+  g_clear_pointer (&reader->bytes, g_bytes_unref);
+  g_clear_pointer (&reader->file, g_mapped_file_unref);
+  g_free (reader->path);
+
+  G_OBJECT_CLASS (chatbot_chat_log_reader_parent_class)->finalize (object);
+}
+
+static void
+chatbot_chat_log_reader_class_init (ChatbotChatLogReaderClass *klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = chatbot_chat_log_reader_finalize;
+}
+
+static void
+chatbot_chat_log_reader_init (ChatbotChatLogReader *reader)
+{
+}
+
+/**
+ * chatbot_chat_log_reader_new:
+ * @path: log file
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Open a log written by [class@ChatLog] to read. The file is mapped, so
+ * records are read without loading the whole log.
+ *
+ * Returns: (transfer full) (nullable): reader, or %NULL on failure
+ */
+ChatbotChatLogReader *
+chatbot_chat_log_reader_new (const gchar *path, GError **error)
+{
+  ChatbotChatLogReader *reader;
+  GMappedFile *file;
+
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), NULL);
+
+  file = g_mapped_file_new (path, FALSE, error);
+  if (file == NULL)
+    return NULL;
+  if (!chatbot_chat_log_check_header (
+          (const guint8 *)g_mapped_file_get_contents (file),
+          g_mapped_file_get_length (file), path, error))
+    {
+      g_mapped_file_unref (file);
+      return NULL;
+    }
+
+  reader = g_object_new (CHATBOT_TYPE_CHAT_LOG_READER, NULL);
+  reader->path = g_strdup (path);
+  reader->file = file;
+  reader->bytes = g_mapped_file_get_bytes (file);
+  reader->offset = CHATBOT_CHAT_LOG_HEADER_SIZE;
+  return reader;
+}
+
+static GBytes *
+chatbot_chat_log_reader_decompress (ChatbotChatLogReader *reader,
+                                    const guint8 *data, gsize size,
+                                    gsize payload_size, GError **error)
+{
+  guint8 *out = g_malloc (payload_size);
+  gsize read = 0, written = 0;
+  GConverterResult result;
+
+  if (reader->decompressor == NULL)
+    reader->decompressor = G_CONVERTER (
+        g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+  g_converter_reset (reader->decompressor);
+
+  result = g_converter_convert (reader->decompressor, data, size, out,
+                                payload_size, G_CONVERTER_INPUT_AT_END, &read,
+                                &written, error);
+  if ((result != G_CONVERTER_FINISHED) || (written != payload_size))
+    {
+      if (result != G_CONVERTER_ERROR)
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Broken record in chat log \"%s\".", reader->path);
+      g_free (out);
+      return NULL;
+    }
+  return g_bytes_new_take (out, payload_size);
+}
+
+/**
+ * chatbot_chat_log_reader_next:
+ * @reader: reader
+ * @session: (out) (optional): session of the message
+ * @time: (out) (optional): real time in microseconds when it was written
+ * @role: (out) (optional) (transfer full): role
+ * @message: (out) (optional) (transfer full): message
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Read the next record. A record torn by a crash at the end is treated as
+ * the end of the log.
+ *
+ * Returns: %TRUE if a record is read, %FALSE at the end or on failure
+ */
+gboolean
+chatbot_chat_log_reader_next (ChatbotChatLogReader *reader, guint64 *session,
+                              gint64 *time, gchar **role, gchar **message,
+                              GError **error)
+{
+  const guint8 *data;
+  gsize size;
+  guint32 header[3];
+  gsize stored_size, payload_size;
+  GBytes *payload;
+  GVariant *record;
+
+  g_return_val_if_fail (CHATBOT_IS_CHAT_LOG_READER (reader), FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  data = g_bytes_get_data (reader->bytes, &size);
+  if (size - reader->offset < CHATBOT_CHAT_LOG_RECORD_HEADER_SIZE)
+    return FALSE;
+
+  memcpy (header, data + reader->offset, sizeof (header));
+  stored_size = GUINT32_FROM_LE (header[0]);
+  payload_size = GUINT32_FROM_LE (header[1]);
+  if (size - reader->offset - CHATBOT_CHAT_LOG_RECORD_HEADER_SIZE
+      < stored_size)
+    return FALSE;
+
+  data += reader->offset + CHATBOT_CHAT_LOG_RECORD_HEADER_SIZE;
+  if (GUINT32_FROM_LE (header[2]) & CHATBOT_CHAT_LOG_RECORD_COMPRESSED)
+    payload = chatbot_chat_log_reader_decompress (reader, data, stored_size,
+                                                  payload_size, error);
+  else
+    payload = g_bytes_new_from_bytes (
+        reader->bytes, reader->offset + CHATBOT_CHAT_LOG_RECORD_HEADER_SIZE,
+        stored_size);
+  if (payload == NULL)
+    return FALSE;
+  reader->offset += CHATBOT_CHAT_LOG_RECORD_HEADER_SIZE + stored_size;
+
+  record = g_variant_ref_sink (g_variant_new_from_bytes (
+      G_VARIANT_TYPE (CHATBOT_CHAT_LOG_RECORD_TYPE), payload, FALSE));
+  g_bytes_unref (payload);
+  if (G_BYTE_ORDER == G_BIG_ENDIAN)
+    {
+      GVariant *swapped = g_variant_byteswap (record);
+      g_variant_unref (record);
+      record = swapped;
+    }
+  if (!g_variant_is_normal_form (record))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Broken record in chat log \"%s\".", reader->path);
+      g_variant_unref (record);
+      return FALSE;
+    }
+
+  g_variant_get (record, CHATBOT_CHAT_LOG_RECORD_TYPE, session, time, role,
+                 message);
+  g_variant_unref (record);
+  return TRUE;
+}
+
+/**
+ * chatbot_chat_log_reader_rewind:
+ * @reader: reader
+ *
+ * Make [method@ChatLogReader.next] read from the first record again.
+ */
+void
+chatbot_chat_log_reader_rewind (ChatbotChatLogReader *reader)
+{
+  g_return_if_fail (CHATBOT_IS_CHAT_LOG_READER (reader));
+  reader->offset = CHATBOT_CHAT_LOG_HEADER_SIZE;
+}
+
+/**
+ * chatbot_chat_log_reader_get_sessions:
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Read all records into one conversation per session, in the order the first
+ * message of each session was logged. The cursor of
+ * [method@ChatLogReader.next] doesn't move.
+ *
+ * Returns: (transfer container) (element-type ChatbotChatData) (nullable):
+ * conversations, or %NULL if a record is broken
+ */
+GPtrArray *
+chatbot_chat_log_reader_get_sessions (ChatbotChatLogReader *reader,
+                                      GError **error)
+{
+  GPtrArray *conversations;
+  GError *local_error = NULL;
+
+  g_return_val_if_fail (CHATBOT_IS_CHAT_LOG_READER (reader), NULL);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), NULL);
+
+  conversations
+      = chatbot_chat_log_reader_collect_sessions (reader, &local_error);
+  if (local_error)
+    {
+      g_propagate_error (error, local_error);
+      g_clear_pointer (&conversations, g_ptr_array_unref);
+    }
+  return conversations;
+}
@@ -0,0 +1,62 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gio/gio.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ChatbotChatLogFlags:
+ * @CHATBOT_CHAT_LOG_NONE: store messages as is
+ * @CHATBOT_CHAT_LOG_COMPRESS: compress each message with deflate
+ *
+ * How [class@ChatLog] writes messages.
+ */
+typedef enum
+{
+  CHATBOT_CHAT_LOG_NONE = 0,
+  CHATBOT_CHAT_LOG_COMPRESS = 1 << 0
+} ChatbotChatLogFlags;
+
+#define CHATBOT_TYPE_CHAT_LOG chatbot_chat_log_get_type ()
+G_DECLARE_FINAL_TYPE (ChatbotChatLog, chatbot_chat_log, CHATBOT, CHAT_LOG,
+                      GObject);
+
+#define CHATBOT_TYPE_CHAT_LOG_READER chatbot_chat_log_reader_get_type ()
+G_DECLARE_FINAL_TYPE (ChatbotChatLogReader, chatbot_chat_log_reader, CHATBOT,
+                      CHAT_LOG_READER, GObject);
+
+ChatbotChatLog *chatbot_chat_log_open (const gchar *path,
+                                       ChatbotChatLogFlags flags,
+                                       GError **error);
+guint64 chatbot_chat_log_new_session (void);
+gboolean chatbot_chat_log_append (ChatbotChatLog *log, guint64 session,
+                                  const gchar *role, const gchar *message,
+                                  GError **error);
+gboolean chatbot_chat_log_is_log (const gchar *path);
+
+ChatbotChatLogReader *chatbot_chat_log_reader_new (const gchar *path,
+                                                   GError **error);
+gboolean chatbot_chat_log_reader_next (ChatbotChatLogReader *reader,
+                                       guint64 *session, gint64 *time,
+                                       gchar **role, gchar **message,
+                                       GError **error);
+void chatbot_chat_log_reader_rewind (ChatbotChatLogReader *reader);
+GPtrArray *chatbot_chat_log_reader_get_sessions (ChatbotChatLogReader *reader,
+                                                 GError **error);
+
+G_END_DECLS
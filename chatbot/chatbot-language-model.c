@@ -26,6 +26,10 @@
 
 #include "chatbot-language-model.h"
 
+#include <string.h>
+
+#include "chatbot-trace.h"
+
 enum
 {
   GENERATING,
@@ -35,6 +39,143 @@ enum
 
 static int signals[N_SIGNALS];
 
+/*
+ * Per instance timing attached as qdata. @generate_start is 0 outside of
+ * [method@LanguageModel.generate].
+ */
+typedef struct
+{
+  ChatbotMetrics *metrics;
+  gint64 generate_start;
+  gint64 last_token;
+} ChatbotLanguageModelTiming;
+
+G_DEFINE_QUARK (chatbot-language-model-timing, chatbot_language_model_timing);
+
+static GMutex timing_mutex;
+
+static void
+chatbot_language_model_timing_free (ChatbotLanguageModelTiming *timing)
+{
+  chatbot_metrics_unref (timing->metrics);
+  g_free (timing);
+}
+
+static ChatbotLanguageModelTiming *
+chatbot_language_model_get_timing (ChatbotLanguageModel *language_model)
+{
+  GQuark quark = chatbot_language_model_timing_quark ();
+  ChatbotLanguageModelTiming *timing;
+
+  timing = g_object_get_qdata (G_OBJECT (language_model), quark);
+  if (timing)
+    return timing;
+
+  g_mutex_lock (&timing_mutex);
+  timing = g_object_get_qdata (G_OBJECT (language_model), quark);
+  if (timing == NULL)
+    {
+      timing = g_new0 (ChatbotLanguageModelTiming, 1);
+      timing->metrics = chatbot_metrics_new ();
+      g_object_set_qdata_full (
+          G_OBJECT (language_model), quark, timing,
+          (GDestroyNotify)chatbot_language_model_timing_free);
+    }
+  g_mutex_unlock (&timing_mutex);
+  return timing;
+}
+
+/*
+ * Records the time to the first token and the time between tokens of every
+ * implementation, without implementers doing anything.
+ */
+static gboolean
+chatbot_language_model_token_hook (GSignalInvocationHint *hint,
+                                   guint n_param_values,
+                                   const GValue *param_values,
+                                   gpointer user_data)
+{
+  GObject *instance = g_value_get_object (&param_values[0]);
+  ChatbotLanguageModelTiming *timing;
+  gint64 now;
+
+  timing = g_object_get_qdata (instance,
+                               chatbot_language_model_timing_quark ());
+  if ((timing == NULL) || (timing->generate_start == 0))
+    return TRUE;
+
+  now = g_get_monotonic_time ();
+  if (timing->last_token == 0)
+    chatbot_metrics_record (timing->metrics,
+                            CHATBOT_METRICS_TIME_TO_FIRST_TOKEN,
+                            now - timing->generate_start);
+  else
+    chatbot_metrics_record (timing->metrics, CHATBOT_METRICS_INTER_TOKEN,
+                            now - timing->last_token);
+  timing->last_token = now;
+  return TRUE;
+}
+
+/*
+ * Text an instance has consumed since it was reset or loaded @state_file,
+ * attached as qdata. @text is recorded only once @tracking is set by the
+ * first ensure_context(), so instances which never use it don't keep a copy
+ * of their whole session. @known is FALSE after a failed prefill, generation
+ * or rewind, which may have consumed part of their text, or after text was
+ * consumed without tracking.
+ */
+typedef struct
+{
+  GString *text;
+  gchar *state_file;
+  gboolean known;
+  gboolean tracking;
+} ChatbotLanguageModelContext;
+
+G_DEFINE_QUARK (chatbot-language-model-context,
+                chatbot_language_model_context);
+
+static void
+chatbot_language_model_context_free (ChatbotLanguageModelContext *context)
+{
+  g_string_free (context->text, TRUE);
+  g_free (context->state_file);
+  g_free (context);
+}
+
+/*
+ * An instance is used by one thread at a time, so unlike the timing, the
+ * context is not shared between threads.
+ */
+static ChatbotLanguageModelContext *
+chatbot_language_model_get_context (ChatbotLanguageModel *language_model)
+{
+  GQuark quark = chatbot_language_model_context_quark ();
+  ChatbotLanguageModelContext *context;
+
+  context = g_object_get_qdata (G_OBJECT (language_model), quark);
+  if (context == NULL)
+    {
+      context = g_new0 (ChatbotLanguageModelContext, 1);
+      context->text = g_string_new (NULL);
+      context->known = TRUE;
+      g_object_set_qdata_full (
+          G_OBJECT (language_model), quark, context,
+          (GDestroyNotify)chatbot_language_model_context_free);
+    }
+  return context;
+}
+
+static void
+chatbot_language_model_context_restart (ChatbotLanguageModelContext *context,
+                                        const gchar *state_file)
+{
+  g_string_truncate (context->text, 0);
+  g_free (context->state_file);
+  context->state_file = g_strdup (state_file);
+  context->known = TRUE;
+}
+
 G_DEFINE_INTERFACE (ChatbotLanguageModel, chatbot_language_model,
                     CHATBOT_TYPE_MODULE);
 
@@ -100,6 +241,11 @@ chatbot_language_model_default_init (ChatbotLanguageModelInterface *iface)
   signals[THINKING] = g_signal_new ("thinking", CHATBOT_TYPE_LANGUAGE_MODEL,
                                     G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
                                     G_TYPE_BOOLEAN, 1, G_TYPE_STRING);
+
+  g_signal_add_emission_hook (signals[GENERATING], 0,
+                              chatbot_language_model_token_hook, NULL, NULL);
+  g_signal_add_emission_hook (signals[THINKING], 0,
+                              chatbot_language_model_token_hook, NULL, NULL);
 }
 
 /**
@@ -139,13 +285,21 @@ chatbot_language_model_apply_chat_template (
     ChatbotLanguageModel *language_model, const GStrv role_and_message)
 {
   ChatbotLanguageModelInterface *iface;
+  gchar *formatted;
+  gint64 span;
 
   g_return_val_if_fail (CHATBOT_IS_LANGUAGE_MODEL (language_model), NULL);
   g_return_val_if_fail (role_and_message, NULL);
 
   iface = CHATBOT_LANGUAGE_MODEL_GET_IFACE (language_model);
   g_return_val_if_fail (iface->apply_chat_template, NULL);
-  return iface->apply_chat_template (language_model, role_and_message);
+
+  span = chatbot_trace_begin ();
+  formatted = iface->apply_chat_template (language_model, role_and_message);
+  chatbot_trace_end (
+      span, "apply-chat-template",
+      chatbot_module_get_name (CHATBOT_MODULE (language_model)));
+  return formatted;
 }
 
 /**
@@ -162,6 +316,10 @@ chatbot_language_model_prefill (ChatbotLanguageModel *language_model,
                                 const gchar *text, GError **error)
 {
   ChatbotLanguageModelInterface *iface;
+  ChatbotLanguageModelTiming *timing;
+  ChatbotLanguageModelContext *context;
+  gint64 start, span;
+  gboolean ret;
 
   g_return_val_if_fail (CHATBOT_IS_LANGUAGE_MODEL (language_model), FALSE);
   g_return_val_if_fail (text, FALSE);
@@ -169,7 +327,23 @@ chatbot_language_model_prefill (ChatbotLanguageModel *language_model,
 
   iface = CHATBOT_LANGUAGE_MODEL_GET_IFACE (language_model);
   g_return_val_if_fail (iface->prefill, FALSE);
-  return iface->prefill (language_model, text, error);
+
+  timing = chatbot_language_model_get_timing (language_model);
+  span = chatbot_trace_begin ();
+  start = g_get_monotonic_time ();
+  ret = iface->prefill (language_model, text, error);
+  if (ret)
+    chatbot_metrics_record_prefill (timing->metrics, strlen (text),
+                                    g_get_monotonic_time () - start);
+  context = chatbot_language_model_get_context (language_model);
+  if (ret && context->tracking)
+    g_string_append (context->text, text);
+  else
+    context->known = FALSE;
+  chatbot_trace_end (
+      span, "prefill",
+      chatbot_module_get_name (CHATBOT_MODULE (language_model)));
+  return ret;
 }
 
 /**
@@ -192,13 +366,35 @@ chatbot_language_model_generate (ChatbotLanguageModel *language_model,
                                  GError **error)
 {
   ChatbotLanguageModelInterface *iface;
+  ChatbotLanguageModelTiming *timing;
+  ChatbotLanguageModelContext *context;
+  gchar *generated;
+  gint64 span;
 
   g_return_val_if_fail (CHATBOT_IS_LANGUAGE_MODEL (language_model), FALSE);
   g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
 
   iface = CHATBOT_LANGUAGE_MODEL_GET_IFACE (language_model);
   g_return_val_if_fail (iface->generate, FALSE);
-  return iface->generate (language_model, error);
+
+  timing = chatbot_language_model_get_timing (language_model);
+  span = chatbot_trace_begin ();
+  timing->generate_start = g_get_monotonic_time ();
+  timing->last_token = 0;
+  generated = iface->generate (language_model, error);
+  if (generated)
+    chatbot_metrics_record (timing->metrics, CHATBOT_METRICS_GENERATE,
+                            g_get_monotonic_time () - timing->generate_start);
+  timing->generate_start = 0;
+  context = chatbot_language_model_get_context (language_model);
+  if (generated && context->tracking)
+    g_string_append (context->text, generated);
+  else
+    context->known = FALSE;
+  chatbot_trace_end (
+      span, "generate",
+      chatbot_module_get_name (CHATBOT_MODULE (language_model)));
+  return generated;
 }
 
 /**
@@ -262,5 +458,191 @@ chatbot_language_model_load_state (ChatbotLanguageModel *language_model,
       return FALSE;
     }
 
-  return iface->load_state (language_model, filename, error);
+  if (!iface->load_state (language_model, filename, error))
+    return FALSE;
+  chatbot_language_model_context_restart (
+      chatbot_language_model_get_context (language_model), filename);
+  return TRUE;
+}
+
+/**
+ * chatbot_language_model_reset:
+ * @error: (out) (optional): Location to store error.
+ *
+ * Discard everything prefilled and generated, so the next prefill starts a
+ * new session as if the instance was just constructed.
+ *
+ * Returns: %TRUE if succeed, %FALSE on failure.
+ */
+gboolean
+chatbot_language_model_reset (ChatbotLanguageModel *language_model,
+                              GError **error)
+{
+  ChatbotLanguageModelInterface *iface;
+
+  g_return_val_if_fail (CHATBOT_IS_LANGUAGE_MODEL (language_model), FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  iface = CHATBOT_LANGUAGE_MODEL_GET_IFACE (language_model);
+  if (iface->reset == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Resetting state is not supported for this module.");
+      return FALSE;
+    }
+
+  if (!iface->reset (language_model, error))
+    return FALSE;
+  chatbot_language_model_context_restart (
+      chatbot_language_model_get_context (language_model), NULL);
+  return TRUE;
+}
+
+/**
+ * chatbot_language_model_rewind:
+ * @n_bytes: Length of the text to discard.
+ * @error: (out) (optional): Location to store error.
+ *
+ * Discard the last @n_bytes of the text given to
+ * [method@LanguageModel.prefill], as if it was never prefilled. This lets a
+ * caller prefill text which may still change, and roll back only the part
+ * that changed. Implementations may refuse to rewind past the last
+ * generation. Rewinding 0 bytes checks if rewinding is supported.
+ *
+ * Returns: %TRUE if succeed, %FALSE on failure.
+ */
+gboolean
+chatbot_language_model_rewind (ChatbotLanguageModel *language_model,
+                               gsize n_bytes, GError **error)
+{
+  ChatbotLanguageModelInterface *iface;
+  ChatbotLanguageModelContext *context;
+  gboolean ret;
+  gint64 span;
+
+  g_return_val_if_fail (CHATBOT_IS_LANGUAGE_MODEL (language_model), FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  iface = CHATBOT_LANGUAGE_MODEL_GET_IFACE (language_model);
+  if (iface->rewind == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Rewinding is not supported for this module.");
+      return FALSE;
+    }
+  if (n_bytes == 0)
+    return TRUE;
+
+  span = chatbot_trace_begin ();
+  ret = iface->rewind (language_model, n_bytes, error);
+  context = chatbot_language_model_get_context (language_model);
+  if (ret && context->tracking && (n_bytes <= context->text->len))
+    g_string_truncate (context->text, context->text->len - n_bytes);
+  else
+    context->known = FALSE;
+  chatbot_trace_end (
+      span, "rewind",
+      chatbot_module_get_name (CHATBOT_MODULE (language_model)));
+  return ret;
+}
+
+/**
+ * chatbot_language_model_ensure_context:
+ * @text: Whole text the model should have consumed, e.g. chat template of
+ * the conversation so far.
+ * @rebuilt: (out) (optional): Location to store whether the session was
+ * rebuilt from the start.
+ * @error: (out) (optional): Location to store error.
+ *
+ * Bring the model to the state of having consumed @text since it was reset,
+ * or since [method@LanguageModel.load_state] if a state was loaded, doing as
+ * little work as possible.
+ *
+ * From the first call on an instance, the text consumed by
+ * [method@LanguageModel.prefill], [method@LanguageModel.generate] and
+ * [method@LanguageModel.rewind] is tracked. If it's a prefix of @text, only
+ * the rest is prefilled. Otherwise the model is rewound to the longest common
+ * prefix. If rewinding is not supported or fails, or the consumed text is
+ * unknown, e.g. after a failure or at the first call on an instance which has
+ * consumed text, the model is reset, or the state is loaded again, and the
+ * whole @text is prefilled. That is reported with @rebuilt and a
+ * "rebuild-context" trace span, since it costs a full prefill.
+ *
+ * Returns: %TRUE if succeed, %FALSE on failure.
+ */
+gboolean
+chatbot_language_model_ensure_context (ChatbotLanguageModel *language_model,
+                                       const gchar *text, gboolean *rebuilt,
+                                       GError **error)
+{
+  ChatbotLanguageModelContext *context;
+  gsize common = 0;
+  gchar *state_file;
+  gboolean ret;
+  gint64 span;
+
+  g_return_val_if_fail (CHATBOT_IS_LANGUAGE_MODEL (language_model), FALSE);
+  g_return_val_if_fail (text, FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  if (rebuilt)
+    *rebuilt = FALSE;
+  context = chatbot_language_model_get_context (language_model);
+  context->tracking = TRUE;
+  if (context->known)
+    {
+      while ((common < context->text->len) && text[common]
+             && (text[common] == context->text->str[common]))
+        common++;
+      // Keep UTF-8 characters whole, as models tokenize them.
+      while ((common > 0) && (common < context->text->len)
+             && ((context->text->str[common] & 0xc0) == 0x80))
+        common--;
+
+      if ((common == context->text->len)
+          || chatbot_language_model_rewind (
+              language_model, context->text->len - common, NULL))
+        {
+          if (text[common] == '\0')
+            return TRUE;
+          return chatbot_language_model_prefill (language_model,
+                                                 text + common, error);
+        }
+    }
+
+  // Rebuild from the start of the session.
+  if (rebuilt)
+    *rebuilt = TRUE;
+  span = chatbot_trace_begin ();
+  state_file = g_strdup (context->state_file);
+  if (state_file)
+    ret = chatbot_language_model_load_state (language_model, state_file,
+                                             error);
+  else
+    ret = chatbot_language_model_reset (language_model, error);
+  g_free (state_file);
+  if (ret && (text[0] != '\0'))
+    ret = chatbot_language_model_prefill (language_model, text, error);
+  chatbot_trace_end (
+      span, "rebuild-context",
+      chatbot_module_get_name (CHATBOT_MODULE (language_model)));
+  return ret;
+}
+
+/**
+ * chatbot_language_model_get_metrics:
+ *
+ * Get latency metrics of the instance. They are recorded by
+ * [method@LanguageModel.prefill], [method@LanguageModel.generate], the
+ * [signal@LanguageModel::generating] and [signal@LanguageModel::thinking]
+ * emissions during generation, and [method@Tool.call_function] given this
+ * instance.
+ *
+ * Returns: (transfer none): metrics of @language_model
+ */
+ChatbotMetrics *
+chatbot_language_model_get_metrics (ChatbotLanguageModel *language_model)
+{
+  g_return_val_if_fail (CHATBOT_IS_LANGUAGE_MODEL (language_model), NULL);
+  return chatbot_language_model_get_timing (language_model)->metrics;
 }
@@ -17,6 +17,7 @@
 #include <gio/gio.h>
 #include <glib-object.h>
 
+#include "chatbot-metrics.h"
 #include "chatbot-module.h"
 
 G_BEGIN_DECLS
@@ -38,6 +39,9 @@ struct _ChatbotLanguageModelInterface
                           const gchar *filename, GError **error);
   gboolean (*load_state) (ChatbotLanguageModel *language_model,
                           const gchar *filename, GError **error);
+  gboolean (*reset) (ChatbotLanguageModel *language_model, GError **error);
+  gboolean (*rewind) (ChatbotLanguageModel *language_model, gsize n_bytes,
+                      GError **error);
 };
 
 gpointer chatbot_language_model_new (GType type, const gchar *parameter,
@@ -54,5 +58,15 @@ chatbot_language_model_save_state (ChatbotLanguageModel *language_model,
 gboolean
 chatbot_language_model_load_state (ChatbotLanguageModel *language_model,
                                    const gchar *filename, GError **error);
+gboolean chatbot_language_model_reset (ChatbotLanguageModel *language_model,
+                                       GError **error);
+gboolean chatbot_language_model_rewind (ChatbotLanguageModel *language_model,
+                                        gsize n_bytes, GError **error);
+gboolean
+chatbot_language_model_ensure_context (ChatbotLanguageModel *language_model,
+                                       const gchar *text, gboolean *rebuilt,
+                                       GError **error);
+ChatbotMetrics *
+chatbot_language_model_get_metrics (ChatbotLanguageModel *language_model);
 
 G_END_DECLS
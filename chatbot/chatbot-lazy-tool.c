@@ -0,0 +1,521 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * ChatbotLazyTool:
+ *
+ * [iface@Tool] proxy that instantiates a tool module at its first call.
+ *
+ * Name, description and function definitions are taken from
+ * [class@ModuleManifest], so the proxy can be added to language models
+ * without opening the module file. The module is opened and initialized with
+ * [method@ModuleRegistry.checkout] of the default registry when a function is
+ * called for the first time, and the instance is returned to the registry
+ * when the proxy is disposed.
+ *
+ * The manifest only records functions an uninitialized instance defines.
+ * Once the module is loaded, the proxy exposes the function definitions of
+ * the instance and forwards its [signal@Tool::functions-changed], emitting
+ * the signal at loading if they differ from the manifest. A tool whose
+ * manifest entry has no functions at all is loaded at initialization,
+ * because nothing could ever call it otherwise, so only tools which define
+ * functions without their parameters benefit from the proxy.
+ */
+
+#include "chatbot-lazy-tool.h"
+
+#include "chatbot-module-registry.h"
+
+struct _ChatbotLazyTool
+{
+  ChatbotModule parent_instance;
+
+  ChatbotModuleManifest *manifest;
+  gchar *module_path;
+  gchar *module_parameter;
+
+  gchar *name;
+  gchar *description;
+  ChatbotToolFunction **functions;
+
+  GMutex mutex;
+  ChatbotTool *tool; // atomic
+};
+
+enum
+{
+  PROP_MANIFEST = 1,
+  PROP_MODULE_PATH,
+  PROP_MODULE_PARAMETER,
+  PROP_LOADED,
+  N_PROPERTIES,
+  PROP_FUNCTIONS = N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES] = {
+  NULL,
+};
+
+static GInitableIface *chatbot_lazy_tool_initable_parent_iface;
+
+static void chatbot_lazy_tool_initable_iface_init (GInitableIface *iface);
+static void chatbot_lazy_tool_tool_iface_init (ChatbotToolInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (
+    ChatbotLazyTool, chatbot_lazy_tool, CHATBOT_TYPE_MODULE,
+    G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+                           chatbot_lazy_tool_initable_iface_init)
+        G_IMPLEMENT_INTERFACE (CHATBOT_TYPE_TOOL,
+                               chatbot_lazy_tool_tool_iface_init));
+
+static ChatbotTool *chatbot_lazy_tool_ensure (ChatbotLazyTool *self,
+                                              GError **error);
+
+static gboolean
+chatbot_lazy_tool_initable_init (GInitable *initable,
+                                 GCancellable *cancellable, GError **error)
+{
+  ChatbotLazyTool *self = CHATBOT_LAZY_TOOL (initable);
+  GPtrArray *functions;
+
+  if (!chatbot_lazy_tool_initable_parent_iface->init (initable, cancellable,
+                                                      error))
+    return FALSE;
+
+  if ((self->manifest == NULL) || (self->module_path == NULL))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Manifest and module path of the lazy tool are not "
+                   "specified.");
+      return FALSE;
+    }
+
+  self->name = chatbot_module_manifest_get_name (self->manifest,
+                                                 self->module_path);
+  if (self->name == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                   "Module \"%s\" is not in the manifest.", self->module_path);
+      return FALSE;
+    }
+
+  if (!(chatbot_module_manifest_get_interfaces (self->manifest,
+                                                self->module_path)
+        & CHATBOT_MODULE_INTERFACE_TOOL))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Module \"%s\" doesn't implement ChatbotTool.",
+                   self->module_path);
+      return FALSE;
+    }
+
+  functions = chatbot_module_manifest_get_functions (
+      self->manifest, self->module_path, error);
+  if (functions == NULL)
+    return FALSE;
+  g_ptr_array_set_free_func (functions, NULL);
+  g_ptr_array_add (functions, NULL);
+  self->functions = (ChatbotToolFunction **)g_ptr_array_free (functions,
+                                                               FALSE);
+
+  self->description = chatbot_module_manifest_get_description (
+      self->manifest, self->module_path);
+
+  // Everything needed is copied, the manifest may be updated by later scans.
+  g_clear_object (&self->manifest);
+
+  // All functions depend on parameters, so load the real definitions now.
+  if (self->functions[0] == NULL)
+    {
+      ChatbotTool *tool = chatbot_lazy_tool_ensure (self, error);
+      if (tool == NULL)
+        return FALSE;
+      g_object_unref (tool);
+    }
+  return TRUE;
+}
+
+static void
+chatbot_lazy_tool_initable_iface_init (GInitableIface *iface)
+{
+  chatbot_lazy_tool_initable_parent_iface
+      = g_type_interface_peek_parent (iface);
+  iface->init = chatbot_lazy_tool_initable_init;
+}
+
+static void
+chatbot_lazy_tool_functions_changed (ChatbotLazyTool *self)
+{
+  g_signal_emit_by_name (self, "functions-changed");
+}
+
+/* Whether @tool defines the same functions as the manifest. */
+static gboolean
+chatbot_lazy_tool_same_functions (ChatbotLazyTool *self, ChatbotTool *tool)
+{
+  const ChatbotToolFunction *const *functions;
+  ChatbotToolFunction **i;
+
+  functions = chatbot_tool_get_function_definitions (tool);
+  for (i = self->functions; i && *i && functions && *functions;
+       i++, functions++)
+    {
+      GVariant *a, *b;
+      gboolean equal;
+
+      a = g_variant_ref_sink (chatbot_tool_function_to_variant (*i));
+      b = g_variant_ref_sink (chatbot_tool_function_to_variant (*functions));
+      equal = g_variant_equal (a, b);
+      g_variant_unref (a);
+      g_variant_unref (b);
+      if (!equal)
+        return FALSE;
+    }
+  return ((i == NULL) || (*i == NULL))
+         && ((functions == NULL) || (*functions == NULL));
+}
+
+static ChatbotTool *
+chatbot_lazy_tool_ensure (ChatbotLazyTool *self, GError **error)
+{
+  ChatbotModuleRegistry *registry = chatbot_module_registry_get_default ();
+  ChatbotModule *module = NULL;
+  ChatbotTool *tool = NULL;
+  gboolean loaded = FALSE;
+  GType type;
+
+  g_mutex_lock (&self->mutex);
+  if (self->tool)
+    {
+      tool = g_object_ref (self->tool);
+      goto cleanup;
+    }
+
+  type = chatbot_module_registry_load_type (registry, self->module_path,
+                                            error);
+  if (type == G_TYPE_INVALID)
+    goto cleanup;
+
+  module = chatbot_module_registry_checkout (registry, type,
+                                             self->module_parameter, error);
+  if (module == NULL)
+    goto cleanup;
+
+  if (!CHATBOT_IS_TOOL (module))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Module \"%s\" doesn't implement ChatbotTool.",
+                   self->module_path);
+      g_object_unref (module);
+      goto cleanup;
+    }
+
+  tool = g_object_ref (CHATBOT_TOOL (module));
+  g_signal_connect_object (tool, "functions-changed",
+                           G_CALLBACK (chatbot_lazy_tool_functions_changed),
+                           self, G_CONNECT_SWAPPED);
+  g_atomic_pointer_set (&self->tool, module);
+  loaded = TRUE;
+
+cleanup:
+  g_mutex_unlock (&self->mutex);
+  if (loaded)
+    {
+      g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_LOADED]);
+      if (!chatbot_lazy_tool_same_functions (self, tool))
+        chatbot_lazy_tool_functions_changed (self);
+    }
+  return tool;
+}
+
+static const ChatbotToolFunction *const *
+chatbot_lazy_tool_get_function_definitions (ChatbotTool *tool)
+{
+  ChatbotLazyTool *self = CHATBOT_LAZY_TOOL (tool);
+  ChatbotTool *loaded = g_atomic_pointer_get (&self->tool);
+
+  if (loaded)
+    return chatbot_tool_get_function_definitions (loaded);
+  return (const ChatbotToolFunction *const *)self->functions;
+}
+
+static GVariantDict *
+chatbot_lazy_tool_call_function (ChatbotTool *tool, const gchar *function_name,
+                                 GVariantDict *parameters,
+                                 ChatbotLanguageModel *language_model,
+                                 GCancellable *cancellable, GError **error)
+{
+  ChatbotLazyTool *self = CHATBOT_LAZY_TOOL (tool);
+  ChatbotTool *instance;
+  GVariantDict *result;
+
+  instance = chatbot_lazy_tool_ensure (self, error);
+  if (instance == NULL)
+    return NULL;
+
+  result = chatbot_tool_call_function (instance, function_name, parameters,
+                                       language_model, cancellable, error);
+  g_object_unref (instance);
+  return result;
+}
+
+static gboolean
+chatbot_lazy_tool_call_function_stream (ChatbotTool *tool,
+                                        const ChatbotToolFunction *function,
+                                        GVariant *const *args,
+                                        ChatbotToolStream *stream,
+                                        ChatbotLanguageModel *language_model,
+                                        GCancellable *cancellable,
+                                        GError **error)
+{
+  ChatbotLazyTool *self = CHATBOT_LAZY_TOOL (tool);
+  ChatbotTool *instance;
+  GVariantDict *parameters;
+  gboolean ret;
+
+  instance = chatbot_lazy_tool_ensure (self, error);
+  if (instance == NULL)
+    return FALSE;
+
+  // Arguments are decoded in schema order, the instance decodes them again.
+  parameters = g_variant_dict_new (NULL);
+  for (gsize i = 0; function->input_schemas[i]; i++)
+    g_variant_dict_insert_value (parameters, function->input_schemas[i]->name,
+                                 args[i]);
+
+  ret = chatbot_tool_call_function_stream (instance, function->name,
+                                           parameters, stream, language_model,
+                                           cancellable, error);
+  g_variant_dict_unref (parameters);
+  g_object_unref (instance);
+  return ret;
+}
+
+static void
+chatbot_lazy_tool_tool_iface_init (ChatbotToolInterface *iface)
+{
+  iface->get_function_definitions = chatbot_lazy_tool_get_function_definitions;
+  iface->call_function = chatbot_lazy_tool_call_function;
+  iface->call_function_stream = chatbot_lazy_tool_call_function_stream;
+}
+
+static const gchar *
+chatbot_lazy_tool_get_name (ChatbotModule *module)
+{
+  return CHATBOT_LAZY_TOOL (module)->name;
+}
+
+static const gchar *
+chatbot_lazy_tool_get_description (ChatbotModule *module)
+{
+  return CHATBOT_LAZY_TOOL (module)->description;
+}
+
+static void
+chatbot_lazy_tool_set_property (GObject *object, guint property_id,
+                                const GValue *value, GParamSpec *pspec)
+{
+  ChatbotLazyTool *self = CHATBOT_LAZY_TOOL (object);
+
+  switch (property_id)
+    {
+    case PROP_MANIFEST:
+      g_set_object (&self->manifest, g_value_get_object (value));
+      break;
+    case PROP_MODULE_PATH:
+      g_free (self->module_path);
+      self->module_path = g_value_dup_string (value);
+      break;
+    case PROP_MODULE_PARAMETER:
+      g_free (self->module_parameter);
+      self->module_parameter = g_value_dup_string (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_lazy_tool_get_property (GObject *object, guint property_id,
+                                GValue *value, GParamSpec *pspec)
+{
+  ChatbotLazyTool *self = CHATBOT_LAZY_TOOL (object);
+
+  switch (property_id)
+    {
+    case PROP_MANIFEST:
+      g_value_set_object (value, self->manifest);
+      break;
+    case PROP_MODULE_PATH:
+      g_value_set_string (value, self->module_path);
+      break;
+    case PROP_MODULE_PARAMETER:
+      g_value_set_string (value, self->module_parameter);
+      break;
+    case PROP_LOADED:
+      g_value_set_boolean (value, chatbot_lazy_tool_is_loaded (self));
+      break;
+    case PROP_FUNCTIONS:
+      g_value_take_boxed (
+          value, chatbot_tool_dup_function_definitions (CHATBOT_TOOL (self)));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_lazy_tool_dispose (GObject *object)
+{
+  ChatbotLazyTool *self = CHATBOT_LAZY_TOOL (object);
+
+  // Keep the instance warm for the next user of the same module.
+  if (self->tool)
+    {
+      ChatbotModule *module = CHATBOT_MODULE (g_steal_pointer (&self->tool));
+      g_signal_handlers_disconnect_by_data (module, self);
+      chatbot_module_registry_return (chatbot_module_registry_get_default (),
+                                      module);
+    }
+  g_clear_object (&self->manifest);
+
+  G_OBJECT_CLASS (chatbot_lazy_tool_parent_class)->dispose (object);
+}
+
+static void
+chatbot_lazy_tool_finalize (GObject *object)
+{
+  ChatbotLazyTool *self = CHATBOT_LAZY_TOOL (object);
+
+  for (ChatbotToolFunction **i = self->functions; i && *i; i++)
+    chatbot_tool_function_unref (*i);
+  g_free (self->functions);
+  g_free (self->name);
+  g_free (self->description);
+  g_free (self->module_parameter);
+  g_free (self->module_path);
+  g_mutex_clear (&self->mutex);
+
+  G_OBJECT_CLASS (chatbot_lazy_tool_parent_class)->finalize (object);
+}
+
+static void
+chatbot_lazy_tool_class_init (ChatbotLazyToolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ChatbotModuleClass *module_class = CHATBOT_MODULE_CLASS (klass);
+
+  object_class->set_property = chatbot_lazy_tool_set_property;
+  object_class->get_property = chatbot_lazy_tool_get_property;
+  object_class->dispose = chatbot_lazy_tool_dispose;
+  object_class->finalize = chatbot_lazy_tool_finalize;
+
+  module_class->get_name = chatbot_lazy_tool_get_name;
+  module_class->get_description = chatbot_lazy_tool_get_description;
+
+  /**
+   * ChatbotLazyTool:manifest:
+   *
+   * Manifest which has the entry of the tool module. It's released after
+   * initialization.
+   */
+  properties[PROP_MANIFEST] = g_param_spec_object (
+      "manifest", "manifest", "module manifest", CHATBOT_TYPE_MODULE_MANIFEST,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  /**
+   * ChatbotLazyTool:module-path:
+   *
+   * Tool module path in the manifest.
+   */
+  properties[PROP_MODULE_PATH] = g_param_spec_string (
+      "module-path", "module-path", "tool module path", NULL,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  /**
+   * ChatbotLazyTool:module-parameter:
+   *
+   * Parameter of the tool module.
+   */
+  properties[PROP_MODULE_PARAMETER] = g_param_spec_string (
+      "module-parameter", "module-parameter", "tool module parameter", "",
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  /**
+   * ChatbotLazyTool:loaded:
+   *
+   * Whether the tool module is instantiated.
+   */
+  properties[PROP_LOADED]
+      = g_param_spec_boolean ("loaded", "loaded", "tool module is loaded",
+                              FALSE, G_PARAM_READABLE);
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+  g_object_class_override_property (object_class, PROP_FUNCTIONS,
+                                    "functions");
+}
+
+static void
+chatbot_lazy_tool_init (ChatbotLazyTool *self)
+{
+  g_mutex_init (&self->mutex);
+}
+
+/**
+ * chatbot_lazy_tool_new:
+ * @manifest: manifest which has the entry of @module_path
+ * @module_path: tool module path
+ * @module_parameter: (nullable): parameter of the tool module
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Create a proxy of the tool module from its manifest entry. The module is
+ * not opened until a function is called.
+ *
+ * Returns: (transfer full) (nullable): newly created proxy, or %NULL if
+ * @module_path is not a tool in @manifest.
+ */
+ChatbotLazyTool *
+chatbot_lazy_tool_new (ChatbotModuleManifest *manifest,
+                       const gchar *module_path,
+                       const gchar *module_parameter, GError **error)
+{
+  g_return_val_if_fail (CHATBOT_IS_MODULE_MANIFEST (manifest), NULL);
+  g_return_val_if_fail (module_path != NULL, NULL);
+
+  return g_initable_new (CHATBOT_TYPE_LAZY_TOOL, NULL, error, "raw_parameter",
+                         "", "manifest", manifest, "module-path", module_path,
+                         "module-parameter",
+                         module_parameter ? module_parameter : "", NULL);
+}
+
+/**
+ * chatbot_lazy_tool_is_loaded: (get-property loaded)
+ *
+ * Returns: %TRUE if the tool module is instantiated
+ */
+gboolean
+chatbot_lazy_tool_is_loaded (ChatbotLazyTool *lazy_tool)
+{
+  gboolean loaded;
+
+  g_return_val_if_fail (CHATBOT_IS_LAZY_TOOL (lazy_tool), FALSE);
+
+  g_mutex_lock (&lazy_tool->mutex);
+  loaded = lazy_tool->tool != NULL;
+  g_mutex_unlock (&lazy_tool->mutex);
+  return loaded;
+}
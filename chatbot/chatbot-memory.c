@@ -0,0 +1,250 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Process wide memory accounting.
+ *
+ * Modules report their usage with chatbot_module_set_memory_usage() and
+ * ChatbotChatData reports its messages, which are summed here per
+ * ChatbotMemoryKind. chatbot_memory_check() compares the usage with the
+ * memory limit of the cgroup, so a caller can refuse or evict sessions before
+ * the process is killed.
+ */
+
+#include "chatbot-memory.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static GMutex memory_mutex;
+static gsize memory_usage[CHATBOT_MEMORY_N_KINDS];
+
+static const gchar *const memory_kind_names[CHATBOT_MEMORY_N_KINDS]
+    = { "weights", "state", "scratch", "chat-data" };
+
+/**
+ * chatbot_memory_update:
+ * @kind: what the memory is used for
+ * @old_bytes: previously reported size
+ * @new_bytes: current size
+ *
+ * Replace @old_bytes of @kind in the process usage with @new_bytes.
+ */
+void
+chatbot_memory_update (ChatbotMemoryKind kind, gsize old_bytes,
+                       gsize new_bytes)
+{
+  g_return_if_fail (kind < CHATBOT_MEMORY_N_KINDS);
+
+  g_mutex_lock (&memory_mutex);
+  g_warn_if_fail (memory_usage[kind] >= old_bytes);
+  memory_usage[kind] -= MIN (memory_usage[kind], old_bytes);
+  memory_usage[kind] += new_bytes;
+  g_mutex_unlock (&memory_mutex);
+}
+
+/**
+ * chatbot_memory_get_usage:
+ * @kind: what the memory is used for
+ *
+ * Returns: bytes of @kind reported in the process
+ */
+gsize
+chatbot_memory_get_usage (ChatbotMemoryKind kind)
+{
+  gsize usage;
+
+  g_return_val_if_fail (kind < CHATBOT_MEMORY_N_KINDS, 0);
+
+  g_mutex_lock (&memory_mutex);
+  usage = memory_usage[kind];
+  g_mutex_unlock (&memory_mutex);
+  return usage;
+}
+
+/**
+ * chatbot_memory_get_total:
+ *
+ * Returns: bytes of all kinds reported in the process
+ */
+gsize
+chatbot_memory_get_total (void)
+{
+  gsize total = 0;
+
+  g_mutex_lock (&memory_mutex);
+  for (guint i = 0; i < CHATBOT_MEMORY_N_KINDS; i++)
+    total += memory_usage[i];
+  g_mutex_unlock (&memory_mutex);
+  return total;
+}
+
+/**
+ * chatbot_memory_get_resident:
+ *
+ * Resident set size of the process, which includes memory not reported by
+ * modules.
+ *
+ * Returns: resident bytes, or 0 if it can't be read
+ */
+gsize
+chatbot_memory_get_resident (void)
+{
+  unsigned long size, resident;
+  FILE *file;
+  int n;
+
+  file = fopen ("/proc/self/statm", "r");
+  if (file == NULL)
+    return 0;
+  n = fscanf (file, "%lu %lu", &size, &resident);
+  fclose (file);
+  if (n != 2)
+    return 0;
+
+  return (gsize)resident * sysconf (_SC_PAGESIZE);
+}
+
+static guint64
+chatbot_memory_read_limit (const gchar *path)
+{
+  gchar *contents = NULL;
+  guint64 limit = G_MAXUINT64;
+
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    return G_MAXUINT64;
+
+  g_strstrip (contents);
+  if (g_ascii_isdigit (contents[0]))
+    limit = g_ascii_strtoull (contents, NULL, 10);
+  g_free (contents);
+  return limit;
+}
+
+/**
+ * chatbot_memory_get_limit:
+ *
+ * Memory limit of the cgroup the process belongs to. Both cgroup v2
+ * "memory.max" and cgroup v1 "memory.limit_in_bytes" are supported.
+ *
+ * Returns: limit in bytes, or %G_MAXUINT64 if there is no limit
+ */
+guint64
+chatbot_memory_get_limit (void)
+{
+  gchar *contents = NULL;
+  gchar **lines;
+  guint64 limit = G_MAXUINT64;
+
+  if (g_file_get_contents ("/proc/self/cgroup", &contents, NULL, NULL))
+    {
+      lines = g_strsplit (contents, "\n", -1);
+      for (gchar **line = lines; *line; line++)
+        {
+          gchar *path;
+
+          // cgroup v2 has only "0::/path".
+          if (!g_str_has_prefix (*line, "0::"))
+            continue;
+          path = g_build_filename ("/sys/fs/cgroup", *line + 3, "memory.max",
+                                   NULL);
+          limit = chatbot_memory_read_limit (path);
+          g_free (path);
+          break;
+        }
+      g_strfreev (lines);
+      g_free (contents);
+    }
+
+  if (limit == G_MAXUINT64)
+    limit = chatbot_memory_read_limit (
+        "/sys/fs/cgroup/memory/memory.limit_in_bytes");
+
+  // cgroup v1 reports a huge page aligned number for no limit.
+  if (limit >= (G_MAXUINT64 >> 2))
+    limit = G_MAXUINT64;
+  return limit;
+}
+
+/**
+ * chatbot_memory_check:
+ * @n_bytes: bytes going to be allocated
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Check if @n_bytes more fit in the memory limit. Usage is the larger of the
+ * reported total and the resident size.
+ *
+ * Returns: %TRUE if @n_bytes fit, %FALSE with %G_IO_ERROR_NO_SPACE if not.
+ */
+gboolean
+chatbot_memory_check (gsize n_bytes, GError **error)
+{
+  guint64 limit = chatbot_memory_get_limit ();
+  guint64 used;
+
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  if (limit == G_MAXUINT64)
+    return TRUE;
+
+  used = MAX (chatbot_memory_get_total (), chatbot_memory_get_resident ());
+  if ((used > limit) || (n_bytes > limit - used))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                   "%" G_GSIZE_FORMAT " bytes don't fit in memory limit. "
+                   "Used %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT
+                   " bytes.",
+                   n_bytes, used, limit);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/**
+ * chatbot_memory_to_variant:
+ *
+ * Snapshot the accounting for printing. The value is "a{sv}" which has
+ * bytes of each [enum@MemoryKind], "total", "resident" and "limit" as "t".
+ *
+ * Returns: (transfer floating): snapshot of the accounting
+ */
+GVariant *
+chatbot_memory_to_variant (void)
+{
+  GVariantBuilder builder;
+  gsize usage[CHATBOT_MEMORY_N_KINDS];
+  gsize total = 0;
+
+  g_mutex_lock (&memory_mutex);
+  memcpy (usage, memory_usage, sizeof (usage));
+  g_mutex_unlock (&memory_mutex);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  for (guint i = 0; i < CHATBOT_MEMORY_N_KINDS; i++)
+    {
+      g_variant_builder_add (&builder, "{sv}", memory_kind_names[i],
+                             g_variant_new_uint64 (usage[i]));
+      total += usage[i];
+    }
+  g_variant_builder_add (&builder, "{sv}", "total",
+                         g_variant_new_uint64 (total));
+  g_variant_builder_add (
+      &builder, "{sv}", "resident",
+      g_variant_new_uint64 (chatbot_memory_get_resident ()));
+  g_variant_builder_add (&builder, "{sv}", "limit",
+                         g_variant_new_uint64 (chatbot_memory_get_limit ()));
+  return g_variant_builder_end (&builder);
+}
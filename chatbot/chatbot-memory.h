@@ -0,0 +1,50 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gio/gio.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ChatbotMemoryKind:
+ * @CHATBOT_MEMORY_WEIGHTS: model weights
+ * @CHATBOT_MEMORY_STATE: KV cache or other per session state
+ * @CHATBOT_MEMORY_SCRATCH: temporary buffers of computation
+ * @CHATBOT_MEMORY_CHAT_DATA: messages held by [class@ChatData]
+ * @CHATBOT_MEMORY_N_KINDS: number of kinds
+ *
+ * What accounted memory is used for.
+ */
+typedef enum
+{
+  CHATBOT_MEMORY_WEIGHTS,
+  CHATBOT_MEMORY_STATE,
+  CHATBOT_MEMORY_SCRATCH,
+  CHATBOT_MEMORY_CHAT_DATA,
+  CHATBOT_MEMORY_N_KINDS
+} ChatbotMemoryKind;
+
+void chatbot_memory_update (ChatbotMemoryKind kind, gsize old_bytes,
+                            gsize new_bytes);
+gsize chatbot_memory_get_usage (ChatbotMemoryKind kind);
+gsize chatbot_memory_get_total (void);
+gsize chatbot_memory_get_resident (void);
+guint64 chatbot_memory_get_limit (void);
+gboolean chatbot_memory_check (gsize n_bytes, GError **error);
+GVariant *chatbot_memory_to_variant (void);
+
+G_END_DECLS
@@ -0,0 +1,347 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * ChatbotMetrics:
+ *
+ * Latency histograms filled by [iface@LanguageModel] around prefill,
+ * generation, each emitted token and tool calls. Obtain them with
+ * [method@LanguageModel.get_metrics].
+ *
+ * Each [enum@MetricsKind] has a histogram of power of 2 microsecond buckets,
+ * so recording only updates counters in place and never allocates.
+ * Percentiles are reported as the upper bound of the bucket, which is at most
+ * twice the real value.
+ */
+
+#include "chatbot-metrics.h"
+
+#include <string.h>
+
+#define CHATBOT_METRICS_N_BUCKETS 40
+
+typedef struct
+{
+  guint64 count;
+  gint64 sum;
+  gint64 min;
+  gint64 max;
+  guint64 buckets[CHATBOT_METRICS_N_BUCKETS];
+} ChatbotMetricsHistogram;
+
+struct _ChatbotMetrics
+{
+  GMutex mutex;
+  ChatbotMetricsHistogram histograms[CHATBOT_METRICS_N_KINDS];
+  guint64 prefill_bytes;
+  gint64 prefill_us;
+  gatomicrefcount ref;
+};
+
+static const gchar *const chatbot_metrics_kind_names[CHATBOT_METRICS_N_KINDS]
+    = { "prefill", "generate", "time-to-first-token", "inter-token",
+        "tool-call" };
+
+G_DEFINE_BOXED_TYPE (ChatbotMetrics, chatbot_metrics, chatbot_metrics_ref,
+                     chatbot_metrics_unref);
+
+/**
+ * chatbot_metrics_new:
+ *
+ * Returns: (transfer full): empty metrics
+ */
+ChatbotMetrics *
+chatbot_metrics_new (void)
+{
+  ChatbotMetrics *metrics = g_new0 (ChatbotMetrics, 1);
+
+  g_mutex_init (&metrics->mutex);
+  g_atomic_ref_count_init (&metrics->ref);
+  return metrics;
+}
+
+/**
+ * chatbot_metrics_ref:
+ * @metrics: metrics
+ *
+ * Returns: @metrics
+ */
+ChatbotMetrics *
+chatbot_metrics_ref (ChatbotMetrics *metrics)
+{
+  g_return_val_if_fail (metrics != NULL, NULL);
+  g_atomic_ref_count_inc (&metrics->ref);
+  return metrics;
+}
+
+/**
+ * chatbot_metrics_unref:
+ * @metrics: metrics
+ */
+void
+chatbot_metrics_unref (ChatbotMetrics *metrics)
+{
+  g_return_if_fail (metrics != NULL);
+  if (!g_atomic_ref_count_dec (&metrics->ref))
+    return;
+
+  g_mutex_clear (&metrics->mutex);
+  g_free (metrics);
+}
+
+/**
+ * chatbot_metrics_record:
+ * @metrics: metrics
+ * @kind: what is measured
+ * @duration_us: duration in microseconds
+ *
+ * Add a duration to the histogram of @kind.
+ */
+void
+chatbot_metrics_record (ChatbotMetrics *metrics, ChatbotMetricsKind kind,
+                        gint64 duration_us)
+{
+  ChatbotMetricsHistogram *histogram;
+  guint bucket;
+
+  g_return_if_fail (metrics != NULL);
+  g_return_if_fail (kind < CHATBOT_METRICS_N_KINDS);
+
+  duration_us = MAX (duration_us, 0);
+  // Bucket i holds durations in [2^(i-1), 2^i).
+  bucket = MIN (g_bit_storage ((gulong)duration_us),
+                CHATBOT_METRICS_N_BUCKETS - 1);
+
+  g_mutex_lock (&metrics->mutex);
+  histogram = &metrics->histograms[kind];
+  if ((histogram->count == 0) || (duration_us < histogram->min))
+    histogram->min = duration_us;
+  histogram->max = MAX (histogram->max, duration_us);
+  histogram->count++;
+  histogram->sum += duration_us;
+  histogram->buckets[bucket]++;
+  g_mutex_unlock (&metrics->mutex);
+}
+
+/**
+ * chatbot_metrics_record_prefill:
+ * @metrics: metrics
+ * @n_bytes: size of the prefilled text
+ * @duration_us: duration in microseconds
+ *
+ * Record a prefill. Models don't report their token count, so throughput is
+ * measured in bytes of text.
+ */
+void
+chatbot_metrics_record_prefill (ChatbotMetrics *metrics, gsize n_bytes,
+                                gint64 duration_us)
+{
+  g_return_if_fail (metrics != NULL);
+
+  chatbot_metrics_record (metrics, CHATBOT_METRICS_PREFILL, duration_us);
+  g_mutex_lock (&metrics->mutex);
+  metrics->prefill_bytes += n_bytes;
+  metrics->prefill_us += MAX (duration_us, 0);
+  g_mutex_unlock (&metrics->mutex);
+}
+
+/**
+ * chatbot_metrics_get_count:
+ * @metrics: metrics
+ * @kind: what is measured
+ *
+ * Returns: number of recorded durations of @kind
+ */
+guint64
+chatbot_metrics_get_count (ChatbotMetrics *metrics, ChatbotMetricsKind kind)
+{
+  guint64 count;
+
+  g_return_val_if_fail (metrics != NULL, 0);
+  g_return_val_if_fail (kind < CHATBOT_METRICS_N_KINDS, 0);
+
+  g_mutex_lock (&metrics->mutex);
+  count = metrics->histograms[kind].count;
+  g_mutex_unlock (&metrics->mutex);
+  return count;
+}
+
+static gdouble
+chatbot_metrics_histogram_mean (const ChatbotMetricsHistogram *histogram)
+{
+  if (histogram->count == 0)
+    return 0.0;
+  return (gdouble)histogram->sum / (gdouble)histogram->count;
+}
+
+static gint64
+chatbot_metrics_histogram_percentile (const ChatbotMetricsHistogram *histogram,
+                                      gdouble percentile)
+{
+  guint64 rank, seen = 0;
+
+  if (histogram->count == 0)
+    return 0;
+
+  rank = (guint64)(CLAMP (percentile, 0.0, 100.0) / 100.0
+                   * (gdouble)histogram->count);
+  rank = CLAMP (rank, 1, histogram->count);
+  for (guint i = 0; i < CHATBOT_METRICS_N_BUCKETS; i++)
+    {
+      seen += histogram->buckets[i];
+      if (seen >= rank)
+        return MIN ((G_GINT64_CONSTANT (1) << i) - 1, histogram->max);
+    }
+  return histogram->max;
+}
+
+/**
+ * chatbot_metrics_get_mean:
+ * @metrics: metrics
+ * @kind: what is measured
+ *
+ * Returns: mean duration of @kind in microseconds, or 0 if nothing is
+ * recorded
+ */
+gdouble
+chatbot_metrics_get_mean (ChatbotMetrics *metrics, ChatbotMetricsKind kind)
+{
+  gdouble mean;
+
+  g_return_val_if_fail (metrics != NULL, 0.0);
+  g_return_val_if_fail (kind < CHATBOT_METRICS_N_KINDS, 0.0);
+
+  g_mutex_lock (&metrics->mutex);
+  mean = chatbot_metrics_histogram_mean (&metrics->histograms[kind]);
+  g_mutex_unlock (&metrics->mutex);
+  return mean;
+}
+
+/**
+ * chatbot_metrics_get_percentile:
+ * @metrics: metrics
+ * @kind: what is measured
+ * @percentile: percentile from 0 to 100
+ *
+ * Returns: upper bound of the @percentile duration of @kind in microseconds,
+ * or 0 if nothing is recorded
+ */
+gint64
+chatbot_metrics_get_percentile (ChatbotMetrics *metrics,
+                                ChatbotMetricsKind kind, gdouble percentile)
+{
+  gint64 value;
+
+  g_return_val_if_fail (metrics != NULL, 0);
+  g_return_val_if_fail (kind < CHATBOT_METRICS_N_KINDS, 0);
+
+  g_mutex_lock (&metrics->mutex);
+  value = chatbot_metrics_histogram_percentile (&metrics->histograms[kind],
+                                                percentile);
+  g_mutex_unlock (&metrics->mutex);
+  return value;
+}
+
+/**
+ * chatbot_metrics_get_prefill_throughput:
+ * @metrics: metrics
+ *
+ * Returns: prefilled bytes per second, or 0 if nothing is recorded
+ */
+gdouble
+chatbot_metrics_get_prefill_throughput (ChatbotMetrics *metrics)
+{
+  gdouble throughput = 0.0;
+
+  g_return_val_if_fail (metrics != NULL, 0.0);
+
+  g_mutex_lock (&metrics->mutex);
+  if (metrics->prefill_us > 0)
+    throughput = (gdouble)metrics->prefill_bytes * G_USEC_PER_SEC
+                 / (gdouble)metrics->prefill_us;
+  g_mutex_unlock (&metrics->mutex);
+  return throughput;
+}
+
+/**
+ * chatbot_metrics_to_variant:
+ * @metrics: metrics
+ *
+ * Snapshot the metrics for dumping. The value is "a{sv}" which has
+ * "prefill-bytes-per-second" and an "a{sv}" for each [enum@MetricsKind]
+ * holding "count", "mean-us", "min-us", "max-us", "p50-us", "p90-us" and
+ * "p99-us".
+ *
+ * Returns: (transfer floating): snapshot of @metrics
+ */
+GVariant *
+chatbot_metrics_to_variant (ChatbotMetrics *metrics)
+{
+  ChatbotMetricsHistogram histograms[CHATBOT_METRICS_N_KINDS];
+  GVariantBuilder builder;
+
+  g_return_val_if_fail (metrics != NULL, NULL);
+
+  g_mutex_lock (&metrics->mutex);
+  memcpy (histograms, metrics->histograms, sizeof (histograms));
+  g_mutex_unlock (&metrics->mutex);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (
+      &builder, "{sv}", "prefill-bytes-per-second",
+      g_variant_new_double (chatbot_metrics_get_prefill_throughput (metrics)));
+  for (guint i = 0; i < CHATBOT_METRICS_N_KINDS; i++)
+    {
+      const ChatbotMetricsHistogram *histogram = &histograms[i];
+      GVariantDict dict;
+
+      g_variant_dict_init (&dict, NULL);
+      g_variant_dict_insert (&dict, "count", "t", histogram->count);
+      g_variant_dict_insert (&dict, "mean-us", "d",
+                             chatbot_metrics_histogram_mean (histogram));
+      g_variant_dict_insert (&dict, "min-us", "x", histogram->min);
+      g_variant_dict_insert (&dict, "max-us", "x", histogram->max);
+      g_variant_dict_insert (
+          &dict, "p50-us", "x",
+          chatbot_metrics_histogram_percentile (histogram, 50.0));
+      g_variant_dict_insert (
+          &dict, "p90-us", "x",
+          chatbot_metrics_histogram_percentile (histogram, 90.0));
+      g_variant_dict_insert (
+          &dict, "p99-us", "x",
+          chatbot_metrics_histogram_percentile (histogram, 99.0));
+      g_variant_builder_add (&builder, "{sv}", chatbot_metrics_kind_names[i],
+                             g_variant_dict_end (&dict));
+    }
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * chatbot_metrics_reset:
+ * @metrics: metrics
+ *
+ * Clear all recorded values.
+ */
+void
+chatbot_metrics_reset (ChatbotMetrics *metrics)
+{
+  g_return_if_fail (metrics != NULL);
+
+  g_mutex_lock (&metrics->mutex);
+  memset (metrics->histograms, 0, sizeof (metrics->histograms));
+  metrics->prefill_bytes = 0;
+  metrics->prefill_us = 0;
+  g_mutex_unlock (&metrics->mutex);
+}
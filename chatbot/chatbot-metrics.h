@@ -0,0 +1,71 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ChatbotMetricsKind:
+ * @CHATBOT_METRICS_PREFILL: duration of a prefill
+ * @CHATBOT_METRICS_GENERATE: duration of a whole generation
+ * @CHATBOT_METRICS_TIME_TO_FIRST_TOKEN: time from the start of a generation
+ * to its first token
+ * @CHATBOT_METRICS_INTER_TOKEN: time between consecutive tokens
+ * @CHATBOT_METRICS_TOOL_CALL: duration of a tool function call
+ * @CHATBOT_METRICS_N_KINDS: number of kinds
+ *
+ * Durations recorded in [struct@Metrics].
+ */
+typedef enum
+{
+  CHATBOT_METRICS_PREFILL,
+  CHATBOT_METRICS_GENERATE,
+  CHATBOT_METRICS_TIME_TO_FIRST_TOKEN,
+  CHATBOT_METRICS_INTER_TOKEN,
+  CHATBOT_METRICS_TOOL_CALL,
+  CHATBOT_METRICS_N_KINDS
+} ChatbotMetricsKind;
+
+#define CHATBOT_TYPE_METRICS chatbot_metrics_get_type ()
+GType chatbot_metrics_get_type (void) G_GNUC_CONST;
+
+/**
+ * ChatbotMetrics:
+ *
+ * Opaque structure that holds latency histograms of a language model.
+ */
+typedef struct _ChatbotMetrics ChatbotMetrics;
+
+ChatbotMetrics *chatbot_metrics_new (void);
+ChatbotMetrics *chatbot_metrics_ref (ChatbotMetrics *metrics);
+void chatbot_metrics_unref (ChatbotMetrics *metrics);
+void chatbot_metrics_record (ChatbotMetrics *metrics, ChatbotMetricsKind kind,
+                             gint64 duration_us);
+void chatbot_metrics_record_prefill (ChatbotMetrics *metrics, gsize n_bytes,
+                                     gint64 duration_us);
+guint64 chatbot_metrics_get_count (ChatbotMetrics *metrics,
+                                   ChatbotMetricsKind kind);
+gdouble chatbot_metrics_get_mean (ChatbotMetrics *metrics,
+                                  ChatbotMetricsKind kind);
+gint64 chatbot_metrics_get_percentile (ChatbotMetrics *metrics,
+                                       ChatbotMetricsKind kind,
+                                       gdouble percentile);
+gdouble chatbot_metrics_get_prefill_throughput (ChatbotMetrics *metrics);
+GVariant *chatbot_metrics_to_variant (ChatbotMetrics *metrics);
+void chatbot_metrics_reset (ChatbotMetrics *metrics);
+
+G_END_DECLS
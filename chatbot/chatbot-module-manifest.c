@@ -0,0 +1,819 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * ChatbotModuleManifest:
+ *
+ * Cache of what module files in plugin directories provide.
+ *
+ * [method@ModuleManifest.scan] records the name, description, implemented
+ * interfaces, typed parameters and tool function definitions of each module
+ * file in a directory. Module files are opened only if they are new or
+ * modified since the last scan, which is detected by modification time and
+ * size, so listing plugins doesn't load them once the cache is warm.
+ *
+ * Module files are opened by `chatbot-tool-worker --inspect`, which calls
+ * [func@Chatbot.module_manifest_describe], so scanning doesn't load them
+ * into this process where a loaded module file stays resident. To collect
+ * information, an instance is created but not initialized, so
+ * [vfunc@Module.get_name], [vfunc@Module.get_description] and
+ * [vfunc@Tool.get_function_definitions] should work before initialization.
+ * Tool functions which depend on parameters are not recorded.
+ *
+ * The cache is a #GKeyFile, one group per module file named by its
+ * URI-escaped path.
+ */
+
+#include "chatbot-module-manifest.h"
+
+#include <stdlib.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <gmodule.h>
+
+#include "chatbot-language-model.h"
+#include "chatbot-module.h"
+#include "chatbot-tool.h"
+#include "chatbot-trainer.h"
+
+#define CHATBOT_MODULE_MANIFEST_GROUP "Manifest"
+#define CHATBOT_MODULE_MANIFEST_ENTRY_GROUP "Module"
+#define CHATBOT_MODULE_MANIFEST_VERSION 2
+
+#define CHATBOT_MODULE_MANIFEST_PARAMETERS_TYPE "a(sssmsas)"
+#define CHATBOT_MODULE_MANIFEST_FUNCTIONS_TYPE "a(ssa(sss)a(sss))"
+
+struct _ChatbotModuleManifest
+{
+  GObject parent_instance;
+
+  gchar *cache_path;
+  gchar *worker_path;
+  GKeyFile *key_file;
+  // canonical paths of scanned directories
+  GPtrArray *directories;
+};
+
+enum
+{
+  PROP_CACHE_PATH = 1,
+  PROP_WORKER_PATH,
+  N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES] = {
+  NULL,
+};
+
+G_DEFINE_TYPE (ChatbotModuleManifest, chatbot_module_manifest, G_TYPE_OBJECT);
+
+static const gchar *const chatbot_module_manifest_parameter_types[] = {
+  [CHATBOT_MODULE_PARAMETER_INT] = "int",
+  [CHATBOT_MODULE_PARAMETER_DOUBLE] = "double",
+  [CHATBOT_MODULE_PARAMETER_BOOLEAN] = "boolean",
+  [CHATBOT_MODULE_PARAMETER_PATH] = "path",
+  [CHATBOT_MODULE_PARAMETER_ENUM] = "enum",
+};
+
+static const struct
+{
+  ChatbotModuleInterfaceFlags flag;
+  const gchar *name;
+  GType (*get_type) (void);
+} chatbot_module_manifest_interfaces[] = {
+  { CHATBOT_MODULE_INTERFACE_LANGUAGE_MODEL, "LanguageModel",
+    chatbot_language_model_get_type },
+  { CHATBOT_MODULE_INTERFACE_TOOL, "Tool", chatbot_tool_get_type },
+  { CHATBOT_MODULE_INTERFACE_TRAINER, "Trainer", chatbot_trainer_get_type },
+};
+
+static void
+chatbot_module_manifest_load (ChatbotModuleManifest *manifest)
+{
+  GError *error = NULL;
+
+  // Missing or broken cache is just cold, it's rebuilt by the next scan.
+  if (!g_key_file_load_from_file (manifest->key_file, manifest->cache_path,
+                                  G_KEY_FILE_NONE, &error))
+    {
+      g_debug ("Module manifest \"%s\" isn't loaded: %s",
+               manifest->cache_path, error->message);
+      g_clear_error (&error);
+    }
+  else if (g_key_file_get_integer (manifest->key_file,
+                                   CHATBOT_MODULE_MANIFEST_GROUP, "version",
+                                   NULL)
+           == CHATBOT_MODULE_MANIFEST_VERSION)
+    return;
+
+  g_key_file_unref (manifest->key_file);
+  manifest->key_file = g_key_file_new ();
+  g_key_file_set_integer (manifest->key_file, CHATBOT_MODULE_MANIFEST_GROUP,
+                          "version", CHATBOT_MODULE_MANIFEST_VERSION);
+}
+
+static gboolean
+chatbot_module_manifest_save (ChatbotModuleManifest *manifest, GError **error)
+{
+  gchar *directory;
+  gboolean ret;
+
+  directory = g_path_get_dirname (manifest->cache_path);
+  g_mkdir_with_parents (directory, 0755);
+  g_free (directory);
+
+  ret = g_key_file_save_to_file (manifest->key_file, manifest->cache_path,
+                                 error);
+  return ret;
+}
+
+static GVariant *
+chatbot_module_manifest_parameters_to_variant (
+    const ChatbotModuleParameterSpec *specs)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (
+      &builder, G_VARIANT_TYPE (CHATBOT_MODULE_MANIFEST_PARAMETERS_TYPE));
+  for (; specs && specs->name; specs++)
+    g_variant_builder_add (
+        &builder, "(sssms@as)", specs->name,
+        specs->description ? specs->description : "",
+        chatbot_module_manifest_parameter_types[specs->type],
+        specs->default_value,
+        g_variant_new_strv ((const gchar *const *)specs->enum_values,
+                            specs->enum_values ? -1 : 0));
+  return g_variant_builder_end (&builder);
+}
+
+/* Group of the module file at @path. Group names can't hold '[', ']' or
+ * control characters, so the path is URI-escaped.
+ */
+static gchar *
+chatbot_module_manifest_group (const gchar *path)
+{
+  return g_uri_escape_string (path, G_URI_RESERVED_CHARS_ALLOWED_IN_PATH,
+                              TRUE);
+}
+
+/* Run the worker to describe the module file, and replace its group with
+ * the result.
+ */
+static gboolean
+chatbot_module_manifest_inspect (ChatbotModuleManifest *manifest,
+                                 const gchar *path, GStatBuf *stat_buf,
+                                 GError **error)
+{
+  GSubprocess *subprocess;
+  GKeyFile *entry = NULL;
+  gchar *stdout_buf = NULL, *stderr_buf = NULL;
+  gchar **keys = NULL;
+  gchar *group = NULL;
+  gboolean ret = FALSE;
+
+  subprocess = g_subprocess_new (
+      G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_PIPE, error,
+      manifest->worker_path, "--inspect", "--module", path, NULL);
+  if (subprocess == NULL)
+    return FALSE;
+  if (!g_subprocess_communicate_utf8 (subprocess, NULL, NULL, &stdout_buf,
+                                      &stderr_buf, error))
+    goto cleanup;
+  if (!g_subprocess_get_successful (subprocess))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                   "Failed to inspect module: %s",
+                   g_strstrip (stderr_buf ? stderr_buf : ""));
+      goto cleanup;
+    }
+
+  entry = g_key_file_new ();
+  if (!g_key_file_load_from_data (entry, stdout_buf, -1, G_KEY_FILE_NONE,
+                                  error))
+    goto cleanup;
+  keys = g_key_file_get_keys (entry, CHATBOT_MODULE_MANIFEST_ENTRY_GROUP,
+                              NULL, error);
+  if (keys == NULL)
+    goto cleanup;
+
+  group = chatbot_module_manifest_group (path);
+  g_key_file_remove_group (manifest->key_file, group, NULL);
+  g_key_file_set_int64 (manifest->key_file, group, "mtime",
+                        stat_buf->st_mtime);
+  g_key_file_set_int64 (manifest->key_file, group, "size",
+                        stat_buf->st_size);
+  for (gchar **key = keys; *key; key++)
+    {
+      gchar *value = g_key_file_get_value (
+          entry, CHATBOT_MODULE_MANIFEST_ENTRY_GROUP, *key, NULL);
+      g_key_file_set_value (manifest->key_file, group, *key, value);
+      g_free (value);
+    }
+  ret = TRUE;
+
+cleanup:
+  g_free (group);
+  g_strfreev (keys);
+  g_clear_pointer (&entry, g_key_file_unref);
+  g_free (stdout_buf);
+  g_free (stderr_buf);
+  g_object_unref (subprocess);
+  return ret;
+}
+
+static void
+chatbot_module_manifest_set_property (GObject *object, guint property_id,
+                                      const GValue *value, GParamSpec *pspec)
+{
+  ChatbotModuleManifest *manifest = CHATBOT_MODULE_MANIFEST (object);
+
+  switch (property_id)
+    {
+    case PROP_CACHE_PATH:
+      g_free (manifest->cache_path);
+      manifest->cache_path = g_value_dup_string (value);
+      break;
+    case PROP_WORKER_PATH:
+      g_free (manifest->worker_path);
+      manifest->worker_path = g_value_dup_string (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_module_manifest_get_property (GObject *object, guint property_id,
+                                      GValue *value, GParamSpec *pspec)
+{
+  ChatbotModuleManifest *manifest = CHATBOT_MODULE_MANIFEST (object);
+
+  switch (property_id)
+    {
+    case PROP_CACHE_PATH:
+      g_value_set_string (value, manifest->cache_path);
+      break;
+    case PROP_WORKER_PATH:
+      g_value_set_string (value, manifest->worker_path);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_module_manifest_constructed (GObject *object)
+{
+  ChatbotModuleManifest *manifest = CHATBOT_MODULE_MANIFEST (object);
+
+  G_OBJECT_CLASS (chatbot_module_manifest_parent_class)->constructed (object);
+
+  if (manifest->cache_path == NULL)
+    manifest->cache_path = g_build_filename (
+        g_get_user_cache_dir (), "chatbot", "module-manifest.ini", NULL);
+  chatbot_module_manifest_load (manifest);
+}
+
+static void
+chatbot_module_manifest_finalize (GObject *object)
+{
+  ChatbotModuleManifest *manifest = CHATBOT_MODULE_MANIFEST (object);
+
+  g_key_file_unref (manifest->key_file);
+  g_ptr_array_unref (manifest->directories);
+  g_free (manifest->cache_path);
+  g_free (manifest->worker_path);
+
+  G_OBJECT_CLASS (chatbot_module_manifest_parent_class)->finalize (object);
+}
+
+static void
+chatbot_module_manifest_class_init (ChatbotModuleManifestClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = chatbot_module_manifest_set_property;
+  object_class->get_property = chatbot_module_manifest_get_property;
+  object_class->constructed = chatbot_module_manifest_constructed;
+  object_class->finalize = chatbot_module_manifest_finalize;
+
+  /**
+   * ChatbotModuleManifest:cache-path:
+   *
+   * File to store the manifest. If %NULL, `chatbot/module-manifest.ini` in
+   * the user cache directory is used.
+   */
+  properties[PROP_CACHE_PATH] = g_param_spec_string (
+      "cache-path", "cache-path", "file to store the manifest", NULL,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  /**
+   * ChatbotModuleManifest:worker-path:
+   *
+   * Executable to inspect module files, which is run as
+   * `worker-path --inspect --module path`.
+   */
+  properties[PROP_WORKER_PATH] = g_param_spec_string (
+      "worker-path", "worker-path", "executable to inspect module files",
+      "chatbot-tool-worker", G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+chatbot_module_manifest_init (ChatbotModuleManifest *manifest)
+{
+  manifest->key_file = g_key_file_new ();
+  manifest->directories = g_ptr_array_new_with_free_func (g_free);
+}
+
+/**
+ * chatbot_module_manifest_new:
+ * @cache_path: (nullable): file to store the manifest, or %NULL for default
+ * @worker_path: (nullable): executable to inspect module files, or %NULL to
+ * use "chatbot-tool-worker" in `PATH`
+ *
+ * Create a manifest, loading the cache if it exists.
+ *
+ * Returns: (transfer full): newly created manifest
+ */
+ChatbotModuleManifest *
+chatbot_module_manifest_new (const gchar *cache_path,
+                             const gchar *worker_path)
+{
+  return g_object_new (CHATBOT_TYPE_MODULE_MANIFEST, "cache-path", cache_path,
+                       "worker-path",
+                       worker_path ? worker_path : "chatbot-tool-worker",
+                       NULL);
+}
+
+/**
+ * chatbot_module_manifest_scan:
+ * @directory: plugin directory
+ * @error: location to store the error
+ *
+ * Update entries of module files in @directory. Files which are not modules
+ * are skipped, and entries of removed files are dropped. The cache is saved
+ * if anything is changed.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+chatbot_module_manifest_scan (ChatbotModuleManifest *manifest,
+                              const gchar *directory, GError **error)
+{
+  GDir *dir;
+  gchar *canonical;
+  gchar **groups;
+  const gchar *name;
+  gboolean changed = FALSE;
+  gboolean ret = TRUE;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_MANIFEST (manifest), FALSE);
+  g_return_val_if_fail (directory != NULL, FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  dir = g_dir_open (directory, 0, error);
+  if (dir == NULL)
+    return FALSE;
+  canonical = g_canonicalize_filename (directory, NULL);
+
+  while ((name = g_dir_read_name (dir)))
+    {
+      GError *inspect_error = NULL;
+      GStatBuf stat_buf;
+      gchar *path, *group;
+
+      if (!g_str_has_suffix (name, "." G_MODULE_SUFFIX))
+        continue;
+
+      path = g_build_filename (canonical, name, NULL);
+      group = chatbot_module_manifest_group (path);
+      if ((g_stat (path, &stat_buf) != 0) || !S_ISREG (stat_buf.st_mode))
+        goto next;
+
+      if (g_key_file_has_group (manifest->key_file, group)
+          && (g_key_file_get_int64 (manifest->key_file, group, "mtime", NULL)
+              == stat_buf.st_mtime)
+          && (g_key_file_get_int64 (manifest->key_file, group, "size", NULL)
+              == stat_buf.st_size))
+        goto next;
+
+      changed = TRUE;
+      if (!chatbot_module_manifest_inspect (manifest, path, &stat_buf,
+                                            &inspect_error))
+        {
+          // Plugin directory may hold libraries modules depend on.
+          g_debug ("Skipping \"%s\": %s", path, inspect_error->message);
+          g_key_file_remove_group (manifest->key_file, group, NULL);
+          g_clear_error (&inspect_error);
+        }
+    next:
+      g_free (group);
+      g_free (path);
+    }
+  g_dir_close (dir);
+
+  groups = g_key_file_get_groups (manifest->key_file, NULL);
+  for (gchar **group = groups; *group; group++)
+    {
+      gchar *path, *group_directory;
+
+      if (!g_strcmp0 (*group, CHATBOT_MODULE_MANIFEST_GROUP))
+        continue;
+      path = g_uri_unescape_string (*group, NULL);
+      if (path == NULL)
+        {
+          g_key_file_remove_group (manifest->key_file, *group, NULL);
+          changed = TRUE;
+          continue;
+        }
+      group_directory = g_path_get_dirname (path);
+      if (!g_strcmp0 (group_directory, canonical)
+          && !g_file_test (path, G_FILE_TEST_IS_REGULAR))
+        {
+          g_key_file_remove_group (manifest->key_file, *group, NULL);
+          changed = TRUE;
+        }
+      g_free (group_directory);
+      g_free (path);
+    }
+  g_strfreev (groups);
+
+  if (!g_ptr_array_find_with_equal_func (manifest->directories, canonical,
+                                         g_str_equal, NULL))
+    g_ptr_array_add (manifest->directories, g_steal_pointer (&canonical));
+  g_free (canonical);
+
+  if (changed)
+    ret = chatbot_module_manifest_save (manifest, error);
+  return ret;
+}
+
+/**
+ * chatbot_module_manifest_describe:
+ * @path: path of the module file
+ * @error: location to store the error
+ *
+ * Describe a module file as a #GKeyFile group `[Module]`, which
+ * [method@ModuleManifest.scan] reads from `chatbot-tool-worker --inspect`.
+ *
+ * The module file is opened with g_module_open() and closed again, but GTypes
+ * it registers can't be unregistered. Call this only in a process which
+ * exits afterwards and never loads the module otherwise.
+ *
+ * Returns: (transfer full) (nullable): key file data, or %NULL on failure
+ */
+gchar *
+chatbot_module_manifest_describe (const gchar *path, GError **error)
+{
+  const gchar *group = CHATBOT_MODULE_MANIFEST_ENTRY_GROUP;
+  const gchar *name, *description;
+  GType (*get_type) (void);
+  ChatbotModule *module;
+  GPtrArray *interfaces;
+  GKeyFile *key_file;
+  GModule *gmodule;
+  GVariant *value;
+  gchar *text;
+  GType type;
+
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), NULL);
+
+  gmodule = g_module_open_full (path, G_MODULE_BIND_LAZY, error);
+  if (gmodule == NULL)
+    return NULL;
+  if (!g_module_symbol (gmodule, "get_type", (gpointer)&get_type))
+    {
+      g_set_error (error, G_MODULE_ERROR, G_MODULE_ERROR_FAILED,
+                   "Failed to obtain get_type() from module \"%s\".", path);
+      g_module_close (gmodule);
+      return NULL;
+    }
+  type = get_type ();
+  if (!g_type_is_a (type, CHATBOT_TYPE_MODULE))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Module \"%s\" doesn't implement ChatbotModule.", path);
+      g_module_close (gmodule);
+      return NULL;
+    }
+
+  // Not initialized, so parameters aren't required and nothing is loaded.
+  module = g_object_new (type, "raw_parameter", "", NULL);
+
+  key_file = g_key_file_new ();
+  g_key_file_set_string (key_file, group, "type", g_type_name (type));
+  name = chatbot_module_get_name (module);
+  description = chatbot_module_get_description (module);
+  g_key_file_set_string (key_file, group, "name", name ? name : "");
+  g_key_file_set_string (key_file, group, "description",
+                         description ? description : "");
+
+  interfaces = g_ptr_array_new ();
+  for (gsize i = 0; i < G_N_ELEMENTS (chatbot_module_manifest_interfaces);
+       i++)
+    if (g_type_is_a (type, chatbot_module_manifest_interfaces[i].get_type ()))
+      g_ptr_array_add (interfaces,
+                       (gpointer)chatbot_module_manifest_interfaces[i].name);
+  g_key_file_set_string_list (key_file, group, "interfaces",
+                              (const gchar *const *)interfaces->pdata,
+                              interfaces->len);
+  g_ptr_array_unref (interfaces);
+
+  value = g_variant_ref_sink (chatbot_module_manifest_parameters_to_variant (
+      CHATBOT_MODULE_GET_CLASS (module)->parameter_specs));
+  text = g_variant_print (value, FALSE);
+  g_key_file_set_string (key_file, group, "parameters", text);
+  g_free (text);
+  g_variant_unref (value);
+
+  if (CHATBOT_IS_TOOL (module))
+    {
+      const ChatbotToolFunction *const *functions;
+      GVariantBuilder builder;
+
+      g_variant_builder_init (
+          &builder, G_VARIANT_TYPE (CHATBOT_MODULE_MANIFEST_FUNCTIONS_TYPE));
+      functions
+          = chatbot_tool_get_function_definitions (CHATBOT_TOOL (module));
+      for (; functions && *functions; functions++)
+        g_variant_builder_add_value (
+            &builder, chatbot_tool_function_to_variant (*functions));
+      value = g_variant_ref_sink (g_variant_builder_end (&builder));
+      text = g_variant_print (value, FALSE);
+      g_key_file_set_string (key_file, group, "functions", text);
+      g_free (text);
+      g_variant_unref (value);
+    }
+
+  g_object_unref (module);
+  g_module_close (gmodule);
+
+  text = g_key_file_to_data (key_file, NULL, NULL);
+  g_key_file_unref (key_file);
+  return text;
+}
+
+static int
+chatbot_module_manifest_compare_paths (const void *a, const void *b)
+{
+  return g_strcmp0 (*(const gchar *const *)a, *(const gchar *const *)b);
+}
+
+/**
+ * chatbot_module_manifest_get_paths:
+ *
+ * The cache may hold entries of other directories from earlier runs, which
+ * are not listed.
+ *
+ * Returns: (transfer full) (array zero-terminated=1): sorted paths of module
+ * files in directories scanned by [method@ModuleManifest.scan]
+ */
+gchar **
+chatbot_module_manifest_get_paths (ChatbotModuleManifest *manifest)
+{
+  GStrvBuilder *builder;
+  gchar **groups;
+  gchar **paths;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_MANIFEST (manifest), NULL);
+
+  builder = g_strv_builder_new ();
+  groups = g_key_file_get_groups (manifest->key_file, NULL);
+  for (gchar **group = groups; *group; group++)
+    {
+      gchar *path, *directory;
+
+      if (!g_strcmp0 (*group, CHATBOT_MODULE_MANIFEST_GROUP))
+        continue;
+      path = g_uri_unescape_string (*group, NULL);
+      if (path == NULL)
+        continue;
+      directory = g_path_get_dirname (path);
+      if (g_ptr_array_find_with_equal_func (manifest->directories, directory,
+                                            g_str_equal, NULL))
+        g_strv_builder_add (builder, path);
+      g_free (directory);
+      g_free (path);
+    }
+  g_strfreev (groups);
+
+  paths = g_strv_builder_end (builder);
+  g_strv_builder_unref (builder);
+  qsort (paths, g_strv_length (paths), sizeof (gchar *),
+         chatbot_module_manifest_compare_paths);
+  return paths;
+}
+
+/**
+ * chatbot_module_manifest_lookup:
+ * @name: module name
+ *
+ * Find the module file whose module name is @name. If several files have the
+ * same name, the first one in sorted order is returned.
+ *
+ * Returns: (transfer full) (nullable): path of the module file, or %NULL if
+ * not found
+ */
+gchar *
+chatbot_module_manifest_lookup (ChatbotModuleManifest *manifest,
+                                const gchar *name)
+{
+  gchar **paths;
+  gchar *found = NULL;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_MANIFEST (manifest), NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  paths = chatbot_module_manifest_get_paths (manifest);
+  for (gchar **path = paths; *path && (found == NULL); path++)
+    {
+      gchar *module_name = chatbot_module_manifest_get_name (manifest, *path);
+      if (!g_strcmp0 (module_name, name))
+        found = g_strdup (*path);
+      g_free (module_name);
+    }
+  g_strfreev (paths);
+  return found;
+}
+
+/**
+ * chatbot_module_manifest_get_name:
+ * @path: path of the module file
+ *
+ * Returns: (transfer full) (nullable): module name
+ */
+gchar *
+chatbot_module_manifest_get_name (ChatbotModuleManifest *manifest,
+                                  const gchar *path)
+{
+  gchar *group, *name;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_MANIFEST (manifest), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+
+  group = chatbot_module_manifest_group (path);
+  name = g_key_file_get_string (manifest->key_file, group, "name", NULL);
+  g_free (group);
+  return name;
+}
+
+/**
+ * chatbot_module_manifest_get_description:
+ * @path: path of the module file
+ *
+ * Returns: (transfer full) (nullable): module description
+ */
+gchar *
+chatbot_module_manifest_get_description (ChatbotModuleManifest *manifest,
+                                         const gchar *path)
+{
+  gchar *group, *description;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_MANIFEST (manifest), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+
+  group = chatbot_module_manifest_group (path);
+  description = g_key_file_get_string (manifest->key_file, group,
+                                       "description", NULL);
+  g_free (group);
+  return description;
+}
+
+/**
+ * chatbot_module_manifest_get_interfaces:
+ * @path: path of the module file
+ *
+ * Returns: interfaces the module implements
+ */
+ChatbotModuleInterfaceFlags
+chatbot_module_manifest_get_interfaces (ChatbotModuleManifest *manifest,
+                                        const gchar *path)
+{
+  ChatbotModuleInterfaceFlags flags = CHATBOT_MODULE_INTERFACE_NONE;
+  gchar **names;
+  gchar *group;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_MANIFEST (manifest), flags);
+  g_return_val_if_fail (path != NULL, flags);
+
+  group = chatbot_module_manifest_group (path);
+  names = g_key_file_get_string_list (manifest->key_file, group, "interfaces",
+                                      NULL, NULL);
+  g_free (group);
+  for (gsize i = 0; i < G_N_ELEMENTS (chatbot_module_manifest_interfaces);
+       i++)
+    if (names
+        && g_strv_contains ((const gchar *const *)names,
+                            chatbot_module_manifest_interfaces[i].name))
+      flags |= chatbot_module_manifest_interfaces[i].flag;
+  g_strfreev (names);
+  return flags;
+}
+
+static GVariant *
+chatbot_module_manifest_get_variant (ChatbotModuleManifest *manifest,
+                                     const gchar *path, const gchar *key,
+                                     const gchar *type, GError **error)
+{
+  GVariant *value;
+  gchar *group, *text;
+
+  group = chatbot_module_manifest_group (path);
+  text = g_key_file_get_string (manifest->key_file, group, key, error);
+  g_free (group);
+  if (text == NULL)
+    return NULL;
+  value = g_variant_parse (G_VARIANT_TYPE (type), text, NULL, NULL, error);
+  g_free (text);
+  return value;
+}
+
+/**
+ * chatbot_module_manifest_get_parameters:
+ * @path: path of the module file
+ *
+ * Get typed parameters declared with
+ * [func@Chatbot.module_class_set_parameter_specs]. Each element holds name,
+ * description, type ("int", "double", "boolean", "path" or "enum"), default
+ * value which is nothing if the parameter is required, and enum values.
+ *
+ * Returns: (transfer full) (nullable): `a(sssmsas)`, or %NULL if @path is not
+ * in the manifest
+ */
+GVariant *
+chatbot_module_manifest_get_parameters (ChatbotModuleManifest *manifest,
+                                        const gchar *path)
+{
+  g_return_val_if_fail (CHATBOT_IS_MODULE_MANIFEST (manifest), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+  return chatbot_module_manifest_get_variant (
+      manifest, path, "parameters", CHATBOT_MODULE_MANIFEST_PARAMETERS_TYPE,
+      NULL);
+}
+
+/**
+ * chatbot_module_manifest_get_functions:
+ * @path: path of the module file
+ * @error: location to store the error
+ *
+ * Get function definitions of a tool module.
+ *
+ * Returns: (transfer container) (element-type ChatbotToolFunction) (nullable):
+ * function definitions, or %NULL if the module isn't a tool or the entry is
+ * broken
+ */
+GPtrArray *
+chatbot_module_manifest_get_functions (ChatbotModuleManifest *manifest,
+                                       const gchar *path, GError **error)
+{
+  GPtrArray *functions;
+  GVariant *value, *child;
+  GVariantIter iter;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_MANIFEST (manifest), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), NULL);
+
+  value = chatbot_module_manifest_get_variant (
+      manifest, path, "functions", CHATBOT_MODULE_MANIFEST_FUNCTIONS_TYPE,
+      error);
+  if (value == NULL)
+    return NULL;
+
+  functions = g_ptr_array_new_with_free_func (
+      (GDestroyNotify)chatbot_tool_function_unref);
+  g_variant_iter_init (&iter, value);
+  while ((child = g_variant_iter_next_value (&iter)))
+    {
+      ChatbotToolFunction *function;
+
+      function = chatbot_tool_function_new_from_variant (child, error);
+      g_variant_unref (child);
+      if (function == NULL)
+        {
+          g_clear_pointer (&functions, g_ptr_array_unref);
+          break;
+        }
+      g_ptr_array_add (functions, chatbot_tool_function_ref (function));
+    }
+  g_variant_unref (value);
+  return functions;
+}
@@ -0,0 +1,67 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gio/gio.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ChatbotModuleInterfaceFlags:
+ * @CHATBOT_MODULE_INTERFACE_NONE: no interface
+ * @CHATBOT_MODULE_INTERFACE_LANGUAGE_MODEL: [iface@LanguageModel]
+ * @CHATBOT_MODULE_INTERFACE_TOOL: [iface@Tool]
+ * @CHATBOT_MODULE_INTERFACE_TRAINER: [iface@Trainer]
+ *
+ * Interfaces implemented by a module.
+ */
+typedef enum
+{
+  CHATBOT_MODULE_INTERFACE_NONE = 0,
+  CHATBOT_MODULE_INTERFACE_LANGUAGE_MODEL = 1 << 0,
+  CHATBOT_MODULE_INTERFACE_TOOL = 1 << 1,
+  CHATBOT_MODULE_INTERFACE_TRAINER = 1 << 2
+} ChatbotModuleInterfaceFlags;
+
+#define CHATBOT_TYPE_MODULE_MANIFEST chatbot_module_manifest_get_type ()
+G_DECLARE_FINAL_TYPE (ChatbotModuleManifest, chatbot_module_manifest, CHATBOT,
+                      MODULE_MANIFEST, GObject);
+
+ChatbotModuleManifest *chatbot_module_manifest_new (const gchar *cache_path,
+                                                    const gchar *worker_path);
+gboolean chatbot_module_manifest_scan (ChatbotModuleManifest *manifest,
+                                       const gchar *directory,
+                                       GError **error);
+gchar *chatbot_module_manifest_describe (const gchar *path, GError **error);
+gchar **chatbot_module_manifest_get_paths (ChatbotModuleManifest *manifest);
+gchar *chatbot_module_manifest_lookup (ChatbotModuleManifest *manifest,
+                                       const gchar *name);
+gchar *chatbot_module_manifest_get_name (ChatbotModuleManifest *manifest,
+                                         const gchar *path);
+gchar *
+chatbot_module_manifest_get_description (ChatbotModuleManifest *manifest,
+                                         const gchar *path);
+ChatbotModuleInterfaceFlags
+chatbot_module_manifest_get_interfaces (ChatbotModuleManifest *manifest,
+                                        const gchar *path);
+GVariant *
+chatbot_module_manifest_get_parameters (ChatbotModuleManifest *manifest,
+                                        const gchar *path);
+GPtrArray *
+chatbot_module_manifest_get_functions (ChatbotModuleManifest *manifest,
+                                       const gchar *path, GError **error);
+
+G_END_DECLS
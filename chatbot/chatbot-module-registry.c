@@ -0,0 +1,495 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * ChatbotModuleRegistry:
+ *
+ * Cache of module files and pool of initialized module instances.
+ *
+ * [method@ModuleRegistry.load_type] opens a module file once and returns the
+ * same GType for later calls with the same path. Module files are made
+ * resident, because GTypes registered by them can't be unregistered.
+ *
+ * [method@ModuleRegistry.checkout] returns an idle instance created with the
+ * same GType and parameter if there is one, and creates a new one otherwise.
+ * Once the caller finishes with it, give it back with
+ * [method@ModuleRegistry.return] so the next checkout reuses it instead of
+ * initializing a module again. Don't return an instance whose state must not
+ * be seen by the next user, drop it instead.
+ *
+ * Instances idle longer than [property@ModuleRegistry:idle-timeout] are
+ * released from the main context which was thread default when the registry
+ * was created.
+ *
+ * All methods are thread safe.
+ */
+
+#include "chatbot-module-registry.h"
+
+#include <gio/gio.h>
+#include <gmodule.h>
+
+struct _ChatbotModuleRegistry
+{
+  GObject parent_instance;
+
+  guint idle_timeout;
+  guint max_idle;
+
+  GMutex mutex;
+  // path -> GType
+  GHashTable *types;
+  // "type name\nparameter" -> GQueue of ChatbotModuleRegistryIdle
+  GHashTable *pools;
+  GSource *evict_source;
+};
+
+typedef struct
+{
+  ChatbotModule *module;
+  gint64 since;
+} ChatbotModuleRegistryIdle;
+
+enum
+{
+  PROP_IDLE_TIMEOUT = 1,
+  PROP_MAX_IDLE,
+  N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES] = {
+  NULL,
+};
+
+G_DEFINE_TYPE (ChatbotModuleRegistry, chatbot_module_registry,
+               G_TYPE_OBJECT);
+
+static void
+chatbot_module_registry_idle_free (gpointer data)
+{
+  ChatbotModuleRegistryIdle *idle = data;
+  g_object_unref (idle->module);
+  g_free (idle);
+}
+
+static void
+chatbot_module_registry_pool_free (gpointer data)
+{
+  g_queue_free_full (data, chatbot_module_registry_idle_free);
+}
+
+static gchar *
+chatbot_module_registry_pool_key (GType type, const gchar *parameter)
+{
+  return g_strdup_printf ("%s\n%s", g_type_name (type),
+                          parameter ? parameter : "");
+}
+
+static gboolean
+chatbot_module_registry_evict_source_func (gpointer user_data)
+{
+  ChatbotModuleRegistry *registry = user_data;
+  chatbot_module_registry_evict_idle (registry, registry->idle_timeout);
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+chatbot_module_registry_set_property (GObject *object, guint property_id,
+                                      const GValue *value, GParamSpec *pspec)
+{
+  ChatbotModuleRegistry *registry = CHATBOT_MODULE_REGISTRY (object);
+
+  switch (property_id)
+    {
+    case PROP_IDLE_TIMEOUT:
+      registry->idle_timeout = g_value_get_uint (value);
+      break;
+    case PROP_MAX_IDLE:
+      registry->max_idle = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_module_registry_get_property (GObject *object, guint property_id,
+                                      GValue *value, GParamSpec *pspec)
+{
+  ChatbotModuleRegistry *registry = CHATBOT_MODULE_REGISTRY (object);
+
+  switch (property_id)
+    {
+    case PROP_IDLE_TIMEOUT:
+      g_value_set_uint (value, registry->idle_timeout);
+      break;
+    case PROP_MAX_IDLE:
+      g_value_set_uint (value, registry->max_idle);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_module_registry_constructed (GObject *object)
+{
+  ChatbotModuleRegistry *registry = CHATBOT_MODULE_REGISTRY (object);
+  GMainContext *context;
+
+  G_OBJECT_CLASS (chatbot_module_registry_parent_class)->constructed (object);
+
+  if (registry->idle_timeout == 0)
+    return;
+
+  // The source doesn't hold a reference, it's destroyed on dispose.
+  context = g_main_context_ref_thread_default ();
+  registry->evict_source
+      = g_timeout_source_new_seconds (registry->idle_timeout);
+  g_source_set_callback (registry->evict_source,
+                         chatbot_module_registry_evict_source_func, registry,
+                         NULL);
+  g_source_attach (registry->evict_source, context);
+  g_main_context_unref (context);
+}
+
+static void
+chatbot_module_registry_dispose (GObject *object)
+{
+  ChatbotModuleRegistry *registry = CHATBOT_MODULE_REGISTRY (object);
+
+  if (registry->evict_source)
+    {
+      g_source_destroy (registry->evict_source);
+      g_clear_pointer (&registry->evict_source, g_source_unref);
+    }
+  g_hash_table_remove_all (registry->pools);
+
+  G_OBJECT_CLASS (chatbot_module_registry_parent_class)->dispose (object);
+}
+
+static void
+chatbot_module_registry_finalize (GObject *object)
+{
+  ChatbotModuleRegistry *registry = CHATBOT_MODULE_REGISTRY (object);
+
+  g_hash_table_unref (registry->pools);
+  g_hash_table_unref (registry->types);
+  g_mutex_clear (&registry->mutex);
+
+  G_OBJECT_CLASS (chatbot_module_registry_parent_class)->finalize (object);
+}
+
+static void
+chatbot_module_registry_class_init (ChatbotModuleRegistryClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = chatbot_module_registry_set_property;
+  object_class->get_property = chatbot_module_registry_get_property;
+  object_class->constructed = chatbot_module_registry_constructed;
+  object_class->dispose = chatbot_module_registry_dispose;
+  object_class->finalize = chatbot_module_registry_finalize;
+
+  /**
+   * ChatbotModuleRegistry:idle-timeout:
+   *
+   * Seconds an idle instance is kept before it's released, or 0 to keep
+   * until the registry is disposed.
+   */
+  properties[PROP_IDLE_TIMEOUT] = g_param_spec_uint (
+      "idle-timeout", "idle-timeout", "seconds to keep idle instances", 0,
+      G_MAXUINT, 60, G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  /**
+   * ChatbotModuleRegistry:max-idle:
+   *
+   * Idle instances kept for each GType and parameter, or 0 for unlimited.
+   * Instances returned beyond this are released immediately.
+   */
+  properties[PROP_MAX_IDLE] = g_param_spec_uint (
+      "max-idle", "max-idle", "idle instances per GType and parameter", 0,
+      G_MAXUINT, 0, G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+chatbot_module_registry_init (ChatbotModuleRegistry *registry)
+{
+  g_mutex_init (&registry->mutex);
+  registry->types = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                           NULL);
+  registry->pools = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                           chatbot_module_registry_pool_free);
+}
+
+/**
+ * chatbot_module_registry_new:
+ * @idle_timeout: seconds to keep idle instances, or 0 to keep until the
+ * registry is disposed
+ * @max_idle: idle instances kept for each GType and parameter, or 0 for
+ * unlimited
+ *
+ * Returns: (transfer full): newly created registry
+ */
+ChatbotModuleRegistry *
+chatbot_module_registry_new (guint idle_timeout, guint max_idle)
+{
+  return g_object_new (CHATBOT_TYPE_MODULE_REGISTRY, "idle-timeout",
+                       idle_timeout, "max-idle", max_idle, NULL);
+}
+
+/**
+ * chatbot_module_registry_get_default:
+ *
+ * Get the process wide registry. It's created at the first call, and its idle
+ * instances are released from the main context which was thread default at
+ * that time.
+ *
+ * Returns: (transfer none): default registry
+ */
+ChatbotModuleRegistry *
+chatbot_module_registry_get_default (void)
+{
+  static gsize initialized = 0;
+  static ChatbotModuleRegistry *default_registry = NULL;
+
+  if (g_once_init_enter (&initialized))
+    {
+      default_registry = chatbot_module_registry_new (60, 0);
+      g_once_init_leave (&initialized, 1);
+    }
+  return default_registry;
+}
+
+/**
+ * chatbot_module_registry_load_type:
+ * @path: path of the module file
+ * @error: location to store the error
+ *
+ * Open a module file and obtain its module implementation from `get_type()`
+ * exported by it. The file is opened only at the first call for @path.
+ *
+ * Returns: GType of module implementation, or %G_TYPE_INVALID on failure
+ */
+GType
+chatbot_module_registry_load_type (ChatbotModuleRegistry *registry,
+                                   const gchar *path, GError **error)
+{
+  GModule *gmodule;
+  GType (*get_type) (void);
+  GType type = G_TYPE_INVALID;
+  gpointer cached;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_REGISTRY (registry),
+                        G_TYPE_INVALID);
+  g_return_val_if_fail (path != NULL, G_TYPE_INVALID);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), G_TYPE_INVALID);
+
+  g_mutex_lock (&registry->mutex);
+  if (g_hash_table_lookup_extended (registry->types, path, NULL, &cached))
+    {
+      type = GPOINTER_TO_SIZE (cached);
+      goto cleanup;
+    }
+
+  gmodule = g_module_open_full (path, G_MODULE_BIND_LAZY, error);
+  if (gmodule == NULL)
+    goto cleanup;
+
+  if (!g_module_symbol (gmodule, "get_type", (gpointer)&get_type))
+    {
+      g_set_error (error, G_MODULE_ERROR, G_MODULE_ERROR_FAILED,
+                   "Failed to obtain get_type() from module \"%s\".", path);
+      g_module_close (gmodule);
+      goto cleanup;
+    }
+
+  type = get_type ();
+  if (!g_type_is_a (type, CHATBOT_TYPE_MODULE))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Module \"%s\" doesn't implement ChatbotModule.", path);
+      type = G_TYPE_INVALID;
+      g_module_close (gmodule);
+      goto cleanup;
+    }
+
+  g_module_make_resident (gmodule);
+  g_hash_table_insert (registry->types, g_strdup (path),
+                       GSIZE_TO_POINTER (type));
+
+cleanup:
+  g_mutex_unlock (&registry->mutex);
+  return type;
+}
+
+/**
+ * chatbot_module_registry_checkout:
+ * @type: GType which is module implementation
+ * @parameter: (nullable): module parameter
+ * @error: location to store the error
+ *
+ * Take an idle instance of @type created with @parameter, or create a new one
+ * if there is none. Give it back with [method@ModuleRegistry.return] once
+ * finished.
+ *
+ * Returns: (transfer full) (nullable): initialized instance, or %NULL on
+ * failure
+ */
+ChatbotModule *
+chatbot_module_registry_checkout (ChatbotModuleRegistry *registry, GType type,
+                                  const gchar *parameter, GError **error)
+{
+  ChatbotModuleRegistryIdle *idle = NULL;
+  ChatbotModule *module;
+  GQueue *pool;
+  gchar *key;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_REGISTRY (registry), NULL);
+  g_return_val_if_fail (g_type_is_a (type, CHATBOT_TYPE_MODULE), NULL);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), NULL);
+
+  key = chatbot_module_registry_pool_key (type, parameter);
+  g_mutex_lock (&registry->mutex);
+  pool = g_hash_table_lookup (registry->pools, key);
+  if (pool)
+    idle = g_queue_pop_head (pool);
+  g_mutex_unlock (&registry->mutex);
+  g_free (key);
+
+  if (idle == NULL)
+    return chatbot_module_new (type, parameter ? parameter : "", error);
+
+  module = idle->module;
+  g_free (idle);
+  return module;
+}
+
+/**
+ * chatbot_module_registry_return:
+ * @module: (transfer full): instance to give back
+ *
+ * Give an instance back to the pool so that later checkout of the same GType
+ * and parameter reuses it. The instance doesn't have to be created by
+ * [method@ModuleRegistry.checkout].
+ */
+void
+chatbot_module_registry_return (ChatbotModuleRegistry *registry,
+                                ChatbotModule *module)
+{
+  ChatbotModuleRegistryIdle *idle;
+  GQueue *pool;
+  gchar *key;
+
+  g_return_if_fail (CHATBOT_IS_MODULE_REGISTRY (registry));
+  g_return_if_fail (CHATBOT_IS_MODULE (module));
+
+  key = chatbot_module_registry_pool_key (
+      G_OBJECT_TYPE (module), chatbot_module_get_raw_parameter (module));
+
+  g_mutex_lock (&registry->mutex);
+  pool = g_hash_table_lookup (registry->pools, key);
+  if (pool == NULL)
+    {
+      pool = g_queue_new ();
+      g_hash_table_insert (registry->pools, key, pool);
+      key = NULL;
+    }
+  if (registry->max_idle && (pool->length >= registry->max_idle))
+    {
+      g_mutex_unlock (&registry->mutex);
+      g_object_unref (module);
+      g_free (key);
+      return;
+    }
+
+  // Most recently used instance is at the head, so checkout takes the warmest
+  // one and eviction starts from the tail.
+  idle = g_new (ChatbotModuleRegistryIdle, 1);
+  idle->module = module;
+  idle->since = g_get_monotonic_time ();
+  g_queue_push_head (pool, idle);
+  g_mutex_unlock (&registry->mutex);
+  g_free (key);
+}
+
+/**
+ * chatbot_module_registry_evict_idle:
+ * @idle_seconds: release instances idle at least this seconds
+ *
+ * Release idle instances. This is called periodically with
+ * [property@ModuleRegistry:idle-timeout], and can be called to release memory
+ * immediately with 0.
+ *
+ * Returns: number of released instances
+ */
+guint
+chatbot_module_registry_evict_idle (ChatbotModuleRegistry *registry,
+                                    guint idle_seconds)
+{
+  GHashTableIter iter;
+  GQueue *pool;
+  GQueue evicted = G_QUEUE_INIT;
+  gint64 deadline;
+  guint n_evicted;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_REGISTRY (registry), 0);
+
+  deadline = g_get_monotonic_time () - (gint64)idle_seconds * G_USEC_PER_SEC;
+
+  g_mutex_lock (&registry->mutex);
+  g_hash_table_iter_init (&iter, registry->pools);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&pool))
+    {
+      ChatbotModuleRegistryIdle *idle;
+
+      while ((idle = g_queue_peek_tail (pool)) && (idle->since <= deadline))
+        g_queue_push_tail (&evicted, g_queue_pop_tail (pool));
+      if (g_queue_is_empty (pool))
+        g_hash_table_iter_remove (&iter);
+    }
+  g_mutex_unlock (&registry->mutex);
+
+  // Finalizing a module may take time, so it's done without the lock.
+  n_evicted = evicted.length;
+  g_queue_clear_full (&evicted, chatbot_module_registry_idle_free);
+  return n_evicted;
+}
+
+/**
+ * chatbot_module_registry_get_n_idle:
+ *
+ * Returns: number of idle instances in the pool
+ */
+guint
+chatbot_module_registry_get_n_idle (ChatbotModuleRegistry *registry)
+{
+  GHashTableIter iter;
+  GQueue *pool;
+  guint n_idle = 0;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE_REGISTRY (registry), 0);
+
+  g_mutex_lock (&registry->mutex);
+  g_hash_table_iter_init (&iter, registry->pools);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&pool))
+    n_idle += pool->length;
+  g_mutex_unlock (&registry->mutex);
+  return n_idle;
+}
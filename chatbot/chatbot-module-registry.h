@@ -0,0 +1,41 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <glib-object.h>
+
+#include "chatbot-module.h"
+
+G_BEGIN_DECLS
+
+#define CHATBOT_TYPE_MODULE_REGISTRY chatbot_module_registry_get_type ()
+G_DECLARE_FINAL_TYPE (ChatbotModuleRegistry, chatbot_module_registry,
+                      CHATBOT, MODULE_REGISTRY, GObject);
+
+ChatbotModuleRegistry *chatbot_module_registry_new (guint idle_timeout,
+                                                    guint max_idle);
+ChatbotModuleRegistry *chatbot_module_registry_get_default (void);
+GType chatbot_module_registry_load_type (ChatbotModuleRegistry *registry,
+                                         const gchar *path, GError **error);
+ChatbotModule *
+chatbot_module_registry_checkout (ChatbotModuleRegistry *registry, GType type,
+                                  const gchar *parameter, GError **error);
+void chatbot_module_registry_return (ChatbotModuleRegistry *registry,
+                                     ChatbotModule *module);
+guint chatbot_module_registry_evict_idle (ChatbotModuleRegistry *registry,
+                                          guint idle_seconds);
+guint chatbot_module_registry_get_n_idle (ChatbotModuleRegistry *registry);
+
+G_END_DECLS
@@ -17,12 +17,30 @@
  * ChatbotModule:
  *
  * Base class for any modules.
+ *
+ * Module parameter is given as "key=value:key=value" string. Subclass can
+ * declare typed parameters with
+ * [func@Chatbot.module_class_set_parameter_specs]. Then the parameter is
+ * parsed once at initialization into a struct, which can be read with
+ * [method@Module.get_parameter_struct] without parsing strings again, and
+ * unknown keys or invalid values make the initialization fail.
+ *
+ * Subclass which implements #GInitable by itself must chain up to the parent
+ * implementation before reading typed parameters.
+ *
+ * Module also implements #GAsyncInitable, which runs #GInitable
+ * initialization in a thread. Heavy initialization like loading weights
+ * should be done in #GInitable initialization and report its progress with
+ * [method@Module.report_progress], so [func@Chatbot.module_new_async] can
+ * load modules without blocking the main loop.
  */
 
 #include "chatbot-module.h"
 
 #include <gio/gio.h>
 
+#include "chatbot-trace.h"
+
 enum
 {
   PROP_RAW_PARAMETER = 1,
@@ -38,20 +56,172 @@ typedef struct
 {
   gchar *raw_parameter;
   GHashTable *parameter;
+  gpointer parameter_struct;
+  GMainContext *progress_context;
+  gsize memory_usage[CHATBOT_MEMORY_N_KINDS];
 } ChatbotModulePrivate;
 
+enum
+{
+  PROGRESS,
+  N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
 static void chatbot_module_initable_iface_init (GInitableIface *iface);
+static void
+chatbot_module_async_initable_iface_init (GAsyncInitableIface *iface);
+
+G_DEFINE_TYPE_EXTENDED (
+    ChatbotModule, chatbot_module, G_TYPE_OBJECT, 0,
+    G_ADD_PRIVATE (ChatbotModule)
+        G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+                               chatbot_module_initable_iface_init)
+            G_IMPLEMENT_INTERFACE (G_TYPE_ASYNC_INITABLE,
+                                   chatbot_module_async_initable_iface_init));
+
+static const ChatbotModuleParameterSpec *
+chatbot_module_find_parameter_spec (const ChatbotModuleParameterSpec *specs,
+                                    const gchar *name)
+{
+  for (; specs->name; specs++)
+    if (!strcmp (specs->name, name))
+      return specs;
+  return NULL;
+}
 
-G_DEFINE_TYPE_EXTENDED (ChatbotModule, chatbot_module, G_TYPE_OBJECT, 0,
-                        G_ADD_PRIVATE (ChatbotModule) G_IMPLEMENT_INTERFACE (
-                            G_TYPE_INITABLE,
-                            chatbot_module_initable_iface_init));
+static gboolean
+chatbot_module_parse_parameter (const ChatbotModuleParameterSpec *spec,
+                                const gchar *value, gpointer field,
+                                GError **error)
+{
+  gchar *end = NULL;
+
+  switch (spec->type)
+    {
+    case CHATBOT_MODULE_PARAMETER_INT:
+      if ((value != NULL)
+          && g_ascii_string_to_signed (value, 10, G_MININT64, G_MAXINT64,
+                                       (gint64 *)field, NULL))
+        return TRUE;
+      break;
+    case CHATBOT_MODULE_PARAMETER_DOUBLE:
+      if ((value == NULL) || (*value == '\0'))
+        break;
+      *(gdouble *)field = g_ascii_strtod (value, &end);
+      if (*end == '\0')
+        return TRUE;
+      break;
+    case CHATBOT_MODULE_PARAMETER_BOOLEAN:
+      // "key" without value is same as "key=true".
+      if ((value == NULL) || !g_ascii_strcasecmp (value, "true")
+          || !g_ascii_strcasecmp (value, "yes") || !strcmp (value, "1"))
+        {
+          *(gboolean *)field = TRUE;
+          return TRUE;
+        }
+      if (!g_ascii_strcasecmp (value, "false")
+          || !g_ascii_strcasecmp (value, "no") || !strcmp (value, "0"))
+        {
+          *(gboolean *)field = FALSE;
+          return TRUE;
+        }
+      break;
+    case CHATBOT_MODULE_PARAMETER_PATH:
+      if (value == NULL)
+        break;
+      g_clear_pointer ((gchar **)field, g_free);
+      // Empty path means the path is not specified.
+      if (*value != '\0')
+        *(gchar **)field = g_canonicalize_filename (value, NULL);
+      return TRUE;
+    case CHATBOT_MODULE_PARAMETER_ENUM:
+      for (gint i = 0; value && spec->enum_values && spec->enum_values[i];
+           i++)
+        {
+          if (strcmp (spec->enum_values[i], value))
+            continue;
+          *(gint *)field = i;
+          return TRUE;
+        }
+      break;
+    }
+
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+               "Invalid value \"%s\" for parameter \"%s\".",
+               value ? value : "", spec->name);
+  return FALSE;
+}
+
+static void
+chatbot_module_free_parameter_struct (ChatbotModule *module)
+{
+  ChatbotModuleClass *klass = CHATBOT_MODULE_GET_CLASS (module);
+  ChatbotModulePrivate *priv = chatbot_module_get_instance_private (module);
+
+  for (const ChatbotModuleParameterSpec *spec = klass->parameter_specs;
+       priv->parameter_struct && spec->name; spec++)
+    if (spec->type == CHATBOT_MODULE_PARAMETER_PATH)
+      g_free (*(gchar **)((guint8 *)priv->parameter_struct + spec->offset));
+  g_clear_pointer (&priv->parameter_struct, g_free);
+}
 
 static gboolean
 chatbot_module_initable_init (GInitable *initable, GCancellable *cancellable,
                               GError **error)
 {
+  ChatbotModule *module = CHATBOT_MODULE (initable);
+  ChatbotModuleClass *klass = CHATBOT_MODULE_GET_CLASS (module);
+  ChatbotModulePrivate *priv = chatbot_module_get_instance_private (module);
+  GHashTableIter iter;
+  gpointer key;
+
+  if ((klass->parameter_specs == NULL) || (priv->parameter_struct != NULL))
+    return TRUE;
+
+  priv->parameter_struct = g_malloc0 (klass->parameter_size);
+
+  g_hash_table_iter_init (&iter, priv->parameter);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      if (chatbot_module_find_parameter_spec (klass->parameter_specs, key))
+        continue;
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Unknown parameter \"%s\" for module \"%s\".",
+                   (const gchar *)key, G_OBJECT_TYPE_NAME (module));
+      goto on_error;
+    }
+
+  for (const ChatbotModuleParameterSpec *spec = klass->parameter_specs;
+       spec->name; spec++)
+    {
+      gpointer field = (guint8 *)priv->parameter_struct + spec->offset;
+      gpointer value;
+
+      if (!g_hash_table_lookup_extended (priv->parameter, spec->name, NULL,
+                                         &value))
+        {
+          if (spec->default_value == NULL)
+            {
+              g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                           "Parameter \"%s\" is required for module "
+                           "\"%s\".",
+                           spec->name, G_OBJECT_TYPE_NAME (module));
+              goto on_error;
+            }
+          value = (gpointer)spec->default_value;
+        }
+
+      if (!chatbot_module_parse_parameter (spec, value, field, error))
+        goto on_error;
+    }
+
   return TRUE;
+on_error:
+  // A retry parses the parameters again instead of seeing them parsed.
+  chatbot_module_free_parameter_struct (module);
+  return FALSE;
 }
 
 static void
@@ -60,6 +230,36 @@ chatbot_module_initable_iface_init (GInitableIface *iface)
   iface->init = chatbot_module_initable_init;
 }
 
+static void (*chatbot_module_parent_init_async) (
+    GAsyncInitable *initable, int io_priority, GCancellable *cancellable,
+    GAsyncReadyCallback callback, gpointer user_data);
+
+static void
+chatbot_module_async_initable_init_async (GAsyncInitable *initable,
+                                          int io_priority,
+                                          GCancellable *cancellable,
+                                          GAsyncReadyCallback callback,
+                                          gpointer user_data)
+{
+  ChatbotModulePrivate *priv
+      = chatbot_module_get_instance_private (CHATBOT_MODULE (initable));
+
+  // Progress is reported from the initializing thread, so it's dispatched to
+  // the context of the caller.
+  g_clear_pointer (&priv->progress_context, g_main_context_unref);
+  priv->progress_context = g_main_context_ref_thread_default ();
+  chatbot_module_parent_init_async (initable, io_priority, cancellable,
+                                    callback, user_data);
+}
+
+static void
+chatbot_module_async_initable_iface_init (GAsyncInitableIface *iface)
+{
+  // Default implementation runs GInitable initialization in a thread.
+  chatbot_module_parent_init_async = iface->init_async;
+  iface->init_async = chatbot_module_async_initable_init_async;
+}
+
 static void
 chatbot_module_set_property (GObject *object, guint property_id,
                              const GValue *value, GParamSpec *pspec)
@@ -111,6 +311,7 @@ chatbot_module_dispose (GObject *object)
       = chatbot_module_get_instance_private (CHATBOT_MODULE (object));
 
   g_clear_pointer (&priv->parameter, g_hash_table_unref);
+  g_clear_pointer (&priv->progress_context, g_main_context_unref);
 
   G_OBJECT_CLASS (chatbot_module_parent_class)->dispose (object);
 }
@@ -121,7 +322,10 @@ chatbot_module_finalize (GObject *object)
   ChatbotModulePrivate *priv
       = chatbot_module_get_instance_private (CHATBOT_MODULE (object));
 
+  chatbot_module_free_parameter_struct (CHATBOT_MODULE (object));
   g_clear_pointer (&priv->raw_parameter, g_free);
+  for (guint i = 0; i < CHATBOT_MEMORY_N_KINDS; i++)
+    chatbot_memory_update (i, priv->memory_usage[i], 0);
 
   G_OBJECT_CLASS (chatbot_module_parent_class)->finalize (object);
 }
@@ -133,11 +337,15 @@ chatbot_module_constructed (GObject *object)
   ChatbotModulePrivate *priv = chatbot_module_get_instance_private (module);
 
   gchar **kv_array;
-  kv_array = g_strsplit (priv->raw_parameter, ":", -1);
+  kv_array = g_strsplit (priv->raw_parameter ? priv->raw_parameter : "", ":",
+                         -1);
 
   for (gchar **iter = kv_array; *iter != NULL; iter++)
     {
-      gchar **kv = g_strsplit (*iter, "=", 2); // "k=v" into {k, v}
+      gchar **kv;
+      if (**iter == '\0')
+        continue;
+      kv = g_strsplit (*iter, "=", 2); // "k=v" into {k, v}
       if (!g_hash_table_insert (priv->parameter, g_strdup (kv[0]),
                                 g_strdup (kv[1])))
         g_warning ("Failed to insert parameter \"%s\".", kv[0]);
@@ -166,7 +374,7 @@ chatbot_module_class_init (ChatbotModuleClass *klass)
    */
   properties[PROP_RAW_PARAMETER] = g_param_spec_string (
       "raw_parameter", "raw_parameter", "raw parameter string", "",
-      G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE);
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
 
   /**
    * Module:parameter:
@@ -178,6 +386,19 @@ chatbot_module_class_init (ChatbotModuleClass *klass)
                             G_TYPE_HASH_TABLE, G_PARAM_READABLE);
 
   g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+
+  /**
+   * ChatbotModule::progress:
+   * @module: module instance
+   * @fraction: progress from 0.0 to 1.0
+   * @message: (nullable): description of current stage
+   *
+   * Emits when the module reports initialization progress with
+   * [method@Module.report_progress].
+   */
+  signals[PROGRESS] = g_signal_new (
+      "progress", CHATBOT_TYPE_MODULE, G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
+      G_TYPE_NONE, 2, G_TYPE_DOUBLE, G_TYPE_STRING);
 }
 
 static void
@@ -202,7 +423,137 @@ chatbot_module_init (ChatbotModule *module)
 ChatbotModule *
 chatbot_module_new (GType type, const gchar *parameter, GError **error)
 {
-  return g_initable_new (type, NULL, error, "raw_parameter", parameter, NULL);
+  gint64 span = chatbot_trace_begin ();
+  ChatbotModule *module;
+
+  module = g_initable_new (type, NULL, error, "raw_parameter", parameter,
+                           NULL);
+  chatbot_trace_end (span, "module-new", g_type_name (type));
+  return module;
+}
+
+/**
+ * chatbot_module_new_async:
+ * @type: GType which is module implementation
+ * @parameter: module parameter
+ * @io_priority: priority of the initialization
+ * @cancellable: (nullable): cancellable to cancel the initialization
+ * @callback: (scope async): callback called when the module is initialized
+ * @user_data: user data of @callback
+ *
+ * Create instance from GType without blocking the thread.
+ *
+ * The returned instance is not initialized yet. It's returned so that the
+ * caller can connect to [signal@Module::progress]; don't use it for anything
+ * else until @callback is called. Obtain the initialized instance with
+ * [func@Chatbot.module_new_finish] in @callback.
+ *
+ * Returns: (transfer none): instance being initialized, which is valid until
+ * @callback is called
+ */
+ChatbotModule *
+chatbot_module_new_async (GType type, const gchar *parameter, int io_priority,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data)
+{
+  ChatbotModule *module;
+
+  g_return_val_if_fail (g_type_is_a (type, CHATBOT_TYPE_MODULE), NULL);
+
+  module = g_object_new (type, "raw_parameter", parameter ? parameter : "",
+                         NULL);
+  g_async_initable_init_async (G_ASYNC_INITABLE (module), io_priority,
+                               cancellable, callback, user_data);
+  // The initialization holds its own reference until callback is called.
+  g_object_unref (module);
+  return module;
+}
+
+/**
+ * chatbot_module_new_finish:
+ * @result: result passed to the callback of [func@Chatbot.module_new_async]
+ * @error: location to store the error
+ *
+ * Finish [func@Chatbot.module_new_async].
+ *
+ * Returns: (transfer full) (nullable): initialized instance, or %NULL on
+ * failure
+ */
+ChatbotModule *
+chatbot_module_new_finish (GAsyncResult *result, GError **error)
+{
+  GObject *source;
+  ChatbotModule *module = NULL;
+
+  g_return_val_if_fail (G_IS_ASYNC_RESULT (result), NULL);
+
+  source = g_async_result_get_source_object (result);
+  if (g_async_initable_init_finish (G_ASYNC_INITABLE (source), result, error))
+    module = CHATBOT_MODULE (g_object_ref (source));
+  g_object_unref (source);
+  return module;
+}
+
+typedef struct
+{
+  ChatbotModule *module;
+  gdouble fraction;
+  gchar *message;
+} ChatbotModuleProgress;
+
+static gboolean
+chatbot_module_emit_progress (gpointer user_data)
+{
+  ChatbotModuleProgress *progress = user_data;
+  g_signal_emit (progress->module, signals[PROGRESS], 0, progress->fraction,
+                 progress->message);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+chatbot_module_progress_free (gpointer user_data)
+{
+  ChatbotModuleProgress *progress = user_data;
+  g_object_unref (progress->module);
+  g_free (progress->message);
+  g_free (progress);
+}
+
+/**
+ * chatbot_module_report_progress:
+ * @fraction: progress from 0.0 to 1.0
+ * @message: (nullable): description of current stage
+ *
+ * Report initialization progress. This can be called from any thread.
+ *
+ * If the module is initialized with [func@Chatbot.module_new_async],
+ * [signal@Module::progress] is emitted in the main context of the caller of
+ * it. Otherwise, it's emitted immediately.
+ */
+void
+chatbot_module_report_progress (ChatbotModule *module, gdouble fraction,
+                                const gchar *message)
+{
+  ChatbotModulePrivate *priv;
+  ChatbotModuleProgress *progress;
+
+  g_return_if_fail (CHATBOT_IS_MODULE (module));
+
+  priv = chatbot_module_get_instance_private (module);
+  fraction = CLAMP (fraction, 0.0, 1.0);
+  if (priv->progress_context == NULL)
+    {
+      g_signal_emit (module, signals[PROGRESS], 0, fraction, message);
+      return;
+    }
+
+  progress = g_new (ChatbotModuleProgress, 1);
+  progress->module = g_object_ref (module);
+  progress->fraction = fraction;
+  progress->message = g_strdup (message);
+  g_main_context_invoke_full (priv->progress_context, G_PRIORITY_DEFAULT,
+                              chatbot_module_emit_progress, progress,
+                              chatbot_module_progress_free);
 }
 
 /**
@@ -235,8 +586,68 @@ chatbot_module_get_description (ChatbotModule *module)
   ChatbotModuleClass *klass;
   g_return_val_if_fail (CHATBOT_IS_MODULE (module), NULL);
   klass = CHATBOT_MODULE_GET_CLASS (module);
-  g_return_val_if_fail (klass->get_name != NULL, NULL);
-  return klass->get_name (module);
+  g_return_val_if_fail (klass->get_description != NULL, NULL);
+  return klass->get_description (module);
+}
+
+/**
+ * chatbot_module_set_memory_usage:
+ * @kind: what the memory is used for
+ * @n_bytes: bytes currently used for @kind
+ *
+ * Report memory used by the module. Call this again whenever the size
+ * changes, e.g. when KV cache grows. Reported sizes are added to the process
+ * accounting of [func@Chatbot.memory_get_usage] and removed when the module
+ * is finalized.
+ */
+void
+chatbot_module_set_memory_usage (ChatbotModule *module,
+                                 ChatbotMemoryKind kind, gsize n_bytes)
+{
+  ChatbotModulePrivate *priv;
+  gsize old_bytes;
+
+  g_return_if_fail (CHATBOT_IS_MODULE (module));
+  g_return_if_fail (kind < CHATBOT_MEMORY_N_KINDS);
+
+  priv = chatbot_module_get_instance_private (module);
+  old_bytes = priv->memory_usage[kind];
+  priv->memory_usage[kind] = n_bytes;
+  chatbot_memory_update (kind, old_bytes, n_bytes);
+}
+
+/**
+ * chatbot_module_get_memory_usage:
+ * @kind: what the memory is used for
+ *
+ * Returns: bytes reported with [method@Module.set_memory_usage]
+ */
+gsize
+chatbot_module_get_memory_usage (ChatbotModule *module, ChatbotMemoryKind kind)
+{
+  ChatbotModulePrivate *priv;
+
+  g_return_val_if_fail (CHATBOT_IS_MODULE (module), 0);
+  g_return_val_if_fail (kind < CHATBOT_MEMORY_N_KINDS, 0);
+
+  priv = chatbot_module_get_instance_private (module);
+  return priv->memory_usage[kind];
+}
+
+/**
+ * chatbot_module_get_raw_parameter: (get-property raw_parameter)
+ *
+ * Get the parameter string the module is constructed with.
+ *
+ * Returns: (transfer none): [property@Module:raw_parameter], never %NULL
+ */
+const gchar *
+chatbot_module_get_raw_parameter (ChatbotModule *module)
+{
+  ChatbotModulePrivate *priv;
+  g_return_val_if_fail (CHATBOT_IS_MODULE (module), NULL);
+  priv = chatbot_module_get_instance_private (module);
+  return priv->raw_parameter ? priv->raw_parameter : "";
 }
 
 /**
@@ -254,3 +665,63 @@ chatbot_module_get_parameter (ChatbotModule *module)
   priv = chatbot_module_get_instance_private (module);
   return priv->parameter;
 }
+
+/**
+ * chatbot_module_class_set_parameter_specs:
+ * @klass: module class
+ * @specs: (array zero-terminated=1): parameter declarations, which must be
+ * valid while the class is
+ * @parameter_size: size of the parameter struct
+ *
+ * Declare typed parameters of the module. This should be called in class
+ * initialization.
+ *
+ * ```c
+ * typedef struct
+ * {
+ *   gint64 n_threads;
+ *   gchar *model;
+ * } MyModelParameter;
+ *
+ * static const ChatbotModuleParameterSpec my_model_parameter_specs[] = {
+ *   { "threads", "number of threads", CHATBOT_MODULE_PARAMETER_INT,
+ *     G_STRUCT_OFFSET (MyModelParameter, n_threads), "4", NULL },
+ *   { "model", "model file", CHATBOT_MODULE_PARAMETER_PATH,
+ *     G_STRUCT_OFFSET (MyModelParameter, model), NULL, NULL },
+ *   { NULL }
+ * };
+ *
+ * chatbot_module_class_set_parameter_specs (module_class,
+ *                                           my_model_parameter_specs,
+ *                                           sizeof (MyModelParameter));
+ * ```
+ */
+void
+chatbot_module_class_set_parameter_specs (
+    ChatbotModuleClass *klass, const ChatbotModuleParameterSpec *specs,
+    gsize parameter_size)
+{
+  g_return_if_fail (CHATBOT_IS_MODULE_CLASS (klass));
+  g_return_if_fail (specs != NULL);
+
+  klass->parameter_specs = specs;
+  klass->parameter_size = parameter_size;
+}
+
+/**
+ * chatbot_module_get_parameter_struct:
+ *
+ * Get typed parameters declared with
+ * [func@Chatbot.module_class_set_parameter_specs].
+ *
+ * Returns: (transfer none) (nullable): parameter struct, or %NULL if the
+ * module doesn't declare typed parameters or isn't initialized yet.
+ */
+gconstpointer
+chatbot_module_get_parameter_struct (ChatbotModule *module)
+{
+  ChatbotModulePrivate *priv;
+  g_return_val_if_fail (CHATBOT_IS_MODULE (module), NULL);
+  priv = chatbot_module_get_instance_private (module);
+  return priv->parameter_struct;
+}
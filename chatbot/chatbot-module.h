@@ -14,10 +14,57 @@
  */
 #pragma once
 
+#include <gio/gio.h>
 #include <glib-object.h>
 
+#include "chatbot-memory.h"
+
 G_BEGIN_DECLS
 
+/**
+ * ChatbotModuleParameterType:
+ * @CHATBOT_MODULE_PARAMETER_INT: #gint64
+ * @CHATBOT_MODULE_PARAMETER_DOUBLE: #gdouble
+ * @CHATBOT_MODULE_PARAMETER_BOOLEAN: #gboolean
+ * @CHATBOT_MODULE_PARAMETER_PATH: #gchar* holding absolute path
+ * @CHATBOT_MODULE_PARAMETER_ENUM: #gint index of the value in
+ * [field@ModuleParameterSpec.enum_values]
+ *
+ * Type of a module parameter and the C type stored in the parameter struct.
+ */
+typedef enum
+{
+  CHATBOT_MODULE_PARAMETER_INT,
+  CHATBOT_MODULE_PARAMETER_DOUBLE,
+  CHATBOT_MODULE_PARAMETER_BOOLEAN,
+  CHATBOT_MODULE_PARAMETER_PATH,
+  CHATBOT_MODULE_PARAMETER_ENUM
+} ChatbotModuleParameterType;
+
+/**
+ * ChatbotModuleParameterSpec:
+ * @name: parameter key
+ * @description: parameter description
+ * @type: parameter type
+ * @offset: offset of the field in the parameter struct
+ * @default_value: (nullable): value used if the parameter is not given, or
+ * %NULL to make the parameter required
+ * @enum_values: (nullable) (array zero-terminated=1): valid values for
+ * %CHATBOT_MODULE_PARAMETER_ENUM
+ *
+ * Declares a typed module parameter. Array of this is terminated by an
+ * element whose @name is %NULL.
+ */
+typedef struct _ChatbotModuleParameterSpec
+{
+  const gchar *name;
+  const gchar *description;
+  ChatbotModuleParameterType type;
+  gsize offset;
+  const gchar *default_value;
+  const gchar *const *enum_values;
+} ChatbotModuleParameterSpec;
+
 #define CHATBOT_TYPE_MODULE chatbot_module_get_type ()
 G_DECLARE_DERIVABLE_TYPE (ChatbotModule, chatbot_module, CHATBOT, MODULE,
                           GObject);
@@ -27,12 +74,44 @@ struct _ChatbotModuleClass
   GObjectClass parent_class;
   const gchar *(*get_name) (ChatbotModule *module);
   const gchar *(*get_description) (ChatbotModule *module);
+
+  const ChatbotModuleParameterSpec *parameter_specs;
+  gsize parameter_size;
 };
 
+/**
+ * CHATBOT_MODULE_PARAMETER_STRUCT:
+ * @module: module instance
+ * @Type: parameter struct type declared with
+ * [func@Chatbot.module_class_set_parameter_specs]
+ *
+ * Returns: (transfer none): typed parameters of @module
+ */
+#define CHATBOT_MODULE_PARAMETER_STRUCT(module, Type)                         \
+  ((const Type *)chatbot_module_get_parameter_struct (CHATBOT_MODULE (module)))
+
 ChatbotModule *chatbot_module_new (GType type, const gchar *parameter,
                                    GError **error);
+ChatbotModule *chatbot_module_new_async (GType type, const gchar *parameter,
+                                         int io_priority,
+                                         GCancellable *cancellable,
+                                         GAsyncReadyCallback callback,
+                                         gpointer user_data);
+ChatbotModule *chatbot_module_new_finish (GAsyncResult *result,
+                                          GError **error);
+void chatbot_module_report_progress (ChatbotModule *module, gdouble fraction,
+                                     const gchar *message);
 const gchar *chatbot_module_get_name (ChatbotModule *module);
 const gchar *chatbot_module_get_description (ChatbotModule *module);
+const gchar *chatbot_module_get_raw_parameter (ChatbotModule *module);
 GHashTable *chatbot_module_get_parameter (ChatbotModule *module);
+void chatbot_module_set_memory_usage (ChatbotModule *module,
+                                      ChatbotMemoryKind kind, gsize n_bytes);
+gsize chatbot_module_get_memory_usage (ChatbotModule *module,
+                                       ChatbotMemoryKind kind);
+void chatbot_module_class_set_parameter_specs (
+    ChatbotModuleClass *klass, const ChatbotModuleParameterSpec *specs,
+    gsize parameter_size);
+gconstpointer chatbot_module_get_parameter_struct (ChatbotModule *module);
 
 G_END_DECLS
@@ -0,0 +1,1039 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * ChatbotRemoteTool:
+ *
+ * [iface@Tool] proxy that runs a tool module in worker processes.
+ *
+ * Workers are spawned when the instance is initialized, and each of them
+ * loads the tool module and serves calls with [func@remote_tool_serve]. A
+ * crash of the tool, or a call which doesn't reply within
+ * [property@RemoteTool:call-timeout], only kills the worker; the worker is
+ * spawned again at the next call, which waits for it to load the module for
+ * at most the same timeout.
+ *
+ * Messages are serialized #GVariant sent over a Unix socket. Payloads larger
+ * than 64 KiB are written to an unlinked temporary file and only its file
+ * descriptor is sent, so the receiver maps it instead of copying through the
+ * socket.
+ *
+ * Language model can't be shared with workers, so tools called through this
+ * proxy always receive %NULL as language model.
+ */
+
+#include "chatbot-remote-tool.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gio/gunixfdmessage.h>
+#include <glib/gstdio.h>
+
+#define CHATBOT_REMOTE_SHM_THRESHOLD (64 * 1024)
+
+typedef enum
+{
+  CHATBOT_REMOTE_MESSAGE_HELLO = 1,
+  CHATBOT_REMOTE_MESSAGE_CALL,
+  CHATBOT_REMOTE_MESSAGE_RESULT,
+  CHATBOT_REMOTE_MESSAGE_ERROR,
+  CHATBOT_REMOTE_N_MESSAGES
+} ChatbotRemoteMessage;
+
+enum
+{
+  CHATBOT_REMOTE_FLAG_SHM = 1 << 0
+};
+
+typedef struct
+{
+  guint32 message;
+  guint32 flags;
+  guint64 size;
+} ChatbotRemoteHeader;
+
+static const gchar *const message_types[CHATBOT_REMOTE_N_MESSAGES] = {
+  [CHATBOT_REMOTE_MESSAGE_HELLO] = "(ssa(ssa(sss)a(sss)))",
+  [CHATBOT_REMOTE_MESSAGE_CALL] = "(sa{sv})",
+  [CHATBOT_REMOTE_MESSAGE_RESULT] = "(a{sv})",
+  [CHATBOT_REMOTE_MESSAGE_ERROR] = "(sis)",
+};
+
+static gboolean
+chatbot_remote_send_all (GSocket *socket, const gchar *buffer, gsize size,
+                         GCancellable *cancellable, GError **error)
+{
+  while (size > 0)
+    {
+      gssize n = g_socket_send (socket, buffer, size, cancellable, error);
+      if (n < 0)
+        return FALSE;
+      buffer += n;
+      size -= n;
+    }
+  return TRUE;
+}
+
+static gboolean
+chatbot_remote_receive_all (GSocket *socket, gchar *buffer, gsize size,
+                            GCancellable *cancellable, GError **error)
+{
+  while (size > 0)
+    {
+      gssize n = g_socket_receive (socket, buffer, size, cancellable, error);
+      if (n < 0)
+        return FALSE;
+      if (n == 0)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+                       "Connection is closed by the peer.");
+          return FALSE;
+        }
+      buffer += n;
+      size -= n;
+    }
+  return TRUE;
+}
+
+static gint
+chatbot_remote_create_shm (GVariant *value, GError **error)
+{
+  gchar *path = NULL;
+  gsize size = g_variant_get_size (value);
+  gpointer map;
+  gint fd;
+  int errsv;
+
+  fd = g_file_open_tmp ("chatbot-remote-XXXXXX", &path, error);
+  if (fd < 0)
+    return -1;
+  g_unlink (path);
+  g_free (path);
+
+  if (ftruncate (fd, size) < 0)
+    goto on_errno;
+  map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    goto on_errno;
+  g_variant_store (value, map);
+  munmap (map, size);
+  return fd;
+
+on_errno:
+  errsv = errno;
+  g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+               "Failed to prepare shared memory: %s", g_strerror (errsv));
+  close (fd);
+  return -1;
+}
+
+/*
+ * Sends @value, which can be floating. Header and payload are sent with one
+ * sendmsg() unless the kernel accepts only a part of them.
+ */
+static gboolean
+chatbot_remote_send (GSocket *socket, ChatbotRemoteMessage message,
+                     GVariant *value, GCancellable *cancellable,
+                     GError **error)
+{
+  ChatbotRemoteHeader header = { message, 0, 0 };
+  GOutputVector vectors[2];
+  guint n_vectors = 1;
+  GSocketControlMessage *fd_message = NULL;
+  GVariant *normal;
+  gssize n;
+  gboolean ret = FALSE;
+
+  g_variant_ref_sink (value);
+  normal = g_variant_get_normal_form (value);
+  g_variant_unref (value);
+
+  header.size = g_variant_get_size (normal);
+  vectors[0].buffer = &header;
+  vectors[0].size = sizeof (header);
+  if (header.size >= CHATBOT_REMOTE_SHM_THRESHOLD)
+    {
+      gint fd = chatbot_remote_create_shm (normal, error);
+      if (fd < 0)
+        goto cleanup;
+      fd_message = g_unix_fd_message_new ();
+      ret = g_unix_fd_message_append_fd (G_UNIX_FD_MESSAGE (fd_message), fd,
+                                         error);
+      close (fd);
+      if (!ret)
+        goto cleanup;
+      header.flags |= CHATBOT_REMOTE_FLAG_SHM;
+    }
+  else
+    {
+      vectors[1].buffer = g_variant_get_data (normal);
+      vectors[1].size = header.size;
+      n_vectors++;
+    }
+
+  ret = FALSE;
+  n = g_socket_send_message (socket, NULL, vectors, n_vectors,
+                             fd_message ? &fd_message : NULL,
+                             fd_message ? 1 : 0, G_SOCKET_MSG_NONE,
+                             cancellable, error);
+  if (n < 0)
+    goto cleanup;
+
+  if ((gsize)n < sizeof (header))
+    {
+      if (!chatbot_remote_send_all (socket, (const gchar *)&header + n,
+                                    sizeof (header) - n, cancellable, error))
+        goto cleanup;
+      n = sizeof (header);
+    }
+  if (n_vectors == 2
+      && !chatbot_remote_send_all (
+          socket, (const gchar *)vectors[1].buffer + (n - sizeof (header)),
+          header.size - (n - sizeof (header)), cancellable, error))
+    goto cleanup;
+
+  ret = TRUE;
+cleanup:
+  g_clear_object (&fd_message);
+  g_variant_unref (normal);
+  return ret;
+}
+
+static GVariant *
+chatbot_remote_receive (GSocket *socket, ChatbotRemoteMessage *message,
+                        GCancellable *cancellable, GError **error)
+{
+  ChatbotRemoteHeader header;
+  GInputVector vector = { &header, sizeof (header) };
+  GSocketControlMessage **messages = NULL;
+  gint n_messages = 0;
+  gint flags = 0;
+  gint fd = -1;
+  gssize n;
+  GBytes *bytes = NULL;
+  GVariant *value = NULL;
+
+  n = g_socket_receive_message (socket, NULL, &vector, 1, &messages,
+                                &n_messages, &flags, cancellable, error);
+  for (gint i = 0; i < n_messages; i++)
+    {
+      if (G_IS_UNIX_FD_MESSAGE (messages[i]))
+        {
+          gint n_fds;
+          gint *fds = g_unix_fd_message_steal_fds (
+              G_UNIX_FD_MESSAGE (messages[i]), &n_fds);
+          for (gint j = 0; j < n_fds; j++)
+            {
+              if (fd < 0)
+                fd = fds[j];
+              else
+                close (fds[j]);
+            }
+          g_free (fds);
+        }
+      g_object_unref (messages[i]);
+    }
+  g_free (messages);
+
+  if (n < 0)
+    goto cleanup;
+  if (n == 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+                   "Connection is closed by the peer.");
+      goto cleanup;
+    }
+  if (((gsize)n < sizeof (header))
+      && !chatbot_remote_receive_all (socket, (gchar *)&header + n,
+                                      sizeof (header) - n, cancellable, error))
+    goto cleanup;
+
+  if ((header.message == 0) || (header.message >= CHATBOT_REMOTE_N_MESSAGES))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Received unknown message %u.", header.message);
+      goto cleanup;
+    }
+
+  if (header.flags & CHATBOT_REMOTE_FLAG_SHM)
+    {
+      GMappedFile *mapped;
+      GBytes *file_bytes;
+
+      if (fd < 0)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Shared memory is not attached to the message.");
+          goto cleanup;
+        }
+      mapped = g_mapped_file_new_from_fd (fd, FALSE, error);
+      if (mapped == NULL)
+        goto cleanup;
+      if (g_mapped_file_get_length (mapped) < header.size)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Shared memory is smaller than the message.");
+          g_mapped_file_unref (mapped);
+          goto cleanup;
+        }
+      file_bytes = g_mapped_file_get_bytes (mapped);
+      bytes = g_bytes_new_from_bytes (file_bytes, 0, header.size);
+      g_bytes_unref (file_bytes);
+      g_mapped_file_unref (mapped);
+    }
+  else
+    {
+      gchar *data;
+
+      if (header.size >= CHATBOT_REMOTE_SHM_THRESHOLD)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Inline message is too large.");
+          goto cleanup;
+        }
+      data = g_malloc (header.size);
+      if (!chatbot_remote_receive_all (socket, data, header.size, cancellable,
+                                       error))
+        {
+          g_free (data);
+          goto cleanup;
+        }
+      bytes = g_bytes_new_take (data, header.size);
+    }
+
+  value = g_variant_ref_sink (g_variant_new_from_bytes (
+      G_VARIANT_TYPE (message_types[header.message]), bytes, FALSE));
+  *message = header.message;
+
+cleanup:
+  if (fd >= 0)
+    close (fd);
+  g_clear_pointer (&bytes, g_bytes_unref);
+  return value;
+}
+
+static GVariant *
+chatbot_remote_hello_new (ChatbotTool *tool)
+{
+  const ChatbotToolFunction *const *functions;
+  const gchar *name, *description;
+  GVariantBuilder builder;
+
+  name = chatbot_module_get_name (CHATBOT_MODULE (tool));
+  description = chatbot_module_get_description (CHATBOT_MODULE (tool));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssa(sss)a(sss))"));
+  functions = chatbot_tool_get_function_definitions (tool);
+  for (; functions && *functions; functions++)
+    g_variant_builder_add_value (
+        &builder, chatbot_tool_function_to_variant (*functions));
+
+  return g_variant_new ("(ss@a(ssa(sss)a(sss)))", name ? name : "",
+                        description ? description : "",
+                        g_variant_builder_end (&builder));
+}
+
+typedef struct
+{
+  GSubprocess *process;
+  GSocket *socket;
+} ChatbotRemoteWorker;
+
+struct _ChatbotRemoteTool
+{
+  ChatbotModule parent_instance;
+
+  gchar *worker_path;
+  gchar *module_path;
+  gchar *module_parameter;
+  guint n_workers;
+  guint call_timeout; // atomic, in milliseconds
+
+  gchar *name;
+  gchar *description;
+  ChatbotToolFunction **functions;
+  ChatbotRemoteWorker *workers;
+  GAsyncQueue *idle_workers;
+};
+
+enum
+{
+  PROP_WORKER_PATH = 1,
+  PROP_MODULE_PATH,
+  PROP_MODULE_PARAMETER,
+  PROP_N_WORKERS,
+  PROP_CALL_TIMEOUT,
+  N_PROPERTIES,
+  PROP_FUNCTIONS = N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES] = {
+  NULL,
+};
+
+static GInitableIface *chatbot_remote_tool_initable_parent_iface;
+
+static void chatbot_remote_tool_initable_iface_init (GInitableIface *iface);
+static void chatbot_remote_tool_tool_iface_init (ChatbotToolInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (
+    ChatbotRemoteTool, chatbot_remote_tool, CHATBOT_TYPE_MODULE,
+    G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+                           chatbot_remote_tool_initable_iface_init)
+        G_IMPLEMENT_INTERFACE (CHATBOT_TYPE_TOOL,
+                               chatbot_remote_tool_tool_iface_init));
+
+static gboolean
+chatbot_remote_worker_spawn (ChatbotRemoteTool *self,
+                             ChatbotRemoteWorker *worker, GError **error)
+{
+  GSubprocessLauncher *launcher;
+  gint fds[2];
+
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    {
+      int errsv = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Failed to create socket pair: %s", g_strerror (errsv));
+      return FALSE;
+    }
+
+  worker->socket = g_socket_new_from_fd (fds[0], error);
+  if (worker->socket == NULL)
+    {
+      close (fds[0]);
+      close (fds[1]);
+      return FALSE;
+    }
+
+  launcher = g_subprocess_launcher_new (G_SUBPROCESS_FLAGS_NONE);
+  g_subprocess_launcher_take_fd (launcher, fds[1], 3);
+  worker->process = g_subprocess_launcher_spawn (
+      launcher, error, self->worker_path, "--fd", "3", "--module",
+      self->module_path, "--parameter",
+      self->module_parameter ? self->module_parameter : "", NULL);
+  g_object_unref (launcher);
+  if (worker->process == NULL)
+    {
+      g_clear_object (&worker->socket);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/*
+ * Waits until the worker finishes loading the module. Returns HELLO message.
+ */
+static GVariant *
+chatbot_remote_worker_handshake (ChatbotRemoteWorker *worker,
+                                 GCancellable *cancellable, GError **error)
+{
+  ChatbotRemoteMessage message;
+  GVariant *hello;
+
+  hello = chatbot_remote_receive (worker->socket, &message, cancellable,
+                                  error);
+  if (hello == NULL)
+    return NULL;
+  if (message != CHATBOT_REMOTE_MESSAGE_HELLO)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Tool worker didn't send function definitions.");
+      g_variant_unref (hello);
+      return NULL;
+    }
+  return hello;
+}
+
+static void
+chatbot_remote_worker_stop (ChatbotRemoteWorker *worker, gboolean force)
+{
+  if (worker->socket)
+    g_socket_close (worker->socket, NULL);
+  g_clear_object (&worker->socket);
+  if (worker->process)
+    {
+      // Worker exits by itself when the socket is closed.
+      if (force)
+        g_subprocess_force_exit (worker->process);
+      g_subprocess_wait (worker->process, NULL, NULL);
+    }
+  g_clear_object (&worker->process);
+}
+
+/*
+ * Waits until the worker starts replying, for at most @timeout milliseconds
+ * (0 waits forever). The socket timeout bounds the rest of the reply.
+ */
+static gboolean
+chatbot_remote_worker_wait_reply (ChatbotRemoteWorker *worker, guint timeout,
+                                  GCancellable *cancellable, GError **error)
+{
+  GError *local_error = NULL;
+
+  if (timeout == 0)
+    return TRUE;
+
+  g_socket_set_timeout (worker->socket, MAX ((timeout + 999) / 1000, 1));
+  if (g_socket_condition_timed_wait (worker->socket, G_IO_IN,
+                                     (gint64)timeout * 1000, cancellable,
+                                     &local_error))
+    return TRUE;
+
+  if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT))
+    {
+      g_error_free (local_error);
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                   "No reply in %u ms.", timeout);
+    }
+  else
+    g_propagate_error (error, local_error);
+  return FALSE;
+}
+
+static gboolean
+chatbot_remote_worker_restart (ChatbotRemoteTool *self,
+                               ChatbotRemoteWorker *worker,
+                               GCancellable *cancellable, GError **error)
+{
+  GVariant *hello = NULL;
+
+  if (!chatbot_remote_worker_spawn (self, worker, error))
+    return FALSE;
+  // A worker stuck loading the module would block the call forever.
+  if (chatbot_remote_worker_wait_reply (
+          worker, g_atomic_int_get (&self->call_timeout), cancellable, error))
+    hello = chatbot_remote_worker_handshake (worker, cancellable, error);
+  if (hello == NULL)
+    {
+      chatbot_remote_worker_stop (worker, TRUE);
+      return FALSE;
+    }
+  g_variant_unref (hello);
+  return TRUE;
+}
+
+static gboolean
+chatbot_remote_tool_parse_hello (ChatbotRemoteTool *self, GVariant *hello,
+                                 GError **error)
+{
+  GVariant *functions, *function;
+  GVariantIter iter;
+  gsize i = 0;
+
+  g_variant_get (hello, "(ss@a(ssa(sss)a(sss)))", &self->name,
+                 &self->description, &functions);
+  self->functions
+      = g_new0 (ChatbotToolFunction *, g_variant_n_children (functions) + 1);
+
+  g_variant_iter_init (&iter, functions);
+  while ((function = g_variant_iter_next_value (&iter)))
+    {
+      ChatbotToolFunction *definition;
+
+      definition = chatbot_tool_function_new_from_variant (function, error);
+      g_variant_unref (function);
+      if (definition == NULL)
+        {
+          g_variant_unref (functions);
+          return FALSE;
+        }
+      self->functions[i++] = chatbot_tool_function_ref (definition);
+    }
+
+  g_variant_unref (functions);
+  return TRUE;
+}
+
+static gboolean
+chatbot_remote_tool_initable_init (GInitable *initable,
+                                   GCancellable *cancellable, GError **error)
+{
+  ChatbotRemoteTool *self = CHATBOT_REMOTE_TOOL (initable);
+  gboolean ret = TRUE;
+
+  if (!chatbot_remote_tool_initable_parent_iface->init (initable, cancellable,
+                                                        error))
+    return FALSE;
+
+  if (self->worker_path == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Worker path of the remote tool is not specified.");
+      return FALSE;
+    }
+
+  if (self->module_path == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Module path of the remote tool is not specified.");
+      return FALSE;
+    }
+
+  // Spawn all workers first so they load the module concurrently.
+  self->workers = g_new0 (ChatbotRemoteWorker, self->n_workers);
+  for (guint i = 0; i < self->n_workers; i++)
+    if (!chatbot_remote_worker_spawn (self, &self->workers[i], error))
+      return FALSE;
+
+  for (guint i = 0; i < self->n_workers; i++)
+    {
+      GVariant *hello;
+
+      if (!ret)
+        {
+          chatbot_remote_worker_stop (&self->workers[i], TRUE);
+          continue;
+        }
+
+      hello = chatbot_remote_worker_handshake (&self->workers[i], cancellable,
+                                               error);
+      if (hello == NULL)
+        {
+          chatbot_remote_worker_stop (&self->workers[i], TRUE);
+          ret = FALSE;
+          continue;
+        }
+
+      if (i == 0)
+        ret = chatbot_remote_tool_parse_hello (self, hello, error);
+      g_variant_unref (hello);
+      g_async_queue_push (self->idle_workers, &self->workers[i]);
+    }
+
+  return ret;
+}
+
+static void
+chatbot_remote_tool_initable_iface_init (GInitableIface *iface)
+{
+  chatbot_remote_tool_initable_parent_iface
+      = g_type_interface_peek_parent (iface);
+  iface->init = chatbot_remote_tool_initable_init;
+}
+
+static const ChatbotToolFunction *const *
+chatbot_remote_tool_get_function_definitions (ChatbotTool *tool)
+{
+  ChatbotRemoteTool *self = CHATBOT_REMOTE_TOOL (tool);
+  return (const ChatbotToolFunction *const *)self->functions;
+}
+
+static GVariantDict *
+chatbot_remote_tool_call_function_args (ChatbotTool *tool,
+                                        const ChatbotToolFunction *function,
+                                        GVariant *const *args,
+                                        ChatbotLanguageModel *language_model,
+                                        GCancellable *cancellable,
+                                        GError **error)
+{
+  ChatbotRemoteTool *self = CHATBOT_REMOTE_TOOL (tool);
+  ChatbotRemoteWorker *worker;
+  ChatbotRemoteMessage message;
+  GVariantBuilder parameters;
+  GVariant *reply = NULL;
+  GVariantDict *result = NULL;
+  GError *local_error = NULL;
+
+  g_variant_builder_init (&parameters, G_VARIANT_TYPE_VARDICT);
+  for (gsize i = 0; function->input_schemas && function->input_schemas[i];
+       i++)
+    g_variant_builder_add (&parameters, "{sv}",
+                           function->input_schemas[i]->name, args[i]);
+
+  worker = g_async_queue_pop (self->idle_workers);
+  if ((worker->socket == NULL)
+      && !chatbot_remote_worker_restart (self, worker, cancellable, error))
+    {
+      g_variant_builder_clear (&parameters);
+      goto cleanup;
+    }
+
+  if (chatbot_remote_send (worker->socket, CHATBOT_REMOTE_MESSAGE_CALL,
+                           g_variant_new ("(sa{sv})", function->name,
+                                          &parameters),
+                           cancellable, &local_error)
+      && chatbot_remote_worker_wait_reply (
+          worker, g_atomic_int_get (&self->call_timeout), cancellable,
+          &local_error))
+    reply = chatbot_remote_receive (worker->socket, &message, cancellable,
+                                    &local_error);
+
+  if (reply == NULL)
+    {
+      // The worker crashed, stalled, or is left in the middle of the call.
+      chatbot_remote_worker_stop (worker, TRUE);
+      g_propagate_prefixed_error (error, local_error,
+                                  "Tool worker of \"%s\" failed: ",
+                                  self->module_path);
+      goto cleanup;
+    }
+
+  if (message == CHATBOT_REMOTE_MESSAGE_RESULT)
+    {
+      GVariant *dict;
+      g_variant_get (reply, "(@a{sv})", &dict);
+      result = g_variant_dict_new (dict);
+      g_variant_unref (dict);
+    }
+  else if (message == CHATBOT_REMOTE_MESSAGE_ERROR)
+    {
+      const gchar *domain, *error_message;
+      gint code;
+      g_variant_get (reply, "(&si&s)", &domain, &code, &error_message);
+      g_set_error_literal (error, g_quark_from_string (domain), code,
+                           error_message);
+    }
+  else
+    {
+      chatbot_remote_worker_stop (worker, TRUE);
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Tool worker of \"%s\" sent unexpected message %u.",
+                   self->module_path, message);
+    }
+
+cleanup:
+  g_clear_pointer (&reply, g_variant_unref);
+  g_async_queue_push (self->idle_workers, worker);
+  return result;
+}
+
+static void
+chatbot_remote_tool_tool_iface_init (ChatbotToolInterface *iface)
+{
+  iface->get_function_definitions
+      = chatbot_remote_tool_get_function_definitions;
+  iface->call_function_args = chatbot_remote_tool_call_function_args;
+}
+
+static const gchar *
+chatbot_remote_tool_get_name (ChatbotModule *module)
+{
+  return CHATBOT_REMOTE_TOOL (module)->name;
+}
+
+static const gchar *
+chatbot_remote_tool_get_description (ChatbotModule *module)
+{
+  return CHATBOT_REMOTE_TOOL (module)->description;
+}
+
+static void
+chatbot_remote_tool_set_property (GObject *object, guint property_id,
+                                  const GValue *value, GParamSpec *pspec)
+{
+  ChatbotRemoteTool *self = CHATBOT_REMOTE_TOOL (object);
+
+  switch (property_id)
+    {
+    case PROP_WORKER_PATH:
+      g_free (self->worker_path);
+      self->worker_path = g_value_dup_string (value);
+      break;
+    case PROP_MODULE_PATH:
+      g_free (self->module_path);
+      self->module_path = g_value_dup_string (value);
+      break;
+    case PROP_MODULE_PARAMETER:
+      g_free (self->module_parameter);
+      self->module_parameter = g_value_dup_string (value);
+      break;
+    case PROP_N_WORKERS:
+      self->n_workers = g_value_get_uint (value);
+      break;
+    case PROP_CALL_TIMEOUT:
+      g_atomic_int_set (&self->call_timeout, g_value_get_uint (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_remote_tool_get_property (GObject *object, guint property_id,
+                                  GValue *value, GParamSpec *pspec)
+{
+  ChatbotRemoteTool *self = CHATBOT_REMOTE_TOOL (object);
+
+  switch (property_id)
+    {
+    case PROP_WORKER_PATH:
+      g_value_set_string (value, self->worker_path);
+      break;
+    case PROP_MODULE_PATH:
+      g_value_set_string (value, self->module_path);
+      break;
+    case PROP_MODULE_PARAMETER:
+      g_value_set_string (value, self->module_parameter);
+      break;
+    case PROP_N_WORKERS:
+      g_value_set_uint (value, self->n_workers);
+      break;
+    case PROP_CALL_TIMEOUT:
+      g_value_set_uint (value, g_atomic_int_get (&self->call_timeout));
+      break;
+    case PROP_FUNCTIONS:
+      g_value_take_boxed (
+          value, chatbot_tool_dup_function_definitions (CHATBOT_TOOL (self)));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_remote_tool_dispose (GObject *object)
+{
+  ChatbotRemoteTool *self = CHATBOT_REMOTE_TOOL (object);
+
+  // Calls are drained before the tool is released, so killing the workers
+  // only avoids waiting for one stuck in a call.
+  for (guint i = 0; self->workers && (i < self->n_workers); i++)
+    chatbot_remote_worker_stop (&self->workers[i], TRUE);
+
+  G_OBJECT_CLASS (chatbot_remote_tool_parent_class)->dispose (object);
+}
+
+static void
+chatbot_remote_tool_finalize (GObject *object)
+{
+  ChatbotRemoteTool *self = CHATBOT_REMOTE_TOOL (object);
+
+  for (ChatbotToolFunction **i = self->functions; i && *i; i++)
+    chatbot_tool_function_unref (*i);
+  g_free (self->functions);
+  g_async_queue_unref (self->idle_workers);
+  g_free (self->workers);
+  g_free (self->name);
+  g_free (self->description);
+  g_free (self->module_parameter);
+  g_free (self->module_path);
+  g_free (self->worker_path);
+
+  G_OBJECT_CLASS (chatbot_remote_tool_parent_class)->finalize (object);
+}
+
+static void
+chatbot_remote_tool_class_init (ChatbotRemoteToolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ChatbotModuleClass *module_class = CHATBOT_MODULE_CLASS (klass);
+
+  object_class->set_property = chatbot_remote_tool_set_property;
+  object_class->get_property = chatbot_remote_tool_get_property;
+  object_class->dispose = chatbot_remote_tool_dispose;
+  object_class->finalize = chatbot_remote_tool_finalize;
+
+  module_class->get_name = chatbot_remote_tool_get_name;
+  module_class->get_description = chatbot_remote_tool_get_description;
+
+  /**
+   * ChatbotRemoteTool:worker-path:
+   *
+   * Worker executable which serves the tool module.
+   */
+  properties[PROP_WORKER_PATH] = g_param_spec_string (
+      "worker-path", "worker-path", "worker executable",
+      "chatbot-tool-worker",
+      G_PARAM_CONSTRUCT | G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  /**
+   * ChatbotRemoteTool:module-path:
+   *
+   * Tool module workers load.
+   */
+  properties[PROP_MODULE_PATH] = g_param_spec_string (
+      "module-path", "module-path", "tool module path", NULL,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  /**
+   * ChatbotRemoteTool:module-parameter:
+   *
+   * Parameter of the tool module.
+   */
+  properties[PROP_MODULE_PARAMETER] = g_param_spec_string (
+      "module-parameter", "module-parameter", "tool module parameter", "",
+      G_PARAM_CONSTRUCT | G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  /**
+   * ChatbotRemoteTool:n-workers:
+   *
+   * Number of worker processes. Calls more than this number wait until a
+   * worker is available.
+   */
+  properties[PROP_N_WORKERS] = g_param_spec_uint (
+      "n-workers", "n-workers", "number of workers", 1, G_MAXUINT16, 1,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  /**
+   * ChatbotRemoteTool:call-timeout:
+   *
+   * Milliseconds a call waits for the worker to reply, or for a respawned
+   * worker to load the module. The worker of a call which doesn't reply in
+   * time is killed, and the call fails with %G_IO_ERROR_TIMED_OUT. 0 waits
+   * forever.
+   */
+  properties[PROP_CALL_TIMEOUT] = g_param_spec_uint (
+      "call-timeout", "call-timeout", "call timeout in milliseconds", 0,
+      G_MAXUINT, 60000, G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+  g_object_class_override_property (object_class, PROP_FUNCTIONS,
+                                    "functions");
+}
+
+static void
+chatbot_remote_tool_init (ChatbotRemoteTool *self)
+{
+  self->idle_workers = g_async_queue_new ();
+}
+
+/**
+ * chatbot_remote_tool_new:
+ * @worker_path: (nullable): worker executable, or %NULL to use
+ * "chatbot-tool-worker" in `PATH`
+ * @module_path: tool module path
+ * @module_parameter: (nullable): parameter of the tool module
+ * @n_workers: number of worker processes
+ * @cancellable: (nullable): cancellable to cancel waiting for workers
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Spawn workers of the tool module and wait until all of them are ready.
+ *
+ * Returns: (transfer full) (nullable): newly created proxy, or %NULL if
+ * workers failed to start.
+ */
+ChatbotRemoteTool *
+chatbot_remote_tool_new (const gchar *worker_path, const gchar *module_path,
+                         const gchar *module_parameter, guint n_workers,
+                         GCancellable *cancellable, GError **error)
+{
+  g_return_val_if_fail (module_path != NULL, NULL);
+  g_return_val_if_fail (n_workers > 0, NULL);
+
+  return g_initable_new (
+      CHATBOT_TYPE_REMOTE_TOOL, cancellable, error, "raw_parameter", "",
+      "worker-path", worker_path ? worker_path : "chatbot-tool-worker",
+      "module-path", module_path, "module-parameter",
+      module_parameter ? module_parameter : "", "n-workers", n_workers, NULL);
+}
+
+/**
+ * chatbot_remote_tool_get_n_workers: (get-property n-workers)
+ *
+ * Returns: number of worker processes
+ */
+guint
+chatbot_remote_tool_get_n_workers (ChatbotRemoteTool *remote_tool)
+{
+  g_return_val_if_fail (CHATBOT_IS_REMOTE_TOOL (remote_tool), 0);
+  return remote_tool->n_workers;
+}
+
+/**
+ * chatbot_remote_tool_serve:
+ * @tool: tool to serve
+ * @socket: socket connected to [class@RemoteTool]
+ * @cancellable: (nullable): cancellable to stop serving
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Serve calls from [class@RemoteTool] until the connection is closed. This is
+ * the main loop of worker processes.
+ *
+ * Returns: %TRUE if the peer closed the connection, %FALSE on failure.
+ */
+gboolean
+chatbot_remote_tool_serve (ChatbotTool *tool, GSocket *socket,
+                           GCancellable *cancellable, GError **error)
+{
+  GError *local_error = NULL;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL (tool), FALSE);
+  g_return_val_if_fail (G_IS_SOCKET (socket), FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  if (!chatbot_remote_send (socket, CHATBOT_REMOTE_MESSAGE_HELLO,
+                            chatbot_remote_hello_new (tool), cancellable,
+                            error))
+    return FALSE;
+
+  while (TRUE)
+    {
+      ChatbotRemoteMessage message;
+      GVariant *request, *parameters;
+      GVariantDict *dict, *result;
+      const gchar *function_name;
+      GError *call_error = NULL;
+      gboolean sent;
+
+      request = chatbot_remote_receive (socket, &message, cancellable,
+                                        &local_error);
+      if (request == NULL)
+        {
+          if (g_error_matches (local_error, G_IO_ERROR,
+                               G_IO_ERROR_CONNECTION_CLOSED))
+            {
+              g_error_free (local_error);
+              return TRUE;
+            }
+          g_propagate_error (error, local_error);
+          return FALSE;
+        }
+      if (message != CHATBOT_REMOTE_MESSAGE_CALL)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Received unexpected message %u.", message);
+          g_variant_unref (request);
+          return FALSE;
+        }
+
+      g_variant_get (request, "(&s@a{sv})", &function_name, &parameters);
+      dict = g_variant_dict_new (parameters);
+      result = chatbot_tool_call_function (tool, function_name, dict, NULL,
+                                           cancellable, &call_error);
+      if (result)
+        {
+          sent = chatbot_remote_send (
+              socket, CHATBOT_REMOTE_MESSAGE_RESULT,
+              g_variant_new ("(@a{sv})", g_variant_dict_end (result)),
+              cancellable, error);
+          g_variant_dict_unref (result);
+        }
+      else
+        {
+          if (call_error == NULL)
+            g_set_error (&call_error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                         "Function \"%s\" returned no result.",
+                         function_name);
+          sent = chatbot_remote_send (
+              socket, CHATBOT_REMOTE_MESSAGE_ERROR,
+              g_variant_new ("(sis)", g_quark_to_string (call_error->domain),
+                             call_error->code, call_error->message),
+              cancellable, error);
+          g_error_free (call_error);
+        }
+
+      g_variant_dict_unref (dict);
+      g_variant_unref (parameters);
+      g_variant_unref (request);
+      if (!sent)
+        return FALSE;
+    }
+}
@@ -0,0 +1,40 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gio/gio.h>
+#include <glib-object.h>
+
+#include "chatbot-module.h"
+#include "chatbot-tool.h"
+
+G_BEGIN_DECLS
+
+#define CHATBOT_TYPE_REMOTE_TOOL chatbot_remote_tool_get_type ()
+G_DECLARE_FINAL_TYPE (ChatbotRemoteTool, chatbot_remote_tool, CHATBOT,
+                      REMOTE_TOOL, ChatbotModule);
+
+ChatbotRemoteTool *chatbot_remote_tool_new (const gchar *worker_path,
+                                            const gchar *module_path,
+                                            const gchar *module_parameter,
+                                            guint n_workers,
+                                            GCancellable *cancellable,
+                                            GError **error);
+guint chatbot_remote_tool_get_n_workers (ChatbotRemoteTool *remote_tool);
+gboolean chatbot_remote_tool_serve (ChatbotTool *tool, GSocket *socket,
+                                    GCancellable *cancellable,
+                                    GError **error);
+
+G_END_DECLS
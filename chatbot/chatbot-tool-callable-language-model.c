@@ -21,16 +21,76 @@
  * Implementers are responsible for following things:
  *
  * 1. Supply appropriate prompt to describe tool usage via system role.
+ * [class@ToolRenderer] can be used to render function definitions once and
+ * reuse them until tools change.
  *
  * 2. Make [method@ChatbotLanguageModel.generate] to handle tool calling.
  */
 
 #include "chatbot-tool-callable-language-model.h"
 
+enum
+{
+  FUNCTIONS_CHANGED,
+  N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+// Tool added with add_tool() and its forwarded "functions-changed" handler.
+typedef struct
+{
+  ChatbotTool *tool;
+  gulong handler_id;
+} ChatbotToolCallableLanguageModelTool;
+
+G_DEFINE_QUARK (chatbot-tool-callable-language-model-tools,
+                chatbot_tool_callable_language_model_tools);
+
 G_DEFINE_INTERFACE (ChatbotToolCallableLanguageModel,
                     chatbot_tool_callable_language_model,
                     CHATBOT_TYPE_LANGUAGE_MODEL);
 
+static void
+chatbot_tool_callable_language_model_tool_free (gpointer data)
+{
+  ChatbotToolCallableLanguageModelTool *added = data;
+
+  if (g_signal_handler_is_connected (added->tool, added->handler_id))
+    g_signal_handler_disconnect (added->tool, added->handler_id);
+  g_object_unref (added->tool);
+  g_free (added);
+}
+
+static GHashTable *
+chatbot_tool_callable_language_model_get_tools (
+    ChatbotToolCallableLanguageModel *language_model)
+{
+  GHashTable *tools;
+
+  tools = g_object_get_qdata (
+      G_OBJECT (language_model),
+      chatbot_tool_callable_language_model_tools_quark ());
+  if (tools == NULL)
+    {
+      tools = g_hash_table_new_full (
+          g_str_hash, g_str_equal, g_free,
+          chatbot_tool_callable_language_model_tool_free);
+      g_object_set_qdata_full (
+          G_OBJECT (language_model),
+          chatbot_tool_callable_language_model_tools_quark (), tools,
+          (GDestroyNotify)g_hash_table_unref);
+    }
+  return tools;
+}
+
+static void
+chatbot_tool_callable_language_model_functions_changed (
+    ChatbotToolCallableLanguageModel *language_model)
+{
+  g_signal_emit (language_model, signals[FUNCTIONS_CHANGED], 0);
+}
+
 static void
 chatbot_tool_callable_language_model_default_init (
     ChatbotToolCallableLanguageModelInterface *iface)
@@ -46,6 +106,17 @@ chatbot_tool_callable_language_model_default_init (
   g_object_interface_install_property (
       iface, g_param_spec_boxed ("tools", "tools", "External tools",
                                  G_TYPE_PTR_ARRAY, G_PARAM_READABLE));
+
+  /**
+   * ChatbotToolCallableLanguageModel::functions-changed:
+   *
+   * Emitted when functions the language model can call changed, that is a
+   * tool is added or removed, or [signal@Tool::functions-changed] of a tool
+   * added with [method@ToolCallableLanguageModel.add_tool] is emitted.
+   */
+  signals[FUNCTIONS_CHANGED] = g_signal_new (
+      "functions-changed", CHATBOT_TYPE_TOOL_CALLABLE_LANGUAGE_MODEL,
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
 }
 
 /**
@@ -53,7 +124,9 @@ chatbot_tool_callable_language_model_default_init (
  * @tool: tool to add
  * @error: (nullable): pointer to the #GError* to store the error
  *
- * Add tool to the language model
+ * Add tool to the language model.
+ * [signal@ToolCallableLanguageModel::functions-changed] is emitted if the
+ * tool is added.
  *
  * Returns: TRUE if tool is added, and FALSE if it's not added.
  */
@@ -63,6 +136,8 @@ chatbot_tool_callable_language_model_add_tool (
     GError **error)
 {
   ChatbotToolCallableLanguageModelInterface *iface;
+  ChatbotToolCallableLanguageModelTool *added;
+  const gchar *name;
 
   g_return_val_if_fail (
       CHATBOT_IS_TOOL_CALLABLE_LANGUAGE_MODEL (language_model), FALSE);
@@ -70,14 +145,35 @@ chatbot_tool_callable_language_model_add_tool (
   g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
   iface = CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL_GET_IFACE (language_model);
   g_return_val_if_fail (iface->add_tool != NULL, FALSE);
-  return iface->add_tool (language_model, tool, error);
+  if (!iface->add_tool (language_model, tool, error))
+    return FALSE;
+
+  name = chatbot_module_get_name (CHATBOT_MODULE (tool));
+  added = g_new (ChatbotToolCallableLanguageModelTool, 1);
+  added->tool = g_object_ref (tool);
+  added->handler_id = g_signal_connect_object (
+      tool, "functions-changed",
+      G_CALLBACK (chatbot_tool_callable_language_model_functions_changed),
+      language_model, G_CONNECT_SWAPPED);
+  g_hash_table_replace (
+      chatbot_tool_callable_language_model_get_tools (language_model),
+      g_strdup (name ? name : ""), added);
+
+  chatbot_tool_callable_language_model_functions_changed (
+      language_model);
+  return TRUE;
 }
 
 /**
  * chatbot_tool_callable_language_model_remove_tool:
  * @tool_name: tool name to remove
  *
- * Remove tool from the language model
+ * Remove tool from the language model.
+ * [signal@ToolCallableLanguageModel::functions-changed] is emitted if the
+ * tool is removed.
+ *
+ * In-flight calls of the removed tool may still be running. Wait for them
+ * with [method@Tool.drain] before releasing the tool.
  *
  * Returns: TRUE if tool is removed, and FALSE if it's not removed.
  */
@@ -91,6 +187,14 @@ chatbot_tool_callable_language_model_remove_tool (
       CHATBOT_IS_TOOL_CALLABLE_LANGUAGE_MODEL (language_model), FALSE);
   g_return_val_if_fail (tool_name != NULL, FALSE);
   iface = CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL_GET_IFACE (language_model);
-  g_return_val_if_fail (iface->add_tool != NULL, FALSE);
-  return iface->remove_tool (language_model, tool_name);
+  g_return_val_if_fail (iface->remove_tool != NULL, FALSE);
+  if (!iface->remove_tool (language_model, tool_name))
+    return FALSE;
+
+  g_hash_table_remove (
+      chatbot_tool_callable_language_model_get_tools (language_model),
+      tool_name);
+  chatbot_tool_callable_language_model_functions_changed (
+      language_model);
+  return TRUE;
 }
@@ -0,0 +1,422 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * ChatbotToolRenderer:
+ *
+ * Renders function definitions of tools into a prompt block.
+ *
+ * This is a helper for [iface@ToolCallableLanguageModel] implementers. The
+ * prompt is rendered at the first [method@ToolRenderer.dup_prompt] and kept
+ * until a tool is added or removed, or [signal@Tool::functions-changed] is
+ * emitted. Functions are sorted by name, so the same set of tools always
+ * renders the same prompt regardless of the order they are added.
+ *
+ * [method@ToolRenderer.dup_hash] is the SHA-256 of the prompt. It can be used
+ * as a key to reuse the model state prefilled with the prompt across
+ * sessions.
+ *
+ * Tools may emit [signal@Tool::functions-changed] from any thread, so the
+ * renderer is guarded by a mutex and returns copies of the prompt and the
+ * hash. [signal@ToolRenderer::changed] is emitted in the thread which
+ * invalidated the prompt.
+ *
+ * Default format is one JSON object per function:
+ *
+ * {"name": ..., "description": ..., "parameters": [...], "returns": [...]}
+ *
+ * where each parameter is {"name": ..., "description": ..., "type": ...}.
+ */
+
+#include "chatbot-tool-renderer.h"
+
+struct _ChatbotToolRenderer
+{
+  GObject parent_instance;
+
+  GMutex mutex; // guards the fields below
+  GPtrArray *tools;
+  ChatbotToolRenderFunc render_func;
+  gpointer render_func_data;
+  GDestroyNotify render_func_destroy;
+
+  gchar *prompt;
+  gchar *hash;
+};
+
+enum
+{
+  CHANGED,
+  N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+G_DEFINE_TYPE (ChatbotToolRenderer, chatbot_tool_renderer, G_TYPE_OBJECT);
+
+static void
+chatbot_tool_renderer_append_json_string (GString *prompt, const gchar *text)
+{
+  g_string_append_c (prompt, '"');
+  for (const gchar *c = text ? text : ""; *c; c++)
+    {
+      switch (*c)
+        {
+        case '"':
+          g_string_append (prompt, "\\\"");
+          break;
+        case '\\':
+          g_string_append (prompt, "\\\\");
+          break;
+        case '\n':
+          g_string_append (prompt, "\\n");
+          break;
+        case '\r':
+          g_string_append (prompt, "\\r");
+          break;
+        case '\t':
+          g_string_append (prompt, "\\t");
+          break;
+        default:
+          if ((guchar)*c < 0x20)
+            g_string_append_printf (prompt, "\\u%04x", (guint)(guchar)*c);
+          else
+            g_string_append_c (prompt, *c);
+          break;
+        }
+    }
+  g_string_append_c (prompt, '"');
+}
+
+static void
+chatbot_tool_renderer_append_args (GString *prompt, ChatbotToolArg **args)
+{
+  g_string_append_c (prompt, '[');
+  for (gsize i = 0; args && args[i]; i++)
+    {
+      if (i != 0)
+        g_string_append (prompt, ", ");
+      g_string_append (prompt, "{\"name\": ");
+      chatbot_tool_renderer_append_json_string (prompt, args[i]->name);
+      g_string_append (prompt, ", \"description\": ");
+      chatbot_tool_renderer_append_json_string (prompt, args[i]->description);
+      g_string_append (prompt, ", \"type\": ");
+      chatbot_tool_renderer_append_json_string (prompt, args[i]->type);
+      g_string_append_c (prompt, '}');
+    }
+  g_string_append_c (prompt, ']');
+}
+
+static void
+chatbot_tool_renderer_render_json (const ChatbotToolFunction *function,
+                                   GString *prompt, gpointer user_data)
+{
+  g_string_append (prompt, "{\"name\": ");
+  chatbot_tool_renderer_append_json_string (prompt, function->name);
+  g_string_append (prompt, ", \"description\": ");
+  chatbot_tool_renderer_append_json_string (prompt, function->description);
+  g_string_append (prompt, ", \"parameters\": ");
+  chatbot_tool_renderer_append_args (prompt, function->input_schemas);
+  g_string_append (prompt, ", \"returns\": ");
+  chatbot_tool_renderer_append_args (prompt, function->output_schemas);
+  g_string_append (prompt, "}\n");
+}
+
+static gint
+chatbot_tool_renderer_compare_functions (gconstpointer a, gconstpointer b)
+{
+  const ChatbotToolFunction *fa = *(const ChatbotToolFunction *const *)a;
+  const ChatbotToolFunction *fb = *(const ChatbotToolFunction *const *)b;
+  gint ret = g_strcmp0 (fa->name, fb->name);
+  return ret ? ret : g_strcmp0 (fa->description, fb->description);
+}
+
+/*
+ * Drops the rendered prompt. Called with the mutex held, and returns whether
+ * "changed" should be emitted after unlocking it.
+ */
+static gboolean
+chatbot_tool_renderer_invalidate_locked (ChatbotToolRenderer *renderer)
+{
+  gboolean rendered = renderer->prompt != NULL;
+
+  g_clear_pointer (&renderer->prompt, g_free);
+  g_clear_pointer (&renderer->hash, g_free);
+  return rendered;
+}
+
+static void
+chatbot_tool_renderer_invalidate (ChatbotToolRenderer *renderer)
+{
+  gboolean rendered;
+
+  g_mutex_lock (&renderer->mutex);
+  rendered = chatbot_tool_renderer_invalidate_locked (renderer);
+  g_mutex_unlock (&renderer->mutex);
+  if (rendered)
+    g_signal_emit (renderer, signals[CHANGED], 0);
+}
+
+static void
+chatbot_tool_renderer_functions_changed (ChatbotTool *tool,
+                                         ChatbotToolRenderer *renderer)
+{
+  chatbot_tool_renderer_invalidate (renderer);
+}
+
+static void
+chatbot_tool_renderer_disconnect_tool (gpointer tool, gpointer renderer)
+{
+  g_signal_handlers_disconnect_by_func (
+      tool, chatbot_tool_renderer_functions_changed, renderer);
+}
+
+static void
+chatbot_tool_renderer_dispose (GObject *object)
+{
+  ChatbotToolRenderer *renderer = CHATBOT_TOOL_RENDERER (object);
+
+  if (renderer->tools)
+    g_ptr_array_foreach (renderer->tools,
+                         chatbot_tool_renderer_disconnect_tool, renderer);
+  g_clear_pointer (&renderer->tools, g_ptr_array_unref);
+  if (renderer->render_func_destroy)
+    renderer->render_func_destroy (renderer->render_func_data);
+  renderer->render_func_destroy = NULL;
+  renderer->render_func_data = NULL;
+
+  G_OBJECT_CLASS (chatbot_tool_renderer_parent_class)->dispose (object);
+}
+
+static void
+chatbot_tool_renderer_finalize (GObject *object)
+{
+  ChatbotToolRenderer *renderer = CHATBOT_TOOL_RENDERER (object);
+
+  g_free (renderer->prompt);
+  g_free (renderer->hash);
+  g_mutex_clear (&renderer->mutex);
+
+  G_OBJECT_CLASS (chatbot_tool_renderer_parent_class)->finalize (object);
+}
+
+static void
+chatbot_tool_renderer_class_init (ChatbotToolRendererClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = chatbot_tool_renderer_dispose;
+  object_class->finalize = chatbot_tool_renderer_finalize;
+
+  /**
+   * ChatbotToolRenderer::changed:
+   * @renderer: renderer instance
+   *
+   * Emits when the rendered prompt is invalidated. Model state prefilled with
+   * the previous prompt should not be reused after this.
+   */
+  signals[CHANGED]
+      = g_signal_new ("changed", CHATBOT_TYPE_TOOL_RENDERER, G_SIGNAL_RUN_LAST,
+                      0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+}
+
+static void
+chatbot_tool_renderer_init (ChatbotToolRenderer *renderer)
+{
+  g_mutex_init (&renderer->mutex);
+  renderer->tools = g_ptr_array_new_with_free_func (g_object_unref);
+  renderer->render_func = chatbot_tool_renderer_render_json;
+}
+
+/**
+ * chatbot_tool_renderer_new:
+ *
+ * Returns: (transfer full): newly created renderer without tools
+ */
+ChatbotToolRenderer *
+chatbot_tool_renderer_new (void)
+{
+  return g_object_new (CHATBOT_TYPE_TOOL_RENDERER, NULL);
+}
+
+/**
+ * chatbot_tool_renderer_set_render_func:
+ * @func: (nullable) (scope notified) (closure user_data): function to render
+ * each function definition, or %NULL to use default format
+ * @user_data: user data of @func
+ * @destroy: (nullable): function to free @user_data
+ *
+ * Set model specific format of function definitions. @func is called with
+ * the renderer locked, so it must not call the renderer.
+ */
+void
+chatbot_tool_renderer_set_render_func (ChatbotToolRenderer *renderer,
+                                       ChatbotToolRenderFunc func,
+                                       gpointer user_data,
+                                       GDestroyNotify destroy)
+{
+  GDestroyNotify old_destroy;
+  gpointer old_data;
+  gboolean rendered;
+
+  g_return_if_fail (CHATBOT_IS_TOOL_RENDERER (renderer));
+
+  g_mutex_lock (&renderer->mutex);
+  old_destroy = renderer->render_func_destroy;
+  old_data = renderer->render_func_data;
+  renderer->render_func = func ? func : chatbot_tool_renderer_render_json;
+  renderer->render_func_data = func ? user_data : NULL;
+  renderer->render_func_destroy = func ? destroy : NULL;
+  rendered = chatbot_tool_renderer_invalidate_locked (renderer);
+  g_mutex_unlock (&renderer->mutex);
+
+  if (old_destroy)
+    old_destroy (old_data);
+  if (rendered)
+    g_signal_emit (renderer, signals[CHANGED], 0);
+}
+
+/**
+ * chatbot_tool_renderer_add_tool:
+ * @tool: tool to render
+ *
+ * Add tool to the prompt.
+ */
+void
+chatbot_tool_renderer_add_tool (ChatbotToolRenderer *renderer,
+                                ChatbotTool *tool)
+{
+  gboolean rendered;
+
+  g_return_if_fail (CHATBOT_IS_TOOL_RENDERER (renderer));
+  g_return_if_fail (CHATBOT_IS_TOOL (tool));
+
+  g_mutex_lock (&renderer->mutex);
+  g_ptr_array_add (renderer->tools, g_object_ref (tool));
+  rendered = chatbot_tool_renderer_invalidate_locked (renderer);
+  g_mutex_unlock (&renderer->mutex);
+
+  g_signal_connect (tool, "functions-changed",
+                    G_CALLBACK (chatbot_tool_renderer_functions_changed),
+                    renderer);
+  if (rendered)
+    g_signal_emit (renderer, signals[CHANGED], 0);
+}
+
+/**
+ * chatbot_tool_renderer_remove_tool:
+ * @tool: tool to remove
+ *
+ * Remove tool from the prompt.
+ *
+ * Returns: %TRUE if @tool is removed, %FALSE if @tool is not added.
+ */
+gboolean
+chatbot_tool_renderer_remove_tool (ChatbotToolRenderer *renderer,
+                                   ChatbotTool *tool)
+{
+  gboolean rendered;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL_RENDERER (renderer), FALSE);
+  g_return_val_if_fail (CHATBOT_IS_TOOL (tool), FALSE);
+
+  chatbot_tool_renderer_disconnect_tool (tool, renderer);
+  g_mutex_lock (&renderer->mutex);
+  if (!g_ptr_array_remove (renderer->tools, tool))
+    {
+      g_mutex_unlock (&renderer->mutex);
+      return FALSE;
+    }
+  rendered = chatbot_tool_renderer_invalidate_locked (renderer);
+  g_mutex_unlock (&renderer->mutex);
+
+  if (rendered)
+    g_signal_emit (renderer, signals[CHANGED], 0);
+  return TRUE;
+}
+
+/* Renders the prompt if it's not rendered yet. Called with the mutex held. */
+static void
+chatbot_tool_renderer_ensure_locked (ChatbotToolRenderer *renderer)
+{
+  GPtrArray *functions;
+  GString *prompt;
+
+  if (renderer->prompt)
+    return;
+
+  // Functions are referenced, so a tool may drop them while rendering.
+  functions = g_ptr_array_new_with_free_func (
+      (GDestroyNotify)chatbot_tool_function_unref);
+  for (guint i = 0; i < renderer->tools->len; i++)
+    {
+      GPtrArray *definitions = chatbot_tool_dup_function_definitions (
+          renderer->tools->pdata[i]);
+      g_ptr_array_extend_and_steal (functions, definitions);
+    }
+  g_ptr_array_sort (functions, chatbot_tool_renderer_compare_functions);
+
+  prompt = g_string_new (NULL);
+  for (guint i = 0; i < functions->len; i++)
+    renderer->render_func (functions->pdata[i], prompt,
+                           renderer->render_func_data);
+  g_ptr_array_unref (functions);
+
+  renderer->prompt = g_string_free (prompt, FALSE);
+  renderer->hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256,
+                                                  renderer->prompt, -1);
+}
+
+/**
+ * chatbot_tool_renderer_dup_prompt:
+ *
+ * Get the prompt block describing all function definitions of the tools.
+ *
+ * Returns: (transfer full): copy of the rendered prompt
+ */
+gchar *
+chatbot_tool_renderer_dup_prompt (ChatbotToolRenderer *renderer)
+{
+  gchar *prompt;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL_RENDERER (renderer), NULL);
+
+  g_mutex_lock (&renderer->mutex);
+  chatbot_tool_renderer_ensure_locked (renderer);
+  prompt = g_strdup (renderer->prompt);
+  g_mutex_unlock (&renderer->mutex);
+  return prompt;
+}
+
+/**
+ * chatbot_tool_renderer_dup_hash:
+ *
+ * Get the hash of [method@ToolRenderer.dup_prompt].
+ *
+ * Returns: (transfer full): hexadecimal SHA-256 of the prompt
+ */
+gchar *
+chatbot_tool_renderer_dup_hash (ChatbotToolRenderer *renderer)
+{
+  gchar *hash;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL_RENDERER (renderer), NULL);
+
+  g_mutex_lock (&renderer->mutex);
+  chatbot_tool_renderer_ensure_locked (renderer);
+  hash = g_strdup (renderer->hash);
+  g_mutex_unlock (&renderer->mutex);
+  return hash;
+}
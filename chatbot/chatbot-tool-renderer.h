@@ -0,0 +1,50 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <glib-object.h>
+
+#include "chatbot-tool.h"
+
+G_BEGIN_DECLS
+
+#define CHATBOT_TYPE_TOOL_RENDERER chatbot_tool_renderer_get_type ()
+G_DECLARE_FINAL_TYPE (ChatbotToolRenderer, chatbot_tool_renderer, CHATBOT,
+                      TOOL_RENDERER, GObject);
+
+/**
+ * ChatbotToolRenderFunc:
+ * @function: function definition to render
+ * @prompt: string to append rendered @function
+ * @user_data: user data
+ *
+ * Renders a function definition in model specific format.
+ */
+typedef void (*ChatbotToolRenderFunc) (const ChatbotToolFunction *function,
+                                       GString *prompt, gpointer user_data);
+
+ChatbotToolRenderer *chatbot_tool_renderer_new (void);
+void chatbot_tool_renderer_set_render_func (ChatbotToolRenderer *renderer,
+                                            ChatbotToolRenderFunc func,
+                                            gpointer user_data,
+                                            GDestroyNotify destroy);
+void chatbot_tool_renderer_add_tool (ChatbotToolRenderer *renderer,
+                                     ChatbotTool *tool);
+gboolean chatbot_tool_renderer_remove_tool (ChatbotToolRenderer *renderer,
+                                            ChatbotTool *tool);
+gchar *chatbot_tool_renderer_dup_prompt (ChatbotToolRenderer *renderer);
+gchar *chatbot_tool_renderer_dup_hash (ChatbotToolRenderer *renderer);
+
+G_END_DECLS
@@ -0,0 +1,376 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * ChatbotToolStream:
+ *
+ * Channel to deliver tool result incrementally.
+ *
+ * Tool writes its output with [method@ToolStream.write] as it's produced, and
+ * the consumer receives each piece with [signal@ToolStream::chunk]. The
+ * consumer can stop the tool by returning %FALSE from the signal, or by
+ * setting [property@ToolStream:max-bytes]. Once the stream is stopped,
+ * [method@ToolStream.write] returns %FALSE and the cancellable given to the
+ * tool is cancelled, so the tool should finish as soon as possible.
+ *
+ * [method@ToolStream.connect_language_model] makes each chunk prefilled to
+ * the model as it arrives.
+ */
+
+#include "chatbot-tool-stream.h"
+
+struct _ChatbotToolStream
+{
+  GObject parent_instance;
+
+  guint64 max_bytes;
+  guint64 n_bytes;
+  GCancellable *cancellable;
+  // Stopping can come from the thread of a cancelled call.
+  GMutex mutex;
+  GError *error;    // protected by mutex
+  gboolean stopped; // protected by mutex
+};
+
+enum
+{
+  PROP_MAX_BYTES = 1,
+  N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES] = {
+  NULL,
+};
+
+enum
+{
+  CHUNK,
+  N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+G_DEFINE_TYPE (ChatbotToolStream, chatbot_tool_stream, G_TYPE_OBJECT);
+
+static void
+chatbot_tool_stream_set_property (GObject *object, guint property_id,
+                                  const GValue *value, GParamSpec *pspec)
+{
+  ChatbotToolStream *stream = CHATBOT_TOOL_STREAM (object);
+
+  switch (property_id)
+    {
+    case PROP_MAX_BYTES:
+      stream->max_bytes = g_value_get_uint64 (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_tool_stream_get_property (GObject *object, guint property_id,
+                                  GValue *value, GParamSpec *pspec)
+{
+  ChatbotToolStream *stream = CHATBOT_TOOL_STREAM (object);
+
+  switch (property_id)
+    {
+    case PROP_MAX_BYTES:
+      g_value_set_uint64 (value, stream->max_bytes);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_tool_stream_dispose (GObject *object)
+{
+  ChatbotToolStream *stream = CHATBOT_TOOL_STREAM (object);
+
+  g_clear_object (&stream->cancellable);
+
+  G_OBJECT_CLASS (chatbot_tool_stream_parent_class)->dispose (object);
+}
+
+static void
+chatbot_tool_stream_finalize (GObject *object)
+{
+  ChatbotToolStream *stream = CHATBOT_TOOL_STREAM (object);
+
+  g_clear_error (&stream->error);
+  g_mutex_clear (&stream->mutex);
+
+  G_OBJECT_CLASS (chatbot_tool_stream_parent_class)->finalize (object);
+}
+
+static void
+chatbot_tool_stream_class_init (ChatbotToolStreamClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->set_property = chatbot_tool_stream_set_property;
+  object_class->get_property = chatbot_tool_stream_get_property;
+  object_class->dispose = chatbot_tool_stream_dispose;
+  object_class->finalize = chatbot_tool_stream_finalize;
+
+  /**
+   * ChatbotToolStream:max-bytes:
+   *
+   * Bytes the consumer accepts, or 0 for unlimited. Output beyond this is
+   * dropped and the stream is stopped.
+   */
+  properties[PROP_MAX_BYTES] = g_param_spec_uint64 (
+      "max-bytes", "max-bytes", "maximum bytes to deliver", 0, G_MAXUINT64,
+      0, G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+  g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+
+  /**
+   * ChatbotToolStream::chunk:
+   * @stream: stream instance
+   * @text: chunk of the tool result
+   *
+   * Emits when the tool writes a chunk.
+   *
+   * Returns: %TRUE if want to receive more chunks, %FALSE to stop the tool.
+   */
+  signals[CHUNK]
+      = g_signal_new ("chunk", CHATBOT_TYPE_TOOL_STREAM, G_SIGNAL_RUN_LAST, 0,
+                      NULL, NULL, NULL, G_TYPE_BOOLEAN, 1, G_TYPE_STRING);
+}
+
+static void
+chatbot_tool_stream_init (ChatbotToolStream *stream)
+{
+  stream->cancellable = g_cancellable_new ();
+  g_mutex_init (&stream->mutex);
+}
+
+/**
+ * chatbot_tool_stream_new:
+ * @max_bytes: bytes the consumer accepts, or 0 for unlimited
+ *
+ * Returns: (transfer full): newly created stream
+ */
+ChatbotToolStream *
+chatbot_tool_stream_new (guint64 max_bytes)
+{
+  return g_object_new (CHATBOT_TYPE_TOOL_STREAM, "max-bytes", max_bytes,
+                       NULL);
+}
+
+/**
+ * chatbot_tool_stream_write:
+ * @text: (array length=length) (element-type guint8): UTF-8 text to deliver
+ * @length: length of @text, or -1 if @text is nul-terminated
+ *
+ * Deliver a chunk of the result to the consumer.
+ *
+ * If the chunk exceeds [property@ToolStream:max-bytes], it's truncated at the
+ * character boundary before the limit.
+ *
+ * Returns: %TRUE if the consumer wants more, %FALSE if the stream is stopped.
+ */
+gboolean
+chatbot_tool_stream_write (ChatbotToolStream *stream, const gchar *text,
+                           gssize length)
+{
+  gboolean keep_going = TRUE;
+  gboolean reached = FALSE;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL_STREAM (stream), FALSE);
+  g_return_val_if_fail (text != NULL, FALSE);
+
+  if (chatbot_tool_stream_is_stopped (stream))
+    return FALSE;
+
+  if (length < 0)
+    length = strlen (text);
+
+  if (stream->max_bytes && (stream->n_bytes + length >= stream->max_bytes))
+    {
+      if (stream->n_bytes + length > stream->max_bytes)
+        {
+          // @end is inside @text here, so it can be read.
+          const gchar *end = text + (stream->max_bytes - stream->n_bytes);
+          // Don't cut a multi-byte character.
+          while ((end > text) && (((guchar)*end & 0xc0) == 0x80))
+            end--;
+          length = end - text;
+        }
+      reached = TRUE;
+    }
+
+  if ((length > 0)
+      && g_signal_has_handler_pending (stream, signals[CHUNK], 0, TRUE))
+    {
+      gchar *chunk = g_strndup (text, length);
+      g_signal_emit (stream, signals[CHUNK], 0, chunk, &keep_going);
+      g_free (chunk);
+    }
+  stream->n_bytes += length;
+
+  if (!keep_going || reached)
+    chatbot_tool_stream_stop (stream, NULL);
+  return !chatbot_tool_stream_is_stopped (stream);
+}
+
+/**
+ * chatbot_tool_stream_stop:
+ * @error: (nullable) (transfer full): reason of the stop, or %NULL if the
+ * consumer just has enough
+ *
+ * Stop the stream and cancel [method@ToolStream.get_cancellable]. Only the
+ * first call takes effect. This can be called from any thread.
+ */
+void
+chatbot_tool_stream_stop (ChatbotToolStream *stream, GError *error)
+{
+  gboolean stopped;
+
+  g_return_if_fail (CHATBOT_IS_TOOL_STREAM (stream));
+
+  g_mutex_lock (&stream->mutex);
+  stopped = stream->stopped;
+  if (!stopped)
+    {
+      stream->stopped = TRUE;
+      stream->error = g_steal_pointer (&error);
+    }
+  g_mutex_unlock (&stream->mutex);
+
+  g_clear_error (&error);
+  if (!stopped)
+    g_cancellable_cancel (stream->cancellable);
+}
+
+/**
+ * chatbot_tool_stream_is_stopped:
+ *
+ * Returns: %TRUE if the stream is stopped
+ */
+gboolean
+chatbot_tool_stream_is_stopped (ChatbotToolStream *stream)
+{
+  gboolean stopped;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL_STREAM (stream), TRUE);
+
+  g_mutex_lock (&stream->mutex);
+  stopped = stream->stopped;
+  g_mutex_unlock (&stream->mutex);
+  return stopped;
+}
+
+/**
+ * chatbot_tool_stream_get_max_bytes: (get-property max-bytes)
+ *
+ * Returns: bytes the consumer accepts, or 0 for unlimited
+ */
+guint64
+chatbot_tool_stream_get_max_bytes (ChatbotToolStream *stream)
+{
+  g_return_val_if_fail (CHATBOT_IS_TOOL_STREAM (stream), 0);
+  return stream->max_bytes;
+}
+
+/**
+ * chatbot_tool_stream_get_n_bytes:
+ *
+ * Returns: bytes delivered to the consumer so far
+ */
+guint64
+chatbot_tool_stream_get_n_bytes (ChatbotToolStream *stream)
+{
+  g_return_val_if_fail (CHATBOT_IS_TOOL_STREAM (stream), 0);
+  return stream->n_bytes;
+}
+
+/**
+ * chatbot_tool_stream_get_cancellable:
+ *
+ * Returns: (transfer none): cancellable which is cancelled when the stream is
+ * stopped
+ */
+GCancellable *
+chatbot_tool_stream_get_cancellable (ChatbotToolStream *stream)
+{
+  g_return_val_if_fail (CHATBOT_IS_TOOL_STREAM (stream), NULL);
+  return stream->cancellable;
+}
+
+/**
+ * chatbot_tool_stream_propagate_error:
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Get the reason the stream is stopped, if it's stopped by an error.
+ *
+ * Returns: %FALSE if the stream is stopped by an error, %TRUE otherwise.
+ */
+gboolean
+chatbot_tool_stream_propagate_error (ChatbotToolStream *stream,
+                                     GError **error)
+{
+  GError *copy = NULL;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL_STREAM (stream), FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  g_mutex_lock (&stream->mutex);
+  if (stream->error)
+    copy = g_error_copy (stream->error);
+  g_mutex_unlock (&stream->mutex);
+
+  if (copy == NULL)
+    return TRUE;
+  g_propagate_error (error, copy);
+  return FALSE;
+}
+
+static gboolean
+chatbot_tool_stream_prefill_chunk (ChatbotToolStream *stream,
+                                   const gchar *text,
+                                   ChatbotLanguageModel *language_model)
+{
+  GError *error = NULL;
+
+  if (chatbot_language_model_prefill (language_model, text, &error))
+    return TRUE;
+  chatbot_tool_stream_stop (stream, error);
+  return FALSE;
+}
+
+/**
+ * chatbot_tool_stream_connect_language_model:
+ * @language_model: language model to prefill chunks
+ *
+ * Prefill each chunk to @language_model as it arrives. If prefill fails, the
+ * stream is stopped with the error.
+ */
+void
+chatbot_tool_stream_connect_language_model (
+    ChatbotToolStream *stream, ChatbotLanguageModel *language_model)
+{
+  g_return_if_fail (CHATBOT_IS_TOOL_STREAM (stream));
+  g_return_if_fail (CHATBOT_IS_LANGUAGE_MODEL (language_model));
+
+  g_signal_connect_object (stream, "chunk",
+                           G_CALLBACK (chatbot_tool_stream_prefill_chunk),
+                           language_model, 0);
+}
@@ -0,0 +1,42 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gio/gio.h>
+#include <glib-object.h>
+
+#include "chatbot-language-model.h"
+
+G_BEGIN_DECLS
+
+#define CHATBOT_TYPE_TOOL_STREAM chatbot_tool_stream_get_type ()
+G_DECLARE_FINAL_TYPE (ChatbotToolStream, chatbot_tool_stream, CHATBOT,
+                      TOOL_STREAM, GObject);
+
+ChatbotToolStream *chatbot_tool_stream_new (guint64 max_bytes);
+gboolean chatbot_tool_stream_write (ChatbotToolStream *stream,
+                                    const gchar *text, gssize length);
+void chatbot_tool_stream_stop (ChatbotToolStream *stream, GError *error);
+gboolean chatbot_tool_stream_is_stopped (ChatbotToolStream *stream);
+guint64 chatbot_tool_stream_get_max_bytes (ChatbotToolStream *stream);
+guint64 chatbot_tool_stream_get_n_bytes (ChatbotToolStream *stream);
+GCancellable *chatbot_tool_stream_get_cancellable (ChatbotToolStream *stream);
+gboolean chatbot_tool_stream_propagate_error (ChatbotToolStream *stream,
+                                              GError **error);
+void
+chatbot_tool_stream_connect_language_model (ChatbotToolStream *stream,
+                                            ChatbotLanguageModel *language_model);
+
+G_END_DECLS
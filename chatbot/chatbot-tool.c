@@ -18,11 +18,63 @@
  *
  * External tool interface for Chatbot.
  *
- * Implementing all methods is required.
+ * Implementing [vfunc@Tool.get_function_definitions] and either
+ * [vfunc@Tool.call_function] or [vfunc@Tool.call_function_args] is required.
+ * [vfunc@Tool.call_function_args] receives args already validated and
+ * unpacked in the order of [field@ToolFunction.input_schemas], so the
+ * implementer doesn't need to look up parameters by name.
+ *
+ * Tools producing large output can also implement
+ * [vfunc@Tool.call_function_stream] to deliver the result incrementally
+ * through [class@ToolStream].
+ *
+ * Implementers also override [property@Tool:functions] with
+ * g_object_class_override_property(), and can get its value with
+ * [method@Tool.dup_function_definitions].
  */
 
 #include "chatbot-tool.h"
 
+#include <string.h>
+
+#include "chatbot-trace.h"
+
+/*
+ * Reference count of ChatbotToolArg and ChatbotToolFunction. -1 means
+ * statically defined, and 0 means floating, which is freed by the first
+ * unref without ref.
+ */
+static void
+chatbot_tool_ref_inc (gint *ref)
+{
+  gint old;
+
+  do
+    {
+      old = g_atomic_int_get (ref);
+      if (old == -1)
+        return;
+    }
+  while (!g_atomic_int_compare_and_exchange (ref, old, old + 1));
+}
+
+static gboolean
+chatbot_tool_ref_dec (gint *ref)
+{
+  gint old;
+
+  do
+    {
+      old = g_atomic_int_get (ref);
+      if (old == -1)
+        return FALSE;
+      if (old == 0)
+        return TRUE;
+    }
+  while (!g_atomic_int_compare_and_exchange (ref, old, old - 1));
+  return old == 1;
+}
+
 G_DEFINE_BOXED_TYPE (ChatbotToolArg, chatbot_tool_arg, chatbot_tool_arg_ref,
                      chatbot_tool_arg_unref);
 
@@ -31,10 +83,13 @@ G_DEFINE_BOXED_TYPE (ChatbotToolArg, chatbot_tool_arg, chatbot_tool_arg_ref,
  * @name: arg name
  * @description: arg description
  * @type: GVariant compatible type signature
- * @required: TRUE if required arg, FALSE for not.
  *
  * Helper function to dynamically allocate [struct@ChatbotToolArg].
  *
+ * Name and type are interned with g_intern_string(), as they come from a
+ * small vocabulary shared between all args. Description is copied into the
+ * same allocation as the arg, and freed with it.
+ *
  * Returns: Newly created floating [struct@ChatbotToolArg]
  */
 ChatbotToolArg *
@@ -47,10 +102,10 @@ chatbot_tool_arg_new (const gchar *name, const gchar *description,
   g_return_val_if_fail (description != NULL, NULL);
   g_return_val_if_fail (g_variant_is_signature (type), NULL);
 
-  arg = g_new (ChatbotToolArg, 1);
-  arg->name = g_strdup (name);
-  arg->description = g_strdup (description);
-  arg->type = g_strdup (type);
+  arg = g_malloc (sizeof (ChatbotToolArg) + strlen (description) + 1);
+  arg->name = g_intern_string (name);
+  arg->description = strcpy ((gchar *)(arg + 1), description);
+  arg->type = g_intern_string (type);
   arg->ref = 0;
   return arg;
 }
@@ -65,8 +120,7 @@ ChatbotToolArg *
 chatbot_tool_arg_ref (ChatbotToolArg *arg)
 {
   g_return_val_if_fail (arg != NULL, NULL);
-  if (arg->ref != -1)
-    arg->ref++;
+  chatbot_tool_ref_inc (&arg->ref);
   return arg;
 }
 
@@ -74,15 +128,8 @@ void
 chatbot_tool_arg_unref (ChatbotToolArg *arg)
 {
   g_return_if_fail (arg != NULL);
-  if (arg->ref == -1)
-    return;
-  if (--arg->ref == 0)
-    {
-      g_free (arg->name);
-      g_free (arg->description);
-      g_free (arg->type);
-      g_free (arg);
-    }
+  if (chatbot_tool_ref_dec (&arg->ref))
+    g_free (arg);
 }
 
 G_DEFINE_BOXED_TYPE (ChatbotToolFunction, chatbot_tool_function,
@@ -101,6 +148,9 @@ G_DEFINE_BOXED_TYPE (ChatbotToolFunction, chatbot_tool_function,
  *
  * Helper function to dynamically define [struct@ChatbotToolFunction].
  *
+ * The function, its schema arrays and its description are allocated as one
+ * block, and the name is interned as [func@Chatbot.tool_arg_new] does.
+ *
  * Returns: newly created floating [struct@ChatbotToolFunction]
  */
 ChatbotToolFunction *
@@ -119,23 +169,22 @@ chatbot_tool_function_new (const gchar *name, const gchar *description,
   g_return_val_if_fail ((output_schemas_len == 0) || (output_schemas != NULL),
                         NULL);
 
-  function = g_new (ChatbotToolFunction, 1);
-  function->name = g_strdup (name);
-  function->description = g_strdup (description);
-  function->input_schemas = g_new (ChatbotToolArg *, input_schemas_len + 1);
+  function = g_malloc (sizeof (ChatbotToolFunction)
+                       + sizeof (ChatbotToolArg *)
+                             * (input_schemas_len + output_schemas_len + 2)
+                       + strlen (description) + 1);
+  function->name = g_intern_string (name);
+  function->input_schemas = (ChatbotToolArg **)(function + 1);
   for (gsize i = 0; i < input_schemas_len; i++)
-    {
-      chatbot_tool_arg_ref (input_schemas[i]);
-      function->input_schemas[i] = input_schemas[i];
-    }
+    function->input_schemas[i] = chatbot_tool_arg_ref (input_schemas[i]);
   function->input_schemas[input_schemas_len] = NULL;
-  function->output_schemas = g_new (ChatbotToolArg *, output_schemas_len + 1);
+  function->output_schemas = function->input_schemas + input_schemas_len + 1;
   for (gsize i = 0; i < output_schemas_len; i++)
-    {
-      chatbot_tool_arg_ref (output_schemas[i]);
-      function->output_schemas[i] = output_schemas[i];
-    }
+    function->output_schemas[i] = chatbot_tool_arg_ref (output_schemas[i]);
   function->output_schemas[output_schemas_len] = NULL;
+  function->description = strcpy (
+      (gchar *)(function->output_schemas + output_schemas_len + 1),
+      description);
   function->ref = 0;
   return function;
 }
@@ -150,8 +199,7 @@ ChatbotToolFunction *
 chatbot_tool_function_ref (ChatbotToolFunction *function)
 {
   g_return_val_if_fail (function != NULL, NULL);
-  if (function->ref != -1)
-    function->ref++;
+  chatbot_tool_ref_inc (&function->ref);
   return function;
 }
 
@@ -163,22 +211,347 @@ void
 chatbot_tool_function_unref (ChatbotToolFunction *function)
 {
   g_return_if_fail (function != NULL);
-  if (function->ref == -1)
+  if (!chatbot_tool_ref_dec (&function->ref))
+    return;
+
+  for (ChatbotToolArg **i = function->input_schemas; *i; i++)
+    chatbot_tool_arg_unref (*i);
+  for (ChatbotToolArg **i = function->output_schemas; *i; i++)
+    chatbot_tool_arg_unref (*i);
+  g_free (function);
+}
+
+static GVariant *
+chatbot_tool_args_to_variant (ChatbotToolArg *const *args)
+{
+  GVariantBuilder builder;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sss)"));
+  for (; args && *args; args++)
+    g_variant_builder_add (&builder, "(sss)", (*args)->name,
+                           (*args)->description, (*args)->type);
+  return g_variant_builder_end (&builder);
+}
+
+static ChatbotToolArg **
+chatbot_tool_args_from_variant (GVariant *value, gsize *n_args,
+                                GError **error)
+{
+  ChatbotToolArg **args;
+  const gchar *name, *description, *type;
+  GVariantIter iter;
+  gsize i = 0;
+
+  *n_args = g_variant_n_children (value);
+  args = g_new0 (ChatbotToolArg *, *n_args + 1);
+  g_variant_iter_init (&iter, value);
+  while (g_variant_iter_next (&iter, "(&s&s&s)", &name, &description, &type))
+    {
+      if (!g_variant_is_signature (type))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Argument \"%s\" has invalid type \"%s\".", name,
+                       type);
+          for (gsize j = 0; j < i; j++)
+            chatbot_tool_arg_unref (args[j]);
+          g_free (args);
+          return NULL;
+        }
+      args[i++] = chatbot_tool_arg_new (name, description, type);
+    }
+  return args;
+}
+
+/**
+ * chatbot_tool_function_to_variant:
+ * @function: function
+ *
+ * Serialize @function to send it to another process or store it.
+ *
+ * Returns: (transfer floating): `(ssa(sss)a(sss))` holding name, description,
+ * input schemas and output schemas
+ */
+GVariant *
+chatbot_tool_function_to_variant (const ChatbotToolFunction *function)
+{
+  g_return_val_if_fail (function != NULL, NULL);
+
+  return g_variant_new (
+      "(ss@a(sss)@a(sss))", function->name, function->description,
+      chatbot_tool_args_to_variant (function->input_schemas),
+      chatbot_tool_args_to_variant (function->output_schemas));
+}
+
+/**
+ * chatbot_tool_function_new_from_variant:
+ * @value: value created with [method@ToolFunction.to_variant]
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Returns: (nullable): newly created floating [struct@ChatbotToolFunction],
+ * or %NULL if @value has invalid schemas
+ */
+ChatbotToolFunction *
+chatbot_tool_function_new_from_variant (GVariant *value, GError **error)
+{
+  ChatbotToolFunction *function = NULL;
+  ChatbotToolArg **inputs = NULL, **outputs = NULL;
+  GVariant *input_value, *output_value;
+  const gchar *name, *description;
+  gsize n_inputs = 0, n_outputs = 0;
+
+  g_return_val_if_fail (value != NULL, NULL);
+  g_return_val_if_fail (
+      g_variant_is_of_type (value, G_VARIANT_TYPE ("(ssa(sss)a(sss))")),
+      NULL);
+
+  g_variant_get (value, "(&s&s@a(sss)@a(sss))", &name, &description,
+                 &input_value, &output_value);
+  inputs = chatbot_tool_args_from_variant (input_value, &n_inputs, error);
+  if (inputs == NULL)
+    goto cleanup;
+  outputs = chatbot_tool_args_from_variant (output_value, &n_outputs, error);
+  if (outputs == NULL)
+    {
+      for (gsize i = 0; i < n_inputs; i++)
+        chatbot_tool_arg_unref (inputs[i]);
+      goto cleanup;
+    }
+
+  function = chatbot_tool_function_new (name, description, inputs, n_inputs,
+                                        outputs, n_outputs);
+
+cleanup:
+  g_free (inputs);
+  g_free (outputs);
+  g_variant_unref (input_value);
+  g_variant_unref (output_value);
+  return function;
+}
+
+G_DEFINE_BOXED_TYPE (ChatbotToolArgDecoder, chatbot_tool_arg_decoder,
+                     chatbot_tool_arg_decoder_ref,
+                     chatbot_tool_arg_decoder_unref);
+
+typedef struct
+{
+  gchar *name;
+  GVariantType *type;
+  const GVariantType *element_type; // non-NULL if type is maybe type
+} ChatbotToolArgEntry;
+
+struct _ChatbotToolArgDecoder
+{
+  ChatbotToolFunction *function;
+  ChatbotToolArgEntry *entries;
+  gsize n_entries;
+  gatomicrefcount ref;
+};
+
+/**
+ * chatbot_tool_arg_decoder_new:
+ * @function: function definition to compile
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Compile [field@ToolFunction.input_schemas] into a decoder.
+ *
+ * Type strings are parsed once here, so [method@ToolArgDecoder.decode] only
+ * compares already parsed #GVariantType. Arg which has maybe type (e.g.
+ * "ms") is optional and decoded to nothing if it's not supplied.
+ *
+ * The decoder takes a reference of @function, so
+ * [method@ToolArgDecoder.get_function] is valid as long as the decoder is,
+ * even after the tool which defined @function dropped it. A floating
+ * @function is owned by the decoder.
+ *
+ * Returns: (transfer full) (nullable): newly created decoder or %NULL if
+ * @function contains invalid type.
+ */
+ChatbotToolArgDecoder *
+chatbot_tool_arg_decoder_new (const ChatbotToolFunction *function,
+                              GError **error)
+{
+  ChatbotToolArgDecoder *decoder;
+  gsize n_entries = 0;
+
+  g_return_val_if_fail (function != NULL, NULL);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), NULL);
+
+  if (function->input_schemas)
+    while (function->input_schemas[n_entries])
+      n_entries++;
+
+  decoder = g_new0 (ChatbotToolArgDecoder, 1);
+  decoder->function
+      = chatbot_tool_function_ref ((ChatbotToolFunction *)function);
+  decoder->entries = g_new0 (ChatbotToolArgEntry, n_entries);
+  decoder->n_entries = n_entries;
+  g_atomic_ref_count_init (&decoder->ref);
+
+  for (gsize i = 0; i < n_entries; i++)
+    {
+      const ChatbotToolArg *arg = function->input_schemas[i];
+      ChatbotToolArgEntry *entry = &decoder->entries[i];
+
+      if (!g_variant_type_string_is_valid (arg->type))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Argument \"%s\" of function \"%s\" has invalid "
+                       "type \"%s\".",
+                       arg->name, function->name, arg->type);
+          chatbot_tool_arg_decoder_unref (decoder);
+          return NULL;
+        }
+
+      entry->name = g_strdup (arg->name);
+      entry->type = g_variant_type_new (arg->type);
+      if (g_variant_type_is_maybe (entry->type))
+        entry->element_type = g_variant_type_element (entry->type);
+    }
+
+  return decoder;
+}
+
+/**
+ * chatbot_tool_arg_decoder_ref:
+ * @decoder: decoder
+ *
+ * Returns: @decoder
+ */
+ChatbotToolArgDecoder *
+chatbot_tool_arg_decoder_ref (ChatbotToolArgDecoder *decoder)
+{
+  g_return_val_if_fail (decoder != NULL, NULL);
+  g_atomic_ref_count_inc (&decoder->ref);
+  return decoder;
+}
+
+/**
+ * chatbot_tool_arg_decoder_unref:
+ * @decoder: decoder
+ */
+void
+chatbot_tool_arg_decoder_unref (ChatbotToolArgDecoder *decoder)
+{
+  g_return_if_fail (decoder != NULL);
+  if (!g_atomic_ref_count_dec (&decoder->ref))
     return;
-  if (--function->ref == 0)
+
+  for (gsize i = 0; i < decoder->n_entries; i++)
     {
-      g_free (function->name);
-      g_free (function->description);
-      if (function->input_schemas)
-        for (ChatbotToolArg **i = function->input_schemas; *i; i++)
-          chatbot_tool_arg_unref (*i);
-      if (function->output_schemas)
-        for (ChatbotToolArg **i = function->output_schemas; *i; i++)
-          chatbot_tool_arg_unref (*i);
-      g_free (function->output_schemas);
-      g_free (function->input_schemas);
-      g_free (function);
+      g_free (decoder->entries[i].name);
+      g_clear_pointer (&decoder->entries[i].type, g_variant_type_free);
     }
+  g_free (decoder->entries);
+  chatbot_tool_function_unref (decoder->function);
+  g_free (decoder);
+}
+
+/**
+ * chatbot_tool_arg_decoder_get_function:
+ * @decoder: decoder
+ *
+ * Returns: (transfer none): function definition @decoder is compiled from
+ */
+const ChatbotToolFunction *
+chatbot_tool_arg_decoder_get_function (ChatbotToolArgDecoder *decoder)
+{
+  g_return_val_if_fail (decoder != NULL, NULL);
+  return decoder->function;
+}
+
+/**
+ * chatbot_tool_arg_decoder_get_n_args:
+ * @decoder: decoder
+ *
+ * Returns: number of positional args [method@ToolArgDecoder.decode] stores
+ */
+gsize
+chatbot_tool_arg_decoder_get_n_args (ChatbotToolArgDecoder *decoder)
+{
+  g_return_val_if_fail (decoder != NULL, 0);
+  return decoder->n_entries;
+}
+
+/**
+ * chatbot_tool_arg_decoder_decode:
+ * @decoder: decoder
+ * @parameters: call parameters
+ * @args: (out caller-allocates) (array): location to store positional args,
+ * which has at least [method@ToolArgDecoder.get_n_args] elements
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Validate @parameters and unpack them into @args in the order of
+ * [field@ToolFunction.input_schemas].
+ *
+ * Each stored value is owned by the caller. On failure, @args is filled with
+ * %NULL. Parameters which are not in the schemas are ignored.
+ *
+ * Returns: %TRUE if all args are valid, %FALSE otherwise.
+ */
+gboolean
+chatbot_tool_arg_decoder_decode (ChatbotToolArgDecoder *decoder,
+                                 GVariantDict *parameters, GVariant **args,
+                                 GError **error)
+{
+  gsize i;
+
+  g_return_val_if_fail (decoder != NULL, FALSE);
+  g_return_val_if_fail (parameters != NULL, FALSE);
+  g_return_val_if_fail ((args != NULL) || (decoder->n_entries == 0), FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  for (i = 0; i < decoder->n_entries; i++)
+    {
+      const ChatbotToolArgEntry *entry = &decoder->entries[i];
+      GVariant *value;
+
+      value = g_variant_dict_lookup_value (parameters, entry->name, NULL);
+      if (entry->element_type != NULL)
+        {
+          // Optional arg can be supplied both wrapped and unwrapped.
+          if (value == NULL)
+            value = g_variant_ref_sink (
+                g_variant_new_maybe (entry->element_type, NULL));
+          else if (g_variant_is_of_type (value, entry->element_type))
+            {
+              GVariant *maybe;
+              maybe = g_variant_ref_sink (g_variant_new_maybe (NULL, value));
+              g_variant_unref (value);
+              value = maybe;
+            }
+        }
+
+      if (value == NULL)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                       "Function \"%s\" requires argument \"%s\".",
+                       decoder->function->name, entry->name);
+          goto on_error;
+        }
+
+      if (!g_variant_is_of_type (value, entry->type))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                       "Argument \"%s\" of function \"%s\" expects type "
+                       "\"%.*s\", but got \"%s\".",
+                       entry->name, decoder->function->name,
+                       (int)g_variant_type_get_string_length (entry->type),
+                       g_variant_type_peek_string (entry->type),
+                       g_variant_get_type_string (value));
+          g_variant_unref (value);
+          goto on_error;
+        }
+
+      args[i] = value;
+    }
+
+  return TRUE;
+on_error:
+  for (gsize j = 0; j < i; j++)
+    g_clear_pointer (&args[j], g_variant_unref);
+  for (gsize j = i; j < decoder->n_entries; j++)
+    args[j] = NULL;
+  return FALSE;
 }
 
 enum
@@ -246,6 +619,308 @@ chatbot_tool_get_function_definitions (ChatbotTool *tool)
   return iface->get_function_definitions (tool);
 }
 
+/**
+ * chatbot_tool_dup_function_definitions:
+ *
+ * Gets the current function definitions of the instance as the value of
+ * [property@ChatbotTool:functions], for implementers' get_property.
+ *
+ * Returns: (element-type ChatbotToolFunction) (transfer full): Function
+ * definitions
+ */
+GPtrArray *
+chatbot_tool_dup_function_definitions (ChatbotTool *tool)
+{
+  const ChatbotToolFunction *const *functions;
+  GPtrArray *array;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL (tool), NULL);
+
+  array = g_ptr_array_new_with_free_func (
+      (GDestroyNotify)chatbot_tool_function_unref);
+  functions = chatbot_tool_get_function_definitions (tool);
+  for (; functions && *functions; functions++)
+    g_ptr_array_add (array, chatbot_tool_function_ref (
+                                (ChatbotToolFunction *)*functions));
+  return array;
+}
+
+typedef struct
+{
+  GMutex mutex;
+  GHashTable *decoders; // function name -> ChatbotToolArgDecoder
+  guint generation;     // incremented when functions change
+} ChatbotToolArgDecoderCache;
+
+G_DEFINE_QUARK (chatbot-tool-arg-decoder-cache,
+                chatbot_tool_arg_decoder_cache);
+
+static void
+chatbot_tool_arg_decoder_cache_free (ChatbotToolArgDecoderCache *cache)
+{
+  g_hash_table_unref (cache->decoders);
+  g_mutex_clear (&cache->mutex);
+  g_free (cache);
+}
+
+static void
+chatbot_tool_arg_decoder_cache_invalidate (ChatbotTool *tool,
+                                           ChatbotToolArgDecoderCache *cache)
+{
+  g_mutex_lock (&cache->mutex);
+  g_hash_table_remove_all (cache->decoders);
+  cache->generation++;
+  g_mutex_unlock (&cache->mutex);
+}
+
+static ChatbotToolArgDecoderCache *
+chatbot_tool_get_arg_decoder_cache (ChatbotTool *tool)
+{
+  GQuark quark = chatbot_tool_arg_decoder_cache_quark ();
+  ChatbotToolArgDecoderCache *cache;
+
+  cache = g_object_get_qdata (G_OBJECT (tool), quark);
+  if (cache)
+    return cache;
+
+  cache = g_new0 (ChatbotToolArgDecoderCache, 1);
+  g_mutex_init (&cache->mutex);
+  cache->decoders = g_hash_table_new_full (
+      g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify)chatbot_tool_arg_decoder_unref);
+
+  // Another thread may have attached its cache in the meantime.
+  if (!g_object_replace_qdata (
+          G_OBJECT (tool), quark, NULL, cache,
+          (GDestroyNotify)chatbot_tool_arg_decoder_cache_free, NULL))
+    {
+      chatbot_tool_arg_decoder_cache_free (cache);
+      return g_object_get_qdata (G_OBJECT (tool), quark);
+    }
+  g_signal_connect (tool, "functions-changed",
+                    G_CALLBACK (chatbot_tool_arg_decoder_cache_invalidate),
+                    cache);
+  return cache;
+}
+
+/**
+ * chatbot_tool_get_arg_decoder:
+ * @function_name: function name to look up
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Get precompiled decoder of the function.
+ *
+ * Decoders are compiled at the first lookup and cached in @tool until
+ * [signal@Tool::functions-changed] is emitted.
+ *
+ * Returns: (transfer full) (nullable): decoder or %NULL if @tool doesn't
+ * define @function_name or its definition is invalid.
+ */
+ChatbotToolArgDecoder *
+chatbot_tool_get_arg_decoder (ChatbotTool *tool, const gchar *function_name,
+                              GError **error)
+{
+  ChatbotToolArgDecoderCache *cache;
+  ChatbotToolArgDecoder *decoder, *cached;
+  const ChatbotToolFunction *const *functions;
+  guint generation;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL (tool), NULL);
+  g_return_val_if_fail (function_name != NULL, NULL);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), NULL);
+
+  cache = chatbot_tool_get_arg_decoder_cache (tool);
+  g_mutex_lock (&cache->mutex);
+  decoder = g_hash_table_lookup (cache->decoders, function_name);
+  if (decoder)
+    chatbot_tool_arg_decoder_ref (decoder);
+  generation = cache->generation;
+  g_mutex_unlock (&cache->mutex);
+  if (decoder)
+    return decoder;
+
+  // Definitions come from the tool, so they're compiled without the lock.
+  functions = chatbot_tool_get_function_definitions (tool);
+  for (gsize i = 0; functions && functions[i]; i++)
+    {
+      if (g_strcmp0 (functions[i]->name, function_name) != 0)
+        continue;
+      decoder = chatbot_tool_arg_decoder_new (functions[i], error);
+      if (decoder == NULL)
+        return NULL;
+      break;
+    }
+
+  if (decoder == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                   "Function \"%s\" is not defined.", function_name);
+      return NULL;
+    }
+
+  g_mutex_lock (&cache->mutex);
+  cached = g_hash_table_lookup (cache->decoders, function_name);
+  if (cached)
+    {
+      // Another thread compiled it first.
+      chatbot_tool_arg_decoder_unref (decoder);
+      decoder = chatbot_tool_arg_decoder_ref (cached);
+    }
+  else if (generation == cache->generation)
+    g_hash_table_insert (cache->decoders, g_strdup (function_name),
+                         chatbot_tool_arg_decoder_ref (decoder));
+  g_mutex_unlock (&cache->mutex);
+  return decoder;
+}
+
+typedef struct
+{
+  GMutex mutex;
+  GCond cond;
+  guint n_calls;
+  gboolean draining;
+} ChatbotToolCalls;
+
+G_DEFINE_QUARK (chatbot-tool-calls, chatbot_tool_calls);
+
+// Tools whose calls are running in this thread, innermost first.
+static GPrivate tool_calls_running
+    = G_PRIVATE_INIT ((GDestroyNotify)g_slist_free);
+
+static void
+chatbot_tool_calls_free (gpointer data)
+{
+  ChatbotToolCalls *calls = data;
+  g_mutex_clear (&calls->mutex);
+  g_cond_clear (&calls->cond);
+  g_free (calls);
+}
+
+static ChatbotToolCalls *
+chatbot_tool_get_calls (ChatbotTool *tool)
+{
+  GQuark quark = chatbot_tool_calls_quark ();
+  ChatbotToolCalls *calls;
+
+  calls = g_object_get_qdata (G_OBJECT (tool), quark);
+  if (calls)
+    return calls;
+
+  calls = g_new0 (ChatbotToolCalls, 1);
+  g_mutex_init (&calls->mutex);
+  g_cond_init (&calls->cond);
+
+  // Another thread may have attached its counter in the meantime.
+  if (!g_object_replace_qdata (G_OBJECT (tool), quark, NULL, calls,
+                               chatbot_tool_calls_free, NULL))
+    {
+      chatbot_tool_calls_free (calls);
+      return g_object_get_qdata (G_OBJECT (tool), quark);
+    }
+  return calls;
+}
+
+static gboolean
+chatbot_tool_begin_call (ChatbotTool *tool, GError **error)
+{
+  ChatbotToolCalls *calls = chatbot_tool_get_calls (tool);
+  gboolean ret = TRUE;
+
+  g_mutex_lock (&calls->mutex);
+  if (calls->draining)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                   "Tool \"%s\" is being unloaded.",
+                   chatbot_module_get_name (CHATBOT_MODULE (tool)));
+      ret = FALSE;
+    }
+  else
+    calls->n_calls++;
+  g_mutex_unlock (&calls->mutex);
+
+  if (ret)
+    g_private_set (&tool_calls_running,
+                   g_slist_prepend (g_private_get (&tool_calls_running),
+                                    tool));
+  return ret;
+}
+
+static void
+chatbot_tool_end_call (ChatbotTool *tool)
+{
+  ChatbotToolCalls *calls = chatbot_tool_get_calls (tool);
+
+  g_private_set (&tool_calls_running,
+                 g_slist_remove (g_private_get (&tool_calls_running), tool));
+
+  g_mutex_lock (&calls->mutex);
+  if ((--calls->n_calls == 0) && calls->draining)
+    g_cond_broadcast (&calls->cond);
+  g_mutex_unlock (&calls->mutex);
+}
+
+static void
+chatbot_tool_drain_cancelled (GCancellable *cancellable, gpointer user_data)
+{
+  ChatbotToolCalls *calls = user_data;
+  g_mutex_lock (&calls->mutex);
+  g_cond_broadcast (&calls->cond);
+  g_mutex_unlock (&calls->mutex);
+}
+
+/**
+ * chatbot_tool_drain:
+ * @cancellable: (nullable): cancellable to stop waiting
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Wait for in-flight calls of @tool to finish, and reject calls made after
+ * this with %G_IO_ERROR_CLOSED.
+ *
+ * Call this after removing @tool from language models and before releasing
+ * it, so that unloading the tool doesn't break calls running in other
+ * threads. Draining from inside a call of @tool would wait for itself, so it
+ * fails with %G_IO_ERROR_WOULD_BLOCK instead.
+ *
+ * Returns: %TRUE if all calls finished, %FALSE if @cancellable is cancelled
+ * or this is called from inside a call of @tool.
+ */
+gboolean
+chatbot_tool_drain (ChatbotTool *tool, GCancellable *cancellable,
+                    GError **error)
+{
+  ChatbotToolCalls *calls;
+  gulong cancelled_id = 0;
+  gboolean ret;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL (tool), FALSE);
+  g_return_val_if_fail (
+      G_IS_CANCELLABLE (cancellable) || (cancellable == NULL), FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  if (g_slist_find (g_private_get (&tool_calls_running), tool))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK,
+                   "Tool \"%s\" can't be drained from its own call.",
+                   chatbot_module_get_name (CHATBOT_MODULE (tool)));
+      return FALSE;
+    }
+
+  calls = chatbot_tool_get_calls (tool);
+  if (cancellable)
+    cancelled_id = g_cancellable_connect (
+        cancellable, G_CALLBACK (chatbot_tool_drain_cancelled), calls, NULL);
+
+  g_mutex_lock (&calls->mutex);
+  calls->draining = TRUE;
+  while (calls->n_calls && !g_cancellable_is_cancelled (cancellable))
+    g_cond_wait (&calls->cond, &calls->mutex);
+  g_mutex_unlock (&calls->mutex);
+
+  g_cancellable_disconnect (cancellable, cancelled_id);
+  ret = !g_cancellable_set_error_if_cancelled (cancellable, error);
+  return ret;
+}
+
 /**
  * chatbot_tool_call_function:
  * @function_name: function name to call
@@ -257,7 +932,8 @@ chatbot_tool_get_function_definitions (ChatbotTool *tool)
  * Call function
  *
  * The valid function and its parameters should be function definitions defined
- * at [property@ChatbotTool:functions]
+ * at [property@ChatbotTool:functions]. @parameters are validated against
+ * [field@ToolFunction.input_schemas] before calling the implementation.
  *
  * @language_model can be used to make tool calling interactive. Though it
  * depends on the user of tools, so, if there is any interactive only tool, the
@@ -272,6 +948,11 @@ chatbot_tool_call_function (ChatbotTool *tool, const gchar *function_name,
                             GCancellable *cancellable, GError **error)
 {
   ChatbotToolInterface *iface;
+  ChatbotToolArgDecoder *decoder;
+  GVariant **args;
+  gsize n_args;
+  GVariantDict *result = NULL;
+  gint64 start, span;
 
   g_return_val_if_fail (CHATBOT_IS_TOOL (tool), NULL);
   g_return_val_if_fail (function_name != NULL, NULL);
@@ -283,7 +964,172 @@ chatbot_tool_call_function (ChatbotTool *tool, const gchar *function_name,
       G_IS_CANCELLABLE (cancellable) || (cancellable == NULL), NULL);
   g_return_val_if_fail ((error == NULL) || (*error == NULL), NULL);
   iface = CHATBOT_TOOL_GET_IFACE (tool);
-  g_return_val_if_fail (iface->call_function != NULL, NULL);
-  return iface->call_function (tool, function_name, parameters, language_model,
-                               cancellable, error);
+  g_return_val_if_fail (
+      (iface->call_function != NULL) || (iface->call_function_args != NULL),
+      NULL);
+
+  if (!chatbot_tool_begin_call (tool, error))
+    return NULL;
+
+  decoder = chatbot_tool_get_arg_decoder (tool, function_name, error);
+  if (decoder == NULL)
+    goto end_call;
+
+  n_args = chatbot_tool_arg_decoder_get_n_args (decoder);
+  args = g_newa (GVariant *, n_args + 1);
+  if (!chatbot_tool_arg_decoder_decode (decoder, parameters, args, error))
+    goto cleanup;
+  args[n_args] = NULL;
+
+  span = chatbot_trace_begin ();
+  start = g_get_monotonic_time ();
+  if (iface->call_function_args != NULL)
+    result = iface->call_function_args (
+        tool, chatbot_tool_arg_decoder_get_function (decoder), args,
+        language_model, cancellable, error);
+  else
+    result = iface->call_function (tool, function_name, parameters,
+                                   language_model, cancellable, error);
+  if (language_model)
+    chatbot_metrics_record (
+        chatbot_language_model_get_metrics (language_model),
+        CHATBOT_METRICS_TOOL_CALL, g_get_monotonic_time () - start);
+  chatbot_trace_end (span, "tool-call-function", function_name);
+
+  for (gsize i = 0; i < n_args; i++)
+    g_variant_unref (args[i]);
+cleanup:
+  chatbot_tool_arg_decoder_unref (decoder);
+end_call:
+  chatbot_tool_end_call (tool);
+  return result;
+}
+
+static void
+chatbot_tool_cancel_stream (GCancellable *cancellable,
+                            ChatbotToolStream *stream)
+{
+  chatbot_tool_stream_stop (stream,
+                            g_error_new_literal (G_IO_ERROR,
+                                                 G_IO_ERROR_CANCELLED,
+                                                 "Operation was cancelled"));
+}
+
+/**
+ * chatbot_tool_call_function_stream:
+ * @function_name: function name to call
+ * @parameters: call parameters
+ * @stream: stream to deliver the result
+ * @language_model: (nullable): language model instance
+ * @cancellable: (nullable): cancellable to cancel operation
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Call function and deliver its result through @stream.
+ *
+ * If the tool doesn't implement [vfunc@Tool.call_function_stream], the result
+ * of [method@Tool.call_function] is delivered as one chunk in #GVariant text
+ * format.
+ *
+ * Stopping @stream because of [property@ToolStream:max-bytes] or the consumer
+ * is not an error.
+ *
+ * Returns: %TRUE if succeed, %FALSE on failure.
+ */
+gboolean
+chatbot_tool_call_function_stream (ChatbotTool *tool,
+                                   const gchar *function_name,
+                                   GVariantDict *parameters,
+                                   ChatbotToolStream *stream,
+                                   ChatbotLanguageModel *language_model,
+                                   GCancellable *cancellable, GError **error)
+{
+  ChatbotToolInterface *iface;
+  ChatbotToolArgDecoder *decoder;
+  GVariant **args;
+  gsize n_args;
+  gulong cancelled_id = 0;
+  GError *local_error = NULL;
+  gboolean ret = FALSE;
+  gint64 start, span;
+
+  g_return_val_if_fail (CHATBOT_IS_TOOL (tool), FALSE);
+  g_return_val_if_fail (function_name != NULL, FALSE);
+  g_return_val_if_fail (parameters != NULL, FALSE);
+  g_return_val_if_fail (CHATBOT_IS_TOOL_STREAM (stream), FALSE);
+  g_return_val_if_fail (CHATBOT_IS_LANGUAGE_MODEL (language_model)
+                            || (language_model == NULL),
+                        FALSE);
+  g_return_val_if_fail (
+      G_IS_CANCELLABLE (cancellable) || (cancellable == NULL), FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  iface = CHATBOT_TOOL_GET_IFACE (tool);
+  if (iface->call_function_stream == NULL)
+    {
+      GVariantDict *result;
+      GVariant *value;
+      gchar *text;
+
+      result = chatbot_tool_call_function (tool, function_name, parameters,
+                                           language_model, cancellable, error);
+      if (result == NULL)
+        return FALSE;
+      value = g_variant_ref_sink (g_variant_dict_end (result));
+      text = g_variant_print (value, FALSE);
+      chatbot_tool_stream_write (stream, text, -1);
+      g_free (text);
+      g_variant_unref (value);
+      g_variant_dict_unref (result);
+      return chatbot_tool_stream_propagate_error (stream, error);
+    }
+
+  if (!chatbot_tool_begin_call (tool, error))
+    return FALSE;
+
+  decoder = chatbot_tool_get_arg_decoder (tool, function_name, error);
+  if (decoder == NULL)
+    goto end_call;
+
+  n_args = chatbot_tool_arg_decoder_get_n_args (decoder);
+  args = g_newa (GVariant *, n_args + 1);
+  if (!chatbot_tool_arg_decoder_decode (decoder, parameters, args, error))
+    goto cleanup;
+  args[n_args] = NULL;
+
+  if (cancellable)
+    cancelled_id = g_cancellable_connect (
+        cancellable, G_CALLBACK (chatbot_tool_cancel_stream), stream, NULL);
+
+  span = chatbot_trace_begin ();
+  start = g_get_monotonic_time ();
+  ret = iface->call_function_stream (
+      tool, chatbot_tool_arg_decoder_get_function (decoder), args, stream,
+      language_model, chatbot_tool_stream_get_cancellable (stream),
+      &local_error);
+  g_cancellable_disconnect (cancellable, cancelled_id);
+  if (language_model)
+    chatbot_metrics_record (
+        chatbot_language_model_get_metrics (language_model),
+        CHATBOT_METRICS_TOOL_CALL, g_get_monotonic_time () - start);
+  chatbot_trace_end (span, "tool-call-function-stream", function_name);
+
+  // Tool cancelled by stopping the stream reports the reason of the stop.
+  if (!ret && chatbot_tool_stream_is_stopped (stream)
+      && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_clear_error (&local_error);
+      ret = TRUE;
+    }
+  if (local_error)
+    g_propagate_error (error, local_error);
+  else
+    ret = chatbot_tool_stream_propagate_error (stream, error) && ret;
+
+  for (gsize i = 0; i < n_args; i++)
+    g_variant_unref (args[i]);
+cleanup:
+  chatbot_tool_arg_decoder_unref (decoder);
+end_call:
+  chatbot_tool_end_call (tool);
+  return ret;
 }
@@ -19,6 +19,7 @@
 
 #include "chatbot-language-model.h"
 #include "chatbot-module.h"
+#include "chatbot-tool-stream.h"
 
 G_BEGIN_DECLS
 
@@ -33,17 +34,19 @@ GType chatbot_tool_arg_get_type (void) G_GNUC_CONST;
  * @name: arg name
  * @description: arg description
  * @type: GVariant type
- * @required: TRUE if the arg is required
  * @ref: -1 if the structure is statically defined
  *
  * Valid basic type of @type is "b", "x", "d", "s", and "a".
+ *
+ * The structure is immutable once created, and @ref is modified atomically,
+ * so it can be shared between threads.
  */
 typedef struct _ChatbotToolArg
 {
-  gchar *name;
-  gchar *description;
-  gchar *type;
-  guint ref;
+  const gchar *name;
+  const gchar *description;
+  const gchar *type;
+  gint ref;
 } ChatbotToolArg;
 
 ChatbotToolArg *chatbot_tool_arg_new (const gchar *name,
@@ -62,14 +65,17 @@ GType chatbot_tool_function_get_type (void) G_GNUC_CONST;
  * @input_schemas: (array zero-terminated=1): input(s) information
  * @output_schemas: (array zero-terminated=1): output(s) information
  * @ref: -1 if the structure is statically defined
+ *
+ * The structure is immutable once created, and @ref is modified atomically,
+ * so it can be shared between threads.
  */
 typedef struct _ChatbotToolFunction
 {
-  gchar *name;
-  gchar *description;
+  const gchar *name;
+  const gchar *description;
   ChatbotToolArg **input_schemas;
   ChatbotToolArg **output_schemas;
-  guint ref;
+  gint ref;
 } ChatbotToolFunction;
 
 ChatbotToolFunction *chatbot_tool_function_new (
@@ -78,6 +84,34 @@ ChatbotToolFunction *chatbot_tool_function_new (
     ChatbotToolArg **output_schemas, gsize output_schemas_len);
 ChatbotToolFunction *chatbot_tool_function_ref (ChatbotToolFunction *function);
 void chatbot_tool_function_unref (ChatbotToolFunction *function);
+GVariant *
+chatbot_tool_function_to_variant (const ChatbotToolFunction *function);
+ChatbotToolFunction *chatbot_tool_function_new_from_variant (GVariant *value,
+                                                             GError **error);
+
+#define CHATBOT_TYPE_TOOL_ARG_DECODER chatbot_tool_arg_decoder_get_type ()
+GType chatbot_tool_arg_decoder_get_type (void) G_GNUC_CONST;
+
+/**
+ * ChatbotToolArgDecoder:
+ *
+ * Opaque structure that holds precompiled input schemas of a
+ * [struct@ToolFunction].
+ */
+typedef struct _ChatbotToolArgDecoder ChatbotToolArgDecoder;
+
+ChatbotToolArgDecoder *
+chatbot_tool_arg_decoder_new (const ChatbotToolFunction *function,
+                              GError **error);
+ChatbotToolArgDecoder *
+chatbot_tool_arg_decoder_ref (ChatbotToolArgDecoder *decoder);
+void chatbot_tool_arg_decoder_unref (ChatbotToolArgDecoder *decoder);
+const ChatbotToolFunction *
+chatbot_tool_arg_decoder_get_function (ChatbotToolArgDecoder *decoder);
+gsize chatbot_tool_arg_decoder_get_n_args (ChatbotToolArgDecoder *decoder);
+gboolean chatbot_tool_arg_decoder_decode (ChatbotToolArgDecoder *decoder,
+                                          GVariantDict *parameters,
+                                          GVariant **args, GError **error);
 
 struct _ChatbotToolInterface
 {
@@ -89,16 +123,39 @@ struct _ChatbotToolInterface
                                   GVariantDict *parameters,
                                   ChatbotLanguageModel *language_model,
                                   GCancellable *cancellable, GError **error);
+  GVariantDict *(*call_function_args) (ChatbotTool *tool,
+                                       const ChatbotToolFunction *function,
+                                       GVariant *const *args,
+                                       ChatbotLanguageModel *language_model,
+                                       GCancellable *cancellable,
+                                       GError **error);
+  gboolean (*call_function_stream) (ChatbotTool *tool,
+                                    const ChatbotToolFunction *function,
+                                    GVariant *const *args,
+                                    ChatbotToolStream *stream,
+                                    ChatbotLanguageModel *language_model,
+                                    GCancellable *cancellable,
+                                    GError **error);
 };
 
 gpointer chatbot_tool_new (GType type);
 const ChatbotToolFunction *const *
 chatbot_tool_get_function_definitions (ChatbotTool *tool);
+GPtrArray *chatbot_tool_dup_function_definitions (ChatbotTool *tool);
+ChatbotToolArgDecoder *chatbot_tool_get_arg_decoder (ChatbotTool *tool,
+                                                     const gchar *function_name,
+                                                     GError **error);
 GVariantDict *chatbot_tool_call_function (ChatbotTool *tool,
                                           const gchar *function_name,
                                           GVariantDict *parameters,
                                           ChatbotLanguageModel *language_model,
                                           GCancellable *cancellable,
                                           GError **error);
+gboolean chatbot_tool_drain (ChatbotTool *tool, GCancellable *cancellable,
+                             GError **error);
+gboolean chatbot_tool_call_function_stream (
+    ChatbotTool *tool, const gchar *function_name, GVariantDict *parameters,
+    ChatbotToolStream *stream, ChatbotLanguageModel *language_model,
+    GCancellable *cancellable, GError **error);
 
 G_END_DECLS
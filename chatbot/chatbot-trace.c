@@ -0,0 +1,241 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Trace spans written as Chrome trace event JSON, which can be opened with
+ * Perfetto or chrome://tracing.
+ *
+ * Tracing is started with chatbot_trace_start() or by setting CHATBOT_TRACE
+ * environment variable to the output path. While it's off, a span costs one
+ * atomic load in chatbot_trace_begin() and one comparison in
+ * chatbot_trace_end().
+ *
+ * ```c
+ * gint64 span = chatbot_trace_begin ();
+ * do_something ();
+ * chatbot_trace_end (span, "do-something", NULL);
+ * ```
+ */
+
+#include "chatbot-trace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+static GMutex trace_mutex;
+static FILE *trace_file = NULL;
+static gboolean trace_first_event = TRUE;
+static gint trace_enabled = FALSE;
+static gint trace_next_tid = 0;
+static GPrivate trace_tid;
+
+static void
+chatbot_trace_init_from_env (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      const gchar *path = g_getenv ("CHATBOT_TRACE");
+      GError *error = NULL;
+
+      if (path && *path)
+        {
+          if (chatbot_trace_start (path, &error))
+            atexit (chatbot_trace_stop);
+          else
+            {
+              g_warning ("Failed to start tracing: %s", error->message);
+              g_error_free (error);
+            }
+        }
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+/*
+ * Small sequential ids are easier to read in the viewer than thread
+ * addresses.
+ */
+static guint
+chatbot_trace_get_tid (void)
+{
+  guint tid = GPOINTER_TO_UINT (g_private_get (&trace_tid));
+
+  if (tid == 0)
+    {
+      tid = g_atomic_int_add (&trace_next_tid, 1) + 1;
+      g_private_set (&trace_tid, GUINT_TO_POINTER (tid));
+    }
+  return tid;
+}
+
+static void
+chatbot_trace_write_string (const gchar *string)
+{
+  fputc ('"', trace_file);
+  for (const guchar *p = (const guchar *)string; *p; p++)
+    {
+      if ((*p == '"') || (*p == '\\'))
+        fprintf (trace_file, "\\%c", *p);
+      else if (*p < 0x20)
+        fprintf (trace_file, "\\u%04x", *p);
+      else
+        fputc (*p, trace_file);
+    }
+  fputc ('"', trace_file);
+}
+
+/**
+ * chatbot_trace_start:
+ * @path: output file
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Start writing trace spans to @path. Spans are buffered until
+ * [func@Chatbot.trace_stop] is called.
+ *
+ * Returns: %TRUE if tracing is started
+ */
+gboolean
+chatbot_trace_start (const gchar *path, GError **error)
+{
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  g_mutex_lock (&trace_mutex);
+  if (trace_file)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_BUSY,
+                   "Tracing is already started.");
+      goto cleanup;
+    }
+
+  trace_file = g_fopen (path, "w");
+  if (trace_file == NULL)
+    {
+      int errsv = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Failed to open \"%s\": %s", path, g_strerror (errsv));
+      goto cleanup;
+    }
+
+  fputs ("[\n", trace_file);
+  trace_first_event = TRUE;
+  g_atomic_int_set (&trace_enabled, TRUE);
+  ret = TRUE;
+
+cleanup:
+  g_mutex_unlock (&trace_mutex);
+  return ret;
+}
+
+/**
+ * chatbot_trace_stop:
+ *
+ * Stop tracing and close the output file.
+ */
+void
+chatbot_trace_stop (void)
+{
+  g_mutex_lock (&trace_mutex);
+  g_atomic_int_set (&trace_enabled, FALSE);
+  if (trace_file)
+    {
+      fputs ("\n]\n", trace_file);
+      fclose (trace_file);
+      trace_file = NULL;
+    }
+  g_mutex_unlock (&trace_mutex);
+}
+
+/**
+ * chatbot_trace_is_enabled:
+ *
+ * Returns: %TRUE if tracing is started
+ */
+gboolean
+chatbot_trace_is_enabled (void)
+{
+  chatbot_trace_init_from_env ();
+  return g_atomic_int_get (&trace_enabled);
+}
+
+/**
+ * chatbot_trace_begin:
+ *
+ * Begin a span.
+ *
+ * Returns: value to pass to [func@Chatbot.trace_end], which is 0 if tracing
+ * is off
+ */
+gint64
+chatbot_trace_begin (void)
+{
+  if (!chatbot_trace_is_enabled ())
+    return 0;
+  return g_get_monotonic_time ();
+}
+
+/**
+ * chatbot_trace_end:
+ * @start: value returned by [func@Chatbot.trace_begin]
+ * @name: span name
+ * @detail: (nullable): additional information shown as "detail" argument
+ *
+ * End a span and write it as a complete event.
+ */
+void
+chatbot_trace_end (gint64 start, const gchar *name, const gchar *detail)
+{
+  gint64 end;
+  guint tid;
+
+  if (start == 0)
+    return;
+
+  g_return_if_fail (name != NULL);
+
+  end = g_get_monotonic_time ();
+  tid = chatbot_trace_get_tid ();
+
+  g_mutex_lock (&trace_mutex);
+  // Tracing may be stopped during the span.
+  if (trace_file == NULL)
+    goto cleanup;
+
+  fputs (trace_first_event ? "{\"name\": " : ",\n{\"name\": ", trace_file);
+  trace_first_event = FALSE;
+  chatbot_trace_write_string (name);
+  fprintf (trace_file,
+           ", \"cat\": \"chatbot\", \"ph\": \"X\", \"ts\": %" G_GINT64_FORMAT
+           ", \"dur\": %" G_GINT64_FORMAT ", \"pid\": %d, \"tid\": %u",
+           start, end - start, (int)getpid (), tid);
+  if (detail)
+    {
+      fputs (", \"args\": {\"detail\": ", trace_file);
+      chatbot_trace_write_string (detail);
+      fputc ('}', trace_file);
+    }
+  fputc ('}', trace_file);
+
+cleanup:
+  g_mutex_unlock (&trace_mutex);
+}
@@ -0,0 +1,28 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gio/gio.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+gboolean chatbot_trace_start (const gchar *path, GError **error);
+void chatbot_trace_stop (void);
+gboolean chatbot_trace_is_enabled (void);
+gint64 chatbot_trace_begin (void);
+void chatbot_trace_end (gint64 start, const gchar *name, const gchar *detail);
+
+G_END_DECLS
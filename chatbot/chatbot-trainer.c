@@ -33,6 +33,8 @@
 
 #include "chatbot-trainer.h"
 
+#include "chatbot-trace.h"
+
 G_DEFINE_INTERFACE (ChatbotTrainer, chatbot_trainer, CHATBOT_TYPE_MODULE);
 
 static void
@@ -83,6 +85,8 @@ chatbot_trainer_train (ChatbotTrainer *trainer, ChatbotData **data,
                        GError **error)
 {
   ChatbotTrainerInterface *iface;
+  gboolean ret;
+  gint64 span;
 
   g_return_val_if_fail (CHATBOT_IS_TRAINER (trainer), FALSE);
   g_return_val_if_fail (data != NULL, FALSE);
@@ -96,5 +100,10 @@ chatbot_trainer_train (ChatbotTrainer *trainer, ChatbotData **data,
                    "Trainer implementation doesn't provide train().");
       return FALSE;
     }
-  return iface->train (trainer, data, data_len, cancellable, error);
+
+  span = chatbot_trace_begin ();
+  ret = iface->train (trainer, data, data_len, cancellable, error);
+  chatbot_trace_end (span, "train",
+                     chatbot_module_get_name (CHATBOT_MODULE (trainer)));
+  return ret;
 }
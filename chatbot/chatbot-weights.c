@@ -0,0 +1,626 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * ChatbotWeights:
+ *
+ * Named tensors of a model file mapped read-only.
+ *
+ * The file is mapped with `MAP_SHARED`, so processes on one host serving the
+ * same model share the page cache instead of keeping their own heap copy.
+ * Within a process, [func@Weights.open] returns the existing mapping when the
+ * same file is opened again, so module instances share it as well.
+ *
+ * The file starts with 8 bytes magic "CHATBOTW", 32 bit version, 32 bit
+ * tensor alignment and 64 bit index size, all little endian. The index
+ * follows as a little endian #GVariant of type "a(stt)" holding name, offset
+ * and size of each tensor. Tensor offsets are multiples of the alignment, so
+ * tensors start on page boundaries. Such a file is made with
+ * [func@Weights.write].
+ */
+
+#include "chatbot-weights.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#define CHATBOT_WEIGHTS_MAGIC "CHATBOTW"
+#define CHATBOT_WEIGHTS_VERSION 1
+#define CHATBOT_WEIGHTS_HEADER_SIZE 24
+#define CHATBOT_WEIGHTS_INDEX_TYPE "a(stt)"
+// Page aligned on all common hosts, including 64 KiB page kernels.
+#define CHATBOT_WEIGHTS_DEFAULT_ALIGNMENT (64 * 1024)
+
+typedef struct
+{
+  guint64 offset;
+  guint64 size;
+} ChatbotWeightsTensor;
+
+struct _ChatbotWeights
+{
+  gchar *path;
+  gchar *key;
+  guint8 *data;
+  gsize size;
+  gsize alignment;
+  gchar **names;
+  GHashTable *tensors;
+  grefcount ref; // protected by weights_mutex
+};
+
+G_DEFINE_BOXED_TYPE (ChatbotWeights, chatbot_weights, chatbot_weights_ref,
+                     chatbot_weights_unref);
+
+/*
+ * Mapped files keyed by device, inode, size and mtime. Entries are removed
+ * when the last reference is dropped.
+ */
+static GMutex weights_mutex;
+static GHashTable *weights_cache = NULL;
+
+static inline guint64
+chatbot_weights_align (guint64 value, guint64 alignment)
+{
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void
+chatbot_weights_advise (ChatbotWeights *weights, ChatbotWeightsFlags flags)
+{
+  // Hints are best effort, failures only affect performance.
+  if (flags & CHATBOT_WEIGHTS_RANDOM)
+    if (madvise (weights->data, weights->size, MADV_RANDOM) < 0)
+      g_debug ("madvise (MADV_RANDOM) failed on \"%s\": %s", weights->path,
+               g_strerror (errno));
+
+  if (flags & CHATBOT_WEIGHTS_WILLNEED)
+    if (madvise (weights->data, weights->size, MADV_WILLNEED) < 0)
+      g_debug ("madvise (MADV_WILLNEED) failed on \"%s\": %s", weights->path,
+               g_strerror (errno));
+
+#ifdef MADV_HUGEPAGE
+  if (flags & CHATBOT_WEIGHTS_HUGEPAGES)
+    if (madvise (weights->data, weights->size, MADV_HUGEPAGE) < 0)
+      g_debug ("madvise (MADV_HUGEPAGE) failed on \"%s\": %s", weights->path,
+               g_strerror (errno));
+#endif
+}
+
+static void
+chatbot_weights_free (ChatbotWeights *weights)
+{
+  if (weights->data)
+    munmap (weights->data, weights->size);
+  g_clear_pointer (&weights->tensors, g_hash_table_unref);
+  g_strfreev (weights->names);
+  g_free (weights->key);
+  g_free (weights->path);
+  g_free (weights);
+}
+
+static gboolean
+chatbot_weights_parse (ChatbotWeights *weights, GError **error)
+{
+  GVariant *index = NULL;
+  GPtrArray *names = NULL;
+  GVariantIter iter;
+  const gchar *name;
+  guint32 version, alignment;
+  guint64 index_size, offset, size;
+  gboolean ret = FALSE;
+
+  if ((weights->size < CHATBOT_WEIGHTS_HEADER_SIZE)
+      || (memcmp (weights->data, CHATBOT_WEIGHTS_MAGIC, 8) != 0))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "\"%s\" is not a weights file.", weights->path);
+      return FALSE;
+    }
+
+  memcpy (&version, weights->data + 8, sizeof (version));
+  memcpy (&alignment, weights->data + 12, sizeof (alignment));
+  memcpy (&index_size, weights->data + 16, sizeof (index_size));
+  version = GUINT32_FROM_LE (version);
+  alignment = GUINT32_FROM_LE (alignment);
+  index_size = GUINT64_FROM_LE (index_size);
+
+  if (version != CHATBOT_WEIGHTS_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Weights file version %u of \"%s\" is not supported.",
+                   version, weights->path);
+      return FALSE;
+    }
+  if ((alignment == 0) || ((alignment & (alignment - 1)) != 0)
+      || (index_size > weights->size - CHATBOT_WEIGHTS_HEADER_SIZE))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Header of \"%s\" is broken.", weights->path);
+      return FALSE;
+    }
+  weights->alignment = alignment;
+
+  index = g_variant_new_from_data (
+      G_VARIANT_TYPE (CHATBOT_WEIGHTS_INDEX_TYPE),
+      weights->data + CHATBOT_WEIGHTS_HEADER_SIZE, index_size, FALSE, NULL,
+      NULL);
+  g_variant_ref_sink (index);
+  if (G_BYTE_ORDER != G_LITTLE_ENDIAN)
+    {
+      GVariant *swapped = g_variant_byteswap (index);
+      g_variant_unref (index);
+      index = swapped;
+    }
+
+  names = g_ptr_array_new_with_free_func (g_free);
+  g_variant_iter_init (&iter, index);
+  while (g_variant_iter_next (&iter, "(&stt)", &name, &offset, &size))
+    {
+      ChatbotWeightsTensor *tensor;
+
+      if ((offset % alignment != 0) || (offset > weights->size)
+          || (size > weights->size - offset))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Tensor \"%s\" is out of \"%s\".", name,
+                       weights->path);
+          goto cleanup;
+        }
+      if (g_hash_table_contains (weights->tensors, name))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Tensor \"%s\" is duplicated in \"%s\".", name,
+                       weights->path);
+          goto cleanup;
+        }
+
+      tensor = g_new (ChatbotWeightsTensor, 1);
+      tensor->offset = offset;
+      tensor->size = size;
+      g_hash_table_insert (weights->tensors, g_strdup (name), tensor);
+      g_ptr_array_add (names, g_strdup (name));
+    }
+
+  g_ptr_array_add (names, NULL);
+  weights->names = (gchar **)g_ptr_array_free (g_steal_pointer (&names),
+                                               FALSE);
+  ret = TRUE;
+
+cleanup:
+  if (names)
+    g_ptr_array_unref (names);
+  g_variant_unref (index);
+  return ret;
+}
+
+/**
+ * chatbot_weights_open:
+ * @path: path of the weights file
+ * @flags: hints applied to the mapping
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Map the weights file read-only. If the file is already mapped in this
+ * process, the mapping is shared and @flags are applied to it in addition.
+ *
+ * Returns: (transfer full) (nullable): mapped weights or %NULL on error
+ */
+ChatbotWeights *
+chatbot_weights_open (const gchar *path, ChatbotWeightsFlags flags,
+                      GError **error)
+{
+  ChatbotWeights *weights = NULL;
+  struct stat st;
+  gchar *key = NULL;
+  gpointer data;
+  int fd, errsv;
+
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), NULL);
+
+  fd = g_open (path, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0)
+    {
+      errsv = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Failed to open \"%s\": %s", path, g_strerror (errsv));
+      return NULL;
+    }
+
+  if (fstat (fd, &st) < 0)
+    {
+      errsv = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Failed to stat \"%s\": %s", path, g_strerror (errsv));
+      goto cleanup;
+    }
+  if ((st.st_size < CHATBOT_WEIGHTS_HEADER_SIZE)
+      || ((guint64)st.st_size > G_MAXSIZE))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "\"%s\" is not a weights file.", path);
+      goto cleanup;
+    }
+
+  // A replaced file has another inode or mtime, so it's mapped again.
+  key = g_strdup_printf ("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT
+                         ":%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT,
+                         (guint64)st.st_dev, (guint64)st.st_ino,
+                         (gint64)st.st_size, (gint64)st.st_mtime);
+
+  g_mutex_lock (&weights_mutex);
+  if (weights_cache == NULL)
+    weights_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+  weights = g_hash_table_lookup (weights_cache, key);
+  if (weights)
+    {
+      g_ref_count_inc (&weights->ref);
+      g_mutex_unlock (&weights_mutex);
+      chatbot_weights_advise (weights, flags);
+      goto cleanup;
+    }
+
+  data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+    {
+      errsv = errno;
+      g_mutex_unlock (&weights_mutex);
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Failed to map \"%s\": %s", path, g_strerror (errsv));
+      goto cleanup;
+    }
+
+  weights = g_new0 (ChatbotWeights, 1);
+  weights->path = g_strdup (path);
+  weights->key = g_steal_pointer (&key);
+  weights->data = data;
+  weights->size = st.st_size;
+  weights->tensors
+      = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  g_ref_count_init (&weights->ref);
+
+  if (!chatbot_weights_parse (weights, error))
+    {
+      g_mutex_unlock (&weights_mutex);
+      g_clear_pointer (&weights, chatbot_weights_free);
+      goto cleanup;
+    }
+
+  g_hash_table_insert (weights_cache, weights->key, weights);
+  g_mutex_unlock (&weights_mutex);
+  chatbot_weights_advise (weights, flags);
+
+cleanup:
+  close (fd);
+  g_free (key);
+  return weights;
+}
+
+/**
+ * chatbot_weights_ref:
+ * @weights: weights
+ *
+ * Returns: @weights
+ */
+ChatbotWeights *
+chatbot_weights_ref (ChatbotWeights *weights)
+{
+  g_return_val_if_fail (weights != NULL, NULL);
+
+  g_mutex_lock (&weights_mutex);
+  g_ref_count_inc (&weights->ref);
+  g_mutex_unlock (&weights_mutex);
+  return weights;
+}
+
+/**
+ * chatbot_weights_unref:
+ * @weights: weights
+ *
+ * Release the reference. The file is unmapped when the last reference in
+ * the process is released.
+ */
+void
+chatbot_weights_unref (ChatbotWeights *weights)
+{
+  g_return_if_fail (weights != NULL);
+
+  // The lock keeps chatbot_weights_open() from reviving a dying mapping.
+  g_mutex_lock (&weights_mutex);
+  if (!g_ref_count_dec (&weights->ref))
+    {
+      g_mutex_unlock (&weights_mutex);
+      return;
+    }
+  g_hash_table_remove (weights_cache, weights->key);
+  g_mutex_unlock (&weights_mutex);
+
+  chatbot_weights_free (weights);
+}
+
+/**
+ * chatbot_weights_get_path:
+ * @weights: weights
+ *
+ * Returns: (transfer none): path the weights are opened from
+ */
+const gchar *
+chatbot_weights_get_path (ChatbotWeights *weights)
+{
+  g_return_val_if_fail (weights != NULL, NULL);
+  return weights->path;
+}
+
+/**
+ * chatbot_weights_get_alignment:
+ * @weights: weights
+ *
+ * Returns: alignment of tensor offsets in bytes
+ */
+gsize
+chatbot_weights_get_alignment (ChatbotWeights *weights)
+{
+  g_return_val_if_fail (weights != NULL, 0);
+  return weights->alignment;
+}
+
+/**
+ * chatbot_weights_get_tensor_names:
+ * @weights: weights
+ *
+ * Returns: (transfer none) (array zero-terminated=1): tensor names in file
+ * order
+ */
+const gchar *const *
+chatbot_weights_get_tensor_names (ChatbotWeights *weights)
+{
+  g_return_val_if_fail (weights != NULL, NULL);
+  return (const gchar *const *)weights->names;
+}
+
+/**
+ * chatbot_weights_get_tensor:
+ * @weights: weights
+ * @name: tensor name
+ * @size: (out) (optional): size of the tensor in bytes
+ *
+ * Get the mapped data of the tensor. The data is read-only, valid while
+ * @weights is alive and aligned to [method@Weights.get_alignment].
+ *
+ * Returns: (transfer none) (nullable): tensor data, or %NULL if @name is not
+ * in @weights
+ */
+gconstpointer
+chatbot_weights_get_tensor (ChatbotWeights *weights, const gchar *name,
+                            gsize *size)
+{
+  ChatbotWeightsTensor *tensor;
+
+  g_return_val_if_fail (weights != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  tensor = g_hash_table_lookup (weights->tensors, name);
+  if (tensor == NULL)
+    return NULL;
+
+  if (size)
+    *size = tensor->size;
+  return weights->data + tensor->offset;
+}
+
+/**
+ * chatbot_weights_get_tensor_bytes:
+ * @weights: weights
+ * @name: tensor name
+ *
+ * Same as [method@Weights.get_tensor], but the returned #GBytes keeps
+ * @weights alive.
+ *
+ * Returns: (transfer full) (nullable): tensor data, or %NULL if @name is not
+ * in @weights
+ */
+GBytes *
+chatbot_weights_get_tensor_bytes (ChatbotWeights *weights, const gchar *name)
+{
+  gconstpointer data;
+  gsize size;
+
+  g_return_val_if_fail (weights != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  data = chatbot_weights_get_tensor (weights, name, &size);
+  if (data == NULL)
+    return NULL;
+
+  return g_bytes_new_with_free_func (data, size,
+                                     (GDestroyNotify)chatbot_weights_unref,
+                                     chatbot_weights_ref (weights));
+}
+
+static GVariant *
+chatbot_weights_build_index (const gchar *const *names,
+                             GBytes *const *tensors, gsize n_tensors,
+                             guint64 start, guint64 alignment)
+{
+  GVariantBuilder builder;
+  guint64 offset = start;
+
+  g_variant_builder_init (&builder,
+                          G_VARIANT_TYPE (CHATBOT_WEIGHTS_INDEX_TYPE));
+  for (gsize i = 0; i < n_tensors; i++)
+    {
+      gsize size = g_bytes_get_size (tensors[i]);
+
+      offset = chatbot_weights_align (offset, alignment);
+      g_variant_builder_add (&builder, "(stt)", names[i], offset,
+                             (guint64)size);
+      offset += size;
+    }
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static gboolean
+chatbot_weights_write_padding (GOutputStream *stream, guint64 *position,
+                               guint64 offset, GCancellable *cancellable,
+                               GError **error)
+{
+  static const guint8 zeros[4096] = { 0 };
+
+  while (*position < offset)
+    {
+      gsize n = MIN (offset - *position, sizeof (zeros));
+
+      if (!g_output_stream_write_all (stream, zeros, n, NULL, cancellable,
+                                      error))
+        return FALSE;
+      *position += n;
+    }
+  return TRUE;
+}
+
+/**
+ * chatbot_weights_write:
+ * @path: path of the weights file
+ * @names: (array length=n_tensors): tensor names
+ * @tensors: (array length=n_tensors): tensor data
+ * @n_tensors: number of tensors
+ * @alignment: alignment of tensor offsets, which must be a power of 2, or 0
+ *   for 64 KiB
+ * @cancellable: (nullable): a #GCancellable
+ * @error: (nullable): pointer to the #GError* to store error
+ *
+ * Write tensors as a weights file for [func@Weights.open]. The file is
+ * replaced atomically, so processes which mapped the old file keep using it.
+ *
+ * Returns: %TRUE if the file is written
+ */
+gboolean
+chatbot_weights_write (const gchar *path, const gchar *const *names,
+                       GBytes *const *tensors, gsize n_tensors,
+                       gsize alignment, GCancellable *cancellable,
+                       GError **error)
+{
+  GFile *file = NULL;
+  GFileOutputStream *stream = NULL;
+  GHashTable *seen = NULL;
+  GVariant *index = NULL;
+  guint8 header[CHATBOT_WEIGHTS_HEADER_SIZE];
+  guint64 position, start, index_size;
+  guint32 value32;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail ((n_tensors == 0) || (names && tensors), FALSE);
+  g_return_val_if_fail ((alignment & (alignment - 1)) == 0, FALSE);
+  g_return_val_if_fail (alignment <= G_MAXUINT32, FALSE);
+  g_return_val_if_fail ((error == NULL) || (*error == NULL), FALSE);
+
+  if (alignment == 0)
+    alignment = CHATBOT_WEIGHTS_DEFAULT_ALIGNMENT;
+
+  for (gsize i = 0; i < n_tensors; i++)
+    g_return_val_if_fail (names[i] && tensors[i], FALSE);
+
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+  for (gsize i = 0; i < n_tensors; i++)
+    {
+      if (!g_hash_table_add (seen, (gpointer)names[i]))
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                       "Tensor \"%s\" is duplicated.", names[i]);
+          goto cleanup;
+        }
+    }
+
+  // Offsets are fixed size, so the index size doesn't depend on them.
+  index = chatbot_weights_build_index (names, tensors, n_tensors, 0,
+                                       alignment);
+  index_size = g_variant_get_size (index);
+  start = chatbot_weights_align (CHATBOT_WEIGHTS_HEADER_SIZE + index_size,
+                                 alignment);
+  g_variant_unref (index);
+  index = chatbot_weights_build_index (names, tensors, n_tensors, start,
+                                       alignment);
+  if (G_BYTE_ORDER != G_LITTLE_ENDIAN)
+    {
+      GVariant *swapped = g_variant_byteswap (index);
+      g_variant_unref (index);
+      index = swapped;
+    }
+
+  memcpy (header, CHATBOT_WEIGHTS_MAGIC, 8);
+  value32 = GUINT32_TO_LE (CHATBOT_WEIGHTS_VERSION);
+  memcpy (header + 8, &value32, sizeof (value32));
+  value32 = GUINT32_TO_LE ((guint32)alignment);
+  memcpy (header + 12, &value32, sizeof (value32));
+  index_size = GUINT64_TO_LE (index_size);
+  memcpy (header + 16, &index_size, sizeof (index_size));
+
+  file = g_file_new_for_path (path);
+  stream = g_file_replace (file, NULL, FALSE,
+                           G_FILE_CREATE_REPLACE_DESTINATION, cancellable,
+                           error);
+  if (stream == NULL)
+    goto cleanup;
+
+  if (!g_output_stream_write_all (G_OUTPUT_STREAM (stream), header,
+                                  sizeof (header), NULL, cancellable, error)
+      || !g_output_stream_write_all (
+          G_OUTPUT_STREAM (stream), g_variant_get_data (index),
+          g_variant_get_size (index), NULL, cancellable, error))
+    goto cleanup;
+  position = CHATBOT_WEIGHTS_HEADER_SIZE + g_variant_get_size (index);
+
+  for (gsize i = 0; i < n_tensors; i++)
+    {
+      gsize size;
+      gconstpointer data = g_bytes_get_data (tensors[i], &size);
+
+      if (!chatbot_weights_write_padding (
+              G_OUTPUT_STREAM (stream), &position,
+              chatbot_weights_align (position, alignment), cancellable,
+              error))
+        goto cleanup;
+      if (!g_output_stream_write_all (G_OUTPUT_STREAM (stream), data, size,
+                                      NULL, cancellable, error))
+        goto cleanup;
+      position += size;
+    }
+
+  ret = g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, error);
+
+cleanup:
+  if (stream && !ret)
+    {
+      // Closing with a cancelled cancellable discards the temporary file
+      // instead of replacing @path with a partial one.
+      GCancellable *abort = g_cancellable_new ();
+      g_cancellable_cancel (abort);
+      g_output_stream_close (G_OUTPUT_STREAM (stream), abort, NULL);
+      g_object_unref (abort);
+    }
+  g_clear_object (&stream);
+  g_clear_object (&file);
+  g_clear_pointer (&index, g_variant_unref);
+  g_hash_table_unref (seen);
+  return ret;
+}
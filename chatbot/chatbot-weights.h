@@ -0,0 +1,68 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <gio/gio.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ChatbotWeightsFlags:
+ * @CHATBOT_WEIGHTS_NONE: no hint
+ * @CHATBOT_WEIGHTS_WILLNEED: start reading the whole file into the page cache
+ * @CHATBOT_WEIGHTS_RANDOM: tensors are accessed sparsely, disable readahead
+ * @CHATBOT_WEIGHTS_HUGEPAGES: back the mapping with huge pages if the kernel
+ *   supports it for the file system
+ *
+ * Hints applied to the mapping with madvise().
+ */
+typedef enum
+{
+  CHATBOT_WEIGHTS_NONE = 0,
+  CHATBOT_WEIGHTS_WILLNEED = 1 << 0,
+  CHATBOT_WEIGHTS_RANDOM = 1 << 1,
+  CHATBOT_WEIGHTS_HUGEPAGES = 1 << 2
+} ChatbotWeightsFlags;
+
+#define CHATBOT_TYPE_WEIGHTS chatbot_weights_get_type ()
+GType chatbot_weights_get_type (void) G_GNUC_CONST;
+
+/**
+ * ChatbotWeights:
+ *
+ * Opaque structure of a read-only mapped weights file.
+ */
+typedef struct _ChatbotWeights ChatbotWeights;
+
+ChatbotWeights *chatbot_weights_open (const gchar *path,
+                                      ChatbotWeightsFlags flags,
+                                      GError **error);
+ChatbotWeights *chatbot_weights_ref (ChatbotWeights *weights);
+void chatbot_weights_unref (ChatbotWeights *weights);
+const gchar *chatbot_weights_get_path (ChatbotWeights *weights);
+gsize chatbot_weights_get_alignment (ChatbotWeights *weights);
+const gchar *const *
+chatbot_weights_get_tensor_names (ChatbotWeights *weights);
+gconstpointer chatbot_weights_get_tensor (ChatbotWeights *weights,
+                                          const gchar *name, gsize *size);
+GBytes *chatbot_weights_get_tensor_bytes (ChatbotWeights *weights,
+                                          const gchar *name);
+gboolean chatbot_weights_write (const gchar *path, const gchar *const *names,
+                                GBytes *const *tensors, gsize n_tensors,
+                                gsize alignment, GCancellable *cancellable,
+                                GError **error);
+
+G_END_DECLS
@@ -15,8 +15,19 @@
 #pragma once
 
 #include "chatbot-chat-data.h"
+#include "chatbot-chat-log.h"
 #include "chatbot-data.h"
 #include "chatbot-language-model.h"
+#include "chatbot-lazy-tool.h"
+#include "chatbot-memory.h"
+#include "chatbot-metrics.h"
+#include "chatbot-module-manifest.h"
+#include "chatbot-module-registry.h"
+#include "chatbot-remote-tool.h"
 #include "chatbot-tool-callable-language-model.h"
+#include "chatbot-tool-renderer.h"
+#include "chatbot-tool-stream.h"
 #include "chatbot-tool.h"
+#include "chatbot-trace.h"
 #include "chatbot-trainer.h"
+#include "chatbot-weights.h"
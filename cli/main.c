@@ -13,140 +13,1993 @@
  * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <gio/gio.h>
-#include <gmodule.h>
+#include <gio/gunixinputstream.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
 
 #include "chatbot.h"
 
 typedef struct
 {
-  GModule *gmodule;
+  GMainLoop *loop;
+  guint n_loads;
+  guint n_finished;
+} ModuleLoader;
+
+typedef struct
+{
+  ModuleLoader *loader;
+  const gchar *path;
+  const gchar *parameter;
+  GType type;
+  ChatbotModule *instance; // connected to "progress" while loading
+  ChatbotModule *module;
+  GError *error;
+  gint64 start_time;
+} ModuleLoad;
+
+static void
+module_load_finish (ModuleLoad *load, gpointer instance, GError *error)
+{
+  ModuleLoader *loader = load->loader;
+
+  load->module = instance;
+  load->error = error;
+  loader->n_finished++;
+
+  // Progress queued before the failure must not reach @load once it's freed.
+  if (load->instance)
+    {
+      g_signal_handlers_disconnect_by_data (load->instance, load);
+      g_clear_object (&load->instance);
+    }
+
+  if (instance)
+    {
+      fprintf (stderr, "[%u/%u] Loaded module \"%s\" in %.2f s.\n",
+               loader->n_finished, loader->n_loads, load->path,
+               (g_get_monotonic_time () - load->start_time)
+                   / (gdouble)G_USEC_PER_SEC);
+    }
+  else
+    fprintf (stderr, "[%u/%u] Failed to load module \"%s\".\n",
+             loader->n_finished, loader->n_loads, load->path);
+
+  if ((loader->n_finished == loader->n_loads) && loader->loop)
+    g_main_loop_quit (loader->loop);
+}
+
+static void
+module_load_ready (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+  GError *error = NULL;
+  ChatbotModule *instance;
+
+  instance = chatbot_module_new_finish (result, &error);
+  module_load_finish (user_data, instance, error);
+}
+
+static void
+module_load_progress (ChatbotModule *module, gdouble fraction,
+                      const gchar *message, ModuleLoad *load)
+{
+  fprintf (stderr, "Loading module \"%s\": %3.0f%%%s%s\n", load->path,
+           fraction * 100.0, message ? " " : "", message ? message : "");
+}
+
+/*
+ * Opens and initializes modules concurrently with chatbot_module_new_async(),
+ * printing the progress they report. Returns loads in the same order as
+ * @paths.
+ */
+static ModuleLoad *
+modules_load (gchar **paths, gchar **parameters, guint n_loads)
+{
+  ModuleLoader loader = { NULL, n_loads, 0 };
+  ModuleLoad *loads = g_new0 (ModuleLoad, n_loads);
+
+  for (guint i = 0; i < n_loads; i++)
+    {
+      ModuleLoad *load = &loads[i];
+      ChatbotModule *instance;
+      GError *error = NULL;
+
+      load->loader = &loader;
+      load->path = paths[i];
+      load->parameter = parameters[i];
+      load->start_time = g_get_monotonic_time ();
+
+      load->type = chatbot_module_registry_load_type (
+          chatbot_module_registry_get_default (), load->path, &error);
+      if (load->type == G_TYPE_INVALID)
+        {
+          module_load_finish (load, NULL, error);
+          continue;
+        }
+
+      instance = chatbot_module_new_async (load->type, load->parameter,
+                                           G_PRIORITY_DEFAULT, NULL,
+                                           module_load_ready, load);
+      load->instance = g_object_ref (instance);
+      g_signal_connect (instance, "progress",
+                        G_CALLBACK (module_load_progress), load);
+    }
+
+  if (loader.n_finished < loader.n_loads)
+    {
+      loader.loop = g_main_loop_new (NULL, FALSE);
+      g_main_loop_run (loader.loop);
+      g_main_loop_unref (loader.loop);
+    }
+
+  for (guint i = 0; i < n_loads; i++)
+    loads[i].loader = NULL;
+  return loads;
+}
+
+enum
+{
+  ARG_MODULES,
+  ARG_MODULE_PARAMETERS,
+  ARG_SYSTEM_PROMPT,
+  ARG_SYSTEM_PROMPT_FILE,
+  ARG_STATE_FILE,
+  ARG_TRAINING_MODULE,
+  ARG_TRAINING_MODULE_PARAMETER,
+  ARG_REMOTE_TOOLS,
+  ARG_REMOTE_TOOL_PARAMETERS,
+  ARG_TOOL_WORKERS,
+  ARG_TOOL_WORKER_PATH,
+  ARG_TOOL_TIMEOUT,
+  ARG_PLUGIN_DIRS,
+  ARG_LIST_MODULES,
+  ARG_LAZY_TOOLS,
+  ARG_METRICS_INTERVAL,
+  ARG_TRACE,
+  ARG_BATCH,
+  ARG_BATCH_OUTPUT,
+  ARG_BATCH_JOBS,
+  ARG_LISTEN,
+  ARG_SPECULATIVE_PREFILL,
+  ARG_CHAT_LOG,
+  ARG_CHAT_LOG_COMPRESS,
+  ARG_NULL,
+  N_ARGS
+};
+
+static gchar **module_paths = NULL;
+static gchar **module_parameters = NULL;
+static gchar *system_prompt = NULL;
+static gchar *system_prompt_file = NULL;
+static gchar *state_file = NULL;
+static gchar *training_module_path = NULL;
+static gchar *training_module_parameter = NULL;
+static gchar **remote_tool_paths = NULL;
+static gchar **remote_tool_parameters = NULL;
+static gint tool_workers = 1;
+static gchar *tool_worker_path = NULL;
+static gint tool_timeout = 60;
+static gchar **plugin_dirs = NULL;
+static gboolean list_modules = FALSE;
+static gboolean lazy_tools = FALSE;
+static gint metrics_interval = 0;
+static gchar *trace_path = NULL;
+static gchar *batch_path = NULL;
+static gchar *batch_output_path = NULL;
+static gint batch_jobs = 1;
+static gchar *listen_path = NULL;
+static gboolean speculative_prefill = FALSE;
+static gchar *chat_log_path = NULL;
+static gboolean chat_log_compress = FALSE;
+
+static const GOptionEntry option_entries[N_ARGS] = {
+  { "modules", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME_ARRAY,
+    &module_paths, "Modules to use, include language model, and tools.",
+    "module..." },
+  { "module-parameters", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING_ARRAY,
+    &module_parameters, "Parameters for each module.", "parameters..." },
+  { "system-prompt", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING,
+    &system_prompt, "System prompt for session." },
+  { "system-prompt-file", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,
+    &system_prompt_file, "System prompt for session." },
+  { "state-file", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &state_file,
+    "State file for session." },
+  { "training-module", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,
+    &training_module_path, "Training Module to train model.", "module" },
+  { "training-module-parameter", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING,
+    &training_module_parameter, "Parameter of Training Module", "parameter" },
+  { "remote-tools", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME_ARRAY,
+    &remote_tool_paths, "Tool modules to run in worker processes.",
+    "module..." },
+  { "remote-tool-parameters", 0, G_OPTION_FLAG_NONE,
+    G_OPTION_ARG_STRING_ARRAY, &remote_tool_parameters,
+    "Parameters for each remote tool module.", "parameters..." },
+  { "tool-workers", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &tool_workers,
+    "Number of worker processes for each remote tool.", "n" },
+  { "tool-worker-path", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,
+    &tool_worker_path, "Worker executable for remote tools and plugin scans.",
+    "path" },
+  { "tool-timeout", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &tool_timeout,
+    "Seconds a remote tool call may take before its worker is killed. 0 "
+    "waits forever.",
+    "seconds" },
+  { "plugin-dir", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME_ARRAY,
+    &plugin_dirs,
+    "Directory of modules. Modules in it can be specified by name.", "dir" },
+  { "list-modules", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &list_modules,
+    "List modules in plugin directories and exit.", NULL },
+  { "lazy-tools", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &lazy_tools,
+    "Load tool modules found in plugin directories at their first call.",
+    NULL },
+  { "metrics-interval", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+    &metrics_interval,
+    "Print latency metrics to stderr every given seconds in interactive "
+    "mode.",
+    "seconds" },
+  { "trace", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &trace_path,
+    "Write trace spans in Chrome trace format to the file.", "file" },
+  { "batch", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &batch_path,
+    "Run each line of the JSONL or TSV file as a new session and exit.",
+    "file" },
+  { "batch-output", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,
+    &batch_output_path, "Write batch results to the file instead of stdout.",
+    "file" },
+  { "batch-jobs", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &batch_jobs,
+    "Number of model instances running batch prompts concurrently.", "n" },
+  { "listen", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &listen_path,
+    "Serve chat sessions on the Unix socket instead of stdin.", "path" },
+  { "speculative-prefill", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+    &speculative_prefill,
+    "Prefill a <<TAG multi-line message while it's being read, if the model "
+    "can rewind.",
+    NULL },
+  { "chat-log", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &chat_log_path,
+    "Append messages of all sessions to the chat log.", "file" },
+  { "chat-log-compress", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+    &chat_log_compress, "Compress messages written to the chat log.", NULL },
+  G_OPTION_ENTRY_NULL
+};
+
+static gboolean
+generating (ChatbotLanguageModel *lm, const gchar *text, gpointer user_data)
+{
+  printf ("%s", text);
+  fflush (stdout);
+  return TRUE;
+}
+
+static ChatbotChatLog *chat_log = NULL;
+
+/*
+ * Appends a message to --chat-log. Losing a message of the log is not worth
+ * failing the session for.
+ */
+static void
+log_message (guint64 session, const gchar *role, const gchar *message)
+{
+  GError *error = NULL;
+
+  if (chat_log == NULL)
+    return;
+  if (!chatbot_chat_log_append (chat_log, session, role, message, &error))
+    {
+      g_warning ("Failed to log message. Error: \"%s\"", error->message);
+      g_error_free (error);
+    }
+}
+
+typedef void (*UserInputCallback) (const gchar *partial, gpointer user_data);
+
+/*
+ * Reads a message from @input. A line "<<TAG" starts a multi-line message
+ * which ends at a line of only TAG, so pasted text can contain blank lines.
+ * @callback is called with the message read so far after each line of a
+ * multi-line message. A single-line message is complete once it's read, so
+ * the callback isn't called for it. Returns NULL at the end of input or on
+ * failure.
+ */
+static gchar *
+read_user_input (GDataInputStream *input, UserInputCallback callback,
+                 gpointer user_data, GError **error)
+{
+  GString *message;
+  gchar *line, *delimiter;
+
+  line = g_data_input_stream_read_line (input, NULL, NULL, error);
+  if ((line == NULL) || !g_str_has_prefix (line, "<<"))
+    return line;
+
+  delimiter = g_strstrip (g_strdup (line + 2));
+  g_free (line);
+  if (delimiter[0] == '\0')
+    {
+      g_free (delimiter);
+      return g_strdup ("<<");
+    }
+
+  message = g_string_new (NULL);
+  while ((line = g_data_input_stream_read_line (input, NULL, NULL, error)))
+    {
+      if (!strcmp (line, delimiter))
+        {
+          g_free (line);
+          break;
+        }
+      if (message->len > 0)
+        g_string_append_c (message, '\n');
+      g_string_append (message, line);
+      g_free (line);
+      callback (message->str, user_data);
+    }
+  g_free (delimiter);
+
+  // Input ending before the delimiter still makes a message.
+  if ((line == NULL) && error && *error)
+    {
+      g_string_free (message, TRUE);
+      return NULL;
+    }
+  return g_string_free (message, FALSE);
+}
+
+/*
+ * Keeps the chat templates and responses of the session in @context, and
+ * brings the model to it with chatbot_language_model_ensure_context(), which
+ * prefills only what the model hasn't consumed yet and rebuilds the session
+ * if the model lost it.
+ *
+ * With --speculative-prefill, a multi-line "<<TAG" message is also prefilled
+ * while the rest of it is being read, so only the text after the last line
+ * read is left to prefill when it's complete. A single-line message gains
+ * nothing, since there is no partial message to prefill before it's read.
+ * Every update applies the chat template to the message read so far, and the
+ * model is rewound to the common prefix with what it has consumed. Since chat
+ * templates put the message before the assistant header, only that header
+ * and the new text are prefilled again. Speculation works at line
+ * granularity, as stdin is read a line at a time.
+ */
+typedef struct
+{
+  ChatbotLanguageModel *language_model;
+  const gchar *system_prompt;
+  GString *context;
+  gboolean enabled;
+} SpeculativePrefill;
+
+static gboolean
+speculative_prefill_to (SpeculativePrefill *speculative, const gchar *text,
+                        GError **error)
+{
+  gchar *full = g_strconcat (speculative->context->str, text, NULL);
+  gboolean rebuilt;
+  gboolean ret;
+
+  ret = chatbot_language_model_ensure_context (speculative->language_model,
+                                               full, &rebuilt, error);
+  if (rebuilt)
+    g_debug ("Prefilled the session again from the start.");
+  g_free (full);
+  return ret;
+}
+
+static void
+speculative_prefill_update (const gchar *partial, gpointer user_data)
+{
+  SpeculativePrefill *speculative = user_data;
+  GStrvBuilder *builder;
+  GStrv role_and_messages;
+  gchar *chat_template;
+  GError *error = NULL;
+
+  // Nothing of the message is known yet.
+  if (!speculative->enabled || (partial[0] == '\0'))
+    return;
+
+  builder = g_strv_builder_new ();
+  if (speculative->system_prompt)
+    g_strv_builder_add_many (builder, "system", speculative->system_prompt,
+                             NULL);
+  g_strv_builder_add_many (builder, "user", partial, "assistant", NULL);
+  role_and_messages = g_strv_builder_end (builder);
+  chat_template = chatbot_language_model_apply_chat_template (
+      speculative->language_model, role_and_messages);
+
+  if (!speculative_prefill_to (speculative, chat_template, &error))
+    {
+      g_warning ("Disabling speculative prefill. Error: \"%s\"",
+                 error->message);
+      g_error_free (error);
+      speculative->enabled = FALSE;
+    }
+
+  g_free (chat_template);
+  g_strfreev (role_and_messages);
+  g_strv_builder_unref (builder);
+}
+
+/*
+ * Appends @text to the context and prefills it, reusing what is prefilled
+ * speculatively, so the next message is speculated from there.
+ */
+static gboolean
+speculative_prefill_commit (SpeculativePrefill *speculative,
+                            const gchar *text, GError **error)
+{
+  if (!speculative_prefill_to (speculative, text, error))
+    return FALSE;
+  g_string_append (speculative->context, text);
+  return TRUE;
+}
+
+typedef struct
+{
+  ChatbotTool *tool;
+  gchar *path;
+  gchar *parameter;
+  gboolean remote;
+} LoadedTool;
+
+static void
+loaded_tool_free (LoadedTool *loaded)
+{
+  g_object_unref (loaded->tool);
+  g_free (loaded->path);
+  g_free (loaded->parameter);
+  g_free (loaded);
+}
+
+static LoadedTool *
+loaded_tool_new (ChatbotTool *tool, const gchar *path, const gchar *parameter,
+                 gboolean remote)
+{
+  LoadedTool *loaded = g_new (LoadedTool, 1);
+
+  loaded->tool = g_object_ref (tool);
+  loaded->path = g_strdup (path);
+  loaded->parameter = g_strdup (parameter);
+  loaded->remote = remote;
+  return loaded;
+}
+
+static LoadedTool *
+loaded_tool_open (const gchar *path, const gchar *parameter, gboolean remote,
+                  GError **error)
+{
+  ChatbotModule *module;
+  LoadedTool *loaded;
+
+  if (remote)
+    {
+      module = CHATBOT_MODULE (chatbot_remote_tool_new (
+          tool_worker_path, path, parameter, MAX (tool_workers, 1), NULL,
+          error));
+      if (module)
+        g_object_set (module, "call-timeout",
+                      (guint)MAX (tool_timeout, 0) * 1000, NULL);
+    }
+  else
+    {
+      GType type = chatbot_module_registry_load_type (
+          chatbot_module_registry_get_default (), path, error);
+      if (type == G_TYPE_INVALID)
+        return NULL;
+      module = chatbot_module_new (type, parameter ? parameter : "", error);
+    }
+  if (module == NULL)
+    return NULL;
+
+  if (!CHATBOT_IS_TOOL (module))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Module \"%s\" doesn't implement ChatbotTool.", path);
+      g_object_unref (module);
+      return NULL;
+    }
+
+  loaded = loaded_tool_new (CHATBOT_TOOL (module), path, parameter, remote);
+  g_object_unref (module);
+  return loaded;
+}
+
+static LoadedTool *
+loaded_tool_find (GPtrArray *tools, const gchar *name, guint *index)
+{
+  for (guint i = 0; i < tools->len; i++)
+    {
+      LoadedTool *loaded = g_ptr_array_index (tools, i);
+      if (!g_strcmp0 (
+              chatbot_module_get_name (CHATBOT_MODULE (loaded->tool)), name))
+        {
+          *index = i;
+          return loaded;
+        }
+    }
+  return NULL;
+}
+
+static gboolean
+tool_attach (ChatbotLanguageModel *language_model, LoadedTool *loaded,
+             GError **error)
+{
+  if (!CHATBOT_IS_TOOL_CALLABLE_LANGUAGE_MODEL (language_model))
+    return TRUE;
+  return chatbot_tool_callable_language_model_add_tool (
+      CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL (language_model), loaded->tool,
+      error);
+}
+
+/*
+ * Stops offering the tool to the model, and waits for its in-flight calls
+ * before it's released.
+ */
+static gboolean
+tool_detach (ChatbotLanguageModel *language_model, LoadedTool *loaded,
+             GError **error)
+{
+  if (CHATBOT_IS_TOOL_CALLABLE_LANGUAGE_MODEL (language_model))
+    chatbot_tool_callable_language_model_remove_tool (
+        CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL (language_model),
+        chatbot_module_get_name (CHATBOT_MODULE (loaded->tool)));
+  return chatbot_tool_drain (loaded->tool, NULL, error);
+}
+
+/*
+ * Takes an instance of the type of @language_model created with the same
+ * parameter from the module registry, and offers @tools to it.
+ */
+static ChatbotLanguageModel *
+language_model_checkout (ChatbotLanguageModel *language_model,
+                         GPtrArray *tools, GError **error)
+{
   ChatbotModule *module;
-} Module;
 
+  module = chatbot_module_registry_checkout (
+      chatbot_module_registry_get_default (), G_OBJECT_TYPE (language_model),
+      chatbot_module_get_raw_parameter (CHATBOT_MODULE (language_model)),
+      error);
+  if (module == NULL)
+    return NULL;
+
+  for (guint i = 0; i < tools->len; i++)
+    if (!tool_attach (CHATBOT_LANGUAGE_MODEL (module),
+                      g_ptr_array_index (tools, i), error))
+      {
+        g_object_unref (module);
+        return NULL;
+      }
+  return CHATBOT_LANGUAGE_MODEL (module);
+}
+
+/*
+ * Gives an instance taken by language_model_checkout() back. It's pooled only
+ * if it can be reset, so the next checkout starts a new session.
+ */
+static void
+language_model_return (ChatbotLanguageModel *language_model, GPtrArray *tools)
+{
+  if (CHATBOT_IS_TOOL_CALLABLE_LANGUAGE_MODEL (language_model))
+    for (guint i = 0; i < tools->len; i++)
+      {
+        LoadedTool *loaded = g_ptr_array_index (tools, i);
+        chatbot_tool_callable_language_model_remove_tool (
+            CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL (language_model),
+            chatbot_module_get_name (CHATBOT_MODULE (loaded->tool)));
+      }
+
+  if (chatbot_language_model_reset (language_model, NULL))
+    chatbot_module_registry_return (chatbot_module_registry_get_default (),
+                                    CHATBOT_MODULE (language_model));
+  else
+    g_object_unref (language_model);
+}
+
+static void
+print_metrics (FILE *file, ChatbotMetrics *metrics)
+{
+  GVariant *value;
+  gchar *text;
+
+  value = g_variant_ref_sink (chatbot_metrics_to_variant (metrics));
+  text = g_variant_print (value, FALSE);
+
+  fprintf (file, "Metrics: %s\n", text);
+  g_free (text);
+  g_variant_unref (value);
+}
+
+static void
+print_memory (GPtrArray *modules, ChatbotChatData *chat_data)
+{
+  GVariant *value = g_variant_ref_sink (chatbot_memory_to_variant ());
+  gchar *text = g_variant_print (value, FALSE);
+
+  printf ("Memory: %s\n", text);
+  for (guint i = 0; i < modules->len; i++)
+    {
+      ChatbotModule *module = g_ptr_array_index (modules, i);
+      printf ("  %s: weights %" G_GSIZE_FORMAT ", state %" G_GSIZE_FORMAT
+              ", scratch %" G_GSIZE_FORMAT "\n",
+              chatbot_module_get_name (module),
+              chatbot_module_get_memory_usage (module, CHATBOT_MEMORY_WEIGHTS),
+              chatbot_module_get_memory_usage (module, CHATBOT_MEMORY_STATE),
+              chatbot_module_get_memory_usage (module,
+                                               CHATBOT_MEMORY_SCRATCH));
+    }
+  printf ("  chat data: %" G_GSIZE_FORMAT "\n",
+          chatbot_chat_data_get_memory_usage (chat_data));
+  g_free (text);
+  g_variant_unref (value);
+}
+
+/*
+ * Handles "metrics", "metrics-reset" and "memory" commands.
+ */
+static gboolean
+run_stats_command (ChatbotLanguageModel *language_model, GPtrArray *modules,
+                   ChatbotChatData *chat_data, const gchar *command)
+{
+  if (!strcmp (command, "metrics"))
+    print_metrics (stdout,
+                   chatbot_language_model_get_metrics (language_model));
+  else if (!strcmp (command, "metrics-reset"))
+    chatbot_metrics_reset (
+        chatbot_language_model_get_metrics (language_model));
+  else if (!strcmp (command, "memory"))
+    print_memory (modules, chat_data);
+  else
+    return FALSE;
+  return TRUE;
+}
+
+/*
+ * Prints metrics to stderr every --metrics-interval seconds. The interactive
+ * loop blocks on reading stdin, so the timer runs in a thread with its own
+ * main context. ChatbotMetrics is locked, so it can be read from there.
+ */
+typedef struct
+{
+  ChatbotMetrics *metrics;
+  GMainContext *context;
+  GMainLoop *loop;
+  GThread *thread;
+} MetricsDumper;
+
+static gboolean
+metrics_dumper_dump (gpointer user_data)
+{
+  MetricsDumper *dumper = user_data;
+
+  print_metrics (stderr, dumper->metrics);
+  return G_SOURCE_CONTINUE;
+}
+
+static gpointer
+metrics_dumper_run (gpointer user_data)
+{
+  MetricsDumper *dumper = user_data;
+
+  g_main_context_push_thread_default (dumper->context);
+  g_main_loop_run (dumper->loop);
+  g_main_context_pop_thread_default (dumper->context);
+  return NULL;
+}
+
+static MetricsDumper *
+metrics_dumper_start (ChatbotMetrics *metrics, guint interval)
+{
+  MetricsDumper *dumper = g_new0 (MetricsDumper, 1);
+  GSource *source;
+
+  dumper->metrics = chatbot_metrics_ref (metrics);
+  dumper->context = g_main_context_new ();
+  dumper->loop = g_main_loop_new (dumper->context, FALSE);
+
+  source = g_timeout_source_new_seconds (interval);
+  g_source_set_callback (source, metrics_dumper_dump, dumper, NULL);
+  g_source_attach (source, dumper->context);
+  g_source_unref (source);
+
+  dumper->thread = g_thread_new ("metrics", metrics_dumper_run, dumper);
+  return dumper;
+}
+
+static gboolean
+metrics_dumper_quit (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+metrics_dumper_stop (MetricsDumper *dumper)
+{
+  // The loop is quit from its own thread, because a quit before it starts
+  // running would be lost.
+  g_main_context_invoke (dumper->context, metrics_dumper_quit, dumper->loop);
+  g_thread_join (dumper->thread);
+
+  g_main_loop_unref (dumper->loop);
+  g_main_context_unref (dumper->context);
+  chatbot_metrics_unref (dumper->metrics);
+  g_free (dumper);
+}
+
+/*
+ * Wraps the module with ChatbotLazyTool if the manifest says it's only a
+ * tool. Returns NULL if the module should be loaded now.
+ */
+static LoadedTool *
+lazy_tool_open (ChatbotModuleManifest *manifest, const gchar *path,
+                const gchar *parameter)
+{
+  ChatbotLazyTool *lazy_tool = NULL;
+  LoadedTool *loaded = NULL;
+  GError *error = NULL;
+  gchar *canonical;
+
+  // Language models and trainers are used right away, so only pure tools are
+  // deferred.
+  canonical = g_canonicalize_filename (path, NULL);
+  if (chatbot_module_manifest_get_interfaces (manifest, canonical)
+      == CHATBOT_MODULE_INTERFACE_TOOL)
+    lazy_tool = chatbot_lazy_tool_new (manifest, canonical, parameter, &error);
+  g_free (canonical);
+
+  if (lazy_tool)
+    {
+      loaded = loaded_tool_new (CHATBOT_TOOL (lazy_tool), path, parameter,
+                                FALSE);
+      g_object_unref (lazy_tool);
+    }
+  else if (error)
+    {
+      g_warning ("Failed to defer loading \"%s\", loading it now. Error: "
+                 "\"%s\"",
+                 path, error->message);
+      g_error_free (error);
+    }
+  return loaded;
+}
+
+/*
+ * Opens @old again as ChatbotLazyTool, after updating the manifest entry of
+ * its module file, which may have been rebuilt. Returns NULL if the module
+ * should be loaded now.
+ */
+static LoadedTool *
+lazy_tool_reopen (ChatbotModuleManifest *manifest, LoadedTool *old)
+{
+  gchar *canonical = g_canonicalize_filename (old->path, NULL);
+  gchar *directory = g_path_get_dirname (canonical);
+  GError *error = NULL;
+
+  if (!chatbot_module_manifest_scan (manifest, directory, &error))
+    {
+      g_warning ("Failed to update the manifest entry of \"%s\". Error: "
+                 "\"%s\"",
+                 old->path, error->message);
+      g_error_free (error);
+    }
+  g_free (directory);
+  g_free (canonical);
+  return lazy_tool_open (manifest, old->path, old->parameter);
+}
+
+/*
+ * Handles tool management commands:
+ *
+ *   !load <module> [parameter]
+ *   !load-remote <module> [parameter]
+ *   !unload <name>
+ *   !reload <name>
+ *   !tools
+ *
+ * Reloading a remote tool restarts its workers, so it picks up the rebuilt
+ * module file. A lazy tool stays lazy if @manifest still allows it. Returns
+ * FALSE if @command is not one of them.
+ */
+static gboolean
+run_tool_command (ChatbotLanguageModel *language_model, GPtrArray *tools,
+                  ChatbotModuleManifest *manifest, const gchar *command)
+{
+  gchar **argv = g_strsplit (command, " ", 3);
+  LoadedTool *loaded = NULL;
+  guint index;
+  gboolean handled = TRUE;
+  GError *error = NULL;
+
+  if (!strcmp (argv[0], "tools"))
+    {
+      for (guint i = 0; i < tools->len; i++)
+        {
+          LoadedTool *tool = g_ptr_array_index (tools, i);
+          printf ("%s%s: %s\n",
+                  chatbot_module_get_name (CHATBOT_MODULE (tool->tool)),
+                  tool->remote ? " (remote)" : "", tool->path);
+        }
+    }
+  else if (!strcmp (argv[0], "load") || !strcmp (argv[0], "load-remote"))
+    {
+      if (argv[1] == NULL)
+        {
+          fprintf (stderr, "Usage: !%s <module> [parameter]\n", argv[0]);
+          goto cleanup;
+        }
+      loaded = loaded_tool_open (argv[1], argv[2],
+                                 !strcmp (argv[0], "load-remote"), &error);
+      if ((loaded == NULL) || !tool_attach (language_model, loaded, &error))
+        goto cleanup;
+      g_ptr_array_add (tools, g_steal_pointer (&loaded));
+    }
+  else if (!strcmp (argv[0], "unload") || !strcmp (argv[0], "reload"))
+    {
+      LoadedTool *old;
+
+      old = argv[1] ? loaded_tool_find (tools, argv[1], &index) : NULL;
+      if (old == NULL)
+        {
+          fprintf (stderr, "Tool \"%s\" is not loaded.\n",
+                   argv[1] ? argv[1] : "");
+          goto cleanup;
+        }
+
+      // Open the new one first, so a broken module keeps the old one.
+      if (!strcmp (argv[0], "reload"))
+        {
+          if (manifest && CHATBOT_IS_LAZY_TOOL (old->tool))
+            loaded = lazy_tool_reopen (manifest, old);
+          if (loaded == NULL)
+            loaded = loaded_tool_open (old->path, old->parameter,
+                                       old->remote, &error);
+          if (loaded == NULL)
+            goto cleanup;
+        }
+
+      if (!tool_detach (language_model, old, &error))
+        goto cleanup;
+      g_ptr_array_remove_index (tools, index);
+
+      if (loaded)
+        {
+          if (!tool_attach (language_model, loaded, &error))
+            goto cleanup;
+          g_ptr_array_add (tools, g_steal_pointer (&loaded));
+        }
+    }
+  else
+    handled = FALSE;
+
+cleanup:
+  if (error)
+    {
+      fprintf (stderr, "Error: %s\n", error->message);
+      g_error_free (error);
+    }
+  g_clear_pointer (&loaded, loaded_tool_free);
+  g_strfreev (argv);
+  return handled;
+}
+
+typedef struct
+{
+  gchar *id;
+  gchar *prompt;
+  gchar *output;
+  GError *error;
+  gint64 prefill_us;
+  gint64 generate_us;
+  gboolean done;
+} BatchItem;
+
+typedef struct
+{
+  GPtrArray *items;
+  const gchar *system_prompt;
+  const gchar *state_file;
+  FILE *output;
+  GMutex mutex;
+  guint next_item;
+  guint next_write;
+  guint n_failed;
+} Batch;
+
+typedef struct
+{
+  Batch *batch;
+  ChatbotLanguageModel *language_model;
+  GPtrArray *tools;
+  gboolean owned;
+  gboolean fresh;
+  GThread *thread;
+} BatchWorker;
+
+static void
+batch_item_free (BatchItem *item)
+{
+  g_free (item->id);
+  g_free (item->prompt);
+  g_free (item->output);
+  g_clear_error (&item->error);
+  g_free (item);
+}
+
+static void
+json_skip_space (const gchar **p)
+{
+  while (g_ascii_isspace (**p))
+    (*p)++;
+}
+
+static gboolean
+json_read_hex4 (const gchar *p, gunichar *c)
+{
+  *c = 0;
+  for (guint i = 0; i < 4; i++)
+    {
+      gint digit = g_ascii_xdigit_value (p[i]);
+      if (digit < 0)
+        return FALSE;
+      *c = (*c << 4) | digit;
+    }
+  return TRUE;
+}
+
+/*
+ * Reads the JSON string at *@p and returns it unescaped, or %NULL if it's
+ * malformed. U+0000 is rejected because the result is a C string.
+ */
+static gchar *
+json_read_string (const gchar **p)
+{
+  GString *string = g_string_new (NULL);
+  const gchar *s = *p + 1;
+  gunichar c, low;
+
+  while (*s != '"')
+    {
+      if ((guchar)*s < 0x20)
+        goto on_error;
+      if (*s != '\\')
+        {
+          g_string_append_c (string, *s++);
+          continue;
+        }
+      s++;
+      switch (*s++)
+        {
+        case '"':
+        case '\\':
+        case '/':
+          g_string_append_c (string, s[-1]);
+          break;
+        case 'b':
+          g_string_append_c (string, '\b');
+          break;
+        case 'f':
+          g_string_append_c (string, '\f');
+          break;
+        case 'n':
+          g_string_append_c (string, '\n');
+          break;
+        case 'r':
+          g_string_append_c (string, '\r');
+          break;
+        case 't':
+          g_string_append_c (string, '\t');
+          break;
+        case 'u':
+          if (!json_read_hex4 (s, &c))
+            goto on_error;
+          s += 4;
+          if ((c >= 0xd800) && (c < 0xdc00))
+            {
+              if ((s[0] != '\\') || (s[1] != 'u')
+                  || !json_read_hex4 (s + 2, &low) || (low < 0xdc00)
+                  || (low >= 0xe000))
+                goto on_error;
+              s += 6;
+              c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+            }
+          else if (((c >= 0xdc00) && (c < 0xe000)) || (c == 0))
+            goto on_error;
+          g_string_append_unichar (string, c);
+          break;
+        default:
+          goto on_error;
+        }
+    }
+  *p = s + 1;
+  return g_string_free (string, FALSE);
+
+on_error:
+  g_string_free (string, TRUE);
+  return NULL;
+}
+
+/*
+ * Reads the JSON value at *@p. A string is stored unescaped in @text, and a
+ * number is stored as is. Objects, arrays, true, false and null are checked
+ * and skipped, leaving @text untouched.
+ */
+static gboolean
+json_read_value (const gchar **p, guint depth, gchar **text)
+{
+  static const gchar *const literals[] = { "true", "false", "null" };
+  const gchar *start;
+
+  json_skip_space (p);
+  if (**p == '"')
+    {
+      gchar *string = json_read_string (p);
+      if (string == NULL)
+        return FALSE;
+      if (text)
+        *text = string;
+      else
+        g_free (string);
+      return TRUE;
+    }
+
+  if ((**p == '{') || (**p == '['))
+    {
+      gchar close = (**p == '{') ? '}' : ']';
+
+      if (depth >= 64)
+        return FALSE;
+      (*p)++;
+      json_skip_space (p);
+      if (**p == close)
+        {
+          (*p)++;
+          return TRUE;
+        }
+      for (;;)
+        {
+          if (close == '}')
+            {
+              json_skip_space (p);
+              if ((**p != '"') || !json_read_value (p, depth + 1, NULL))
+                return FALSE;
+              json_skip_space (p);
+              if (*(*p)++ != ':')
+                return FALSE;
+            }
+          if (!json_read_value (p, depth + 1, NULL))
+            return FALSE;
+          json_skip_space (p);
+          if (**p == close)
+            {
+              (*p)++;
+              return TRUE;
+            }
+          if (*(*p)++ != ',')
+            return FALSE;
+        }
+    }
+
+  for (guint i = 0; i < G_N_ELEMENTS (literals); i++)
+    if (g_str_has_prefix (*p, literals[i]))
+      {
+        *p += strlen (literals[i]);
+        return TRUE;
+      }
+
+  start = *p;
+  while ((**p != '\0') && strchr ("+-.0123456789Ee", **p))
+    (*p)++;
+  if (*p == start)
+    return FALSE;
+  if (text)
+    *text = g_strndup (start, *p - start);
+  return TRUE;
+}
+
+/*
+ * Parses a line of the batch file. A line starting with '{' is a JSON object
+ * with string "prompt" and optional string or number "id". Other members are
+ * ignored. Otherwise the line is "id<TAB>prompt" or just "prompt", where the
+ * prompt is unescaped like a C string so it can contain "\n". The id defaults
+ * to the line number.
+ */
+static BatchItem *
+batch_item_parse (const gchar *line, guint line_number, GError **error)
+{
+  BatchItem *item = g_new0 (BatchItem, 1);
+  const gchar *tab;
+
+  if (line[0] == '{')
+    {
+      const gchar *p = line + 1;
+
+      json_skip_space (&p);
+      if (*p == '}')
+        p++;
+      else
+        for (;;)
+          {
+            gchar *key = NULL, *value = NULL;
+            gboolean is_string;
+
+            json_skip_space (&p);
+            if ((*p != '"') || !json_read_value (&p, 1, &key))
+              goto syntax_error;
+            json_skip_space (&p);
+            if (*p++ != ':')
+              {
+                g_free (key);
+                goto syntax_error;
+              }
+            json_skip_space (&p);
+            is_string = *p == '"';
+            if (!json_read_value (&p, 1, &value))
+              {
+                g_free (key);
+                goto syntax_error;
+              }
+
+            if (!g_strcmp0 (key, "prompt") && !is_string)
+              {
+                g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                             "Line %u: \"prompt\" must be a string.",
+                             line_number);
+                g_free (value);
+                g_free (key);
+                batch_item_free (item);
+                return NULL;
+              }
+            // Objects, arrays and literals leave @value NULL.
+            if (!g_strcmp0 (key, "id") && (value == NULL))
+              {
+                g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                             "Line %u: \"id\" must be a string or a "
+                             "number.",
+                             line_number);
+                g_free (value);
+                g_free (key);
+                batch_item_free (item);
+                return NULL;
+              }
+            if (!g_strcmp0 (key, "prompt"))
+              {
+                g_free (item->prompt);
+                item->prompt = g_steal_pointer (&value);
+              }
+            else if (!g_strcmp0 (key, "id"))
+              {
+                g_free (item->id);
+                item->id = g_steal_pointer (&value);
+              }
+            g_free (value);
+            g_free (key);
+
+            json_skip_space (&p);
+            if (*p == '}')
+              {
+                p++;
+                break;
+              }
+            if (*p++ != ',')
+              goto syntax_error;
+          }
+
+      json_skip_space (&p);
+      if (*p != '\0')
+        goto syntax_error;
+
+      if (item->prompt == NULL)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "Line %u: \"prompt\" is missing.", line_number);
+          batch_item_free (item);
+          return NULL;
+        }
+      goto done;
+
+    syntax_error:
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Line %u: Invalid JSON near column %u.", line_number,
+                   (guint)(p - line));
+      batch_item_free (item);
+      return NULL;
+    }
+  else if ((tab = strchr (line, '\t')))
+    {
+      item->id = g_strndup (line, tab - line);
+      item->prompt = g_strcompress (tab + 1);
+    }
+  else
+    item->prompt = g_strcompress (line);
+
+done:
+  if (item->id == NULL)
+    item->id = g_strdup_printf ("%u", line_number);
+  return item;
+}
+
+static GPtrArray *
+batch_load (const gchar *path, GError **error)
+{
+  GPtrArray *items;
+  gchar *contents;
+  gchar **lines;
+
+  if (!g_file_get_contents (path, &contents, NULL, error))
+    return NULL;
+
+  items = g_ptr_array_new_with_free_func ((GDestroyNotify)batch_item_free);
+  lines = g_strsplit (contents, "\n", -1);
+  for (guint i = 0; lines[i]; i++)
+    {
+      BatchItem *item;
+
+      g_strchomp (lines[i]);
+      if (lines[i][0] == '\0')
+        continue;
+
+      item = batch_item_parse (lines[i], i + 1, error);
+      if (item == NULL)
+        {
+          g_clear_pointer (&items, g_ptr_array_unref);
+          break;
+        }
+      g_ptr_array_add (items, item);
+    }
+  g_strfreev (lines);
+  g_free (contents);
+  return items;
+}
+
+static void
+write_json_string (FILE *file, const gchar *string)
+{
+  fputc ('"', file);
+  for (const guchar *p = (const guchar *)string; *p; p++)
+    {
+      if ((*p == '"') || (*p == '\\'))
+        fprintf (file, "\\%c", *p);
+      else if (*p == '\n')
+        fputs ("\\n", file);
+      else if (*p < 0x20)
+        fprintf (file, "\\u%04x", *p);
+      else
+        fputc (*p, file);
+    }
+  fputc ('"', file);
+}
+
+static void
+batch_item_write (BatchItem *item, FILE *file)
+{
+  fputs ("{\"id\": ", file);
+  write_json_string (file, item->id);
+  if (item->error)
+    {
+      fputs (", \"error\": ", file);
+      write_json_string (file, item->error->message);
+    }
+  else
+    {
+      fputs (", \"output\": ", file);
+      write_json_string (file, item->output);
+    }
+  fprintf (file,
+           ", \"prefill_us\": %" G_GINT64_FORMAT
+           ", \"generate_us\": %" G_GINT64_FORMAT "}\n",
+           item->prefill_us, item->generate_us);
+}
+
+/*
+ * Marks @item as done and writes every done item that has no unfinished item
+ * before it, so the output is in input order while later items run ahead.
+ */
+static void
+batch_item_finish (Batch *batch, BatchItem *item)
+{
+  g_mutex_lock (&batch->mutex);
+  item->done = TRUE;
+  if (item->error)
+    batch->n_failed++;
+  while (batch->next_write < batch->items->len)
+    {
+      BatchItem *next = g_ptr_array_index (batch->items, batch->next_write);
+      if (!next->done)
+        break;
+      batch_item_write (next, batch->output);
+      g_clear_pointer (&next->output, g_free);
+      batch->next_write++;
+    }
+  fflush (batch->output);
+  g_mutex_unlock (&batch->mutex);
+}
+
+/*
+ * Brings the instance back to the state a session starts from: the state file
+ * if one is loaded, or the state after construction. A model that can't
+ * reset is replaced by a new instance.
+ */
+static gboolean
+batch_worker_reset (BatchWorker *worker, GError **error)
+{
+  ChatbotLanguageModel *language_model;
+  GError *local_error = NULL;
+
+  if (worker->batch->state_file)
+    return chatbot_language_model_load_state (
+        worker->language_model, worker->batch->state_file, error);
+
+  if (worker->fresh)
+    return TRUE;
+
+  if (chatbot_language_model_reset (worker->language_model, &local_error))
+    return TRUE;
+  if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+    {
+      g_propagate_error (error, local_error);
+      return FALSE;
+    }
+  g_error_free (local_error);
+
+  language_model = language_model_checkout (worker->language_model,
+                                            worker->tools, error);
+  if (language_model == NULL)
+    return FALSE;
+  if (worker->owned)
+    language_model_return (worker->language_model, worker->tools);
+  else
+    g_object_unref (worker->language_model);
+  worker->language_model = language_model;
+  worker->owned = TRUE;
+  return TRUE;
+}
+
+static void
+batch_item_run (BatchWorker *worker, BatchItem *item)
+{
+  GStrvBuilder *builder;
+  GStrv role_and_messages;
+  gchar *chat_template;
+  gint64 start;
+
+  if (!batch_worker_reset (worker, &item->error))
+    return;
+  worker->fresh = FALSE;
+
+  builder = g_strv_builder_new ();
+  if (worker->batch->system_prompt)
+    g_strv_builder_add_many (builder, "system", worker->batch->system_prompt,
+                             NULL);
+  g_strv_builder_add_many (builder, "user", item->prompt, "assistant", NULL);
+  role_and_messages = g_strv_builder_end (builder);
+  chat_template = chatbot_language_model_apply_chat_template (
+      worker->language_model, role_and_messages);
+
+  start = g_get_monotonic_time ();
+  if (!chatbot_language_model_prefill (worker->language_model, chat_template,
+                                       &item->error))
+    goto cleanup;
+  item->prefill_us = g_get_monotonic_time () - start;
+
+  start = g_get_monotonic_time ();
+  item->output = chatbot_language_model_generate (worker->language_model,
+                                                  &item->error);
+  item->generate_us = g_get_monotonic_time () - start;
+
+  if (item->output && chat_log)
+    {
+      guint64 session = chatbot_chat_log_new_session ();
+
+      if (worker->batch->system_prompt)
+        log_message (session, "system", worker->batch->system_prompt);
+      log_message (session, "user", item->prompt);
+      log_message (session, "assistant", item->output);
+    }
+
+cleanup:
+  g_free (chat_template);
+  g_strfreev (role_and_messages);
+  g_strv_builder_unref (builder);
+}
+
+static gpointer
+batch_worker_run (gpointer user_data)
+{
+  BatchWorker *worker = user_data;
+  Batch *batch = worker->batch;
+
+  while (TRUE)
+    {
+      BatchItem *item = NULL;
+
+      g_mutex_lock (&batch->mutex);
+      if (batch->next_item < batch->items->len)
+        item = g_ptr_array_index (batch->items, batch->next_item++);
+      g_mutex_unlock (&batch->mutex);
+      if (item == NULL)
+        break;
+
+      batch_item_run (worker, item);
+      batch_item_finish (batch, item);
+    }
+  return NULL;
+}
+
+/*
+ * Runs each prompt of --batch as a new session and writes one JSON object per
+ * prompt in input order. Language models process one sequence at a time, so
+ * --batch-jobs runs prompts concurrently on that many instances of the model.
+ * @language_model is the first of them. Failed prompts are reported in the
+ * output and don't stop the batch.
+ */
 static gboolean
-module_init (Module *module, const gchar *filepath, const gchar *parameter,
-             GError **error)
+run_batch (ChatbotLanguageModel *language_model, GPtrArray *tools,
+           const gchar *system_prompt, const gchar *loaded_state_file,
+           GError **error)
+{
+  Batch batch = { 0 };
+  BatchWorker *workers = NULL;
+  guint n_workers;
+  GError *local_error = NULL;
+  gint64 start;
+  gboolean ret = FALSE;
+
+  batch.items = batch_load (batch_path, error);
+  if (batch.items == NULL)
+    return FALSE;
+  batch.system_prompt = system_prompt;
+  batch.state_file = loaded_state_file;
+  batch.output = stdout;
+  g_mutex_init (&batch.mutex);
+
+  if (batch_output_path)
+    {
+      batch.output = g_fopen (batch_output_path, "w");
+      if (batch.output == NULL)
+        {
+          int errsv = errno;
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                       "Failed to open \"%s\": %s", batch_output_path,
+                       g_strerror (errsv));
+          goto cleanup;
+        }
+    }
+
+  n_workers = CLAMP ((guint)MAX (batch_jobs, 1), 1,
+                     MAX (batch.items->len, 1));
+  workers = g_new0 (BatchWorker, n_workers);
+  for (guint i = 0; i < n_workers; i++)
+    {
+      BatchWorker *worker = &workers[i];
+
+      worker->batch = &batch;
+      worker->tools = tools;
+      worker->fresh = TRUE;
+      if (i == 0)
+        {
+          worker->language_model = g_object_ref (language_model);
+          continue;
+        }
+
+      worker->language_model
+          = language_model_checkout (language_model, tools, &local_error);
+      worker->owned = TRUE;
+      if (worker->language_model == NULL)
+        {
+          // Fewer instances only make the batch slower.
+          g_warning ("Running %u of %u batch jobs. Error: \"%s\"", i,
+                     n_workers, local_error->message);
+          g_clear_error (&local_error);
+          n_workers = i;
+          break;
+        }
+    }
+
+  start = g_get_monotonic_time ();
+  for (guint i = 0; i < n_workers; i++)
+    workers[i].thread
+        = g_thread_new ("batch-worker", batch_worker_run, &workers[i]);
+  for (guint i = 0; i < n_workers; i++)
+    g_thread_join (workers[i].thread);
+
+  fprintf (stderr,
+           "Processed %u prompts with %u jobs in %.2f s, %u failed.\n",
+           batch.items->len, n_workers,
+           (g_get_monotonic_time () - start) / (gdouble)G_USEC_PER_SEC,
+           batch.n_failed);
+  ret = TRUE;
+
+cleanup:
+  for (guint i = 0; workers && (i < n_workers); i++)
+    {
+      if (workers[i].owned)
+        language_model_return (workers[i].language_model, tools);
+      else
+        g_object_unref (workers[i].language_model);
+    }
+  g_free (workers);
+  if (batch.output && (batch.output != stdout))
+    fclose (batch.output);
+  g_mutex_clear (&batch.mutex);
+  g_ptr_array_unref (batch.items);
+  return ret;
+}
+
+typedef struct
+{
+  ChatbotLanguageModel *language_model;
+  GPtrArray *tools;
+  const gchar *system_prompt;
+  const gchar *state_file;
+  guint n_sessions;
+  // cancelled when the server stops
+  GCancellable *cancellable;
+} Server;
+
+typedef struct
+{
+  Server *server;
+  GSocketConnection *connection;
+  GDataInputStream *input;
+  GOutputStream *output;
+  ChatbotLanguageModel *language_model;
+  gchar *prompt;
+  gboolean started;
+  guint64 log_session;
+} ServerSession;
+
+static void server_session_read (ServerSession *session);
+
+/*
+ * Escapes "\\" and line breaks, so a token fits in a line. Clients can
+ * unescape it like a C string.
+ */
+static gchar *
+escape_line (const gchar *text)
+{
+  GString *escaped = g_string_sized_new (strlen (text));
+
+  for (const gchar *p = text; *p; p++)
+    {
+      if (*p == '\\')
+        g_string_append (escaped, "\\\\");
+      else if (*p == '\n')
+        g_string_append (escaped, "\\n");
+      else if (*p == '\r')
+        g_string_append (escaped, "\\r");
+      else
+        g_string_append_c (escaped, *p);
+    }
+  return g_string_free (escaped, FALSE);
+}
+
+/*
+ * Writes a line of @prefix followed by escaped @text.
+ */
+static gboolean
+server_session_write (ServerSession *session, const gchar *prefix,
+                      const gchar *text, GError **error)
+{
+  gchar *escaped = escape_line (text);
+  gchar *line = g_strconcat (prefix, escaped, "\n", NULL);
+  gboolean ret;
+
+  ret = g_output_stream_write_all (session->output, line, strlen (line), NULL,
+                                   NULL, error);
+  g_free (line);
+  g_free (escaped);
+  return ret;
+}
+
+static gboolean
+server_session_generating (ChatbotLanguageModel *language_model,
+                           const gchar *text, ServerSession *session)
+{
+  // Stop generating if the client is gone or the server is stopping.
+  if (g_cancellable_is_cancelled (session->server->cancellable))
+    return FALSE;
+  return server_session_write (session, "+ ", text, NULL);
+}
+
+static void
+server_session_free (ServerSession *session)
+{
+  if (session->language_model)
+    language_model_return (session->language_model, session->server->tools);
+  g_io_stream_close (G_IO_STREAM (session->connection), NULL, NULL);
+  g_object_unref (session->input);
+  g_object_unref (session->connection);
+  g_free (session->prompt);
+  session->server->n_sessions--;
+  g_free (session);
+}
+
+/*
+ * Starts the session on the first prompt, taking an instance from the
+ * registry and loading the state file.
+ */
+static gboolean
+server_session_start (ServerSession *session, GError **error)
 {
-  GType (*get_type) (void);
-  g_return_val_if_fail (module, FALSE);
-  g_return_val_if_fail (filepath, FALSE);
-  g_return_val_if_fail ((error != NULL) || (*error == NULL), FALSE);
+  Server *server = session->server;
 
-  // zero clear
-  memset (module, 0, sizeof (Module));
+  if (session->language_model)
+    return TRUE;
 
-  module->gmodule = g_module_open_full (filepath, G_MODULE_BIND_LAZY, error);
-  if (module->gmodule == NULL)
+  session->language_model
+      = language_model_checkout (server->language_model, server->tools, error);
+  if (session->language_model == NULL)
     return FALSE;
 
-  if (!g_module_symbol (module->gmodule, "get_type", (gpointer)&get_type))
+  session->started = FALSE;
+  session->log_session = chatbot_chat_log_new_session ();
+  if (server->state_file)
     {
-      g_set_error (error, G_MODULE_ERROR, G_MODULE_ERROR_FAILED,
-                   "Failed to obtain get_type() from module \"%s\".",
-                   filepath);
-      goto cleanup;
+      if (!chatbot_language_model_load_state (session->language_model,
+                                              server->state_file, error))
+        {
+          language_model_return (g_steal_pointer (&session->language_model),
+                                 server->tools);
+          return FALSE;
+        }
+      // The system prompt is in the state.
+      session->started = TRUE;
     }
+  return TRUE;
+}
+
+static gboolean
+server_session_respond (ServerSession *session, GError **error)
+{
+  GStrvBuilder *builder;
+  GStrv role_and_messages = NULL;
+  gchar *chat_template = NULL;
+  gchar *generated = NULL;
+  gulong handler_id;
+  gboolean ret = FALSE;
 
-  module->module = chatbot_module_new (get_type (), parameter, error);
-  if (module->module == NULL)
+  if (!server_session_start (session, error))
+    return FALSE;
+
+  builder = g_strv_builder_new ();
+  if (!session->started && session->server->system_prompt)
+    g_strv_builder_add_many (builder, "system", session->server->system_prompt,
+                             NULL);
+  g_strv_builder_add_many (builder, "user", session->prompt, "assistant",
+                           NULL);
+  role_and_messages = g_strv_builder_end (builder);
+  chat_template = chatbot_language_model_apply_chat_template (
+      session->language_model, role_and_messages);
+
+  if (!chatbot_language_model_prefill (session->language_model, chat_template,
+                                       error))
     goto cleanup;
+  if (!session->started && session->server->system_prompt)
+    log_message (session->log_session, "system",
+                 session->server->system_prompt);
+  log_message (session->log_session, "user", session->prompt);
+  session->started = TRUE;
+
+  handler_id = g_signal_connect (session->language_model, "generating",
+                                 G_CALLBACK (server_session_generating),
+                                 session);
+  generated = chatbot_language_model_generate (session->language_model,
+                                               error);
+  g_signal_handler_disconnect (session->language_model, handler_id);
+  if (generated == NULL)
+    goto cleanup;
+  log_message (session->log_session, "assistant", generated);
+  ret = server_session_write (session, ".", "", error);
 
-  return TRUE;
 cleanup:
-  g_clear_object (&module->module);
-  g_clear_pointer (&module->gmodule, g_module_close);
-  return FALSE;
+  g_free (generated);
+  g_free (chat_template);
+  g_strfreev (role_and_messages);
+  g_strv_builder_unref (builder);
+  return ret;
 }
 
+/*
+ * Generation blocks, so it runs in a thread of the GTask pool while other
+ * sessions keep being served by the main context.
+ */
 static void
-module_free (Module *module)
+server_session_respond_thread (GTask *task, gpointer source_object,
+                               gpointer task_data, GCancellable *cancellable)
 {
-  g_object_unref (module->module);
-  g_module_close (module->gmodule);
+  ServerSession *session = task_data;
+  GError *error = NULL;
+
+  if (!server_session_respond (session, &error))
+    {
+      if (!server_session_write (session, "! ", error->message, NULL))
+        {
+          g_task_return_error (task, error);
+          return;
+        }
+      g_error_free (error);
+    }
+  g_task_return_boolean (task, TRUE);
 }
 
-enum
+static void
+server_session_respond_ready (GObject *source, GAsyncResult *result,
+                              gpointer user_data)
 {
-  ARG_MODULES,
-  ARG_MODULE_PARAMETERS,
-  ARG_SYSTEM_PROMPT,
-  ARG_SYSTEM_PROMPT_FILE,
-  ARG_STATE_FILE,
-  ARG_TRAINING_MODULE,
-  ARG_TRAINING_MODULE_PARAMETER,
-  ARG_NULL,
-  N_ARGS
-};
+  ServerSession *session = user_data;
 
-static gchar **module_paths = NULL;
-static gchar **module_parameters = NULL;
-static gchar *system_prompt = NULL;
-static gchar *system_prompt_file = NULL;
-static gchar *state_file = NULL;
-static gchar *training_module_path = NULL;
-static gchar *training_module_parameter = NULL;
+  g_clear_pointer (&session->prompt, g_free);
+  if (g_task_propagate_boolean (G_TASK (result), NULL)
+      && !g_cancellable_is_cancelled (session->server->cancellable))
+    server_session_read (session);
+  else
+    server_session_free (session);
+}
 
-static const GOptionEntry option_entries[N_ARGS] = {
-  { "modules", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME_ARRAY,
-    &module_paths, "Modules to use, include language model, and tools.",
-    "module..." },
-  { "module-parameters", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING_ARRAY,
-    &module_parameters, "Parameters for each module.", "parameters..." },
-  { "system-prompt", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING,
-    &system_prompt, "System prompt for session." },
-  { "system-prompt-file", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,
-    &system_prompt_file, "System prompt for session." },
-  { "state-file", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &state_file,
-    "State file for session." },
-  { "training-module", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME,
-    &training_module_path, "Training Module to train model.", "module" },
-  { "training-module-parameter", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING,
-    &training_module_parameter, "Parameter of Training Module", "parameter" },
-  G_OPTION_ENTRY_NULL
-};
+static void
+server_session_line_ready (GObject *source, GAsyncResult *result,
+                           gpointer user_data)
+{
+  ServerSession *session = user_data;
+  GTask *task;
+  gchar *line;
+
+  line = g_data_input_stream_read_line_finish_utf8 (
+      G_DATA_INPUT_STREAM (source), result, NULL, NULL);
+  if (line == NULL)
+    {
+      server_session_free (session);
+      return;
+    }
+
+  g_strchomp (line);
+  if (line[0] == '\0')
+    {
+      g_free (line);
+      server_session_read (session);
+      return;
+    }
+
+  if (!strcmp (line, "!reset"))
+    {
+      // The next prompt takes a new instance and starts over.
+      if (session->language_model)
+        language_model_return (
+            g_steal_pointer (&session->language_model),
+            session->server->tools);
+      g_free (line);
+      if (server_session_write (session, ".", "", NULL))
+        server_session_read (session);
+      else
+        server_session_free (session);
+      return;
+    }
+
+  session->prompt = g_strcompress (line);
+  g_free (line);
+
+  task = g_task_new (NULL, NULL, server_session_respond_ready, session);
+  g_task_set_task_data (task, session, NULL);
+  g_task_run_in_thread (task, server_session_respond_thread);
+  g_object_unref (task);
+}
+
+static void
+server_session_read (ServerSession *session)
+{
+  g_data_input_stream_read_line_async (
+      session->input, G_PRIORITY_DEFAULT, session->server->cancellable,
+      server_session_line_ready, session);
+}
 
 static gboolean
-generating (ChatbotLanguageModel *lm, const gchar *text, gpointer user_data)
+server_incoming (GSocketService *service, GSocketConnection *connection,
+                 GObject *source_object, Server *server)
 {
-  printf ("%s", text);
-  fflush (stdout);
+  ServerSession *session = g_new0 (ServerSession, 1);
+
+  session->server = server;
+  session->connection = g_object_ref (connection);
+  session->input = g_data_input_stream_new (
+      g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+  session->output = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+  server->n_sessions++;
+
+  server_session_read (session);
   return TRUE;
 }
 
-static gchar *
-read_user_input (void)
+static gboolean
+server_quit (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+  return G_SOURCE_CONTINUE;
+}
+
+/*
+ * Serves sessions on the Unix socket of --listen until SIGINT or SIGTERM.
+ * Each connection is a session, and each line it sends is a user prompt
+ * unescaped like a C string. The response is streamed as a "+ <token>" line
+ * per generated token with line breaks escaped, and ends with a "." line, or
+ * a "! <message>" line on failure. "!reset" starts a new session on the same
+ * connection.
+ *
+ * Sessions take model instances from the module registry and give them back
+ * when they end, so a busy server keeps as many instances as concurrent
+ * sessions and a new session mostly reuses a warm one.
+ *
+ * On a signal, it stops accepting connections, cancels pending reads, stops
+ * running generations at their next token, and returns once every session
+ * has ended, so no response thread outlives the server.
+ */
+static gboolean
+run_server (ChatbotLanguageModel *language_model, GPtrArray *tools,
+            const gchar *system_prompt, const gchar *loaded_state_file,
+            GError **error)
+{
+  Server server = { language_model, tools, system_prompt, loaded_state_file,
+                    0, NULL };
+  GSocketService *service;
+  GSocketAddress *address;
+  GMainLoop *loop;
+  guint sigint_id, sigterm_id;
+  GStatBuf stat_buf;
+  gboolean ret;
+
+  // Remove the socket left by a previous server, but nothing else.
+  if (!g_lstat (listen_path, &stat_buf) && S_ISSOCK (stat_buf.st_mode))
+    g_unlink (listen_path);
+
+  service = g_socket_service_new ();
+  address = g_unix_socket_address_new (listen_path);
+  ret = g_socket_listener_add_address (
+      G_SOCKET_LISTENER (service), address, G_SOCKET_TYPE_STREAM,
+      G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, error);
+  g_object_unref (address);
+  if (!ret)
+    {
+      g_object_unref (service);
+      return FALSE;
+    }
+
+  // The loaded instance becomes the first idle one, instead of staying
+  // unused.
+  language_model_return (g_object_ref (language_model), tools);
+
+  loop = g_main_loop_new (NULL, FALSE);
+  server.cancellable = g_cancellable_new ();
+  g_signal_connect (service, "incoming", G_CALLBACK (server_incoming),
+                    &server);
+  sigint_id = g_unix_signal_add (SIGINT, server_quit, loop);
+  sigterm_id = g_unix_signal_add (SIGTERM, server_quit, loop);
+  g_socket_service_start (service);
+  fprintf (stderr, "Listening on \"%s\".\n", listen_path);
+
+  g_main_loop_run (loop);
+
+  g_socket_service_stop (service);
+  g_socket_listener_close (G_SOCKET_LISTENER (service));
+  g_signal_handlers_disconnect_by_data (service, &server);
+  g_object_unref (service);
+  g_unlink (listen_path);
+
+  // Sessions end as their reads and responses finish.
+  if (server.n_sessions)
+    fprintf (stderr, "Stopping %u sessions.\n", server.n_sessions);
+  g_cancellable_cancel (server.cancellable);
+  while (server.n_sessions)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_source_remove (sigint_id);
+  g_source_remove (sigterm_id);
+  g_object_unref (server.cancellable);
+  g_main_loop_unref (loop);
+  fprintf (stderr, "Stopped.\n");
+  return TRUE;
+}
+
+static void
+print_modules (ChatbotModuleManifest *manifest)
 {
-  const gsize chunk = 256;
-  gsize offset = 0;
-  gsize size = chunk;
-  gchar *text = g_malloc (chunk);
+  static const struct
+  {
+    ChatbotModuleInterfaceFlags flag;
+    const gchar *name;
+  } interface_names[] = {
+    { CHATBOT_MODULE_INTERFACE_LANGUAGE_MODEL, "LanguageModel" },
+    { CHATBOT_MODULE_INTERFACE_TOOL, "Tool" },
+    { CHATBOT_MODULE_INTERFACE_TRAINER, "Trainer" },
+  };
+  gchar **paths = chatbot_module_manifest_get_paths (manifest);
 
-  while (fgets (text + offset, chunk, stdin))
+  for (gchar **path = paths; *path; path++)
     {
-      if ((strlen (text + offset) != chunk)
-          || iscntrl (text[offset + chunk - 1]))
-        break;
-      text = g_realloc (text, size + chunk);
-      offset += chunk;
-      size += chunk;
+      ChatbotModuleInterfaceFlags interfaces;
+      gchar *name, *description;
+      GVariant *parameters;
+      GVariantIter iter;
+      const gchar *parameter_name, *parameter_description, *type;
+      const gchar *default_value;
+      gboolean first = TRUE;
+
+      name = chatbot_module_manifest_get_name (manifest, *path);
+      description = chatbot_module_manifest_get_description (manifest, *path);
+      interfaces = chatbot_module_manifest_get_interfaces (manifest, *path);
+
+      printf ("%s (", name);
+      for (guint i = 0; i < G_N_ELEMENTS (interface_names); i++)
+        if (interfaces & interface_names[i].flag)
+          {
+            printf ("%s%s", first ? "" : ", ", interface_names[i].name);
+            first = FALSE;
+          }
+      printf (")\n  %s\n  %s\n", *path, description);
+
+      parameters = chatbot_module_manifest_get_parameters (manifest, *path);
+      if (parameters)
+        {
+          g_variant_iter_init (&iter, parameters);
+          while (g_variant_iter_next (&iter, "(&s&s&sm&s@as)",
+                                      &parameter_name, &parameter_description,
+                                      &type, &default_value, NULL))
+            printf ("  %s=<%s> %s (%s%s)\n", parameter_name, type,
+                    parameter_description,
+                    default_value ? "default: " : "required",
+                    default_value ? default_value : "");
+          g_variant_unref (parameters);
+        }
+
+      g_free (description);
+      g_free (name);
     }
+  g_strfreev (paths);
+}
+
+/*
+ * Replaces @path with the file of the module named @path in the manifest, if
+ * @path is a name rather than a path.
+ */
+static void
+resolve_module_path (ChatbotModuleManifest *manifest, gchar **path)
+{
+  gchar *found;
 
-  return text;
+  if ((*path == NULL) || strchr (*path, G_DIR_SEPARATOR))
+    return;
+
+  found = chatbot_module_manifest_lookup (manifest, *path);
+  if (found)
+    {
+      g_free (*path);
+      *path = found;
+    }
 }
 
 int
 main (int argc, char **argv)
 {
   GOptionContext *option_context = NULL;
-  GArray *modules = NULL;
+  GPtrArray *modules = NULL;
+  ModuleLoad *loads = NULL;
+  GPtrArray *eager_paths, *eager_parameters;
+  guint n_loads;
+  GPtrArray *tools = NULL;
   ChatbotLanguageModel *language_model = NULL;
   ChatbotChatData *chat_data = NULL;
+  GInputStream *stdin_stream;
+  GDataInputStream *input = NULL;
+  SpeculativePrefill speculative = { 0 };
+  MetricsDumper *metrics_dumper = NULL;
   ChatbotTrainer *trainer = NULL;
+  ChatbotModuleManifest *manifest = NULL;
   gboolean state_loaded = FALSE;
+  guint64 log_session = chatbot_chat_log_new_session ();
 
   gchar *pending_system_prompt = NULL;
   gchar *pending_user_prompt = NULL;
@@ -159,33 +2012,98 @@ main (int argc, char **argv)
   if (!g_option_context_parse (option_context, &argc, &argv, &error))
     goto on_error;
 
+  if (trace_path && !chatbot_trace_start (trace_path, &error))
+    goto cleanup;
+
+  if (chat_log_path)
+    {
+      chat_log = chatbot_chat_log_open (chat_log_path,
+                                        chat_log_compress
+                                            ? CHATBOT_CHAT_LOG_COMPRESS
+                                            : CHATBOT_CHAT_LOG_NONE,
+                                        &error);
+      if (chat_log == NULL)
+        goto cleanup;
+    }
+
+  if (plugin_dirs)
+    {
+      manifest = chatbot_module_manifest_new (NULL, tool_worker_path);
+      for (guint i = 0; plugin_dirs[i]; i++)
+        if (!chatbot_module_manifest_scan (manifest, plugin_dirs[i], &error))
+          {
+            g_warning ("Failed to scan plugin directory \"%s\". Error: "
+                       "\"%s\"",
+                       plugin_dirs[i], error->message);
+            g_clear_error (&error);
+          }
+
+      for (guint i = 0; module_paths && module_paths[i]; i++)
+        resolve_module_path (manifest, &module_paths[i]);
+      resolve_module_path (manifest, &training_module_path);
+    }
+
+  if (list_modules)
+    {
+      if (manifest)
+        print_modules (manifest);
+      ret_code = 0;
+      goto cleanup;
+    }
+
   if (g_strv_length (module_paths) != g_strv_length (module_parameters))
     g_warning (
         "Specified number of modules and number of parameters are not equal.");
 
-  modules = g_array_sized_new (FALSE, FALSE, sizeof (Module),
-                               g_strv_length (module_paths));
-  g_array_set_clear_func (modules, (GDestroyNotify)module_free);
+  modules = g_ptr_array_new_full (g_strv_length (module_paths),
+                                  g_object_unref);
+  tools = g_ptr_array_new_with_free_func ((GDestroyNotify)loaded_tool_free);
+
+  eager_paths = g_ptr_array_new ();
+  eager_parameters = g_ptr_array_new ();
+  n_loads = MIN (g_strv_length (module_paths),
+                 g_strv_length (module_parameters));
+  for (guint i = 0; i < n_loads; i++)
+    {
+      LoadedTool *lazy = NULL;
+
+      if (lazy_tools && manifest)
+        lazy = lazy_tool_open (manifest, module_paths[i],
+                               module_parameters[i]);
+      if (lazy)
+        {
+          g_ptr_array_add (tools, lazy);
+          continue;
+        }
+      g_ptr_array_add (eager_paths, module_paths[i]);
+      g_ptr_array_add (eager_parameters, module_parameters[i]);
+    }
+
+  n_loads = eager_paths->len;
+  loads = modules_load ((gchar **)eager_paths->pdata,
+                        (gchar **)eager_parameters->pdata, n_loads);
+  g_ptr_array_unref (eager_paths);
+  g_ptr_array_unref (eager_parameters);
 
-  for (gchar **module_path = module_paths, **parameter = module_parameters;
-       *module_path && *parameter; module_path++, parameter++)
+  for (guint i = 0; i < n_loads; i++)
     {
-      Module module;
+      ChatbotModule *module = loads[i].module;
 
-      if (!module_init (&module, *module_path, *parameter, &error))
+      if (module == NULL)
         {
           g_warning ("Failed to initialize module \"%s\" with parameter "
                      "\"%s\". Error: \"%s\"",
-                     *module_path, *parameter, error->message);
-          g_clear_error (&error);
+                     loads[i].path, loads[i].parameter,
+                     loads[i].error->message);
+          g_clear_error (&loads[i].error);
           continue;
         }
 
-      if (CHATBOT_IS_LANGUAGE_MODEL (module.module))
+      if (CHATBOT_IS_LANGUAGE_MODEL (module))
         {
           if (language_model == NULL)
             {
-              language_model = CHATBOT_LANGUAGE_MODEL (module.module);
+              language_model = CHATBOT_LANGUAGE_MODEL (module);
               g_object_ref (language_model);
             }
           else
@@ -197,11 +2115,11 @@ main (int argc, char **argv)
             }
         }
 
-      if (CHATBOT_IS_TRAINER (module.module))
+      if (CHATBOT_IS_TRAINER (module))
         {
           if (trainer == NULL)
             {
-              trainer = CHATBOT_TRAINER (module.module);
+              trainer = CHATBOT_TRAINER (module);
               g_object_ref (trainer);
             }
           else
@@ -212,8 +2130,14 @@ main (int argc, char **argv)
             }
         }
 
-      g_array_append_val (modules, module);
+      if (CHATBOT_IS_TOOL (module))
+        g_ptr_array_add (tools,
+                         loaded_tool_new (CHATBOT_TOOL (module), loads[i].path,
+                                          loads[i].parameter, FALSE));
+
+      g_ptr_array_add (modules, module);
     }
+  g_clear_pointer (&loads, g_free);
 
   if (language_model == NULL)
     {
@@ -221,21 +2145,31 @@ main (int argc, char **argv)
       goto cleanup;
     }
 
-  for (guint i = 0; CHATBOT_IS_TOOL_CALLABLE_LANGUAGE_MODEL (language_model)
-                    && (i < modules->len);
-       i++)
+  for (guint i = 0; remote_tool_paths && remote_tool_paths[i]; i++)
     {
-      Module module;
+      const gchar *parameter = NULL;
+      LoadedTool *loaded;
 
-      module = g_array_index (modules, Module, i);
-      if (!CHATBOT_IS_TOOL (module.module))
-        continue;
-      if (!chatbot_tool_callable_language_model_add_tool (
-              CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL (language_model),
-              CHATBOT_TOOL (module.module), &error))
-        goto cleanup;
+      if (remote_tool_parameters
+          && (i < g_strv_length (remote_tool_parameters)))
+        parameter = remote_tool_parameters[i];
+
+      loaded = loaded_tool_open (remote_tool_paths[i], parameter, TRUE,
+                                 &error);
+      if (loaded == NULL)
+        {
+          g_warning ("Failed to start remote tool \"%s\". Error: \"%s\"",
+                     remote_tool_paths[i], error->message);
+          g_clear_error (&error);
+          continue;
+        }
+      g_ptr_array_add (tools, loaded);
     }
 
+  for (guint i = 0; i < tools->len; i++)
+    if (!tool_attach (language_model, g_ptr_array_index (tools, i), &error))
+      goto cleanup;
+
   if (state_file)
     {
       state_loaded = chatbot_language_model_load_state (language_model,
@@ -245,8 +2179,9 @@ main (int argc, char **argv)
                          "Continuing with default state.\n");
     }
 
-  g_signal_connect (language_model, "generating", G_CALLBACK (generating),
-                    NULL);
+  if ((batch_path == NULL) && (listen_path == NULL))
+    g_signal_connect (language_model, "generating", G_CALLBACK (generating),
+                      NULL);
 
   if (system_prompt_file)
     {
@@ -256,10 +2191,54 @@ main (int argc, char **argv)
         goto cleanup;
     }
 
+  if (batch_path)
+    {
+      if (!run_batch (language_model, tools,
+                      state_loaded ? NULL : system_prompt,
+                      state_loaded ? state_file : NULL, &error))
+        goto cleanup;
+      ret_code = 0;
+      goto cleanup;
+    }
+
+  if (listen_path)
+    {
+      if (!run_server (language_model, tools,
+                       state_loaded ? NULL : system_prompt,
+                       state_loaded ? state_file : NULL, &error))
+        goto cleanup;
+      ret_code = 0;
+      goto cleanup;
+    }
+
   if (system_prompt && !state_loaded)
     pending_system_prompt = g_strdup (system_prompt);
 
   chat_data = chatbot_chat_data_new ();
+  stdin_stream = g_unix_input_stream_new (STDIN_FILENO, FALSE);
+  input = g_data_input_stream_new (stdin_stream);
+  g_data_input_stream_set_newline_type (input,
+                                        G_DATA_STREAM_NEWLINE_TYPE_ANY);
+  g_object_unref (stdin_stream);
+
+  speculative.language_model = language_model;
+  speculative.context = g_string_new (NULL);
+  if (speculative_prefill)
+    {
+      speculative.enabled
+          = chatbot_language_model_rewind (language_model, 0, &error);
+      if (!speculative.enabled)
+        {
+          g_warning ("Speculative prefill is disabled. Error: \"%s\"",
+                     error->message);
+          g_clear_error (&error);
+        }
+    }
+
+  if (metrics_interval > 0)
+    metrics_dumper = metrics_dumper_start (
+        chatbot_language_model_get_metrics (language_model),
+        metrics_interval);
 
   // Main Loop
   while (TRUE)
@@ -275,7 +2254,27 @@ main (int argc, char **argv)
 
       printf ("User: ");
       fflush (stdout);
-      pending_user_prompt = g_strstrip (read_user_input ());
+      speculative.system_prompt = pending_system_prompt;
+      pending_user_prompt = read_user_input (
+          input, speculative_prefill_update, &speculative, &error);
+      if (pending_user_prompt)
+        g_strstrip (pending_user_prompt);
+
+      // Commands and the end of input are not prompts.
+      if (((pending_user_prompt == NULL) || (pending_user_prompt[0] == '!'))
+          && (error == NULL)
+          && !speculative_prefill_commit (&speculative, "", &error))
+        goto loop_cleanup;
+
+      if (pending_user_prompt == NULL)
+        {
+          g_clear_pointer (&pending_system_prompt, g_free);
+          g_strv_builder_unref (builder);
+          if (error)
+            goto cleanup;
+          printf ("\n");
+          break;
+        }
       if (pending_user_prompt[0] == '!')
         {
           const gchar *command = pending_user_prompt + 1;
@@ -286,17 +2285,32 @@ main (int argc, char **argv)
               g_strv_builder_unref (builder);
               break;
             }
+          if (run_stats_command (language_model, modules, chat_data,
+                                 command))
+            {
+              g_free (pending_user_prompt);
+              g_strv_builder_unref (builder);
+              continue;
+            }
+          if (run_tool_command (language_model, tools, manifest, command))
+            {
+              g_free (pending_user_prompt);
+              g_strv_builder_unref (builder);
+              continue;
+            }
         }
       g_strv_builder_add_many (builder, "user", pending_user_prompt, NULL);
       chatbot_chat_data_append (chat_data, "user", pending_user_prompt);
+      if (pending_system_prompt)
+        log_message (log_session, "system", pending_system_prompt);
+      log_message (log_session, "user", pending_user_prompt);
       g_strv_builder_add (builder, "assistant");
 
       role_and_messages = g_strv_builder_end (builder);
       chat_template = chatbot_language_model_apply_chat_template (
           language_model, role_and_messages);
 
-      if (!chatbot_language_model_prefill (language_model, chat_template,
-                                           &error))
+      if (!speculative_prefill_commit (&speculative, chat_template, &error))
         goto loop_cleanup;
 
       printf ("Assistant: ");
@@ -305,6 +2319,8 @@ main (int argc, char **argv)
       if (generated == NULL)
         goto loop_cleanup;
       chatbot_chat_data_append (chat_data, "assistant", generated);
+      g_string_append (speculative.context, generated);
+      log_message (log_session, "assistant", generated);
       printf ("\n");
 
     loop_cleanup:
@@ -327,25 +2343,35 @@ main (int argc, char **argv)
   if (trainer || training_module_path)
     {
       g_clear_object (&language_model);
-      g_clear_pointer (&modules, g_array_unref);
+      g_clear_pointer (&tools, g_ptr_array_unref);
+      g_clear_pointer (&modules, g_ptr_array_unref);
 
       if (!trainer && training_module_path)
         {
-          Module m;
+          ChatbotModuleRegistry *registry
+              = chatbot_module_registry_get_default ();
+          ChatbotModule *module;
+          GType type;
+
+          type = chatbot_module_registry_load_type (
+              registry, training_module_path, &error);
+          if (type == G_TYPE_INVALID)
+            goto cleanup;
 
-          if (!module_init (&m, training_module_path,
-                            training_module_parameter, &error))
+          module = chatbot_module_registry_checkout (
+              registry, type, training_module_parameter, &error);
+          if (module == NULL)
             goto cleanup;
 
-          if (!CHATBOT_IS_TRAINER (m.module))
+          if (!CHATBOT_IS_TRAINER (module))
             {
               g_set_error (&error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
                            "Module specified as Training Module doesn't "
                            "implement ChatbotTrainer.");
+              g_object_unref (module);
               goto cleanup;
             }
-          trainer = CHATBOT_TRAINER (m.module);
-          g_object_ref (trainer);
+          trainer = CHATBOT_TRAINER (module);
         }
 
       if (!chatbot_trainer_train (
@@ -356,15 +2382,33 @@ main (int argc, char **argv)
 
   ret_code = 0;
 cleanup:
+  g_clear_pointer (&metrics_dumper, metrics_dumper_stop);
   g_clear_object (&trainer);
+  g_clear_object (&input);
+  if (speculative.context)
+    g_string_free (speculative.context, TRUE);
   g_clear_object (&chat_data);
   g_clear_object (&language_model);
-  g_clear_pointer (&modules, g_array_unref);
+  g_clear_pointer (&tools, g_ptr_array_unref);
+  g_clear_pointer (&modules, g_ptr_array_unref);
+  g_clear_object (&manifest);
+  g_clear_object (&chat_log);
   g_clear_pointer (&option_context, g_option_context_free);
+  if (trace_path)
+    chatbot_trace_stop ();
 
+  g_free (chat_log_path);
+  g_free (listen_path);
+  g_free (batch_output_path);
+  g_free (batch_path);
+  g_free (trace_path);
   g_free (state_file);
   g_free (system_prompt_file);
   g_free (system_prompt);
+  g_free (tool_worker_path);
+  g_strfreev (plugin_dirs);
+  g_strfreev (remote_tool_parameters);
+  g_strfreev (remote_tool_paths);
   g_strfreev (module_parameters);
   g_strfreev (module_paths);
   if (error)
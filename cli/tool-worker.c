@@ -0,0 +1,111 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include <gio/gio.h>
+
+#include "chatbot.h"
+
+static gint socket_fd = -1;
+static gchar *module_path = NULL;
+static gchar *module_parameter = NULL;
+static gboolean inspect = FALSE;
+
+static const GOptionEntry option_entries[] = {
+  { "fd", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &socket_fd,
+    "Socket connected to the proxy.", "fd" },
+  { "module", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &module_path,
+    "Tool module to serve.", "module" },
+  { "parameter", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING,
+    &module_parameter, "Parameter of the tool module.", "parameter" },
+  { "inspect", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &inspect,
+    "Print the manifest entry of the module and exit.", NULL },
+  G_OPTION_ENTRY_NULL
+};
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *option_context = NULL;
+  ChatbotModule *module = NULL;
+  GSocket *socket = NULL;
+  GType type;
+  int ret_code = 1;
+  GError *error = NULL;
+
+  option_context = g_option_context_new (NULL);
+  g_option_context_add_main_entries (option_context, option_entries, NULL);
+  if (!g_option_context_parse (option_context, &argc, &argv, &error))
+    goto cleanup;
+
+  if (inspect && module_path)
+    {
+      gchar *text = chatbot_module_manifest_describe (module_path, &error);
+      if (text == NULL)
+        goto cleanup;
+      fputs (text, stdout);
+      g_free (text);
+      ret_code = 0;
+      goto cleanup;
+    }
+
+  if ((socket_fd < 0) || (module_path == NULL))
+    {
+      g_set_error (&error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                   "--fd and --module are required.");
+      goto cleanup;
+    }
+
+  socket = g_socket_new_from_fd (socket_fd, &error);
+  if (socket == NULL)
+    goto cleanup;
+
+  type = chatbot_module_registry_load_type (
+      chatbot_module_registry_get_default (), module_path, &error);
+  if (type == G_TYPE_INVALID)
+    goto cleanup;
+
+  module = chatbot_module_new (
+      type, module_parameter ? module_parameter : "", &error);
+  if (module == NULL)
+    goto cleanup;
+
+  if (!CHATBOT_IS_TOOL (module))
+    {
+      g_set_error (&error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Module \"%s\" doesn't implement ChatbotTool.",
+                   module_path);
+      goto cleanup;
+    }
+
+  if (!chatbot_remote_tool_serve (CHATBOT_TOOL (module), socket, NULL,
+                                  &error))
+    goto cleanup;
+
+  ret_code = 0;
+cleanup:
+  g_clear_object (&module);
+  g_clear_object (&socket);
+  g_clear_pointer (&option_context, g_option_context_free);
+  g_free (module_parameter);
+  g_free (module_path);
+  if (error)
+    {
+      fprintf (stderr, "Tool Worker Error: %s\n", error->message);
+      g_error_free (error);
+    }
+  return ret_code;
+}
@@ -0,0 +1,628 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Deterministic language model without weights, to measure the overhead of
+ * the framework itself.
+ *
+ * Output depends only on the seed and on the text prefilled so far, so runs
+ * with the same input generate the same tokens. Per-token latency is
+ * simulated with sleeps. A prefilled line "/call TOOL FUNCTION" makes the
+ * next generation call the function of the added tool without arguments and
+ * emit its result as a token. Added tools are rendered with
+ * ChatbotToolRenderer, whose hash is the read-only "tools-hash" property.
+ */
+
+#include <chatbot.h>
+#include <gmodule.h>
+#include <string.h>
+
+#define CHATBOT_TYPE_MOCK_LANGUAGE_MODEL                                      \
+  chatbot_mock_language_model_get_type ()
+G_DECLARE_FINAL_TYPE (ChatbotMockLanguageModel, chatbot_mock_language_model,
+                      CHATBOT, MOCK_LANGUAGE_MODEL, ChatbotModule);
+
+#define CHATBOT_MOCK_STATE_TYPE "(tt)"
+
+typedef struct
+{
+  gint64 n_tokens;
+  gint64 n_thinking_tokens;
+  gint64 token_latency_us;
+  gint64 prefill_latency_us;
+  gint64 seed;
+} ChatbotMockLanguageModelParameter;
+
+static const ChatbotModuleParameterSpec
+    chatbot_mock_language_model_parameter_specs[]
+    = { { "tokens", "number of tokens per generation",
+          CHATBOT_MODULE_PARAMETER_INT,
+          G_STRUCT_OFFSET (ChatbotMockLanguageModelParameter, n_tokens), "32",
+          NULL },
+        { "thinking-tokens", "number of thinking tokens before generation",
+          CHATBOT_MODULE_PARAMETER_INT,
+          G_STRUCT_OFFSET (ChatbotMockLanguageModelParameter,
+                           n_thinking_tokens),
+          "0", NULL },
+        { "token-latency-us", "sleep per generated token in microseconds",
+          CHATBOT_MODULE_PARAMETER_INT,
+          G_STRUCT_OFFSET (ChatbotMockLanguageModelParameter,
+                           token_latency_us),
+          "0", NULL },
+        { "prefill-latency-us", "sleep per prefilled word in microseconds",
+          CHATBOT_MODULE_PARAMETER_INT,
+          G_STRUCT_OFFSET (ChatbotMockLanguageModelParameter,
+                           prefill_latency_us),
+          "0", NULL },
+        { "seed", "initial state of the generator",
+          CHATBOT_MODULE_PARAMETER_INT,
+          G_STRUCT_OFFSET (ChatbotMockLanguageModelParameter, seed), "0",
+          NULL },
+        { NULL } };
+
+static const gchar *const chatbot_mock_words[] = {
+  "lorem ", "ipsum ", "dolor ", "sit ", "amet, ", "consectetur ",
+  "adipiscing ", "elit, ", "sed ", "do ", "eiusmod ", "tempor ",
+  "incididunt ", "ut ", "labore ", "et ", "dolore ", "magna ",
+  "aliqua. "
+};
+
+struct _ChatbotMockLanguageModel
+{
+  ChatbotModule parent_instance;
+
+  guint64 state;
+  guint64 n_processed;
+  GString *prefilled;
+  guint64 prefilled_state;
+  guint64 prefilled_n_processed;
+  GHashTable *tools;
+  ChatbotToolRenderer *renderer;
+  gchar *pending_tool;
+  gchar *pending_function;
+};
+
+enum
+{
+  PROP_TOOLS = 1,
+  PROP_TOOLS_HASH,
+  N_PROPERTIES
+};
+
+static GInitableIface *chatbot_mock_language_model_initable_parent_iface;
+
+static void
+chatbot_mock_language_model_initable_iface_init (GInitableIface *iface);
+static void chatbot_mock_language_model_language_model_iface_init (
+    ChatbotLanguageModelInterface *iface);
+static void chatbot_mock_language_model_tool_callable_iface_init (
+    ChatbotToolCallableLanguageModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (
+    ChatbotMockLanguageModel, chatbot_mock_language_model, CHATBOT_TYPE_MODULE,
+    G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE,
+                           chatbot_mock_language_model_initable_iface_init)
+        G_IMPLEMENT_INTERFACE (
+            CHATBOT_TYPE_LANGUAGE_MODEL,
+            chatbot_mock_language_model_language_model_iface_init)
+            G_IMPLEMENT_INTERFACE (
+                CHATBOT_TYPE_TOOL_CALLABLE_LANGUAGE_MODEL,
+                chatbot_mock_language_model_tool_callable_iface_init));
+
+static const ChatbotMockLanguageModelParameter *
+chatbot_mock_language_model_get_parameter (ChatbotMockLanguageModel *self)
+{
+  return CHATBOT_MODULE_PARAMETER_STRUCT (self,
+                                          ChatbotMockLanguageModelParameter);
+}
+
+/*
+ * FNV-1a over the bytes, so the state depends on everything prefilled.
+ */
+static void
+chatbot_mock_language_model_mix (ChatbotMockLanguageModel *self,
+                                 const gchar *text)
+{
+  for (const guchar *p = (const guchar *)text; *p; p++)
+    {
+      self->state ^= *p;
+      self->state *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+}
+
+static const gchar *
+chatbot_mock_language_model_next_token (ChatbotMockLanguageModel *self)
+{
+  const gchar *token;
+
+  self->state = self->state * G_GUINT64_CONSTANT (6364136223846793005)
+                + G_GUINT64_CONSTANT (1442695040888963407);
+  token = chatbot_mock_words[(self->state >> 33)
+                             % G_N_ELEMENTS (chatbot_mock_words)];
+  chatbot_mock_language_model_mix (self, token);
+  self->n_processed++;
+  return token;
+}
+
+/*
+ * Forgets the text prefilled so far, which can't be rewound after this.
+ */
+static void
+chatbot_mock_language_model_commit (ChatbotMockLanguageModel *self)
+{
+  g_string_truncate (self->prefilled, 0);
+  self->prefilled_state = self->state;
+  self->prefilled_n_processed = self->n_processed;
+}
+
+static gboolean
+chatbot_mock_language_model_emit (ChatbotMockLanguageModel *self,
+                                  const gchar *signal_name, const gchar *token)
+{
+  const ChatbotMockLanguageModelParameter *parameter
+      = chatbot_mock_language_model_get_parameter (self);
+  gboolean keep_going = TRUE;
+
+  if (parameter->token_latency_us > 0)
+    g_usleep (parameter->token_latency_us);
+  g_signal_emit_by_name (self, signal_name, token, &keep_going);
+  return keep_going;
+}
+
+static gboolean
+chatbot_mock_language_model_initable_init (GInitable *initable,
+                                           GCancellable *cancellable,
+                                           GError **error)
+{
+  ChatbotMockLanguageModel *self = CHATBOT_MOCK_LANGUAGE_MODEL (initable);
+  const ChatbotMockLanguageModelParameter *parameter;
+
+  if (!chatbot_mock_language_model_initable_parent_iface->init (
+          initable, cancellable, error))
+    return FALSE;
+
+  parameter = chatbot_mock_language_model_get_parameter (self);
+  if ((parameter->n_tokens < 0) || (parameter->n_thinking_tokens < 0)
+      || (parameter->token_latency_us < 0)
+      || (parameter->prefill_latency_us < 0))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Token counts and latencies must not be negative.");
+      return FALSE;
+    }
+
+  self->state = (guint64)parameter->seed;
+  chatbot_mock_language_model_commit (self);
+  return TRUE;
+}
+
+static void
+chatbot_mock_language_model_initable_iface_init (GInitableIface *iface)
+{
+  chatbot_mock_language_model_initable_parent_iface
+      = g_type_interface_peek_parent (iface);
+  iface->init = chatbot_mock_language_model_initable_init;
+}
+
+/*
+ * Mixes @text into the state and picks up "/call" lines.
+ *
+ * Returns: number of words in @text
+ */
+static guint64
+chatbot_mock_language_model_process (ChatbotMockLanguageModel *self,
+                                     const gchar *text)
+{
+  gchar **lines;
+  guint64 n_words = 0;
+  gboolean in_word = FALSE;
+
+  for (const gchar *p = text; *p; p++)
+    {
+      gboolean space = g_ascii_isspace (*p);
+      if (!space && !in_word)
+        n_words++;
+      in_word = !space;
+    }
+
+  lines = g_strsplit (text, "\n", -1);
+  for (gchar **line = lines; *line; line++)
+    {
+      gchar **words;
+
+      if (!g_str_has_prefix (*line, "/call "))
+        continue;
+
+      words = g_strsplit_set (*line + strlen ("/call "), " \t", 3);
+      if (words[0] && words[1])
+        {
+          g_free (self->pending_tool);
+          g_free (self->pending_function);
+          self->pending_tool = g_strdup (words[0]);
+          self->pending_function = g_strdup (g_strchomp (words[1]));
+        }
+      g_strfreev (words);
+    }
+  g_strfreev (lines);
+
+  chatbot_mock_language_model_mix (self, text);
+  self->n_processed += n_words;
+  return n_words;
+}
+
+static gboolean
+chatbot_mock_language_model_prefill (ChatbotLanguageModel *language_model,
+                                     const gchar *text, GError **error)
+{
+  ChatbotMockLanguageModel *self
+      = CHATBOT_MOCK_LANGUAGE_MODEL (language_model);
+  const ChatbotMockLanguageModelParameter *parameter
+      = chatbot_mock_language_model_get_parameter (self);
+  guint64 n_words;
+
+  n_words = chatbot_mock_language_model_process (self, text);
+  g_string_append (self->prefilled, text);
+  if (parameter->prefill_latency_us > 0)
+    g_usleep (parameter->prefill_latency_us * n_words);
+  return TRUE;
+}
+
+/*
+ * The state is a hash which can't be undone, so rewinding replays the kept
+ * text from the state before it. Like a KV cache truncation, it costs no
+ * prefill latency.
+ */
+static gboolean
+chatbot_mock_language_model_rewind (ChatbotLanguageModel *language_model,
+                                    gsize n_bytes, GError **error)
+{
+  ChatbotMockLanguageModel *self
+      = CHATBOT_MOCK_LANGUAGE_MODEL (language_model);
+
+  if (n_bytes > self->prefilled->len)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   "Only text prefilled after the last generation can be "
+                   "rewound.");
+      return FALSE;
+    }
+
+  g_string_truncate (self->prefilled, self->prefilled->len - n_bytes);
+  self->state = self->prefilled_state;
+  self->n_processed = self->prefilled_n_processed;
+  g_clear_pointer (&self->pending_tool, g_free);
+  g_clear_pointer (&self->pending_function, g_free);
+  chatbot_mock_language_model_process (self, self->prefilled->str);
+  return TRUE;
+}
+
+static gchar *
+chatbot_mock_language_model_call_tool (ChatbotMockLanguageModel *self,
+                                       GError **error)
+{
+  ChatbotTool *tool;
+  GVariantDict *parameters = NULL, *result = NULL;
+  GVariant *value;
+  gchar *text = NULL;
+
+  tool = g_hash_table_lookup (self->tools, self->pending_tool);
+  if (tool == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                   "Tool \"%s\" is not added.", self->pending_tool);
+      goto cleanup;
+    }
+
+  parameters = g_variant_dict_new (NULL);
+  result = chatbot_tool_call_function (tool, self->pending_function,
+                                       parameters,
+                                       CHATBOT_LANGUAGE_MODEL (self), NULL,
+                                       error);
+  if (result == NULL)
+    goto cleanup;
+
+  value = g_variant_ref_sink (g_variant_dict_end (result));
+  text = g_variant_print (value, FALSE);
+  g_variant_unref (value);
+
+cleanup:
+  g_clear_pointer (&self->pending_tool, g_free);
+  g_clear_pointer (&self->pending_function, g_free);
+  g_clear_pointer (&parameters, g_variant_dict_unref);
+  g_clear_pointer (&result, g_variant_dict_unref);
+  return text;
+}
+
+static gchar *
+chatbot_mock_language_model_generate_tokens (ChatbotMockLanguageModel *self,
+                                             GError **error)
+{
+  const ChatbotMockLanguageModelParameter *parameter
+      = chatbot_mock_language_model_get_parameter (self);
+  GString *generated;
+
+  for (gint64 i = 0; i < parameter->n_thinking_tokens; i++)
+    if (!chatbot_mock_language_model_emit (
+            self, "thinking", chatbot_mock_language_model_next_token (self)))
+      break;
+
+  generated = g_string_new (NULL);
+  if (self->pending_tool)
+    {
+      gchar *result = chatbot_mock_language_model_call_tool (self, error);
+
+      if (result == NULL)
+        return g_string_free (generated, TRUE);
+
+      chatbot_mock_language_model_mix (self, result);
+      g_string_append (generated, result);
+      if (!chatbot_mock_language_model_emit (self, "generating", result))
+        {
+          g_free (result);
+          return g_string_free (generated, FALSE);
+        }
+      g_free (result);
+    }
+
+  for (gint64 i = 0; i < parameter->n_tokens; i++)
+    {
+      const gchar *token = chatbot_mock_language_model_next_token (self);
+
+      g_string_append (generated, token);
+      if (!chatbot_mock_language_model_emit (self, "generating", token))
+        break;
+    }
+
+  return g_string_free (generated, FALSE);
+}
+
+static gchar *
+chatbot_mock_language_model_generate (ChatbotLanguageModel *language_model,
+                                      GError **error)
+{
+  ChatbotMockLanguageModel *self
+      = CHATBOT_MOCK_LANGUAGE_MODEL (language_model);
+  gchar *generated;
+
+  generated = chatbot_mock_language_model_generate_tokens (self, error);
+  chatbot_mock_language_model_commit (self);
+  return generated;
+}
+
+static gboolean
+chatbot_mock_language_model_save_state (ChatbotLanguageModel *language_model,
+                                        const gchar *filename, GError **error)
+{
+  ChatbotMockLanguageModel *self
+      = CHATBOT_MOCK_LANGUAGE_MODEL (language_model);
+  GVariant *state;
+  gboolean ret;
+
+  state = g_variant_ref_sink (
+      g_variant_new (CHATBOT_MOCK_STATE_TYPE, self->state, self->n_processed));
+  ret = g_file_set_contents (filename, g_variant_get_data (state),
+                             g_variant_get_size (state), error);
+  g_variant_unref (state);
+  return ret;
+}
+
+static gboolean
+chatbot_mock_language_model_load_state (ChatbotLanguageModel *language_model,
+                                        const gchar *filename, GError **error)
+{
+  ChatbotMockLanguageModel *self
+      = CHATBOT_MOCK_LANGUAGE_MODEL (language_model);
+  GBytes *bytes;
+  GVariant *state;
+  gchar *contents;
+  gsize length;
+
+  if (!g_file_get_contents (filename, &contents, &length, error))
+    return FALSE;
+
+  bytes = g_bytes_new_take (contents, length);
+  state = g_variant_ref_sink (g_variant_new_from_bytes (
+      G_VARIANT_TYPE (CHATBOT_MOCK_STATE_TYPE), bytes, FALSE));
+  g_bytes_unref (bytes);
+  if (!g_variant_is_normal_form (state))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "\"%s\" is not a mock language model state.", filename);
+      g_variant_unref (state);
+      return FALSE;
+    }
+
+  g_variant_get (state, CHATBOT_MOCK_STATE_TYPE, &self->state,
+                 &self->n_processed);
+  g_variant_unref (state);
+  g_clear_pointer (&self->pending_tool, g_free);
+  g_clear_pointer (&self->pending_function, g_free);
+  chatbot_mock_language_model_commit (self);
+  return TRUE;
+}
+
+static gboolean
+chatbot_mock_language_model_reset (ChatbotLanguageModel *language_model,
+                                   GError **error)
+{
+  ChatbotMockLanguageModel *self
+      = CHATBOT_MOCK_LANGUAGE_MODEL (language_model);
+  const ChatbotMockLanguageModelParameter *parameter
+      = chatbot_mock_language_model_get_parameter (self);
+
+  self->state = (guint64)parameter->seed;
+  self->n_processed = 0;
+  g_clear_pointer (&self->pending_tool, g_free);
+  g_clear_pointer (&self->pending_function, g_free);
+  chatbot_mock_language_model_commit (self);
+  return TRUE;
+}
+
+static void
+chatbot_mock_language_model_language_model_iface_init (
+    ChatbotLanguageModelInterface *iface)
+{
+  iface->prefill = chatbot_mock_language_model_prefill;
+  iface->generate = chatbot_mock_language_model_generate;
+  iface->save_state = chatbot_mock_language_model_save_state;
+  iface->load_state = chatbot_mock_language_model_load_state;
+  iface->reset = chatbot_mock_language_model_reset;
+  iface->rewind = chatbot_mock_language_model_rewind;
+}
+
+static gboolean
+chatbot_mock_language_model_add_tool (
+    ChatbotToolCallableLanguageModel *language_model, ChatbotTool *tool,
+    GError **error)
+{
+  ChatbotMockLanguageModel *self
+      = CHATBOT_MOCK_LANGUAGE_MODEL (language_model);
+  const gchar *name = chatbot_module_get_name (CHATBOT_MODULE (tool));
+
+  if (g_hash_table_contains (self->tools, name))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_EXISTS,
+                   "Tool \"%s\" is already added.", name);
+      return FALSE;
+    }
+
+  g_hash_table_insert (self->tools, g_strdup (name), g_object_ref (tool));
+  chatbot_tool_renderer_add_tool (self->renderer, tool);
+  return TRUE;
+}
+
+static gboolean
+chatbot_mock_language_model_remove_tool (
+    ChatbotToolCallableLanguageModel *language_model, const gchar *tool_name)
+{
+  ChatbotMockLanguageModel *self
+      = CHATBOT_MOCK_LANGUAGE_MODEL (language_model);
+  ChatbotTool *tool = g_hash_table_lookup (self->tools, tool_name);
+
+  if (tool == NULL)
+    return FALSE;
+  chatbot_tool_renderer_remove_tool (self->renderer, tool);
+  return g_hash_table_remove (self->tools, tool_name);
+}
+
+static void
+chatbot_mock_language_model_tool_callable_iface_init (
+    ChatbotToolCallableLanguageModelInterface *iface)
+{
+  iface->add_tool = chatbot_mock_language_model_add_tool;
+  iface->remove_tool = chatbot_mock_language_model_remove_tool;
+}
+
+static const gchar *
+chatbot_mock_language_model_get_name (ChatbotModule *module)
+{
+  return "mock";
+}
+
+static const gchar *
+chatbot_mock_language_model_get_description (ChatbotModule *module)
+{
+  return "Deterministic language model with simulated latency for "
+         "benchmarking.";
+}
+
+static void
+chatbot_mock_language_model_get_property (GObject *object, guint property_id,
+                                          GValue *value, GParamSpec *pspec)
+{
+  ChatbotMockLanguageModel *self = CHATBOT_MOCK_LANGUAGE_MODEL (object);
+  GPtrArray *tools;
+  GHashTableIter iter;
+  gpointer tool;
+
+  switch (property_id)
+    {
+    case PROP_TOOLS:
+      tools = g_ptr_array_new_with_free_func (g_object_unref);
+      g_hash_table_iter_init (&iter, self->tools);
+      while (g_hash_table_iter_next (&iter, NULL, &tool))
+        g_ptr_array_add (tools, g_object_ref (tool));
+      g_value_take_boxed (value, tools);
+      break;
+    case PROP_TOOLS_HASH:
+      g_value_take_string (value,
+                           chatbot_tool_renderer_dup_hash (self->renderer));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+chatbot_mock_language_model_tools_changed (ChatbotMockLanguageModel *self)
+{
+  g_object_notify (G_OBJECT (self), "tools-hash");
+}
+
+static void
+chatbot_mock_language_model_finalize (GObject *object)
+{
+  ChatbotMockLanguageModel *self = CHATBOT_MOCK_LANGUAGE_MODEL (object);
+
+  g_object_unref (self->renderer);
+  g_hash_table_unref (self->tools);
+  g_string_free (self->prefilled, TRUE);
+  g_free (self->pending_tool);
+  g_free (self->pending_function);
+
+  G_OBJECT_CLASS (chatbot_mock_language_model_parent_class)->finalize (object);
+}
+
+static void
+chatbot_mock_language_model_class_init (ChatbotMockLanguageModelClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ChatbotModuleClass *module_class = CHATBOT_MODULE_CLASS (klass);
+
+  object_class->get_property = chatbot_mock_language_model_get_property;
+  object_class->finalize = chatbot_mock_language_model_finalize;
+
+  module_class->get_name = chatbot_mock_language_model_get_name;
+  module_class->get_description = chatbot_mock_language_model_get_description;
+  chatbot_module_class_set_parameter_specs (
+      module_class, chatbot_mock_language_model_parameter_specs,
+      sizeof (ChatbotMockLanguageModelParameter));
+
+  g_object_class_override_property (object_class, PROP_TOOLS, "tools");
+  g_object_class_install_property (
+      object_class, PROP_TOOLS_HASH,
+      g_param_spec_string ("tools-hash", "tools-hash",
+                           "SHA-256 of the rendered function definitions",
+                           NULL, G_PARAM_READABLE));
+}
+
+static void
+chatbot_mock_language_model_init (ChatbotMockLanguageModel *self)
+{
+  self->tools = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       g_object_unref);
+  self->prefilled = g_string_new (NULL);
+  self->renderer = chatbot_tool_renderer_new ();
+  g_signal_connect_swapped (
+      self->renderer, "changed",
+      G_CALLBACK (chatbot_mock_language_model_tools_changed), self);
+}
+
+G_MODULE_EXPORT GType
+get_type (void)
+{
+  return chatbot_mock_language_model_get_type ();
+}
@@ -0,0 +1,236 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Output order and input parsing of `cli --batch`, whose path is given with
+ * CHATBOT_TEST_CLI, with the mock language model given with
+ * CHATBOT_TEST_MOCK_MODULE.
+ */
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#define TEST_N_PROMPTS 12
+
+static const gchar *cli_path = NULL;
+static const gchar *mock_path = NULL;
+
+/*
+ * Runs `cli --batch` on @input with @n_jobs jobs. Returns the output lines
+ * if the CLI succeeds, or %NULL with its stderr in @errors if it fails.
+ */
+static gchar **
+test_batch_run_input (const gchar *input, guint n_jobs, gchar **errors)
+{
+  gchar *dir, *input_path, *output_path, *jobs, *output = NULL;
+  gchar *stderr_text = NULL;
+  gchar **lines = NULL;
+  GSubprocess *subprocess;
+  GError *error = NULL;
+
+  dir = g_dir_make_tmp ("chatbot-test-batch-XXXXXX", &error);
+  g_assert_no_error (error);
+  input_path = g_build_filename (dir, "prompts.jsonl", NULL);
+  output_path = g_build_filename (dir, "results.jsonl", NULL);
+  g_file_set_contents (input_path, input, -1, &error);
+  g_assert_no_error (error);
+
+  jobs = g_strdup_printf ("%u", n_jobs);
+  subprocess = g_subprocess_new (
+      G_SUBPROCESS_FLAGS_STDERR_PIPE, &error, cli_path, "--modules",
+      mock_path, "--module-parameters", "tokens=4:prefill-latency-us=500",
+      "--batch", input_path, "--batch-output", output_path, "--batch-jobs",
+      jobs, NULL);
+  g_assert_no_error (error);
+  g_subprocess_communicate_utf8 (subprocess, NULL, NULL, NULL, &stderr_text,
+                                 &error);
+  g_assert_no_error (error);
+
+  if (g_subprocess_get_successful (subprocess))
+    {
+      g_file_get_contents (output_path, &output, NULL, &error);
+      g_assert_no_error (error);
+      lines = g_strsplit (output, "\n", -1);
+    }
+  if (errors)
+    *errors = g_steal_pointer (&stderr_text);
+
+  g_unlink (output_path);
+  g_unlink (input_path);
+  g_rmdir (dir);
+  g_free (stderr_text);
+  g_free (output);
+  g_object_unref (subprocess);
+  g_free (jobs);
+  g_free (output_path);
+  g_free (input_path);
+  g_free (dir);
+  return lines;
+}
+
+/*
+ * Runs the batch of TEST_N_PROMPTS prompts whose ids are their indices with
+ * @n_jobs jobs, and returns the output lines.
+ */
+static gchar **
+test_batch_run (guint n_jobs)
+{
+  GString *input = g_string_new (NULL);
+  gchar **lines;
+
+  // The first prompt is the longest to prefill, so later prompts finish
+  // before it when they run concurrently.
+  for (guint i = 0; i < TEST_N_PROMPTS; i++)
+    {
+      GString *prompt = g_string_new (NULL);
+      guint n_words = (i == 0) ? 200 : i;
+
+      for (guint j = 0; j < n_words; j++)
+        g_string_append (prompt, " word");
+      // Both line formats keep their ids.
+      if (i % 2)
+        g_string_append_printf (input, "%u\t%s\n", i, prompt->str);
+      else
+        g_string_append_printf (input, "{\"id\": %u, \"prompt\": \"%s\"}\n",
+                                i, prompt->str);
+      g_string_free (prompt, TRUE);
+    }
+
+  lines = test_batch_run_input (input->str, n_jobs, NULL);
+  g_assert_nonnull (lines);
+  g_string_free (input, TRUE);
+  return lines;
+}
+
+static void
+test_input_order (gconstpointer user_data)
+{
+  guint n_jobs = GPOINTER_TO_UINT (user_data);
+  gchar **lines = test_batch_run (n_jobs);
+
+  g_assert_cmpuint (g_strv_length (lines), ==, TEST_N_PROMPTS + 1);
+  for (guint i = 0; i < TEST_N_PROMPTS; i++)
+    {
+      gchar *prefix = g_strdup_printf ("{\"id\": \"%u\", \"output\": ", i);
+
+      g_assert_true (g_str_has_prefix (lines[i], prefix));
+      g_free (prefix);
+    }
+  g_assert_cmpstr (lines[TEST_N_PROMPTS], ==, "");
+
+  g_strfreev (lines);
+}
+
+static void
+test_json_escapes (void)
+{
+  // Each id is echoed back, escaped again by the CLI.
+  static const gchar *const cases[][2] = {
+    { "{\"id\": \"q\\\"b\\\\s\\/\", \"prompt\": \"a\"}", "\"q\\\"b\\\\s/\"" },
+    { "{\"id\": \"\\u00e9\\u20AC\", \"prompt\": \"a\"}",
+      "\"\xc3\xa9\xe2\x82\xac\"" },
+    // A surrogate pair is one character.
+    { "{\"id\": \"\\ud83d\\ude00\", \"prompt\": \"a\"}",
+      "\"\xf0\x9f\x98\x80\"" },
+    { "{\"id\": \"\\t\\n\", \"prompt\": \"a\"}", "\"\\u0009\\n\"" },
+    // Numbers are kept as written, and other members are skipped.
+    { "{ \"extra\" : {\"a\": [1, \"\\u0041\", null]} , \"id\" : -1.5e3 , "
+      "\"prompt\" : \"a\" }",
+      "\"-1.5e3\"" },
+    { "{\"prompt\": \"a\", \"id\": \"\"}", "\"\"" },
+  };
+  GString *input = g_string_new (NULL);
+  gchar **lines;
+
+  for (gsize i = 0; i < G_N_ELEMENTS (cases); i++)
+    g_string_append_printf (input, "%s\n", cases[i][0]);
+  lines = test_batch_run_input (input->str, 1, NULL);
+  g_assert_nonnull (lines);
+
+  g_assert_cmpuint (g_strv_length (lines), ==, G_N_ELEMENTS (cases) + 1);
+  for (gsize i = 0; i < G_N_ELEMENTS (cases); i++)
+    {
+      gchar *prefix
+          = g_strdup_printf ("{\"id\": %s, \"output\": ", cases[i][1]);
+
+      g_assert_true (g_str_has_prefix (lines[i], prefix));
+      g_free (prefix);
+    }
+
+  g_strfreev (lines);
+  g_string_free (input, TRUE);
+}
+
+static void
+test_json_invalid (void)
+{
+  static const gchar *const cases[][2] = {
+    { "{\"id\": {\"a\": 1}, \"prompt\": \"a\"}", "\"id\" must be" },
+    { "{\"id\": [1], \"prompt\": \"a\"}", "\"id\" must be" },
+    { "{\"id\": null, \"prompt\": \"a\"}", "\"id\" must be" },
+    { "{\"id\": true, \"prompt\": \"a\"}", "\"id\" must be" },
+    { "{\"id\": \"1\", \"prompt\": 1}", "\"prompt\" must be" },
+    { "{\"id\": \"1\"}", "\"prompt\" is missing" },
+    // Lone and reversed surrogates, U+0000 and bad escapes.
+    { "{\"id\": \"\\ud83d\", \"prompt\": \"a\"}", "Invalid JSON" },
+    { "{\"id\": \"\\ude00\\ud83d\", \"prompt\": \"a\"}", "Invalid JSON" },
+    { "{\"id\": \"\\u0000\", \"prompt\": \"a\"}", "Invalid JSON" },
+    { "{\"id\": \"\\u12g4\", \"prompt\": \"a\"}", "Invalid JSON" },
+    { "{\"id\": \"\\x\", \"prompt\": \"a\"}", "Invalid JSON" },
+    { "{\"id\": \"1\", \"prompt\": \"a\"", "Invalid JSON" },
+    { "{\"id\": \"1\", \"prompt\": \"a\"} x", "Invalid JSON" },
+    { "{\"id\" \"1\", \"prompt\": \"a\"}", "Invalid JSON" },
+    { "{\"prompt\": \"a\", \"extra\": [1,]}", "Invalid JSON" },
+  };
+
+  for (gsize i = 0; i < G_N_ELEMENTS (cases); i++)
+    {
+      gchar *input = g_strdup_printf ("%s\n", cases[i][0]);
+      gchar *errors = NULL;
+
+      g_test_message ("Input: %s", cases[i][0]);
+      g_assert_null (test_batch_run_input (input, 1, &errors));
+      g_assert_nonnull (strstr (errors, "Line 1: "));
+      g_assert_nonnull (strstr (errors, cases[i][1]));
+
+      g_free (errors);
+      g_free (input);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  cli_path = g_getenv ("CHATBOT_TEST_CLI");
+  mock_path = g_getenv ("CHATBOT_TEST_MOCK_MODULE");
+  if ((cli_path == NULL) || (mock_path == NULL))
+    {
+      g_printerr ("CHATBOT_TEST_CLI or CHATBOT_TEST_MOCK_MODULE is not "
+                  "set.\n");
+      return 77;
+    }
+
+  g_test_add_data_func ("/batch/input-order/1-job", GUINT_TO_POINTER (1),
+                        test_input_order);
+  g_test_add_data_func ("/batch/input-order/4-jobs", GUINT_TO_POINTER (4),
+                        test_input_order);
+  g_test_add_func ("/batch/json-escapes", test_json_escapes);
+  g_test_add_func ("/batch/json-invalid", test_json_invalid);
+  return g_test_run ();
+}
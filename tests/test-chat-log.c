@@ -0,0 +1,210 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Appending, torn record recovery and reading of ChatbotChatLog. Each case
+ * runs with and without CHATBOT_CHAT_LOG_COMPRESS.
+ */
+
+#include <stdio.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "chatbot.h"
+
+typedef struct
+{
+  gchar *dir;
+  gchar *path;
+} TestChatLog;
+
+static void
+test_chat_log_setup (TestChatLog *fixture, gconstpointer user_data)
+{
+  GError *error = NULL;
+
+  fixture->dir = g_dir_make_tmp ("chatbot-test-chat-log-XXXXXX", &error);
+  g_assert_no_error (error);
+  fixture->path = g_build_filename (fixture->dir, "chat.log", NULL);
+}
+
+static void
+test_chat_log_teardown (TestChatLog *fixture, gconstpointer user_data)
+{
+  g_unlink (fixture->path);
+  g_rmdir (fixture->dir);
+  g_free (fixture->path);
+  g_free (fixture->dir);
+}
+
+static guint64
+test_chat_log_get_size (const gchar *path)
+{
+  GStatBuf buf;
+
+  g_assert_cmpint (g_stat (path, &buf), ==, 0);
+  return buf.st_size;
+}
+
+static void
+test_chat_log_assert_next (ChatbotChatLogReader *reader, guint64 session,
+                           const gchar *role, const gchar *message)
+{
+  guint64 read_session;
+  gchar *read_role, *read_message;
+  GError *error = NULL;
+
+  g_assert_true (chatbot_chat_log_reader_next (
+      reader, &read_session, NULL, &read_role, &read_message, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (read_session, ==, session);
+  g_assert_cmpstr (read_role, ==, role);
+  g_assert_cmpstr (read_message, ==, message);
+  g_free (read_role);
+  g_free (read_message);
+}
+
+static void
+test_chat_log_assert_end (ChatbotChatLogReader *reader)
+{
+  GError *error = NULL;
+
+  g_assert_false (
+      chatbot_chat_log_reader_next (reader, NULL, NULL, NULL, NULL, &error));
+  g_assert_no_error (error);
+}
+
+static void
+test_torn_record (TestChatLog *fixture, gconstpointer user_data)
+{
+  ChatbotChatLogFlags flags = GPOINTER_TO_INT (user_data);
+  // A record header claiming 64 bytes followed by only 5 of them, as left by
+  // a crash in the middle of a write.
+  static const guint8 torn[] = { 64, 0, 0, 0, 64, 0, 0, 0, 0,
+                                 0,  0, 0, 't', 'o', 'r', 'n', '!' };
+  guint64 session = chatbot_chat_log_new_session ();
+  ChatbotChatLog *log;
+  ChatbotChatLogReader *reader;
+  guint64 valid_size;
+  FILE *file;
+  GError *error = NULL;
+
+  log = chatbot_chat_log_open (fixture->path, flags, &error);
+  g_assert_no_error (error);
+  g_assert_true (chatbot_chat_log_append (log, session, "user", "Hello",
+                                          &error));
+  g_assert_no_error (error);
+  g_assert_true (chatbot_chat_log_append (log, session, "assistant",
+                                          "Hi there", &error));
+  g_assert_no_error (error);
+  g_object_unref (log);
+  g_assert_true (chatbot_chat_log_is_log (fixture->path));
+
+  valid_size = test_chat_log_get_size (fixture->path);
+  file = g_fopen (fixture->path, "ab");
+  g_assert_nonnull (file);
+  g_assert_cmpuint (fwrite (torn, 1, sizeof (torn), file), ==, sizeof (torn));
+  fclose (file);
+
+  // The reader stops at the torn record.
+  reader = chatbot_chat_log_reader_new (fixture->path, &error);
+  g_assert_no_error (error);
+  test_chat_log_assert_next (reader, session, "user", "Hello");
+  test_chat_log_assert_next (reader, session, "assistant", "Hi there");
+  test_chat_log_assert_end (reader);
+  g_object_unref (reader);
+
+  // Opening again truncates it, so appended records are readable.
+  log = chatbot_chat_log_open (fixture->path, flags, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (test_chat_log_get_size (fixture->path), ==, valid_size);
+  g_assert_true (chatbot_chat_log_append (log, session, "user", "Again",
+                                          &error));
+  g_assert_no_error (error);
+  g_object_unref (log);
+
+  reader = chatbot_chat_log_reader_new (fixture->path, &error);
+  g_assert_no_error (error);
+  test_chat_log_assert_next (reader, session, "user", "Hello");
+  test_chat_log_assert_next (reader, session, "assistant", "Hi there");
+  test_chat_log_assert_next (reader, session, "user", "Again");
+  test_chat_log_assert_end (reader);
+  g_object_unref (reader);
+}
+
+static void
+test_sessions (TestChatLog *fixture, gconstpointer user_data)
+{
+  ChatbotChatLogFlags flags = GPOINTER_TO_INT (user_data);
+  const gchar *const first_strings[]
+      = { "user", "1a", "assistant", "1b", NULL };
+  const gchar *const second_strings[] = { "user", "2a", NULL };
+  guint64 first = chatbot_chat_log_new_session ();
+  guint64 second = first + 1;
+  ChatbotChatLog *log;
+  ChatbotChatLogReader *reader;
+  GPtrArray *sessions;
+  GError *error = NULL;
+
+  log = chatbot_chat_log_open (fixture->path, flags, &error);
+  g_assert_no_error (error);
+  chatbot_chat_log_append (log, first, "user", "1a", &error);
+  g_assert_no_error (error);
+  chatbot_chat_log_append (log, second, "user", "2a", &error);
+  g_assert_no_error (error);
+  chatbot_chat_log_append (log, first, "assistant", "1b", &error);
+  g_assert_no_error (error);
+  g_object_unref (log);
+
+  reader = chatbot_chat_log_reader_new (fixture->path, &error);
+  g_assert_no_error (error);
+  sessions = chatbot_chat_log_reader_get_sessions (reader, &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (sessions->len, ==, 2);
+  g_assert_true (g_strv_equal (
+      (const gchar *const *)chatbot_data_get_strings (
+          g_ptr_array_index (sessions, 0)),
+      first_strings));
+  g_assert_true (g_strv_equal (
+      (const gchar *const *)chatbot_data_get_strings (
+          g_ptr_array_index (sessions, 1)),
+      second_strings));
+  g_ptr_array_unref (sessions);
+
+  // get_sessions() doesn't move the cursor.
+  test_chat_log_assert_next (reader, first, "user", "1a");
+  g_object_unref (reader);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/chat-log/torn-record", TestChatLog,
+              GINT_TO_POINTER (CHATBOT_CHAT_LOG_NONE), test_chat_log_setup,
+              test_torn_record, test_chat_log_teardown);
+  g_test_add ("/chat-log/torn-record-compress", TestChatLog,
+              GINT_TO_POINTER (CHATBOT_CHAT_LOG_COMPRESS),
+              test_chat_log_setup, test_torn_record, test_chat_log_teardown);
+  g_test_add ("/chat-log/sessions", TestChatLog,
+              GINT_TO_POINTER (CHATBOT_CHAT_LOG_NONE), test_chat_log_setup,
+              test_sessions, test_chat_log_teardown);
+  g_test_add ("/chat-log/sessions-compress", TestChatLog,
+              GINT_TO_POINTER (CHATBOT_CHAT_LOG_COMPRESS),
+              test_chat_log_setup, test_sessions, test_chat_log_teardown);
+  return g_test_run ();
+}
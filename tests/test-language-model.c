@@ -0,0 +1,189 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * chatbot_language_model_ensure_context() with the mock language model, whose
+ * path is given with CHATBOT_TEST_MOCK_MODULE. The mock's output depends on
+ * everything it has consumed, so a model brought to a text by prefilling,
+ * rewinding or rebuilding must generate the same as a fresh one given the
+ * whole text.
+ */
+
+#include <gio/gio.h>
+
+#include "chatbot.h"
+
+#define TEST_MOCK_PARAMETER "tokens=8:thinking-tokens=0:seed=7"
+
+static GType mock_type = G_TYPE_INVALID;
+
+static gboolean
+test_generating (ChatbotLanguageModel *language_model, const gchar *text,
+                 gpointer user_data)
+{
+  return TRUE;
+}
+
+static ChatbotLanguageModel *
+test_language_model_new (void)
+{
+  ChatbotModule *module;
+  GError *error = NULL;
+
+  module = chatbot_module_new (mock_type, TEST_MOCK_PARAMETER, &error);
+  g_assert_no_error (error);
+  g_assert_true (CHATBOT_IS_LANGUAGE_MODEL (module));
+  g_signal_connect (module, "generating", G_CALLBACK (test_generating), NULL);
+  return CHATBOT_LANGUAGE_MODEL (module);
+}
+
+static gchar *
+test_generate (ChatbotLanguageModel *language_model)
+{
+  GError *error = NULL;
+  gchar *output;
+
+  output = chatbot_language_model_generate (language_model, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (output);
+  return output;
+}
+
+/*
+ * Returns what a fresh instance generates after prefilling @text.
+ */
+static gchar *
+test_generate_fresh (const gchar *text)
+{
+  ChatbotLanguageModel *language_model = test_language_model_new ();
+  GError *error = NULL;
+  gchar *output;
+
+  g_assert_true (chatbot_language_model_prefill (language_model, text,
+                                                 &error));
+  g_assert_no_error (error);
+  output = test_generate (language_model);
+  g_object_unref (language_model);
+  return output;
+}
+
+static void
+test_ensure (ChatbotLanguageModel *language_model, const gchar *text,
+             gboolean expect_rebuilt)
+{
+  gboolean rebuilt = !expect_rebuilt;
+  GError *error = NULL;
+
+  g_assert_true (chatbot_language_model_ensure_context (
+      language_model, text, &rebuilt, &error));
+  g_assert_no_error (error);
+  g_assert_cmpint (rebuilt, ==, expect_rebuilt);
+}
+
+static void
+test_prefix_and_rewind (void)
+{
+  ChatbotLanguageModel *language_model = test_language_model_new ();
+  ChatbotLanguageModel *twin = test_language_model_new ();
+  gchar *output, *expected, *text;
+  GError *error = NULL;
+
+  test_ensure (language_model, "Hello", FALSE);
+  // Only the rest is prefilled.
+  test_ensure (language_model, "Hello world", FALSE);
+  // "world" is rewound and "there" is prefilled.
+  test_ensure (language_model, "Hello there", FALSE);
+  test_ensure (language_model, "Hello there", FALSE);
+
+  output = test_generate (language_model);
+  expected = test_generate_fresh ("Hello there");
+  g_assert_cmpstr (output, ==, expected);
+  g_free (expected);
+
+  // The generated text is part of the context, so only the next turn is
+  // prefilled, as the twin does by hand.
+  text = g_strconcat ("Hello there", output, "\nuser: more", NULL);
+  test_ensure (language_model, text, FALSE);
+  g_free (output);
+
+  g_assert_true (chatbot_language_model_prefill (twin, "Hello there",
+                                                 &error));
+  g_assert_no_error (error);
+  g_free (test_generate (twin));
+  g_assert_true (chatbot_language_model_prefill (twin, "\nuser: more",
+                                                 &error));
+  g_assert_no_error (error);
+
+  output = test_generate (language_model);
+  expected = test_generate (twin);
+  g_assert_cmpstr (output, ==, expected);
+
+  g_free (expected);
+  g_free (output);
+  g_free (text);
+  g_object_unref (twin);
+  g_object_unref (language_model);
+}
+
+static void
+test_rebuild (void)
+{
+  ChatbotLanguageModel *language_model = test_language_model_new ();
+  gchar *output, *expected;
+  GError *error = NULL;
+
+  // Text consumed before the first call is unknown.
+  g_assert_true (chatbot_language_model_prefill (language_model, "Untracked",
+                                                 &error));
+  g_assert_no_error (error);
+  test_ensure (language_model, "Hello", TRUE);
+  test_ensure (language_model, "Hello world", FALSE);
+
+  // The mock can't rewind generated text, so going back before it rebuilds.
+  g_free (test_generate (language_model));
+  test_ensure (language_model, "Bye", TRUE);
+
+  output = test_generate (language_model);
+  expected = test_generate_fresh ("Bye");
+  g_assert_cmpstr (output, ==, expected);
+
+  g_free (expected);
+  g_free (output);
+  g_object_unref (language_model);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const gchar *mock_path = g_getenv ("CHATBOT_TEST_MOCK_MODULE");
+  GError *error = NULL;
+
+  g_test_init (&argc, &argv, NULL);
+
+  if (mock_path == NULL)
+    {
+      g_printerr ("CHATBOT_TEST_MOCK_MODULE is not set.\n");
+      return 77;
+    }
+  mock_type = chatbot_module_registry_load_type (
+      chatbot_module_registry_get_default (), mock_path, &error);
+  g_assert_no_error (error);
+
+  g_test_add_func ("/language-model/ensure-context/prefix-and-rewind",
+                   test_prefix_and_rewind);
+  g_test_add_func ("/language-model/ensure-context/rebuild",
+                   test_rebuild);
+  return g_test_run ();
+}
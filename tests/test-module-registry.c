@@ -0,0 +1,127 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Pooling of ChatbotModuleRegistry with the mock language model, whose path
+ * is given with CHATBOT_TEST_MOCK_MODULE.
+ */
+
+#include <gio/gio.h>
+
+#include "chatbot.h"
+
+static GType mock_type = G_TYPE_INVALID;
+
+static void
+test_checkout_reuses_returned (void)
+{
+  ChatbotModuleRegistry *registry = chatbot_module_registry_new (0, 0);
+  ChatbotModule *first, *second, *other;
+  GError *error = NULL;
+
+  first = chatbot_module_registry_checkout (registry, mock_type, "tokens=4",
+                                            &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (first);
+  chatbot_module_registry_return (registry, first);
+  g_assert_cmpuint (chatbot_module_registry_get_n_idle (registry), ==, 1);
+
+  second = chatbot_module_registry_checkout (registry, mock_type, "tokens=4",
+                                             &error);
+  g_assert_no_error (error);
+  g_assert_true (second == first);
+  g_assert_cmpuint (chatbot_module_registry_get_n_idle (registry), ==, 0);
+
+  // An instance with another parameter never comes from that pool.
+  chatbot_module_registry_return (registry, second);
+  other = chatbot_module_registry_checkout (registry, mock_type, "tokens=5",
+                                            &error);
+  g_assert_no_error (error);
+  g_assert_true (other != first);
+  g_assert_cmpstr (chatbot_module_get_raw_parameter (other), ==, "tokens=5");
+  g_assert_cmpuint (chatbot_module_registry_get_n_idle (registry), ==, 1);
+
+  g_object_unref (other);
+  g_object_unref (registry);
+}
+
+static void
+test_checkout_null_parameter (void)
+{
+  ChatbotModuleRegistry *registry = chatbot_module_registry_new (0, 0);
+  ChatbotModule *first, *second;
+  GError *error = NULL;
+
+  // NULL and "" are the same parameter.
+  first = chatbot_module_registry_checkout (registry, mock_type, NULL,
+                                            &error);
+  g_assert_no_error (error);
+  chatbot_module_registry_return (registry, first);
+  second = chatbot_module_registry_checkout (registry, mock_type, "", &error);
+  g_assert_no_error (error);
+  g_assert_true (second == first);
+
+  g_object_unref (second);
+  g_object_unref (registry);
+}
+
+static void
+test_max_idle_and_evict (void)
+{
+  ChatbotModuleRegistry *registry = chatbot_module_registry_new (0, 1);
+  ChatbotModule *first, *second;
+  GError *error = NULL;
+
+  first = chatbot_module_registry_checkout (registry, mock_type, "", &error);
+  g_assert_no_error (error);
+  second = chatbot_module_registry_checkout (registry, mock_type, "", &error);
+  g_assert_no_error (error);
+  g_assert_true (second != first);
+
+  chatbot_module_registry_return (registry, first);
+  chatbot_module_registry_return (registry, second);
+  g_assert_cmpuint (chatbot_module_registry_get_n_idle (registry), ==, 1);
+
+  g_assert_cmpuint (chatbot_module_registry_evict_idle (registry, 0), ==, 1);
+  g_assert_cmpuint (chatbot_module_registry_get_n_idle (registry), ==, 0);
+
+  g_object_unref (registry);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const gchar *mock_path = g_getenv ("CHATBOT_TEST_MOCK_MODULE");
+  GError *error = NULL;
+
+  g_test_init (&argc, &argv, NULL);
+
+  if (mock_path == NULL)
+    {
+      g_printerr ("CHATBOT_TEST_MOCK_MODULE is not set.\n");
+      return 77;
+    }
+  mock_type = chatbot_module_registry_load_type (
+      chatbot_module_registry_get_default (), mock_path, &error);
+  g_assert_no_error (error);
+
+  g_test_add_func ("/module-registry/checkout-reuses-returned",
+                   test_checkout_reuses_returned);
+  g_test_add_func ("/module-registry/checkout-null-parameter",
+                   test_checkout_null_parameter);
+  g_test_add_func ("/module-registry/max-idle-and-evict",
+                   test_max_idle_and_evict);
+  return g_test_run ();
+}
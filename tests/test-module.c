@@ -0,0 +1,207 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Parsing of typed module parameters declared with
+ * chatbot_module_class_set_parameter_specs().
+ */
+
+#include <gio/gio.h>
+
+#include "chatbot.h"
+
+typedef struct
+{
+  gint64 count;
+  gdouble scale;
+  gboolean verbose;
+  gchar *path;
+  gint level;
+  gint64 seed;
+} TestModuleParameter;
+
+static const gchar *const test_module_levels[] = { "low", "high", NULL };
+
+static const ChatbotModuleParameterSpec test_module_parameter_specs[] = {
+  { "count", "count", CHATBOT_MODULE_PARAMETER_INT,
+    G_STRUCT_OFFSET (TestModuleParameter, count), "3", NULL },
+  { "scale", "scale", CHATBOT_MODULE_PARAMETER_DOUBLE,
+    G_STRUCT_OFFSET (TestModuleParameter, scale), "0.5", NULL },
+  { "verbose", "verbose", CHATBOT_MODULE_PARAMETER_BOOLEAN,
+    G_STRUCT_OFFSET (TestModuleParameter, verbose), "false", NULL },
+  { "path", "path", CHATBOT_MODULE_PARAMETER_PATH,
+    G_STRUCT_OFFSET (TestModuleParameter, path), "", NULL },
+  { "level", "level", CHATBOT_MODULE_PARAMETER_ENUM,
+    G_STRUCT_OFFSET (TestModuleParameter, level), "low",
+    test_module_levels },
+  { "seed", "required seed", CHATBOT_MODULE_PARAMETER_INT,
+    G_STRUCT_OFFSET (TestModuleParameter, seed), NULL, NULL },
+  { NULL }
+};
+
+#define TEST_TYPE_MODULE test_module_get_type ()
+G_DECLARE_FINAL_TYPE (TestModule, test_module, TEST, MODULE, ChatbotModule);
+
+struct _TestModule
+{
+  ChatbotModule parent_instance;
+};
+
+G_DEFINE_TYPE (TestModule, test_module, CHATBOT_TYPE_MODULE);
+
+static void
+test_module_class_init (TestModuleClass *klass)
+{
+  chatbot_module_class_set_parameter_specs (CHATBOT_MODULE_CLASS (klass),
+                                            test_module_parameter_specs,
+                                            sizeof (TestModuleParameter));
+}
+
+static void
+test_module_init (TestModule *self)
+{
+}
+
+static ChatbotModule *
+test_module_new (const gchar *parameter)
+{
+  ChatbotModule *module;
+  GError *error = NULL;
+
+  module = chatbot_module_new (TEST_TYPE_MODULE, parameter, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (module);
+  return module;
+}
+
+static void
+test_assert_invalid (const gchar *parameter)
+{
+  GError *error = NULL;
+
+  g_assert_null (chatbot_module_new (TEST_TYPE_MODULE, parameter, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_clear_error (&error);
+}
+
+static void
+test_defaults (void)
+{
+  ChatbotModule *module = test_module_new ("seed=7");
+  const TestModuleParameter *parameter
+      = CHATBOT_MODULE_PARAMETER_STRUCT (module, TestModuleParameter);
+
+  g_assert_cmpint (parameter->count, ==, 3);
+  g_assert_cmpfloat (parameter->scale, ==, 0.5);
+  g_assert_false (parameter->verbose);
+  // Empty path means the path is not given.
+  g_assert_null (parameter->path);
+  g_assert_cmpint (parameter->level, ==, 0);
+  g_assert_cmpint (parameter->seed, ==, 7);
+
+  g_object_unref (module);
+}
+
+static void
+test_values (void)
+{
+  ChatbotModule *module
+      = test_module_new ("count=-12:scale=2.25:verbose:path=/tmp/../tmp/x:"
+                         "level=high:seed=9223372036854775807");
+  const TestModuleParameter *parameter
+      = CHATBOT_MODULE_PARAMETER_STRUCT (module, TestModuleParameter);
+
+  g_assert_cmpint (parameter->count, ==, -12);
+  g_assert_cmpfloat (parameter->scale, ==, 2.25);
+  // "key" without value is same as "key=true".
+  g_assert_true (parameter->verbose);
+  g_assert_cmpstr (parameter->path, ==, "/tmp/x");
+  g_assert_cmpint (parameter->level, ==, 1);
+  g_assert_cmpint (parameter->seed, ==, G_MAXINT64);
+
+  g_object_unref (module);
+
+  module = test_module_new ("seed=0:verbose=No");
+  parameter = CHATBOT_MODULE_PARAMETER_STRUCT (module, TestModuleParameter);
+  g_assert_false (parameter->verbose);
+  g_object_unref (module);
+}
+
+static void
+test_required (void)
+{
+  test_assert_invalid ("");
+  test_assert_invalid ("count=1");
+  // Given without value, which is not an integer.
+  test_assert_invalid ("seed");
+}
+
+static void
+test_unknown (void)
+{
+  test_assert_invalid ("seed=1:colour=red");
+}
+
+static void
+test_invalid_int (void)
+{
+  test_assert_invalid ("seed=1:count=abc");
+  test_assert_invalid ("seed=1:count=12x");
+  test_assert_invalid ("seed=1:count=");
+  test_assert_invalid ("seed=1:count=1.5");
+  test_assert_invalid ("seed=9223372036854775808");
+  test_assert_invalid ("seed=-9223372036854775809");
+}
+
+static void
+test_invalid_double (void)
+{
+  test_assert_invalid ("seed=1:scale=");
+  test_assert_invalid ("seed=1:scale=abc");
+  test_assert_invalid ("seed=1:scale=1.5x");
+}
+
+static void
+test_invalid_boolean (void)
+{
+  test_assert_invalid ("seed=1:verbose=");
+  test_assert_invalid ("seed=1:verbose=maybe");
+  test_assert_invalid ("seed=1:verbose=2");
+}
+
+static void
+test_invalid_enum (void)
+{
+  test_assert_invalid ("seed=1:level=medium");
+  test_assert_invalid ("seed=1:level=HIGH");
+  test_assert_invalid ("seed=1:level=");
+  test_assert_invalid ("seed=1:level");
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/module/defaults", test_defaults);
+  g_test_add_func ("/module/values", test_values);
+  g_test_add_func ("/module/required", test_required);
+  g_test_add_func ("/module/unknown", test_unknown);
+  g_test_add_func ("/module/invalid-int", test_invalid_int);
+  g_test_add_func ("/module/invalid-double", test_invalid_double);
+  g_test_add_func ("/module/invalid-boolean", test_invalid_boolean);
+  g_test_add_func ("/module/invalid-enum", test_invalid_enum);
+  return g_test_run ();
+}
@@ -0,0 +1,254 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Calls through ChatbotRemoteTool to the test tool module given with
+ * CHATBOT_TEST_TOOL_MODULE, served by the worker given with
+ * CHATBOT_TEST_TOOL_WORKER, and restart of failed workers.
+ */
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "chatbot.h"
+
+static const gchar *worker_path = NULL;
+static const gchar *module_path = NULL;
+
+static ChatbotRemoteTool *
+test_remote_tool_new (guint call_timeout)
+{
+  ChatbotRemoteTool *remote_tool;
+  GError *error = NULL;
+
+  remote_tool = chatbot_remote_tool_new (worker_path, module_path, NULL, 1,
+                                         NULL, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (remote_tool);
+  g_object_set (remote_tool, "call-timeout", call_timeout, NULL);
+  return remote_tool;
+}
+
+static GVariantDict *
+test_call (ChatbotRemoteTool *remote_tool, const gchar *function_name,
+           const gchar *arg_name, gint64 value, GError **error)
+{
+  GVariantDict *parameters = g_variant_dict_new (NULL);
+  GVariantDict *result;
+
+  if (arg_name)
+    g_variant_dict_insert (parameters, arg_name, "x", value);
+  result = chatbot_tool_call_function (CHATBOT_TOOL (remote_tool),
+                                       function_name, parameters, NULL, NULL,
+                                       error);
+  g_variant_dict_unref (parameters);
+  return result;
+}
+
+static void
+test_assert_echo (ChatbotRemoteTool *remote_tool, gint64 value)
+{
+  GVariantDict *result;
+  gint64 echoed = 0;
+  GError *error = NULL;
+
+  result = test_call (remote_tool, "echo", "value", value, &error);
+  g_assert_no_error (error);
+  g_assert_true (g_variant_dict_lookup (result, "value", "x", &echoed));
+  g_assert_cmpint (echoed, ==, value);
+  g_variant_dict_unref (result);
+}
+
+static void
+test_functions (void)
+{
+  ChatbotRemoteTool *remote_tool = test_remote_tool_new (0);
+  const ChatbotToolFunction *const *functions;
+  GPtrArray *property;
+
+  g_assert_cmpstr (chatbot_module_get_name (CHATBOT_MODULE (remote_tool)), ==,
+                   "test");
+
+  functions = chatbot_tool_get_function_definitions (
+      CHATBOT_TOOL (remote_tool));
+  g_object_get (remote_tool, "functions", &property, NULL);
+  g_assert_cmpuint (property->len, ==, 5);
+  for (guint i = 0; i < property->len; i++)
+    {
+      const ChatbotToolFunction *function = g_ptr_array_index (property, i);
+
+      g_assert_true (function == functions[i]);
+    }
+  g_assert_null (functions[property->len]);
+  g_assert_cmpstr (functions[0]->name, ==, "echo");
+  g_assert_cmpstr (functions[0]->input_schemas[0]->type, ==, "x");
+
+  g_ptr_array_unref (property);
+  g_object_unref (remote_tool);
+}
+
+static void
+test_call_and_error (void)
+{
+  ChatbotRemoteTool *remote_tool = test_remote_tool_new (0);
+  GError *error = NULL;
+
+  test_assert_echo (remote_tool, 42);
+
+  // The error of the tool reaches the caller as is.
+  g_assert_null (test_call (remote_tool, "fail", NULL, 0, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED);
+  g_assert_cmpstr (error->message, ==, "Failed on request.");
+  g_clear_error (&error);
+
+  test_assert_echo (remote_tool, -1);
+  g_object_unref (remote_tool);
+}
+
+static void
+test_shm (void)
+{
+  ChatbotRemoteTool *remote_tool = test_remote_tool_new (0);
+  GVariantDict *result;
+  const gchar *text;
+  GError *error = NULL;
+
+  // Larger than the threshold, so the result is passed through a file.
+  result = test_call (remote_tool, "large", "size", 1024 * 1024, &error);
+  g_assert_no_error (error);
+  g_assert_true (g_variant_dict_lookup (result, "text", "&s", &text));
+  g_assert_cmpuint (strlen (text), ==, 1024 * 1024);
+  g_assert_cmpint (text[0], ==, 'a');
+  g_variant_dict_unref (result);
+
+  g_object_unref (remote_tool);
+}
+
+static void
+test_crash_restart (void)
+{
+  ChatbotRemoteTool *remote_tool = test_remote_tool_new (0);
+  GError *error = NULL;
+
+  g_assert_null (test_call (remote_tool, "crash", NULL, 0, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED);
+  g_clear_error (&error);
+
+  // The next call spawns the worker again.
+  test_assert_echo (remote_tool, 7);
+  g_object_unref (remote_tool);
+}
+
+static void
+test_timeout_restart (void)
+{
+  ChatbotRemoteTool *remote_tool = test_remote_tool_new (200);
+  GError *error = NULL;
+
+  g_assert_null (test_call (remote_tool, "sleep", "ms", 10000, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+  g_clear_error (&error);
+
+  test_assert_echo (remote_tool, 7);
+  g_object_unref (remote_tool);
+}
+
+static void
+test_restart_timeout (void)
+{
+  ChatbotRemoteTool *remote_tool = test_remote_tool_new (200);
+  gchar *dir, *stall_file;
+  gint64 start;
+  GError *error = NULL;
+
+  dir = g_dir_make_tmp ("chatbot-test-remote-tool-XXXXXX", &error);
+  g_assert_no_error (error);
+  stall_file = g_build_filename (dir, "stall", NULL);
+  g_setenv ("CHATBOT_TEST_TOOL_STALL_FILE", stall_file, TRUE);
+  g_file_set_contents (stall_file, "", 0, &error);
+  g_assert_no_error (error);
+
+  g_assert_null (test_call (remote_tool, "crash", NULL, 0, &error));
+  g_clear_error (&error);
+
+  // The respawned worker is stuck loading the module, which the call doesn't
+  // wait for longer than the call timeout.
+  start = g_get_monotonic_time ();
+  g_assert_null (test_call (remote_tool, "echo", "value", 7, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+  g_clear_error (&error);
+  g_assert_cmpint (g_get_monotonic_time () - start, <, 5 * G_USEC_PER_SEC);
+
+  g_unlink (stall_file);
+  test_assert_echo (remote_tool, 7);
+
+  g_unsetenv ("CHATBOT_TEST_TOOL_STALL_FILE");
+  g_rmdir (dir);
+  g_free (stall_file);
+  g_free (dir);
+  g_object_unref (remote_tool);
+}
+
+static void
+test_construct (void)
+{
+  ChatbotRemoteTool *remote_tool;
+  gchar *module_parameter;
+  GError *error = NULL;
+
+  g_assert_null (g_initable_new (CHATBOT_TYPE_REMOTE_TOOL, NULL, &error,
+                                 "raw_parameter", "", "worker-path", NULL,
+                                 "module-path", module_path, NULL));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_clear_error (&error);
+
+  // Module parameter defaults to empty rather than NULL.
+  remote_tool = g_initable_new (CHATBOT_TYPE_REMOTE_TOOL, NULL, &error,
+                                "raw_parameter", "", "worker-path",
+                                worker_path, "module-path", module_path, NULL);
+  g_assert_no_error (error);
+  g_object_get (remote_tool, "module-parameter", &module_parameter, NULL);
+  g_assert_cmpstr (module_parameter, ==, "");
+  test_assert_echo (remote_tool, 1);
+
+  g_free (module_parameter);
+  g_object_unref (remote_tool);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  worker_path = g_getenv ("CHATBOT_TEST_TOOL_WORKER");
+  module_path = g_getenv ("CHATBOT_TEST_TOOL_MODULE");
+  if ((worker_path == NULL) || (module_path == NULL))
+    {
+      g_printerr ("CHATBOT_TEST_TOOL_WORKER or CHATBOT_TEST_TOOL_MODULE is "
+                  "not set.\n");
+      return 77;
+    }
+
+  g_test_add_func ("/remote-tool/functions", test_functions);
+  g_test_add_func ("/remote-tool/call-and-error", test_call_and_error);
+  g_test_add_func ("/remote-tool/shm", test_shm);
+  g_test_add_func ("/remote-tool/crash-restart", test_crash_restart);
+  g_test_add_func ("/remote-tool/timeout-restart", test_timeout_restart);
+  g_test_add_func ("/remote-tool/restart-timeout", test_restart_timeout);
+  g_test_add_func ("/remote-tool/construct", test_construct);
+  return g_test_run ();
+}
@@ -0,0 +1,189 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Tool module the tests load into tool workers. Its functions misbehave on
+ * request, so the tests can check how the proxy copes with them. While the
+ * file named by CHATBOT_TEST_TOOL_STALL_FILE exists, instances take a long
+ * time to initialize, like a worker stuck loading the module.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <gmodule.h>
+
+#include "chatbot.h"
+
+#define TEST_TYPE_TOOL test_tool_get_type ()
+G_DECLARE_FINAL_TYPE (TestTool, test_tool, TEST, TOOL, ChatbotModule);
+
+struct _TestTool
+{
+  ChatbotModule parent_instance;
+};
+
+enum
+{
+  PROP_FUNCTIONS = 1,
+  N_PROPERTIES
+};
+
+static ChatbotToolArg test_tool_arg_value = { "value", "any integer", "x",
+                                              -1 };
+static ChatbotToolArg test_tool_arg_size = { "size", "bytes to return", "x",
+                                             -1 };
+static ChatbotToolArg test_tool_arg_ms = { "ms", "milliseconds to sleep",
+                                           "x", -1 };
+static ChatbotToolArg test_tool_arg_text = { "text", "text", "s", -1 };
+static ChatbotToolArg *test_tool_no_args[] = { NULL };
+static ChatbotToolArg *test_tool_value_args[] = { &test_tool_arg_value,
+                                                  NULL };
+static ChatbotToolArg *test_tool_size_args[] = { &test_tool_arg_size, NULL };
+static ChatbotToolArg *test_tool_ms_args[] = { &test_tool_arg_ms, NULL };
+static ChatbotToolArg *test_tool_text_args[] = { &test_tool_arg_text, NULL };
+
+static ChatbotToolFunction test_tool_echo
+    = { "echo", "Return the value as is.", test_tool_value_args,
+        test_tool_value_args, -1 };
+static ChatbotToolFunction test_tool_fail
+    = { "fail", "Always fail.", test_tool_no_args, test_tool_no_args, -1 };
+static ChatbotToolFunction test_tool_large
+    = { "large", "Return a text of the given size.", test_tool_size_args,
+        test_tool_text_args, -1 };
+static ChatbotToolFunction test_tool_crash
+    = { "crash", "Abort the process.", test_tool_no_args, test_tool_no_args,
+        -1 };
+static ChatbotToolFunction test_tool_sleep
+    = { "sleep", "Sleep before returning.", test_tool_ms_args,
+        test_tool_no_args, -1 };
+static const ChatbotToolFunction *const test_tool_functions[]
+    = { &test_tool_echo, &test_tool_fail, &test_tool_large, &test_tool_crash,
+        &test_tool_sleep, NULL };
+
+static void test_tool_tool_iface_init (ChatbotToolInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestTool, test_tool, CHATBOT_TYPE_MODULE,
+                         G_IMPLEMENT_INTERFACE (CHATBOT_TYPE_TOOL,
+                                                test_tool_tool_iface_init));
+
+static const ChatbotToolFunction *const *
+test_tool_get_function_definitions (ChatbotTool *tool)
+{
+  return test_tool_functions;
+}
+
+static GVariantDict *
+test_tool_call_function_args (ChatbotTool *tool,
+                              const ChatbotToolFunction *function,
+                              GVariant *const *args,
+                              ChatbotLanguageModel *language_model,
+                              GCancellable *cancellable, GError **error)
+{
+  GVariantDict *result;
+
+  if (function == &test_tool_fail)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+                   "Failed on request.");
+      return NULL;
+    }
+  if (function == &test_tool_crash)
+    abort ();
+
+  result = g_variant_dict_new (NULL);
+  if (function == &test_tool_echo)
+    g_variant_dict_insert_value (result, "value", args[0]);
+  else if (function == &test_tool_large)
+    {
+      gsize size = g_variant_get_int64 (args[0]);
+      gchar *text = g_malloc (size + 1);
+
+      memset (text, 'a', size);
+      text[size] = '\0';
+      g_variant_dict_insert_value (result, "text",
+                                   g_variant_new_take_string (text));
+    }
+  else if (function == &test_tool_sleep)
+    g_usleep (g_variant_get_int64 (args[0]) * 1000);
+  return result;
+}
+
+static void
+test_tool_tool_iface_init (ChatbotToolInterface *iface)
+{
+  iface->get_function_definitions = test_tool_get_function_definitions;
+  iface->call_function_args = test_tool_call_function_args;
+}
+
+static const gchar *
+test_tool_get_name (ChatbotModule *module)
+{
+  return "test";
+}
+
+static const gchar *
+test_tool_get_description (ChatbotModule *module)
+{
+  return "Tool for tests.";
+}
+
+static void
+test_tool_get_property (GObject *object, guint property_id, GValue *value,
+                        GParamSpec *pspec)
+{
+  ChatbotTool *tool = CHATBOT_TOOL (object);
+
+  switch (property_id)
+    {
+    case PROP_FUNCTIONS:
+      g_value_take_boxed (value, chatbot_tool_dup_function_definitions (tool));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+test_tool_class_init (TestToolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ChatbotModuleClass *module_class = CHATBOT_MODULE_CLASS (klass);
+
+  object_class->get_property = test_tool_get_property;
+
+  module_class->get_name = test_tool_get_name;
+  module_class->get_description = test_tool_get_description;
+
+  g_object_class_override_property (object_class, PROP_FUNCTIONS,
+                                    "functions");
+}
+
+static void
+test_tool_init (TestTool *self)
+{
+  const gchar *stall_file = g_getenv ("CHATBOT_TEST_TOOL_STALL_FILE");
+
+  if (stall_file && g_file_test (stall_file, G_FILE_TEST_EXISTS))
+    g_usleep (10 * G_USEC_PER_SEC);
+}
+
+G_MODULE_EXPORT GType
+get_type (void)
+{
+  return test_tool_get_type ();
+}
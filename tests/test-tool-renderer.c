@@ -0,0 +1,374 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Stability of the prompt and the hash of ChatbotToolRenderer, directly and
+ * through the "tools-hash" property of the mock language model given with
+ * CHATBOT_TEST_MOCK_MODULE.
+ */
+
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include "chatbot.h"
+
+#define TEST_TYPE_TOOL test_tool_get_type ()
+G_DECLARE_FINAL_TYPE (TestTool, test_tool, TEST, TOOL, ChatbotModule);
+
+/* Tool named @name whose function definitions can be replaced. */
+struct _TestTool
+{
+  ChatbotModule parent_instance;
+
+  const gchar *name;
+  const ChatbotToolFunction *const *functions; // atomic
+};
+
+enum
+{
+  PROP_FUNCTIONS = 1,
+  N_PROPERTIES
+};
+
+static ChatbotToolArg test_arg_text = { "text", "text", "s", -1 };
+static ChatbotToolArg *test_args[] = { &test_arg_text, NULL };
+static ChatbotToolFunction test_function_a
+    = { "a", "First.", test_args, test_args, -1 };
+static ChatbotToolFunction test_function_b
+    = { "b", "Second.", test_args, test_args, -1 };
+static ChatbotToolFunction test_function_c
+    = { "c", "Third.", test_args, test_args, -1 };
+static const ChatbotToolFunction *const test_functions_ba[]
+    = { &test_function_b, &test_function_a, NULL };
+static const ChatbotToolFunction *const test_functions_a[]
+    = { &test_function_a, NULL };
+static const ChatbotToolFunction *const test_functions_c[]
+    = { &test_function_c, NULL };
+
+static GType mock_type = G_TYPE_INVALID;
+
+static void test_tool_tool_iface_init (ChatbotToolInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestTool, test_tool, CHATBOT_TYPE_MODULE,
+                         G_IMPLEMENT_INTERFACE (CHATBOT_TYPE_TOOL,
+                                                test_tool_tool_iface_init));
+
+static const ChatbotToolFunction *const *
+test_tool_get_function_definitions (ChatbotTool *tool)
+{
+  return g_atomic_pointer_get (&TEST_TOOL (tool)->functions);
+}
+
+static GVariantDict *
+test_tool_call_function_args (ChatbotTool *tool,
+                              const ChatbotToolFunction *function,
+                              GVariant *const *args,
+                              ChatbotLanguageModel *language_model,
+                              GCancellable *cancellable, GError **error)
+{
+  GVariantDict *result = g_variant_dict_new (NULL);
+
+  g_variant_dict_insert_value (result, "text", args[0]);
+  return result;
+}
+
+static void
+test_tool_tool_iface_init (ChatbotToolInterface *iface)
+{
+  iface->get_function_definitions = test_tool_get_function_definitions;
+  iface->call_function_args = test_tool_call_function_args;
+}
+
+static const gchar *
+test_tool_get_name (ChatbotModule *module)
+{
+  return TEST_TOOL (module)->name;
+}
+
+static void
+test_tool_get_property (GObject *object, guint property_id, GValue *value,
+                        GParamSpec *pspec)
+{
+  ChatbotTool *tool = CHATBOT_TOOL (object);
+
+  switch (property_id)
+    {
+    case PROP_FUNCTIONS:
+      g_value_take_boxed (value, chatbot_tool_dup_function_definitions (tool));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+test_tool_class_init (TestToolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = test_tool_get_property;
+
+  CHATBOT_MODULE_CLASS (klass)->get_name = test_tool_get_name;
+
+  g_object_class_override_property (object_class, PROP_FUNCTIONS,
+                                    "functions");
+}
+
+static void
+test_tool_init (TestTool *self)
+{
+}
+
+static ChatbotTool *
+test_tool_new (const gchar *name,
+               const ChatbotToolFunction *const *functions)
+{
+  GError *error = NULL;
+  TestTool *tool;
+
+  tool = TEST_TOOL (chatbot_module_new (TEST_TYPE_TOOL, "", &error));
+  g_assert_no_error (error);
+  tool->name = name;
+  tool->functions = functions;
+  return CHATBOT_TOOL (tool);
+}
+
+static void
+test_tool_set_functions (ChatbotTool *tool,
+                         const ChatbotToolFunction *const *functions)
+{
+  g_atomic_pointer_set (&TEST_TOOL (tool)->functions, functions);
+  g_signal_emit_by_name (tool, "functions-changed");
+}
+
+static void
+test_count (gpointer instance, gpointer user_data)
+{
+  (*(guint *)user_data)++;
+}
+
+static void
+test_order (void)
+{
+  ChatbotTool *first = test_tool_new ("first", test_functions_ba);
+  ChatbotTool *second = test_tool_new ("second", test_functions_c);
+  ChatbotToolRenderer *renderer = chatbot_tool_renderer_new ();
+  ChatbotToolRenderer *reversed = chatbot_tool_renderer_new ();
+  gchar *prompt, *hash, *reversed_prompt, *reversed_hash;
+
+  chatbot_tool_renderer_add_tool (renderer, first);
+  chatbot_tool_renderer_add_tool (renderer, second);
+  chatbot_tool_renderer_add_tool (reversed, second);
+  chatbot_tool_renderer_add_tool (reversed, first);
+
+  // Functions are sorted by name, regardless of the tool they belong to.
+  prompt = chatbot_tool_renderer_dup_prompt (renderer);
+  g_assert_true (g_str_has_prefix (prompt, "{\"name\": \"a\""));
+  g_assert_nonnull (strstr (prompt, "}\n{\"name\": \"b\""));
+  g_assert_true (g_str_has_suffix (prompt, "\"type\": \"s\"}]}\n"));
+
+  reversed_prompt = chatbot_tool_renderer_dup_prompt (reversed);
+  g_assert_cmpstr (prompt, ==, reversed_prompt);
+
+  hash = chatbot_tool_renderer_dup_hash (renderer);
+  reversed_hash = chatbot_tool_renderer_dup_hash (reversed);
+  g_assert_cmpuint (strlen (hash), ==, 64);
+  g_assert_cmpstr (hash, ==, reversed_hash);
+
+  g_free (reversed_hash);
+  g_free (hash);
+  g_free (reversed_prompt);
+  g_free (prompt);
+  g_object_unref (reversed);
+  g_object_unref (renderer);
+  g_object_unref (second);
+  g_object_unref (first);
+}
+
+static void
+test_invalidate (void)
+{
+  ChatbotTool *first = test_tool_new ("first", test_functions_ba);
+  ChatbotTool *second = test_tool_new ("second", test_functions_c);
+  ChatbotToolRenderer *renderer = chatbot_tool_renderer_new ();
+  gchar *hash, *other;
+  guint n_changed = 0;
+
+  g_signal_connect (renderer, "changed", G_CALLBACK (test_count),
+                    &n_changed);
+  chatbot_tool_renderer_add_tool (renderer, first);
+  chatbot_tool_renderer_add_tool (renderer, second);
+
+  // Nothing is rendered yet, so nothing has changed.
+  g_assert_cmpuint (n_changed, ==, 0);
+  hash = chatbot_tool_renderer_dup_hash (renderer);
+  other = chatbot_tool_renderer_dup_hash (renderer);
+  g_assert_cmpstr (hash, ==, other);
+  g_free (other);
+
+  test_tool_set_functions (first, test_functions_a);
+  g_assert_cmpuint (n_changed, ==, 1);
+  other = chatbot_tool_renderer_dup_hash (renderer);
+  g_assert_cmpstr (hash, !=, other);
+  g_free (other);
+
+  // The same functions render the same prompt again.
+  test_tool_set_functions (first, test_functions_ba);
+  g_assert_cmpuint (n_changed, ==, 2);
+  other = chatbot_tool_renderer_dup_hash (renderer);
+  g_assert_cmpstr (hash, ==, other);
+  g_free (other);
+
+  g_assert_true (chatbot_tool_renderer_remove_tool (renderer, second));
+  g_assert_false (chatbot_tool_renderer_remove_tool (renderer, second));
+  g_assert_cmpuint (n_changed, ==, 3);
+  other = chatbot_tool_renderer_dup_hash (renderer);
+  g_assert_cmpstr (hash, !=, other);
+  g_free (other);
+
+  // A removed tool doesn't invalidate the prompt anymore.
+  test_tool_set_functions (second, test_functions_a);
+  g_assert_cmpuint (n_changed, ==, 3);
+
+  g_free (hash);
+  g_object_unref (renderer);
+  g_object_unref (second);
+  g_object_unref (first);
+}
+
+static gpointer
+test_emit_changed (gpointer data)
+{
+  for (guint i = 0; i < 10000; i++)
+    g_signal_emit_by_name (data, "functions-changed");
+  return NULL;
+}
+
+static void
+test_concurrent_invalidate (void)
+{
+  ChatbotTool *tool = test_tool_new ("first", test_functions_ba);
+  ChatbotToolRenderer *renderer = chatbot_tool_renderer_new ();
+  gchar *expected;
+  GThread *thread;
+
+  chatbot_tool_renderer_add_tool (renderer, tool);
+  expected = chatbot_tool_renderer_dup_prompt (renderer);
+
+  // Invalidation from a call thread doesn't free what the reader holds.
+  thread = g_thread_new ("emit", test_emit_changed, tool);
+  for (guint i = 0; i < 10000; i++)
+    {
+      gchar *prompt = chatbot_tool_renderer_dup_prompt (renderer);
+
+      g_assert_cmpstr (prompt, ==, expected);
+      g_free (prompt);
+    }
+  g_thread_join (thread);
+
+  g_free (expected);
+  g_object_unref (renderer);
+  g_object_unref (tool);
+}
+
+static gchar *
+test_mock_dup_hash (ChatbotModule *mock)
+{
+  gchar *hash;
+
+  g_object_get (mock, "tools-hash", &hash, NULL);
+  g_assert_nonnull (hash);
+  return hash;
+}
+
+static void
+test_mock (void)
+{
+  ChatbotTool *first = test_tool_new ("first", test_functions_ba);
+  ChatbotTool *second = test_tool_new ("second", test_functions_c);
+  ChatbotToolRenderer *renderer = chatbot_tool_renderer_new ();
+  ChatbotModule *mock, *reversed;
+  gchar *expected, *hash;
+  GError *error = NULL;
+
+  mock = chatbot_module_new (mock_type, "", &error);
+  g_assert_no_error (error);
+  reversed = chatbot_module_new (mock_type, "", &error);
+  g_assert_no_error (error);
+
+  chatbot_tool_renderer_add_tool (renderer, first);
+  chatbot_tool_renderer_add_tool (renderer, second);
+  expected = chatbot_tool_renderer_dup_hash (renderer);
+
+  g_assert_true (chatbot_tool_callable_language_model_add_tool (
+      CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL (mock), first, &error));
+  g_assert_no_error (error);
+  g_assert_true (chatbot_tool_callable_language_model_add_tool (
+      CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL (mock), second, &error));
+  g_assert_no_error (error);
+  g_assert_true (chatbot_tool_callable_language_model_add_tool (
+      CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL (reversed), second, &error));
+  g_assert_no_error (error);
+  g_assert_true (chatbot_tool_callable_language_model_add_tool (
+      CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL (reversed), first, &error));
+  g_assert_no_error (error);
+
+  hash = test_mock_dup_hash (mock);
+  g_assert_cmpstr (hash, ==, expected);
+  g_free (hash);
+  hash = test_mock_dup_hash (reversed);
+  g_assert_cmpstr (hash, ==, expected);
+  g_free (hash);
+
+  g_assert_true (chatbot_tool_callable_language_model_remove_tool (
+      CHATBOT_TOOL_CALLABLE_LANGUAGE_MODEL (mock), "second"));
+  hash = test_mock_dup_hash (mock);
+  g_assert_cmpstr (hash, !=, expected);
+  g_free (hash);
+
+  g_free (expected);
+  g_object_unref (reversed);
+  g_object_unref (mock);
+  g_object_unref (renderer);
+  g_object_unref (second);
+  g_object_unref (first);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const gchar *mock_path = g_getenv ("CHATBOT_TEST_MOCK_MODULE");
+  GError *error = NULL;
+
+  g_test_init (&argc, &argv, NULL);
+
+  if (mock_path == NULL)
+    {
+      g_printerr ("CHATBOT_TEST_MOCK_MODULE is not set.\n");
+      return 77;
+    }
+  mock_type = chatbot_module_registry_load_type (
+      chatbot_module_registry_get_default (), mock_path, &error);
+  g_assert_no_error (error);
+
+  g_test_add_func ("/tool-renderer/order", test_order);
+  g_test_add_func ("/tool-renderer/invalidate", test_invalidate);
+  g_test_add_func ("/tool-renderer/concurrent-invalidate",
+                   test_concurrent_invalidate);
+  g_test_add_func ("/tool-renderer/mock", test_mock);
+  return g_test_run ();
+}
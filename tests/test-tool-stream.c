@@ -0,0 +1,168 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Delivery and truncation of ChatbotToolStream.
+ */
+
+#include <gio/gio.h>
+
+#include "chatbot.h"
+
+static gboolean
+test_chunk (ChatbotToolStream *stream, const gchar *chunk, gpointer user_data)
+{
+  g_string_append ((GString *)user_data, chunk);
+  return TRUE;
+}
+
+static gboolean
+test_chunk_once (ChatbotToolStream *stream, const gchar *chunk,
+                 gpointer user_data)
+{
+  g_string_append ((GString *)user_data, chunk);
+  return FALSE;
+}
+
+static void
+test_truncate_at_max_bytes (void)
+{
+  ChatbotToolStream *stream = chatbot_tool_stream_new (5);
+  GString *output = g_string_new (NULL);
+  GError *error = NULL;
+
+  g_signal_connect (stream, "chunk", G_CALLBACK (test_chunk), output);
+
+  g_assert_true (chatbot_tool_stream_write (stream, "abc", -1));
+  g_assert_false (chatbot_tool_stream_is_stopped (stream));
+  g_assert_false (chatbot_tool_stream_write (stream, "defgh", -1));
+  g_assert_cmpstr (output->str, ==, "abcde");
+  g_assert_cmpuint (chatbot_tool_stream_get_n_bytes (stream), ==, 5);
+
+  g_assert_true (chatbot_tool_stream_is_stopped (stream));
+  g_assert_true (g_cancellable_is_cancelled (
+      chatbot_tool_stream_get_cancellable (stream)));
+  g_assert_true (chatbot_tool_stream_propagate_error (stream, &error));
+  g_assert_no_error (error);
+
+  // Nothing is delivered after the stop.
+  g_assert_false (chatbot_tool_stream_write (stream, "x", -1));
+  g_assert_cmpstr (output->str, ==, "abcde");
+
+  g_string_free (output, TRUE);
+  g_object_unref (stream);
+}
+
+static void
+test_truncate_exactly_at_max_bytes (void)
+{
+  ChatbotToolStream *stream = chatbot_tool_stream_new (3);
+  GString *output = g_string_new (NULL);
+
+  g_signal_connect (stream, "chunk", G_CALLBACK (test_chunk), output);
+
+  // Reaching the limit stops the stream without dropping anything.
+  g_assert_false (chatbot_tool_stream_write (stream, "abc", -1));
+  g_assert_cmpstr (output->str, ==, "abc");
+
+  g_string_free (output, TRUE);
+  g_object_unref (stream);
+}
+
+static void
+test_truncate_utf8 (void)
+{
+  ChatbotToolStream *stream = chatbot_tool_stream_new (5);
+  GString *output = g_string_new (NULL);
+
+  g_signal_connect (stream, "chunk", G_CALLBACK (test_chunk), output);
+
+  // "a", 2 bytes of "é" and 3 bytes of "€" exceed 5 bytes in the
+  // middle of the last character, which is dropped whole.
+  g_assert_false (chatbot_tool_stream_write (stream, "a\xc3\xa9\xe2\x82\xac",
+                                             -1));
+  g_assert_cmpstr (output->str, ==, "a\xc3\xa9");
+  g_assert_cmpuint (chatbot_tool_stream_get_n_bytes (stream), ==, 3);
+
+  g_string_free (output, TRUE);
+  g_object_unref (stream);
+}
+
+static void
+test_unlimited (void)
+{
+  ChatbotToolStream *stream = chatbot_tool_stream_new (0);
+  GString *output = g_string_new (NULL);
+
+  g_signal_connect (stream, "chunk", G_CALLBACK (test_chunk), output);
+
+  for (guint i = 0; i < 1000; i++)
+    g_assert_true (chatbot_tool_stream_write (stream, "0123456789", 5));
+  g_assert_cmpuint (output->len, ==, 5000);
+  g_assert_false (chatbot_tool_stream_is_stopped (stream));
+
+  g_string_free (output, TRUE);
+  g_object_unref (stream);
+}
+
+static void
+test_consumer_stop (void)
+{
+  ChatbotToolStream *stream = chatbot_tool_stream_new (0);
+  GString *output = g_string_new (NULL);
+
+  g_signal_connect (stream, "chunk", G_CALLBACK (test_chunk_once), output);
+
+  g_assert_false (chatbot_tool_stream_write (stream, "first", -1));
+  g_assert_false (chatbot_tool_stream_write (stream, "second", -1));
+  g_assert_cmpstr (output->str, ==, "first");
+
+  g_string_free (output, TRUE);
+  g_object_unref (stream);
+}
+
+static void
+test_stop_error (void)
+{
+  ChatbotToolStream *stream = chatbot_tool_stream_new (0);
+  GError *error = NULL;
+
+  chatbot_tool_stream_stop (
+      stream, g_error_new_literal (G_IO_ERROR, G_IO_ERROR_TIMED_OUT, "late"));
+  // Only the first stop takes effect.
+  chatbot_tool_stream_stop (stream, NULL);
+
+  g_assert_false (chatbot_tool_stream_propagate_error (stream, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+  g_clear_error (&error);
+
+  g_object_unref (stream);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/tool-stream/truncate-at-max-bytes",
+                   test_truncate_at_max_bytes);
+  g_test_add_func ("/tool-stream/truncate-exactly-at-max-bytes",
+                   test_truncate_exactly_at_max_bytes);
+  g_test_add_func ("/tool-stream/truncate-utf8", test_truncate_utf8);
+  g_test_add_func ("/tool-stream/unlimited", test_unlimited);
+  g_test_add_func ("/tool-stream/consumer-stop", test_consumer_stop);
+  g_test_add_func ("/tool-stream/stop-error", test_stop_error);
+  return g_test_run ();
+}
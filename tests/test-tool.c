@@ -0,0 +1,508 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Argument decoding of ChatbotToolArgDecoder, and draining calls of a tool
+ * with chatbot_tool_drain().
+ */
+
+#include <gio/gio.h>
+
+#include "chatbot.h"
+
+/*
+ * Returns a function "f" taking a required int64 "count" and an optional
+ * string "label".
+ */
+static ChatbotToolFunction *
+test_function_new (void)
+{
+  ChatbotToolArg *inputs[] = {
+    chatbot_tool_arg_new ("count", "number of items", "x"),
+    chatbot_tool_arg_new ("label", "optional label", "ms"),
+  };
+
+  return chatbot_tool_function_ref (chatbot_tool_function_new (
+      "f", "Test function.", inputs, G_N_ELEMENTS (inputs), NULL, 0));
+}
+
+static ChatbotToolArgDecoder *
+test_decoder_new (void)
+{
+  ChatbotToolFunction *function = test_function_new ();
+  ChatbotToolArgDecoder *decoder;
+  GError *error = NULL;
+
+  decoder = chatbot_tool_arg_decoder_new (function, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (decoder);
+  chatbot_tool_function_unref (function);
+  return decoder;
+}
+
+static void
+test_decode (void)
+{
+  ChatbotToolArgDecoder *decoder = test_decoder_new ();
+  GVariantDict *parameters = g_variant_dict_new (NULL);
+  GVariant *args[2], *child;
+  GError *error = NULL;
+
+  g_assert_cmpuint (chatbot_tool_arg_decoder_get_n_args (decoder), ==, 2);
+
+  // Args are stored in schema order, and unknown parameters are ignored.
+  g_variant_dict_insert (parameters, "unknown", "b", TRUE);
+  g_variant_dict_insert (parameters, "label", "s", "apples");
+  g_variant_dict_insert (parameters, "count", "x", G_GINT64_CONSTANT (3));
+  g_assert_true (
+      chatbot_tool_arg_decoder_decode (decoder, parameters, args, &error));
+  g_assert_no_error (error);
+  g_assert_cmpint (g_variant_get_int64 (args[0]), ==, 3);
+  // The optional arg is wrapped.
+  g_assert_cmpstr (g_variant_get_type_string (args[1]), ==, "ms");
+  child = g_variant_get_maybe (args[1]);
+  g_assert_cmpstr (g_variant_get_string (child, NULL), ==, "apples");
+  g_variant_unref (child);
+  g_variant_unref (args[0]);
+  g_variant_unref (args[1]);
+
+  g_variant_dict_unref (parameters);
+  chatbot_tool_arg_decoder_unref (decoder);
+}
+
+static void
+test_decode_maybe (void)
+{
+  ChatbotToolArgDecoder *decoder = test_decoder_new ();
+  GVariantDict *parameters = g_variant_dict_new (NULL);
+  GVariant *args[2], *child;
+  GError *error = NULL;
+
+  // A missing optional arg is decoded to nothing.
+  g_variant_dict_insert (parameters, "count", "x", G_GINT64_CONSTANT (1));
+  g_assert_true (
+      chatbot_tool_arg_decoder_decode (decoder, parameters, args, &error));
+  g_assert_no_error (error);
+  g_assert_null (g_variant_get_maybe (args[1]));
+  g_variant_unref (args[0]);
+  g_variant_unref (args[1]);
+
+  // It's accepted already wrapped, too.
+  g_variant_dict_insert (parameters, "label", "ms", "pears");
+  g_assert_true (
+      chatbot_tool_arg_decoder_decode (decoder, parameters, args, &error));
+  g_assert_no_error (error);
+  child = g_variant_get_maybe (args[1]);
+  g_assert_cmpstr (g_variant_get_string (child, NULL), ==, "pears");
+  g_variant_unref (child);
+  g_variant_unref (args[0]);
+  g_variant_unref (args[1]);
+
+  g_variant_dict_unref (parameters);
+  chatbot_tool_arg_decoder_unref (decoder);
+}
+
+static void
+test_decode_errors (void)
+{
+  ChatbotToolArgDecoder *decoder = test_decoder_new ();
+  GVariantDict *parameters = g_variant_dict_new (NULL);
+  GVariant *args[2] = { NULL, NULL };
+  GError *error = NULL;
+
+  g_assert_false (
+      chatbot_tool_arg_decoder_decode (decoder, parameters, args, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_assert_cmpstr (error->message, ==,
+                   "Function \"f\" requires argument \"count\".");
+  g_clear_error (&error);
+
+  // A failure after a decoded arg releases it.
+  g_variant_dict_insert (parameters, "count", "x", G_GINT64_CONSTANT (1));
+  g_variant_dict_insert (parameters, "label", "i", 5);
+  g_assert_false (
+      chatbot_tool_arg_decoder_decode (decoder, parameters, args, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_assert_cmpstr (error->message, ==,
+                   "Argument \"label\" of function \"f\" expects type "
+                   "\"ms\", but got \"i\".");
+  g_clear_error (&error);
+  g_assert_null (args[0]);
+  g_assert_null (args[1]);
+
+  g_variant_dict_unref (parameters);
+  chatbot_tool_arg_decoder_unref (decoder);
+}
+
+static void
+test_invalid_type (void)
+{
+  ChatbotToolArg arg = { "value", "value", "(x", -1 };
+  ChatbotToolArg *inputs[] = { &arg, NULL };
+  ChatbotToolArg *outputs[] = { NULL };
+  ChatbotToolFunction function = { "g", "Broken.", inputs, outputs, -1 };
+  GError *error = NULL;
+
+  g_assert_null (chatbot_tool_arg_decoder_new (&function, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_clear_error (&error);
+}
+
+static void
+test_function_lifetime (void)
+{
+  ChatbotToolFunction *function = test_function_new ();
+  ChatbotToolArgDecoder *decoder;
+  const ChatbotToolFunction *decoded;
+  GError *error = NULL;
+
+  decoder = chatbot_tool_arg_decoder_new (function, &error);
+  g_assert_no_error (error);
+
+  // The definition outlives its owner while the decoder is in use.
+  chatbot_tool_function_unref (function);
+  decoded = chatbot_tool_arg_decoder_get_function (decoder);
+  g_assert_true (decoded == function);
+  g_assert_cmpstr (decoded->name, ==, "f");
+  g_assert_cmpstr (decoded->input_schemas[0]->name, ==, "count");
+
+  chatbot_tool_arg_decoder_unref (decoder);
+}
+
+#define TEST_TYPE_TOOL test_tool_get_type ()
+G_DECLARE_FINAL_TYPE (TestTool, test_tool, TEST, TOOL, ChatbotModule);
+
+/* Tool whose "block" function waits until released. */
+struct _TestTool
+{
+  ChatbotModule parent_instance;
+
+  GMutex mutex;
+  GCond cond;
+  gboolean started;
+  gboolean released;
+};
+
+enum
+{
+  PROP_FUNCTIONS = 1,
+  N_PROPERTIES
+};
+
+static ChatbotToolArg *test_tool_no_args[] = { NULL };
+static ChatbotToolFunction test_tool_block
+    = { "block", "Wait until released.", test_tool_no_args,
+        test_tool_no_args, -1 };
+static ChatbotToolFunction test_tool_drain_self
+    = { "drain-self", "Drain the tool itself.", test_tool_no_args,
+        test_tool_no_args, -1 };
+static ChatbotToolFunction test_tool_noop
+    = { "noop", "Do nothing.", test_tool_no_args, test_tool_no_args, -1 };
+static const ChatbotToolFunction *const test_tool_functions[]
+    = { &test_tool_block, &test_tool_drain_self, &test_tool_noop, NULL };
+
+static void test_tool_tool_iface_init (ChatbotToolInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestTool, test_tool, CHATBOT_TYPE_MODULE,
+                         G_IMPLEMENT_INTERFACE (CHATBOT_TYPE_TOOL,
+                                                test_tool_tool_iface_init));
+
+static const ChatbotToolFunction *const *
+test_tool_get_function_definitions (ChatbotTool *tool)
+{
+  return test_tool_functions;
+}
+
+static GVariantDict *
+test_tool_call_function_args (ChatbotTool *tool,
+                              const ChatbotToolFunction *function,
+                              GVariant *const *args,
+                              ChatbotLanguageModel *language_model,
+                              GCancellable *cancellable, GError **error)
+{
+  TestTool *self = TEST_TOOL (tool);
+
+  if (function == &test_tool_drain_self)
+    {
+      if (!chatbot_tool_drain (tool, NULL, error))
+        return NULL;
+    }
+  else if (function == &test_tool_block)
+    {
+      g_mutex_lock (&self->mutex);
+      self->started = TRUE;
+      g_cond_broadcast (&self->cond);
+      while (!self->released)
+        g_cond_wait (&self->cond, &self->mutex);
+      g_mutex_unlock (&self->mutex);
+    }
+  return g_variant_dict_new (NULL);
+}
+
+static void
+test_tool_tool_iface_init (ChatbotToolInterface *iface)
+{
+  iface->get_function_definitions = test_tool_get_function_definitions;
+  iface->call_function_args = test_tool_call_function_args;
+}
+
+static const gchar *
+test_tool_get_name (ChatbotModule *module)
+{
+  return "test";
+}
+
+static void
+test_tool_get_property (GObject *object, guint property_id, GValue *value,
+                        GParamSpec *pspec)
+{
+  ChatbotTool *tool = CHATBOT_TOOL (object);
+
+  switch (property_id)
+    {
+    case PROP_FUNCTIONS:
+      g_value_take_boxed (value, chatbot_tool_dup_function_definitions (tool));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+test_tool_finalize (GObject *object)
+{
+  TestTool *self = TEST_TOOL (object);
+
+  g_cond_clear (&self->cond);
+  g_mutex_clear (&self->mutex);
+
+  G_OBJECT_CLASS (test_tool_parent_class)->finalize (object);
+}
+
+static void
+test_tool_class_init (TestToolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = test_tool_get_property;
+  object_class->finalize = test_tool_finalize;
+
+  CHATBOT_MODULE_CLASS (klass)->get_name = test_tool_get_name;
+
+  g_object_class_override_property (object_class, PROP_FUNCTIONS,
+                                    "functions");
+}
+
+static void
+test_tool_init (TestTool *self)
+{
+  g_mutex_init (&self->mutex);
+  g_cond_init (&self->cond);
+}
+
+static TestTool *
+test_tool_new (void)
+{
+  GError *error = NULL;
+  ChatbotModule *module = chatbot_module_new (TEST_TYPE_TOOL, "", &error);
+
+  g_assert_no_error (error);
+  return TEST_TOOL (module);
+}
+
+static GVariantDict *
+test_tool_call (TestTool *tool, const gchar *function_name, GError **error)
+{
+  GVariantDict *parameters = g_variant_dict_new (NULL);
+  GVariantDict *result;
+
+  result = chatbot_tool_call_function (CHATBOT_TOOL (tool), function_name,
+                                       parameters, NULL, NULL, error);
+  g_variant_dict_unref (parameters);
+  return result;
+}
+
+static gpointer
+test_tool_call_block (gpointer data)
+{
+  GError *error = NULL;
+  GVariantDict *result = test_tool_call (data, "block", &error);
+
+  g_assert_no_error (error);
+  g_variant_dict_unref (result);
+  return NULL;
+}
+
+/* Starts a "block" call in a new thread and waits until it's running. */
+static GThread *
+test_tool_start_block (TestTool *tool)
+{
+  GThread *thread;
+
+  thread = g_thread_new ("block", test_tool_call_block, tool);
+  g_mutex_lock (&tool->mutex);
+  while (!tool->started)
+    g_cond_wait (&tool->cond, &tool->mutex);
+  g_mutex_unlock (&tool->mutex);
+  return thread;
+}
+
+static void
+test_tool_release (TestTool *tool)
+{
+  g_mutex_lock (&tool->mutex);
+  tool->released = TRUE;
+  g_cond_broadcast (&tool->cond);
+  g_mutex_unlock (&tool->mutex);
+}
+
+typedef struct
+{
+  TestTool *tool;
+  GCancellable *cancellable;
+  gint done; // atomic
+  gboolean ret;
+  GError *error;
+} TestDrain;
+
+static gpointer
+test_drain_run (gpointer data)
+{
+  TestDrain *drain = data;
+
+  drain->ret = chatbot_tool_drain (CHATBOT_TOOL (drain->tool),
+                                   drain->cancellable, &drain->error);
+  g_atomic_int_set (&drain->done, TRUE);
+  return NULL;
+}
+
+static void
+test_drain_idle (void)
+{
+  TestTool *tool = test_tool_new ();
+  GVariantDict *result;
+  GError *error = NULL;
+
+  result = test_tool_call (tool, "noop", &error);
+  g_assert_no_error (error);
+  g_variant_dict_unref (result);
+
+  g_assert_true (chatbot_tool_drain (CHATBOT_TOOL (tool), NULL, &error));
+  g_assert_no_error (error);
+
+  // Calls after the drain are rejected.
+  g_assert_null (test_tool_call (tool, "noop", &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED);
+  g_clear_error (&error);
+
+  g_object_unref (tool);
+}
+
+static void
+test_drain_in_flight (void)
+{
+  TestTool *tool = test_tool_new ();
+  TestDrain drain = { tool, NULL, FALSE, FALSE, NULL };
+  GThread *block, *drain_thread;
+  GVariantDict *result;
+  GError *error = NULL;
+
+  block = test_tool_start_block (tool);
+  drain_thread = g_thread_new ("drain", test_drain_run, &drain);
+
+  // The drain waits for the running call, while new calls are rejected.
+  while ((result = test_tool_call (tool, "noop", &error)))
+    {
+      g_variant_dict_unref (result);
+      g_usleep (1000);
+    }
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED);
+  g_clear_error (&error);
+  g_usleep (50 * 1000);
+  g_assert_false (g_atomic_int_get (&drain.done));
+
+  test_tool_release (tool);
+  g_thread_join (block);
+  g_thread_join (drain_thread);
+  g_assert_true (drain.ret);
+  g_assert_no_error (drain.error);
+
+  g_object_unref (tool);
+}
+
+static gpointer
+test_cancel_later (gpointer data)
+{
+  g_usleep (50 * 1000);
+  g_cancellable_cancel (data);
+  return NULL;
+}
+
+static void
+test_drain_cancelled (void)
+{
+  TestTool *tool = test_tool_new ();
+  GCancellable *cancellable = g_cancellable_new ();
+  GThread *block, *cancel;
+  GError *error = NULL;
+
+  block = test_tool_start_block (tool);
+  cancel = g_thread_new ("cancel", test_cancel_later, cancellable);
+
+  g_assert_false (chatbot_tool_drain (CHATBOT_TOOL (tool), cancellable,
+                                      &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error (&error);
+
+  g_thread_join (cancel);
+  test_tool_release (tool);
+  g_thread_join (block);
+
+  g_object_unref (cancellable);
+  g_object_unref (tool);
+}
+
+static void
+test_drain_self (void)
+{
+  TestTool *tool = test_tool_new ();
+  GError *error = NULL;
+
+  // Draining from its own call would wait for itself forever.
+  g_assert_null (test_tool_call (tool, "drain-self", &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK);
+  g_clear_error (&error);
+
+  g_object_unref (tool);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/tool/arg-decoder/decode", test_decode);
+  g_test_add_func ("/tool/arg-decoder/decode-maybe", test_decode_maybe);
+  g_test_add_func ("/tool/arg-decoder/decode-errors", test_decode_errors);
+  g_test_add_func ("/tool/arg-decoder/invalid-type", test_invalid_type);
+  g_test_add_func ("/tool/arg-decoder/function-lifetime",
+                   test_function_lifetime);
+  g_test_add_func ("/tool/drain/idle", test_drain_idle);
+  g_test_add_func ("/tool/drain/in-flight", test_drain_in_flight);
+  g_test_add_func ("/tool/drain/cancelled", test_drain_cancelled);
+  g_test_add_func ("/tool/drain/self", test_drain_self);
+  return g_test_run ();
+}
@@ -0,0 +1,165 @@
+/*   This file is part of Chatbot.
+ *
+ *  Chatbot is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or any later version.
+ *
+ *  Chatbot is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ * with Chatbot. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Weights files written with chatbot_weights_write() and mapped with
+ * chatbot_weights_open().
+ */
+
+#include <string.h>
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "chatbot.h"
+
+typedef struct
+{
+  gchar *dir;
+  gchar *path;
+} TestWeightsFixture;
+
+static void
+test_weights_setup (TestWeightsFixture *fixture, gconstpointer user_data)
+{
+  GError *error = NULL;
+
+  fixture->dir = g_dir_make_tmp ("chatbot-test-weights-XXXXXX", &error);
+  g_assert_no_error (error);
+  fixture->path = g_build_filename (fixture->dir, "weights", NULL);
+}
+
+static void
+test_weights_teardown (TestWeightsFixture *fixture, gconstpointer user_data)
+{
+  g_unlink (fixture->path);
+  g_rmdir (fixture->dir);
+  g_free (fixture->path);
+  g_free (fixture->dir);
+}
+
+static GBytes *
+test_tensor_new (gsize size, guint8 seed)
+{
+  guint8 *data = g_malloc (size);
+
+  for (gsize i = 0; i < size; i++)
+    data[i] = (guint8)(seed + i * 7);
+  return g_bytes_new_take (data, size);
+}
+
+static void
+test_round_trip (TestWeightsFixture *fixture, gconstpointer user_data)
+{
+  const gchar *const names[] = { "embed", "layer.0", "norm" };
+  GBytes *tensors[G_N_ELEMENTS (names)];
+  ChatbotWeights *weights;
+  const gchar *const *read_names;
+  GError *error = NULL;
+
+  tensors[0] = test_tensor_new (5000, 1);
+  tensors[1] = test_tensor_new (1, 2);
+  tensors[2] = test_tensor_new (4096, 3);
+
+  g_assert_true (chatbot_weights_write (fixture->path, names,
+                                        (GBytes *const *)tensors,
+                                        G_N_ELEMENTS (names), 4096, NULL,
+                                        &error));
+  g_assert_no_error (error);
+
+  weights = chatbot_weights_open (fixture->path, CHATBOT_WEIGHTS_NONE,
+                                  &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (weights);
+  g_assert_cmpuint (chatbot_weights_get_alignment (weights), ==, 4096);
+
+  // Names come back in the order they're written.
+  read_names = chatbot_weights_get_tensor_names (weights);
+  g_assert_cmpuint (g_strv_length ((gchar **)read_names), ==,
+                    G_N_ELEMENTS (names));
+  for (gsize i = 0; i < G_N_ELEMENTS (names); i++)
+    {
+      gconstpointer data;
+      gsize size = 0;
+
+      g_assert_cmpstr (read_names[i], ==, names[i]);
+      data = chatbot_weights_get_tensor (weights, names[i], &size);
+      g_assert_nonnull (data);
+      g_assert_cmpuint ((gsize)data % 4096, ==, 0);
+      g_assert_cmpmem (data, size, g_bytes_get_data (tensors[i], NULL),
+                       g_bytes_get_size (tensors[i]));
+    }
+  g_assert_null (chatbot_weights_get_tensor (weights, "missing", NULL));
+
+  chatbot_weights_unref (weights);
+  for (gsize i = 0; i < G_N_ELEMENTS (tensors); i++)
+    g_bytes_unref (tensors[i]);
+}
+
+static void
+test_empty (TestWeightsFixture *fixture, gconstpointer user_data)
+{
+  ChatbotWeights *weights;
+  GError *error = NULL;
+
+  g_assert_true (chatbot_weights_write (fixture->path, NULL, NULL, 0, 0,
+                                        NULL, &error));
+  g_assert_no_error (error);
+
+  weights = chatbot_weights_open (fixture->path, CHATBOT_WEIGHTS_NONE,
+                                  &error);
+  g_assert_no_error (error);
+  g_assert_cmpuint (chatbot_weights_get_alignment (weights), ==, 64 * 1024);
+  g_assert_null (chatbot_weights_get_tensor_names (weights)[0]);
+  chatbot_weights_unref (weights);
+}
+
+static void
+test_duplicate_name (TestWeightsFixture *fixture, gconstpointer user_data)
+{
+  const gchar *const names[] = { "a", "b", "a" };
+  GBytes *tensors[G_N_ELEMENTS (names)];
+  GError *error = NULL;
+
+  for (gsize i = 0; i < G_N_ELEMENTS (tensors); i++)
+    tensors[i] = test_tensor_new (16, i);
+
+  g_assert_false (chatbot_weights_write (fixture->path, names,
+                                         (GBytes *const *)tensors,
+                                         G_N_ELEMENTS (names), 0, NULL,
+                                         &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_clear_error (&error);
+  // Nothing is written on failure.
+  g_assert_false (g_file_test (fixture->path, G_FILE_TEST_EXISTS));
+
+  for (gsize i = 0; i < G_N_ELEMENTS (tensors); i++)
+    g_bytes_unref (tensors[i]);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/weights/round-trip", TestWeightsFixture, NULL,
+              test_weights_setup, test_round_trip, test_weights_teardown);
+  g_test_add ("/weights/empty", TestWeightsFixture, NULL, test_weights_setup,
+              test_empty, test_weights_teardown);
+  g_test_add ("/weights/duplicate-name", TestWeightsFixture, NULL,
+              test_weights_setup, test_duplicate_name,
+              test_weights_teardown);
+  return g_test_run ();
+}